@@ -41,7 +41,6 @@ See the file COPYING for details.
 #include <unistd.h>
 #include <time.h>
 #include <sys/wait.h>
-#include <sys/select.h>
 
 #ifndef LINE_MAX
 #define LINE_MAX 1024
@@ -993,15 +992,25 @@ int main(int argc, char *argv[])
 	opts_write_port_file(port_file,port);
 	opts_write_port_file(ssl_port_file,ssl_port);
 
-	while(1) {
-		fd_set rfds;
-		int dfd = datagram_fd(update_dgram);
-		int lfd = link_fd(query_port);
-		int sfd = query_ssl_port ? link_fd(query_ssl_port) : -1;
-		int ufd = link_fd(update_port);
+	/*
+	All listening endpoints are registered once with a persistent poller.
+	The UDP port is not a link, so it is attached to one just for polling.
+	*/
+
+	struct link_poller *poller = link_poller_create();
+	if(!poller)
+		fatal("couldn't create link poller: %s", strerror(errno));
+
+	struct link *update_dgram_link = link_attach_to_fd(datagram_fd(update_dgram));
 
-		int result, maxfd;
-		struct timeval timeout;
+	link_poller_add(poller, update_dgram_link, LINK_READ);
+	link_poller_add(poller, update_port, LINK_READ);
+
+	int accepting_queries = 0;
+
+	while(1) {
+		struct link_info ready[4];
+		int i, n;
 
 		remove_expired_records();
 
@@ -1021,52 +1030,50 @@ int main(int argc, char *argv[])
 			}
 		}
 
-		FD_ZERO(&rfds);
-		FD_SET(dfd, &rfds);
-		FD_SET(ufd, &rfds);
-
 		/* Only accept incoming connections if child_procs available. */
 
 		if(child_procs_count < child_procs_max) {
-			/* Accept plain HTTP */ 
-			FD_SET(lfd, &rfds);
+			if(!accepting_queries) {
+				/* Accept plain HTTP */
+				link_poller_add(poller, query_port, LINK_READ);
 
-			/* Accept HTTPS if enabled */
+				/* Accept HTTPS if enabled */
+				if(query_ssl_port) {
+					link_poller_add(poller, query_ssl_port, LINK_READ);
+				}
+				accepting_queries = 1;
+			}
+		} else if(accepting_queries) {
+			link_poller_remove(poller, query_port);
 			if(query_ssl_port) {
-				FD_SET(sfd,&rfds);
+				link_poller_remove(poller, query_ssl_port);
 			}
+			accepting_queries = 0;
 		}
-		maxfd = MAX(ufd,MAX(dfd, lfd)) + 1;
 
-		timeout.tv_sec = 5;
-		timeout.tv_usec = 0;
-
-		result = select(maxfd, &rfds, 0, 0, &timeout);
-		if(result <= 0)
+		n = link_poller_wait(poller, ready, 4, 5000);
+		if(n <= 0)
 			continue;
 
-		if(FD_ISSET(dfd, &rfds)) {
-			handle_udp_updates(update_dgram);
-		}
-
-		if(FD_ISSET(ufd, &rfds)) {
-			handle_tcp_update(update_port);
-		}
-
-		if(FD_ISSET(lfd, &rfds)) {
-			link = link_accept(query_port,time(0)+5);
-			if(link) {
-				handle_tcp_query(link,0);
-			}
-		}
-
-		if(query_ssl_port && FD_ISSET(sfd, &rfds)) {
-			link = link_accept(query_ssl_port,time(0)+5);
-			if(link) {
-				handle_tcp_query(link,1);
+		for(i = 0; i < n; i++) {
+			struct link *ready_link = ready[i].link;
+
+			if(ready_link == update_dgram_link) {
+				handle_udp_updates(update_dgram);
+			} else if(ready_link == update_port) {
+				handle_tcp_update(update_port);
+			} else if(ready_link == query_port) {
+				link = link_accept(query_port,time(0)+5);
+				if(link) {
+					handle_tcp_query(link,0);
+				}
+			} else if(query_ssl_port && ready_link == query_ssl_port) {
+				link = link_accept(query_ssl_port,time(0)+5);
+				if(link) {
+					handle_tcp_query(link,1);
+				}
 			}
 		}
-
 	}
 
 	return 1;
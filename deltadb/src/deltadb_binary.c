@@ -0,0 +1,600 @@
+/*
+Copyright (C) 2024 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "deltadb_binary.h"
+#include "deltadb_stream.h"
+
+#include "jx.h"
+#include "jx_binary.h"
+#include "jx_parse.h"
+#include "hash_table.h"
+#include "nvpair.h"
+#include "nvpair_jx.h"
+#include "stringtools.h"
+#include "debug.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+/*
+A binary day file consists of:
+- the magic string DELTADB_BINARY_MAGIC
+- a sequence of events, the first of which is the snapshot for the start of the day
+- a footer, which is a binary JX object with the names of all record keys,
+  the names of all attributes, and the time and offset of each snapshot
+- the offset of the footer as a 64 bit integer, followed by the magic string again
+
+Each event has a header of a one byte type, a 32 bit key index, and a 32 bit
+length of the data that follows.  Records in C, U and M events are a sequence
+of attributes, each with a 32 bit name index, a 32 bit length, and the value
+in binary JX.  R events hold the 32 bit name index of the removed attribute,
+T events hold the 64 bit time, and S events hold a binary JX object of all records.
+*/
+
+#define DELTADB_BINARY_MAGIC "DDB1"
+#define EVENT_HEADER_SIZE 9
+
+struct deltadb_binary_writer {
+	FILE *stream;
+	struct hash_table *key_ids;
+	struct hash_table *name_ids;
+	int nkeys;
+	int nnames;
+	struct hash_table *table;
+	struct jx *snapshots;
+	time_t snapshot_interval;
+	time_t next_snapshot;
+	FILE *payload;
+	char *payload_data;
+	size_t payload_size;
+	FILE *value;
+	char *value_data;
+	size_t value_size;
+};
+
+/* The event handlers only receive the query, so the writer being used is kept here. */
+static struct deltadb_binary_writer *writer = 0;
+
+static int write_data( FILE *stream, const void *data, size_t length )
+{
+	if(length==0) return 1;
+	return fwrite(data,length,1,stream)==1;
+}
+
+static int write_uint8( FILE *stream, uint8_t i )
+{
+	return write_data(stream,&i,sizeof(i));
+}
+
+static int write_uint32( FILE *stream, uint32_t i )
+{
+	return write_data(stream,&i,sizeof(i));
+}
+
+static int write_int64( FILE *stream, int64_t i )
+{
+	return write_data(stream,&i,sizeof(i));
+}
+
+static int read_data( FILE *stream, void *data, size_t length )
+{
+	return fread(data,length,1,stream)==1;
+}
+
+/* Scratch streams in memory are used to learn the length of data before writing it. */
+
+static void scratch_reset( FILE *scratch )
+{
+	fseek(scratch,0,SEEK_SET);
+}
+
+static size_t scratch_length( FILE *scratch )
+{
+	fflush(scratch);
+	return ftell(scratch);
+}
+
+/* Return the index of a string, assigning the next one if it is new. */
+
+static uint32_t intern( struct hash_table *ids, int *count, const char *str )
+{
+	long id = (long) hash_table_lookup(ids,str);
+	if(!id) {
+		id = ++(*count);
+		hash_table_insert(ids,str,(void*)id);
+	}
+	return id-1;
+}
+
+static struct jx * names_to_array( struct hash_table *ids, int count )
+{
+	const char **names = calloc(count,sizeof(char*));
+	char *name;
+	void *id;
+
+	HASH_TABLE_ITERATE(ids,name,id) {
+		names[(long)id-1] = name;
+	}
+
+	struct jx *array = jx_array(0);
+	int i;
+	for(i=count-1;i>=0;i--) {
+		jx_array_insert(array,jx_string(names[i]));
+	}
+
+	free(names);
+	return array;
+}
+
+static void write_attribute( struct deltadb_binary_writer *w, const char *name, struct jx *value )
+{
+	scratch_reset(w->value);
+	jx_binary_write(w->value,value);
+	size_t length = scratch_length(w->value);
+
+	write_uint32(w->payload,intern(w->name_ids,&w->nnames,name));
+	write_uint32(w->payload,length);
+	write_data(w->payload,w->value_data,length);
+}
+
+static void write_record( struct deltadb_binary_writer *w, struct jx *record )
+{
+	struct jx_pair *p;
+	for(p=record->u.pairs;p;p=p->next) {
+		if(p->key->type!=JX_STRING) continue;
+		write_attribute(w,p->key->u.string_value,p->value);
+	}
+}
+
+/* Write an event with the current contents of the payload. */
+
+static void write_event( struct deltadb_binary_writer *w, char type, const char *key )
+{
+	size_t length = scratch_length(w->payload);
+
+	write_uint8(w->stream,type);
+	write_uint32(w->stream,key ? intern(w->key_ids,&w->nkeys,key) : 0);
+	write_uint32(w->stream,length);
+	write_data(w->stream,w->payload_data,length);
+
+	scratch_reset(w->payload);
+}
+
+static void write_snapshot( struct deltadb_binary_writer *w, time_t current )
+{
+	long offset = ftell(w->stream);
+
+	/* Borrow the records of the table to write them as one object. */
+	struct jx *all = jx_object(0);
+	char *key;
+	struct jx *record;
+	HASH_TABLE_ITERATE(w->table,key,record) {
+		jx_insert(all,jx_string(key),record);
+	}
+
+	jx_binary_write(w->payload,all);
+	write_event(w,'S',0);
+
+	struct jx_pair *p;
+	for(p=all->u.pairs;p;p=p->next) p->value = 0;
+	jx_delete(all);
+
+	jx_array_append(w->snapshots,jx_arrayv(jx_integer(current),jx_integer(offset),0));
+}
+
+static int writer_create_event( struct deltadb_query *query, const char *key, struct jx *jobject )
+{
+	write_record(writer,jobject);
+	write_event(writer,'C',key);
+
+	jx_delete(hash_table_remove(writer->table,key));
+	hash_table_insert(writer->table,key,jobject);
+	return 1;
+}
+
+static int writer_delete_event( struct deltadb_query *query, const char *key )
+{
+	write_event(writer,'D',key);
+
+	jx_delete(hash_table_remove(writer->table,key));
+	return 1;
+}
+
+static int writer_update_event( struct deltadb_query *query, const char *key, const char *name, struct jx *jvalue )
+{
+	write_attribute(writer,name,jvalue);
+	write_event(writer,'U',key);
+
+	struct jx *jobject = hash_table_lookup(writer->table,key);
+	if(jobject) {
+		struct jx *jname = jx_string(name);
+		jx_delete(jx_remove(jobject,jname));
+		jx_insert(jobject,jname,jvalue);
+	} else {
+		jx_delete(jvalue);
+	}
+	return 1;
+}
+
+static int writer_merge_event( struct deltadb_query *query, const char *key, struct jx *update )
+{
+	write_record(writer,update);
+	write_event(writer,'M',key);
+
+	struct jx *jobject = hash_table_lookup(writer->table,key);
+	if(jobject) {
+		struct jx_pair *p;
+		for(p=update->u.pairs;p;p=p->next) {
+			jx_delete(jx_remove(jobject,p->key));
+			jx_insert(jobject,jx_copy(p->key),jx_copy(p->value));
+		}
+	}
+	jx_delete(update);
+	return 1;
+}
+
+static int writer_remove_event( struct deltadb_query *query, const char *key, const char *name )
+{
+	write_uint32(writer->payload,intern(writer->name_ids,&writer->nnames,name));
+	write_event(writer,'R',key);
+
+	struct jx *jobject = hash_table_lookup(writer->table,key);
+	if(jobject) {
+		struct jx *jname = jx_string(name);
+		jx_delete(jx_remove(jobject,jname));
+		jx_delete(jname);
+	}
+	return 1;
+}
+
+static int writer_time_event( struct deltadb_query *query, time_t starttime, time_t stoptime, time_t current )
+{
+	write_int64(writer->payload,current);
+	write_event(writer,'T',0);
+
+	if(!writer->next_snapshot) {
+		writer->next_snapshot = current - current%writer->snapshot_interval + writer->snapshot_interval;
+	} else if(current>=writer->next_snapshot) {
+		write_snapshot(writer,current);
+		writer->next_snapshot = current - current%writer->snapshot_interval + writer->snapshot_interval;
+	}
+	return 1;
+}
+
+static struct deltadb_event_handlers writer_handlers = {
+	writer_create_event,
+	writer_delete_event,
+	writer_update_event,
+	writer_merge_event,
+	writer_remove_event,
+	writer_time_event,
+	0,
+	0,
+	0
+};
+
+/* Load a checkpoint in either the JX format or the deprecated nvpair format. */
+
+static int checkpoint_load( struct hash_table *table, const char *filename )
+{
+	FILE *file = fopen(filename,"r");
+	if(!file) return 0;
+
+	struct jx *jcheckpoint = jx_parse_stream(file);
+	if(jcheckpoint && jcheckpoint->type==JX_OBJECT) {
+		struct jx_pair *p;
+		for(p=jcheckpoint->u.pairs;p;p=p->next) {
+			if(p->key->type!=JX_STRING) continue;
+			jx_delete(hash_table_remove(table,p->key->u.string_value));
+			hash_table_insert(table,p->key->u.string_value,p->value);
+			p->value = 0;
+		}
+	} else {
+		rewind(file);
+		while(1) {
+			struct nvpair *nv = nvpair_create();
+			if(!nvpair_parse_stream(nv,file)) {
+				nvpair_delete(nv);
+				break;
+			}
+			const char *key = nvpair_lookup_string(nv,"key");
+			if(key) {
+				jx_delete(hash_table_remove(table,key));
+				hash_table_insert(table,key,nvpair_to_jx(nv));
+			}
+			nvpair_delete(nv);
+		}
+	}
+
+	jx_delete(jcheckpoint);
+	fclose(file);
+	return 1;
+}
+
+int deltadb_binary_convert( const char *ckptfile, const char *logfile, const char *binfile, time_t snapshot_interval )
+{
+	struct deltadb_binary_writer w;
+	memset(&w,0,sizeof(w));
+
+	int result = 0;
+	FILE *log = 0;
+	char *tmpfile = string_format("%s.tmp",binfile);
+
+	w.key_ids = hash_table_create(0,0);
+	w.name_ids = hash_table_create(0,0);
+	w.table = hash_table_create(0,0);
+	w.snapshots = jx_array(0);
+	w.snapshot_interval = snapshot_interval>0 ? snapshot_interval : DELTADB_BINARY_SNAPSHOT_INTERVAL;
+	w.payload = open_memstream(&w.payload_data,&w.payload_size);
+	w.value = open_memstream(&w.value_data,&w.value_size);
+
+	if(!checkpoint_load(w.table,ckptfile)) goto done;
+
+	log = fopen(logfile,"r");
+	if(!log) goto done;
+
+	w.stream = fopen(tmpfile,"w");
+	if(!w.stream) goto done;
+
+	write_data(w.stream,DELTADB_BINARY_MAGIC,4);
+	write_snapshot(&w,0);
+
+	writer = &w;
+	deltadb_process_stream(0,&writer_handlers,log,0,0);
+	writer = 0;
+
+	int64_t footer_offset = ftell(w.stream);
+	struct jx *footer = jx_objectv(
+		"keys",names_to_array(w.key_ids,w.nkeys),
+		"names",names_to_array(w.name_ids,w.nnames),
+		"snapshots",jx_copy(w.snapshots),
+		0);
+	jx_binary_write(w.stream,footer);
+	jx_delete(footer);
+
+	write_int64(w.stream,footer_offset);
+	write_data(w.stream,DELTADB_BINARY_MAGIC,4);
+
+	if(ferror(w.stream)) {
+		fclose(w.stream);
+	} else if(fclose(w.stream)==0 && rename(tmpfile,binfile)==0) {
+		result = 1;
+	}
+	w.stream = 0;
+
+done:
+	if(!result) {
+		int saved_errno = errno;
+		unlink(tmpfile);
+		errno = saved_errno;
+	}
+
+	if(log) fclose(log);
+	if(w.stream) fclose(w.stream);
+
+	hash_table_clear(w.table,(void*)jx_delete);
+	hash_table_delete(w.table);
+	hash_table_delete(w.key_ids);
+	hash_table_delete(w.name_ids);
+	jx_delete(w.snapshots);
+	fclose(w.payload);
+	fclose(w.value);
+	free(w.payload_data);
+	free(w.value_data);
+	free(tmpfile);
+
+	return result;
+}
+
+struct deltadb_binary_reader {
+	FILE *stream;
+	char **keys;
+	char **names;
+	int nkeys;
+	int nnames;
+	struct hash_table *wanted;
+};
+
+static char ** array_to_names( struct jx *array, int *count )
+{
+	*count = jx_array_length(array);
+	if(*count<0) *count = 0;
+
+	char **names = calloc(*count+1,sizeof(char*));
+	struct jx_item *i;
+	int n = 0;
+	for(i=array ? array->u.items : 0;i;i=i->next) {
+		names[n++] = jx_istype(i->value,JX_STRING) ? i->value->u.string_value : "";
+	}
+	return names;
+}
+
+static const char * lookup_name( char **names, int count, uint32_t id )
+{
+	return id<(uint32_t)count ? names[id] : 0;
+}
+
+/* Read a record of the given length, keeping only the wanted attributes, in their original order. */
+
+static struct jx * read_record( struct deltadb_binary_reader *r, uint32_t length )
+{
+	struct jx *record = jx_object(0);
+	struct jx_pair **tail = &record->u.pairs;
+	uint32_t consumed = 0;
+
+	while(consumed<length) {
+		uint32_t id, vlength;
+		if(!read_data(r->stream,&id,sizeof(id)) || !read_data(r->stream,&vlength,sizeof(vlength))) break;
+		consumed += 8 + vlength;
+
+		const char *name = lookup_name(r->names,r->nnames,id);
+		if(name && (!r->wanted || hash_table_lookup(r->wanted,name))) {
+			struct jx *value = jx_binary_read(r->stream);
+			if(!value) break;
+			*tail = jx_pair(jx_string(name),value,0);
+			tail = &(*tail)->next;
+		} else {
+			fseek(r->stream,vlength,SEEK_CUR);
+		}
+	}
+
+	return record;
+}
+
+static int read_footer( struct deltadb_binary_reader *r, int64_t *footer_offset, struct jx **snapshots )
+{
+	char magic[4];
+	if(!read_data(r->stream,magic,4) || memcmp(magic,DELTADB_BINARY_MAGIC,4)) return 0;
+
+	if(fseek(r->stream,-12,SEEK_END)<0) return 0;
+	if(!read_data(r->stream,footer_offset,sizeof(*footer_offset))) return 0;
+	if(!read_data(r->stream,magic,4) || memcmp(magic,DELTADB_BINARY_MAGIC,4)) return 0;
+
+	if(fseek(r->stream,*footer_offset,SEEK_SET)<0) return 0;
+	struct jx *footer = jx_binary_read(r->stream);
+	if(!jx_istype(footer,JX_OBJECT)) {
+		jx_delete(footer);
+		return 0;
+	}
+
+	/* The names are borrowed from the footer, which is kept until the end. */
+	r->keys = array_to_names(jx_lookup(footer,"keys"),&r->nkeys);
+	r->names = array_to_names(jx_lookup(footer,"names"),&r->nnames);
+	*snapshots = footer;
+
+	return 1;
+}
+
+int deltadb_process_binary( struct deltadb_query *query, struct deltadb_event_handlers *handlers, FILE *stream, time_t starttime, time_t stoptime, struct hash_table *names, int load_snapshot )
+{
+	struct deltadb_binary_reader r;
+	memset(&r,0,sizeof(r));
+	r.stream = stream;
+	r.wanted = names;
+
+	int64_t footer_offset;
+	struct jx *footer = 0;
+	int keepgoing = 1;
+
+	if(!read_footer(&r,&footer_offset,&footer)) {
+		fprintf(stderr,"corrupt data: invalid binary log\n");
+		goto done;
+	}
+
+	/* Find the latest snapshot before the start time, or the one at the start of the day. */
+
+	int64_t snapshot_time = 0;
+	int64_t snapshot_offset = 0;
+	struct jx *snapshots = jx_lookup(footer,"snapshots");
+	struct jx_item *i;
+	int first = 1;
+
+	for(i=jx_istype(snapshots,JX_ARRAY) ? snapshots->u.items : 0;i;i=i->next) {
+		struct jx *t = jx_array_index(i->value,0);
+		struct jx *o = jx_array_index(i->value,1);
+		if(!jx_istype(t,JX_INTEGER) || !jx_istype(o,JX_INTEGER)) continue;
+		if(first || (load_snapshot && t->u.integer_value<=starttime)) {
+			snapshot_time = t->u.integer_value;
+			snapshot_offset = o->u.integer_value;
+		}
+		first = 0;
+	}
+
+	fseek(stream,snapshot_offset,SEEK_SET);
+
+	int64_t position = snapshot_offset;
+	int64_t current = snapshot_time;
+
+	while(position<footer_offset) {
+		uint8_t type;
+		uint32_t id, length;
+
+		if(!read_data(stream,&type,1) || !read_data(stream,&id,4) || !read_data(stream,&length,4)) {
+			fprintf(stderr,"corrupt data: truncated binary log\n");
+			break;
+		}
+
+		position += EVENT_HEADER_SIZE + length;
+
+		const char *key = lookup_name(r.keys,r.nkeys,id);
+
+		if(type=='S') {
+			/* Only the first snapshot read is loaded, all later ones are skipped. */
+			if(load_snapshot) {
+				struct jx *all = jx_binary_read(stream);
+				struct jx_pair *p;
+				for(p=all ? all->u.pairs : 0;p;p=p->next) {
+					handlers->deltadb_checkpoint_event(query,p->key->u.string_value,p->value);
+					p->value = 0;
+				}
+				jx_delete(all);
+				load_snapshot = 0;
+
+				if(snapshot_time>0 && !handlers->deltadb_time_event(query,starttime,stoptime,current)) {
+					keepgoing = 0;
+					break;
+				}
+			} else {
+				fseek(stream,length,SEEK_CUR);
+			}
+		} else if(type=='T') {
+			if(!read_data(stream,&current,sizeof(current))) break;
+			if(!handlers->deltadb_time_event(query,starttime,stoptime,current) || (stoptime && current>stoptime)) {
+				keepgoing = 0;
+				break;
+			}
+		} else if(!key) {
+			fprintf(stderr,"corrupt data: invalid key in binary log\n");
+			break;
+		} else if(type=='C') {
+			if(!handlers->deltadb_create_event(query,key,read_record(&r,length))) break;
+		} else if(type=='D') {
+			if(!handlers->deltadb_delete_event(query,key)) break;
+		} else if(!handlers->deltadb_select_key(query,key)) {
+			/* Skip changes to records that are not part of the query. */
+			fseek(stream,length,SEEK_CUR);
+		} else if(type=='M') {
+			if(!handlers->deltadb_merge_event(query,key,read_record(&r,length))) break;
+		} else if(type=='U') {
+			/*
+			An update to an attribute that is not wanted is still passed on as an
+			empty merge, so that reductions over events see the same number of events.
+			*/
+			struct jx *update = read_record(&r,length);
+			if(update->u.pairs) {
+				struct jx_pair *p = update->u.pairs;
+				struct jx *value = p->value;
+				p->value = 0;
+				int ok = handlers->deltadb_update_event(query,key,p->key->u.string_value,value);
+				jx_delete(update);
+				if(!ok) break;
+			} else {
+				if(!handlers->deltadb_merge_event(query,key,update)) break;
+			}
+		} else if(type=='R') {
+			uint32_t nameid;
+			if(!read_data(stream,&nameid,sizeof(nameid))) break;
+			const char *name = lookup_name(r.names,r.nnames,nameid);
+			if(name && !handlers->deltadb_remove_event(query,key,name)) break;
+		} else {
+			fprintf(stderr,"corrupt data: invalid event type %d in binary log\n",type);
+			break;
+		}
+	}
+
+done:
+	free(r.keys);
+	free(r.names);
+	jx_delete(footer);
+
+	return keepgoing;
+}
+
+/* vim: set noexpandtab tabstop=8: */
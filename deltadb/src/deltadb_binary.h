@@ -0,0 +1,52 @@
+/*
+Copyright (C) 2024 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef DELTADB_BINARY_H
+#define DELTADB_BINARY_H
+
+/*
+A compacted binary form of one day of a deltadb log directory,
+stored as year/day.bin alongside the year/day.ckpt and year/day.log
+text files that it replaces.  It holds the checkpoint for the start
+of the day, the events of the day, and a snapshot of all records at
+regular intervals, so that a query can start from the last snapshot
+before its start time instead of the beginning of the day.
+
+Each event records the index of its record key and its length, so
+that events for records excluded by the query are skipped without
+decoding them.  Record values are stored one attribute at a time,
+so that attributes not used by the query are skipped as well.
+*/
+
+#include "deltadb_stream.h"
+#include "hash_table.h"
+
+#include <stdio.h>
+#include <time.h>
+
+/* Default time between snapshots, in seconds. */
+#define DELTADB_BINARY_SNAPSHOT_INTERVAL 3600
+
+/*
+Convert a checkpoint and log file for one day into the binary form,
+taking a snapshot every snapshot_interval seconds of log time.
+Returns true on success, false on failure with errno set.
+*/
+
+int deltadb_binary_convert( const char *ckptfile, const char *logfile, const char *binfile, time_t snapshot_interval );
+
+/*
+Play the events of a binary day file to the handlers.
+If load_snapshot is set, the state of the records is first loaded
+from the latest snapshot before starttime, through the checkpoint
+handler, otherwise the events are played from the start of the day.
+If names is not null, only the attributes named in it are decoded.
+Returns false if stoptime was reached, true otherwise.
+*/
+
+int deltadb_process_binary( struct deltadb_query *query, struct deltadb_event_handlers *handlers, FILE *stream, time_t starttime, time_t stoptime, struct hash_table *names, int load_snapshot );
+
+#endif
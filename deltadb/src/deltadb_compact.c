@@ -0,0 +1,99 @@
+/*
+Copyright (C) 2024 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Convert the days of a deltadb log directory into the compact binary
+form read by deltadb_query.  For each year/day.log with a matching
+year/day.ckpt, this writes year/day.bin, unless it is already newer
+than the log.  The text files are left in place, and deltadb_query
+goes back to them for any day whose log is written after conversion.
+*/
+
+#include "deltadb_binary.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static int convert_day( const char *dirname, int day, time_t interval )
+{
+	char ckptfile[4096];
+	char logfile[4096];
+	char binfile[4096];
+	struct stat linfo, binfo;
+
+	snprintf(ckptfile,sizeof(ckptfile),"%s/%d.ckpt",dirname,day);
+	snprintf(logfile,sizeof(logfile),"%s/%d.log",dirname,day);
+	snprintf(binfile,sizeof(binfile),"%s/%d.bin",dirname,day);
+
+	if(stat(logfile,&linfo)!=0) return 0;
+	if(stat(binfile,&binfo)==0 && linfo.st_mtime<binfo.st_mtime) return 0;
+
+	if(!deltadb_binary_convert(ckptfile,logfile,binfile,interval)) {
+		fprintf(stderr,"deltadb_compact: couldn't convert %s: %s\n",logfile,strerror(errno));
+		return -1;
+	}
+
+	printf("%s\n",binfile);
+	return 1;
+}
+
+int main( int argc, char *argv[] )
+{
+	if(argc<2 || argc>3) {
+		fprintf(stderr,"use: %s <logdir> [snapshot-interval]\n",argv[0]);
+		return 1;
+	}
+
+	const char *logdir = argv[1];
+	time_t interval = argc>2 ? atol(argv[2]) : DELTADB_BINARY_SNAPSHOT_INTERVAL;
+
+	DIR *dir = opendir(logdir);
+	if(!dir) {
+		fprintf(stderr,"deltadb_compact: couldn't open %s: %s\n",logdir,strerror(errno));
+		return 1;
+	}
+
+	int converted = 0;
+	int failed = 0;
+	struct dirent *d;
+
+	while((d=readdir(dir))) {
+		int year;
+		char extra;
+		if(sscanf(d->d_name,"%d%c",&year,&extra)!=1) continue;
+
+		char dirname[4096];
+		snprintf(dirname,sizeof(dirname),"%s/%d",logdir,year);
+
+		DIR *ydir = opendir(dirname);
+		if(!ydir) continue;
+
+		struct dirent *e;
+		while((e=readdir(ydir))) {
+			int day;
+			char suffix[8];
+			if(sscanf(e->d_name,"%d.%7s",&day,suffix)!=2 || strcmp(suffix,"log")) continue;
+
+			int result = convert_day(dirname,day,interval);
+			if(result>0) converted++;
+			if(result<0) failed++;
+		}
+
+		closedir(ydir);
+	}
+
+	closedir(dir);
+
+	printf("deltadb_compact: converted %d days, %d failed\n",converted,failed);
+
+	return failed ? 1 : 0;
+}
+
+/* vim: set noexpandtab tabstop=8: */
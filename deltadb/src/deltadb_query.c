@@ -7,6 +7,7 @@ See the file COPYING for details.
 #include "deltadb_stream.h"
 #include "deltadb_reduction.h"
 #include "deltadb_query.h"
+#include "deltadb_binary.h"
 
 #include "jx_eval.h"
 #include "jx_print.h"
@@ -135,6 +136,29 @@ static int deltadb_boolean_expr( struct jx *expr, struct jx *data )
 	return result;
 }
 
+/*
+Load one record of a checkpoint into the table, unless it doesn't match the filter.
+*/
+
+int deltadb_checkpoint_event( struct deltadb_query *query, const char *key, struct jx *jobject )
+{
+	if(!deltadb_boolean_expr(query->filter_expr,jobject)) {
+		jx_delete(jobject);
+		return 1;
+	}
+
+	jx_delete(hash_table_remove(query->table,key));
+	hash_table_insert(query->table,key,jobject);
+	return 1;
+}
+
+/* Changes to a record only matter if the record was accepted by the filter. */
+
+int deltadb_select_key( struct deltadb_query *query, const char *key )
+{
+	return hash_table_lookup(query->table,key)!=0;
+}
+
 /*
 Read a checkpoint in the (deprecated) nvpair format.  This will allow for a seamless upgrade by permitting the new JX database to continue from an nvpair checkpoint.
 */
@@ -149,14 +173,7 @@ static int compat_checkpoint_read( struct deltadb_query *query, const char *file
 		if(nvpair_parse_stream(nv,file)) {
 			const char *key = nvpair_lookup_string(nv,"key");
 			if(key) {
-				nvpair_delete(hash_table_remove(query->table,key));
-				struct jx *j = nvpair_to_jx(nv);
-				/* skip objects that don't match the filter */
-				if(deltadb_boolean_expr(query->filter_expr,j)) {
-					hash_table_insert(query->table,key,j);
-				} else {
-					jx_delete(j);
-				}
+				deltadb_checkpoint_event(query,key,nvpair_to_jx(nv));
 			}
 			nvpair_delete(nv);
 		} else {
@@ -194,8 +211,7 @@ static int checkpoint_read( struct deltadb_query *query, const char *filename )
 	struct jx_pair *p;
 	for(p=jcheckpoint->u.pairs;p;p=p->next) {
 		if(p->key->type!=JX_STRING) continue;
-		if(!deltadb_boolean_expr(query->filter_expr,p->value)) continue;
-		hash_table_insert(query->table,p->key->u.string_value,p->value);
+		deltadb_checkpoint_event(query,p->key->u.string_value,p->value);
 		p->value = 0;
 	}
 
@@ -416,9 +432,9 @@ Merge all the values of the update object into the current object,
 replacing where they exist.  We previously used jx_merge here,
 but the O(n^2) nature of the function and the heavy reliance on
 malloc/free resulted in poor performance.  This function avoids
-many malloc/frees by popping pairs off of the update in order,
-finding matches in current, if needed, and then pushing the pair
-on to the head of the current list.
+copying keys and values by popping pairs off of the update in order,
+removing matches in current, if needed, and then inserting the key
+and value into current, whose index of keys makes both steps cheap.
 */
 
 static void jx_merge_into( struct jx *current, struct jx *update )
@@ -432,11 +448,9 @@ static void jx_merge_into( struct jx *current, struct jx *update )
 		struct jx *oldvalue = jx_remove(current,p->key);
 		if(oldvalue) jx_delete(oldvalue);
 
-		p->next = current->u.pairs;
-		current->u.pairs = p;
+		jx_insert(current,p->key,p->value);
+		free(p);
 	}
-
-
 }
 
 int deltadb_merge_event( struct deltadb_query *query, const char *key, struct jx *update )
@@ -562,7 +576,9 @@ static struct deltadb_event_handlers handlers = {
   deltadb_merge_event,
   deltadb_remove_event,
   deltadb_time_event,
-  deltadb_raw_event
+  deltadb_raw_event,
+  deltadb_checkpoint_event,
+  deltadb_select_key
 };
 
 /*
@@ -579,15 +595,144 @@ int deltadb_query_execute_stream( struct deltadb_query *query, FILE *stream, tim
 	}
 }
 
+/*
+Collect the names of the attributes used by an expression.
+Returns false if the expression may use attributes that cannot
+be known in advance, as the template function does.
+*/
+
+static int collect_names( struct jx *j, struct hash_table *names );
+
+static int collect_comprehension_names( struct jx_comprehension *c, struct hash_table *names )
+{
+	for(;c;c=c->next) {
+		if(!collect_names(c->elements,names) || !collect_names(c->condition,names)) return 0;
+	}
+	return 1;
+}
+
+static int collect_names( struct jx *j, struct hash_table *names )
+{
+	if(!j) return 1;
+
+	switch(j->type) {
+	case JX_SYMBOL:
+		if(!hash_table_lookup(names,j->u.symbol_name)) {
+			hash_table_insert(names,j->u.symbol_name,(void*)1);
+		}
+		return 1;
+	case JX_OPERATOR:
+		if(j->u.oper.type==JX_OP_CALL && jx_istype(j->u.oper.left,JX_SYMBOL) && !strcmp(j->u.oper.left->u.symbol_name,"template")) {
+			return 0;
+		}
+		return collect_names(j->u.oper.left,names) && collect_names(j->u.oper.right,names);
+	case JX_ARRAY:
+		for(struct jx_item *i=j->u.items;i;i=i->next) {
+			if(!collect_names(i->value,names) || !collect_comprehension_names(i->comp,names)) return 0;
+		}
+		return 1;
+	case JX_OBJECT:
+		for(struct jx_pair *p=j->u.pairs;p;p=p->next) {
+			if(!collect_names(p->key,names) || !collect_names(p->value,names) || !collect_comprehension_names(p->comp,names)) return 0;
+		}
+		return 1;
+	default:
+		return 1;
+	}
+}
+
+/*
+Return the set of attributes needed to evaluate the query,
+or null if complete records are needed.
+*/
+
+static struct hash_table * deltadb_query_names( struct deltadb_query *query )
+{
+	if(query->display_mode==DELTADB_DISPLAY_STREAM || query->display_mode==DELTADB_DISPLAY_OBJECTS) return 0;
+
+	struct hash_table *names = hash_table_create(0,0);
+	int ok = collect_names(query->filter_expr,names) && collect_names(query->where_expr,names);
+
+	list_first_item(query->output_exprs);
+	for(struct jx *j; ok && (j = list_next_item(query->output_exprs));) {
+		ok = collect_names(j,names);
+	}
+
+	list_first_item(query->reduce_exprs);
+	for(struct deltadb_reduction *r; ok && (r = list_next_item(query->reduce_exprs));) {
+		ok = collect_names(r->expr,names);
+	}
+
+	if(!ok) {
+		hash_table_delete(names);
+		return 0;
+	}
+
+	return names;
+}
+
+/*
+Return true if the query must replay each day from its start, rather than
+from the last snapshot before starttime: a stream shows every event of the
+day, and global reductions count every event seen since the day began.
+*/
+
+static int deltadb_query_replays_day( struct deltadb_query *query )
+{
+	if(query->display_mode==DELTADB_DISPLAY_STREAM) return 1;
+
+	struct deltadb_reduction *r;
+	list_first_item(query->reduce_exprs);
+	while((r = list_next_item(query->reduce_exprs))) {
+		if(r->scope==DELTADB_SCOPE_GLOBAL) return 1;
+	}
+
+	return 0;
+}
+
+/*
+Open the data for one day, preferring the binary form made by
+deltadb_compact, unless the text log has been written since.
+*/
+
+static FILE * open_day( const char *logdir, int year, int day, int *binary )
+{
+	char *binname = string_format("%s/%d/%d.bin",logdir,year,day);
+	char *logname = string_format("%s/%d/%d.log",logdir,year,day);
+	struct stat binfo, linfo;
+	FILE *file = 0;
+
+	if(stat(binname,&binfo)==0 && (stat(logname,&linfo)!=0 || linfo.st_mtime<binfo.st_mtime)) {
+		file = fopen(binname,"r");
+	}
+
+	if(file) {
+		*binary = 1;
+	} else {
+		*binary = 0;
+		file = fopen(logname,"r");
+		if(!file) fprintf(stderr,"couldn't open %s: %s\n",logname,strerror(errno));
+	}
+
+	free(binname);
+	free(logname);
+
+	return file;
+}
+
 /*
 Execute a query on a directory structure.
 Play the log from starttime to stoptime by opening the appropriate
 checkpoint file and working ahead in the various log files.
+Days in binary form carry their own checkpoint and snapshots,
+so most queries begin at the last snapshot before starttime,
+and skip the records and attributes that they do not use.
 */
 
 int deltadb_query_execute_dir( struct deltadb_query *query, const char *logdir, time_t starttime, time_t stoptime )
 {
 	int file_errors = 0;
+	int first = 1;
 
 	query->display_next = starttime;
 
@@ -601,28 +746,38 @@ int deltadb_query_execute_dir( struct deltadb_query *query, const char *logdir,
 	int stopyear = stoptm->tm_year + 1900;
 	int stopday = stoptm->tm_yday;
 
-	char *filename = string_format("%s/%d/%d.ckpt",logdir,year,day);
-	int ret = checkpoint_read(query,filename);
-	free(filename);
-	if (!ret) {
-		return 0;
-	}
+	struct hash_table *names = deltadb_query_names(query);
+	int replay = deltadb_query_replays_day(query);
 
 	while(1) {
-		char *filename = string_format("%s/%d/%d.log",logdir,year,day);
-		FILE *file = fopen(filename,"r");
+		int binary;
+		FILE *file = open_day(logdir,year,day,&binary);
+
+		if(first && !binary) {
+			char *filename = string_format("%s/%d/%d.ckpt",logdir,year,day);
+			int ret = checkpoint_read(query,filename);
+			free(filename);
+			if (!ret) {
+				if(file) fclose(file);
+				if(names) hash_table_delete(names);
+				return 0;
+			}
+		}
+
 		if(!file) {
 			file_errors += 1;
-			fprintf(stderr,"couldn't open %s: %s\n",filename,strerror(errno));
-			free(filename);
 			if (file_errors>5) {
+				if(names) hash_table_delete(names);
 				return 0;
 			}
 
 		} else {
-			free(filename);
 			int keepgoing;
-			if(is_fast_query(query)) {
+			if(binary) {
+				/* Replaying the whole day, just like the text log, begins at the first snapshot. */
+				time_t snapshot_time = replay ? 0 : starttime;
+				keepgoing = deltadb_process_binary(query,&handlers,file,snapshot_time,stoptime,names,first);
+			} else if(is_fast_query(query)) {
 				keepgoing = deltadb_process_stream_fast(query,&handlers,file,starttime,stoptime);
 			} else {
 				keepgoing = deltadb_process_stream(query,&handlers,file,starttime,stoptime);
@@ -635,6 +790,8 @@ int deltadb_query_execute_dir( struct deltadb_query *query, const char *logdir,
 			if(!keepgoing) break;
 		}
 
+		first = 0;
+
 		day++;
 		if(day>=days_in_year(year)) {
 			year++;
@@ -645,7 +802,7 @@ int deltadb_query_execute_dir( struct deltadb_query *query, const char *logdir,
 		if(year>=stopyear && day>stopday) break;
 	}
 
+	if(names) hash_table_delete(names);
+
 	return 1;
 }
-
-
@@ -0,0 +1,82 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+# 2024-03-05 00:00:00 UTC is day 64 of 2024.
+start=1709596800
+
+prepare()
+{
+	mkdir -p compact.text/2024
+
+	echo '{"a:1":{"key":"a:1","type":"x","load":1},"b:1":{"key":"b:1","type":"y","load":2}}' > compact.text/2024/64.ckpt
+
+	{
+		echo "T $start"
+		i=1
+		while [ $i -le 200 ]
+		do
+			echo "t 60"
+			echo "U a:1 load $i"
+			echo "M b:1 {\"load\":$i,\"extra\":\"e$i\"}"
+			if [ $i = 50 ]
+			then
+				echo "C c:1 {\"key\":\"c:1\",\"type\":\"x\",\"load\":0}"
+			fi
+			if [ $i = 150 ]
+			then
+				echo "R b:1 extra"
+				echo "D c:1"
+			fi
+			i=$((i+1))
+		done
+	} > compact.text/2024/64.log
+
+	cp -r compact.text compact.binary
+}
+
+compare()
+{
+	echo "query: $@"
+	TZ=UTC ../src/deltadb_query --db compact.text "$@" | sort > compact.text.out
+	TZ=UTC ../src/deltadb_query --db compact.binary "$@" | sort > compact.binary.out
+	if ! cmp compact.text.out compact.binary.out
+	then
+		diff compact.text.out compact.binary.out
+		return 1
+	fi
+	if [ ! -s compact.text.out ]
+	then
+		echo "query produced no output"
+		return 1
+	fi
+	return 0
+}
+
+run()
+{
+	../src/deltadb_compact compact.binary 3600 || return 1
+
+	[ -f compact.binary/2024/64.bin ] || return 1
+	rm compact.binary/2024/64.log
+
+	compare --json --at "2024-03-05 02:00:00" || return 1
+	compare --output key --output load --from "2024-03-05 00:00:00" --to "2024-03-05 03:00:00" --every 10m || return 1
+	compare --where 'type=="x"' --output key --output load --from "2024-03-05 01:00:00" --to "2024-03-05 03:00:00" --every 5m || return 1
+	compare --filter 'key=="b:1"' --output extra --from "2024-03-05 00:00:00" --to "2024-03-05 03:00:00" --every 10m || return 1
+	compare --filter 'type=="x"' --from "2024-03-05 01:30:00" --to "2024-03-05 02:30:00" || return 1
+
+	# Global reductions count from the start of the day, whether or not a snapshot is closer.
+	compare --output 'GLOBAL_COUNT(load)' --output 'GLOBAL_MAX(load)' --from "2024-03-05 02:30:00" --to "2024-03-05 03:00:00" --every 10m || return 1
+
+	return 0
+}
+
+clean()
+{
+	rm -rf compact.text compact.binary compact.text.out compact.binary.out
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -49,6 +49,7 @@ SUBSECTION(Workflow Handling)
 OPTIONS_BEGIN
 OPTION_FLAG(a,advertise)Advertise the manager information to a catalog server.
 OPTION_ARG(l, makeflow-log, logfile)Use this file for the makeflow log. (default is X.makeflowlog)
+OPTION_ARG_LONG(log-checkpoint-interval, #)Write a compact checkpoint of the makeflow log every # seconds, so that a restart reads only the log written since. (default is 300s, 0 disables checkpoints)
 OPTION_ARG(L, batch-log, logfile)Use this file for the batch system log. (default is X.PARAM(type)log)
 OPTION_ARG(m, email, email)Email summary of workflow to address.
 OPTION_ARG(j, max-local, #)Max number of local jobs to run at once. (default is # of cores)
@@ -197,6 +198,7 @@ OPTION_FLAG_LONG(enforcement)Use Parrot to restrict access to the given inputs/o
 OPTION_ARG_LONG(parrot-path,path)Path to parrot_run executable on the host system.
 OPTION_ARG_LONG(env-replace-path,path)Path to env_replace executable on the host system.
 OPTION_FLAG_LONG(skip-file-check)Do not check for file existence before running.
+OPTION_ARG_LONG(file-check-threads, #)Check for the existence of up to # files at once before running. (default is 16)
 OPTION_FLAG_LONG(do-not-save-failed-output)Disable saving failed nodes to directory for later analysis.
 OPTION_ARG_LONG(shared-fs,dir)Assume the given directory is a shared filesystem accessible at all execution sites.
 OPTION_ARG(X, change-directory, dir)Change to PARAM(dir) prior to executing the workflow.
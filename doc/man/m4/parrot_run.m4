@@ -20,6 +20,8 @@ OPTION_ARG_LONG(check-driver,driver) Check for the presence of a given driver (e
 OPTION_ARG(a,chirp-auth,unix|hostname|ticket|globus|kerberos)Use this Chirp authentication method.  May be invoked multiple times to indicate a preferred list, in order.
 OPTION_ARG(b,block-size,bytes)Set the I/O block size hint.
 OPTION_ARG(c,status-file,file)Print exit status information to file.
+OPTION_ARG_LONG(cache-block-size,bytes)Cache remote files in blocks of this size, fetching only the blocks that are read, for services that can read a file at any offset, such as HTTP. Files are still cached whole when written or executed. (PARROT_CACHE_BLOCK_SIZE)
+OPTION_ARG_LONG(cache-max-size,bytes)Drop the least recently used blocks to keep the block cache under this size. Defaults to 1G. (PARROT_CACHE_MAX_SIZE)
 OPTION_FLAG(C,channel-auth)Enable data channel authentication in GridFTP.
 OPTION_ARG(d,debug,flag)Enable debugging for this sub-system.
 OPTION_FLAG(D,no-optimize)Disable small file optimizations.
@@ -49,6 +51,7 @@ OPTION_FLAG_LONG(cvmfs-repo-switching) Allow repository switching with CVMFS.
 OPTION_ARG(R,root-checksum,cksum)Enforce this root filesystem checksum, where available.
 OPTION_FLAG(s,stream-no-cache)Use streaming protocols without caching.
 OPTION_FLAG(S,session-caching)Enable whole session caching for all protocols.
+OPTION_FLAG_LONG(seccomp)Install a seccomp filter in the traced programs, so that they only stop at the system calls Parrot must inspect. Requires Linux 4.8 or later, and cannot be used with --valgrind. System calls passed through by the filter are not counted by --syscall-table.
 OPTION_FLAG_LONG(syscall-disable-debug)Disable tracee access to the Parrot debug syscall.
 OPTION_ARG(t,tempdir,dir)Where to store temporary files.
 OPTION_ARG(T,timeout,time)Maximum amount of time to retry failures.
@@ -113,6 +113,7 @@ OPTION_ARG(V,verbatim-to-summary,str)Include this string verbatim in a line in t
 OPTION_ARG_LONG(measure-dir,dir)Follow the size of dir. By default the directory at the start of execution is followed. Can be specified multiple times. See --without-disk-footprint below.
 OPTION_FLAG_LONG(follow-chdir)Follow the current working directories of the processes tree.
 OPTION_FLAG_LONG(without-disk-footprint)Do not measure working directory footprint. Overrides --measure-dir.
+OPTION_FLAG_LONG(without-cgroup)Do not measure the command in its own cgroup. By default, if cgroups v2 are delegated to the user, the command runs in a new cgroup, and its cpu time and block I/O are read from it.
 OPTION_FLAG_LONG(no-pprint)Do not pretty-print summaries.
 OPTION_ARG_LONG(snapshot-events,file)Configuration file for snapshots on file patterns. See below.
 OPTION_ARG_LONG(catalog-task-name,task-name)Report measurements to catalog server with "task"=PARAM(task-name).
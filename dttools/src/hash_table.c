@@ -14,6 +14,26 @@ See the file COPYING for details.
 #define DEFAULT_LOAD 0.75
 #define DEFAULT_FUNC hash_string
 
+/*
+An open addressing table keeps all entries in one array of slots,
+probed linearly, and a parallel array of one control byte per slot.
+A control byte is either EMPTY, DELETED, or holds seven bits of
+the hash of the entry in the slot, so that a probe only touches
+the slots whose tag matches. Keys shorter than OPEN_KEY_INLINE
+are stored in the slot itself, so most entries need no allocation.
+Removed entries leave a DELETED marker and never move, which keeps
+removal during iteration safe, just as with chained buckets.
+*/
+
+#define OPEN_EMPTY 0x80
+#define OPEN_DELETED 0xfe
+#define OPEN_IS_FULL(c) ((c) < 0x80)
+#define OPEN_KEY_INLINE 16
+#define OPEN_MIN_SLOTS 8
+
+/* Rehash when more than 7/8 of the slots are full or deleted. */
+#define OPEN_MAX_USED(n) ((n) - (n) / 8)
+
 struct entry {
 	char *key;
 	void *value;
@@ -21,6 +41,16 @@ struct entry {
 	struct entry *next;
 };
 
+struct slot {
+	unsigned hash;
+	int inline_key;
+	void *value;
+	union {
+		char *ptr;
+		char str[OPEN_KEY_INLINE];
+	} key;
+};
+
 struct hash_table {
 	hash_func_t hash_func;
 	int bucket_count;
@@ -28,8 +58,28 @@ struct hash_table {
 	struct entry **buckets;
 	int ibucket;
 	struct entry *ientry;
+
+	/* Used only by open addressing tables, where bucket_count is the number of slots. */
+	int open;
+	int used;
+	int shift;
+	int icount;
+	unsigned char *control;
+	struct slot *slots;
 };
 
+static int open_create(struct hash_table *h, int bucket_count);
+static void open_clear(struct hash_table *h, void (*delete_func)(void *));
+static void open_delete(struct hash_table *h);
+static void *open_lookup(struct hash_table *h, const char *key);
+static int open_insert(struct hash_table *h, const char *key, const void *value);
+static void *open_remove(struct hash_table *h, const char *key);
+static int open_fromkey(struct hash_table *h, const char *key);
+static void open_firstkey(struct hash_table *h);
+static int open_nextkey(struct hash_table *h, char **key, void **value);
+static void open_randomkey(struct hash_table *h, int *offset_bookkeep);
+static int open_nextkey_with_offset(struct hash_table *h, int offset_bookkeep, char **key, void **value);
+
 struct hash_table *hash_table_create(int bucket_count, hash_func_t func)
 {
 	struct hash_table *h;
@@ -46,6 +96,7 @@ struct hash_table *hash_table_create(int bucket_count, hash_func_t func)
 	h->size = 0;
 	h->hash_func = func;
 	h->bucket_count = bucket_count;
+	h->open = 0;
 	h->buckets = (struct entry **)calloc(bucket_count, sizeof(struct entry *));
 	if (!h->buckets) {
 		free(h);
@@ -55,8 +106,35 @@ struct hash_table *hash_table_create(int bucket_count, hash_func_t func)
 	return h;
 }
 
+struct hash_table *hash_table_create_open(int bucket_count, hash_func_t func)
+{
+	struct hash_table *h;
+
+	h = (struct hash_table *)calloc(1, sizeof(struct hash_table));
+	if (!h)
+		return 0;
+
+	if (!func)
+		func = DEFAULT_FUNC;
+
+	h->hash_func = func;
+	h->open = 1;
+
+	if (!open_create(h, bucket_count)) {
+		free(h);
+		return 0;
+	}
+
+	return h;
+}
+
 void hash_table_clear(struct hash_table *h, void (*delete_func)(void *))
 {
+	if (h->open) {
+		open_clear(h, delete_func);
+		return;
+	}
+
 	struct entry *e, *f;
 	int i;
 
@@ -79,6 +157,11 @@ void hash_table_clear(struct hash_table *h, void (*delete_func)(void *))
 
 void hash_table_delete(struct hash_table *h)
 {
+	if (h->open) {
+		open_delete(h);
+		return;
+	}
+
 	hash_table_clear(h, 0);
 	free(h->buckets);
 	free(h);
@@ -86,6 +169,9 @@ void hash_table_delete(struct hash_table *h)
 
 void *hash_table_lookup(struct hash_table *h, const char *key)
 {
+	if (h->open)
+		return open_lookup(h, key);
+
 	struct entry *e;
 	unsigned hash, index;
 
@@ -152,6 +238,9 @@ static int hash_table_double_buckets(struct hash_table *h)
 
 int hash_table_insert(struct hash_table *h, const char *key, const void *value)
 {
+	if (h->open)
+		return open_insert(h, key, value);
+
 	struct entry *e;
 	unsigned hash, index;
 
@@ -189,6 +278,9 @@ int hash_table_insert(struct hash_table *h, const char *key, const void *value)
 
 void *hash_table_remove(struct hash_table *h, const char *key)
 {
+	if (h->open)
+		return open_remove(h, key);
+
 	struct entry *e, *f;
 	void *value;
 	unsigned hash, index;
@@ -220,6 +312,9 @@ void *hash_table_remove(struct hash_table *h, const char *key)
 
 int hash_table_fromkey(struct hash_table *h, const char *key)
 {
+	if (h->open)
+		return open_fromkey(h, key);
+
 	if (!key) {
 		/* treat NULL as a special case equivalent to firstkey */
 		hash_table_firstkey(h);
@@ -243,6 +338,11 @@ int hash_table_fromkey(struct hash_table *h, const char *key)
 
 void hash_table_firstkey(struct hash_table *h)
 {
+	if (h->open) {
+		open_firstkey(h);
+		return;
+	}
+
 	h->ientry = 0;
 	for (h->ibucket = 0; h->ibucket < h->bucket_count; h->ibucket++) {
 		h->ientry = h->buckets[h->ibucket];
@@ -253,6 +353,9 @@ void hash_table_firstkey(struct hash_table *h)
 
 int hash_table_nextkey(struct hash_table *h, char **key, void **value)
 {
+	if (h->open)
+		return open_nextkey(h, key, value);
+
 	if (h->ientry) {
 		*key = h->ientry->key;
 		*value = h->ientry->value;
@@ -274,6 +377,11 @@ int hash_table_nextkey(struct hash_table *h, char **key, void **value)
 
 void hash_table_randomkey(struct hash_table *h, int *offset_bookkeep)
 {
+	if (h->open) {
+		open_randomkey(h, offset_bookkeep);
+		return;
+	}
+
 	h->ientry = 0;
 	if (h->bucket_count < 1) {
 		return;
@@ -300,6 +408,9 @@ void hash_table_randomkey(struct hash_table *h, int *offset_bookkeep)
 
 int hash_table_nextkey_with_offset(struct hash_table *h, int offset_bookkeep, char **key, void **value)
 {
+	if (h->open)
+		return open_nextkey_with_offset(h, offset_bookkeep, key, value);
+
 	if (h->bucket_count < 1) {
 		return 0;
 	}
@@ -326,6 +437,283 @@ int hash_table_nextkey_with_offset(struct hash_table *h, int offset_bookkeep, ch
 	return 0;
 }
 
+/*
+The slot of an entry is chosen from the high bits of its hash times
+the golden ratio, so that weak hash functions given by the caller
+still spread over the whole table. The tag comes from the low bits.
+*/
+
+static inline unsigned open_mix(unsigned hash)
+{
+	return hash * 0x9e3779b9u;
+}
+
+static inline char *open_slot_key(struct slot *s)
+{
+	return s->inline_key ? s->key.str : s->key.ptr;
+}
+
+static int open_alloc(struct hash_table *h, int slot_count)
+{
+	int bits = 0;
+	while ((1 << bits) < slot_count)
+		bits++;
+
+	unsigned char *control = malloc(1 << bits);
+	struct slot *slots = malloc((1 << bits) * sizeof(struct slot));
+	if (!control || !slots) {
+		free(control);
+		free(slots);
+		return 0;
+	}
+
+	memset(control, OPEN_EMPTY, 1 << bits);
+
+	h->control = control;
+	h->slots = slots;
+	h->bucket_count = 1 << bits;
+	h->shift = 32 - bits;
+	h->used = 0;
+
+	return 1;
+}
+
+static int open_create(struct hash_table *h, int bucket_count)
+{
+	if (bucket_count < OPEN_MIN_SLOTS)
+		bucket_count = OPEN_MIN_SLOTS;
+
+	h->size = 0;
+	return open_alloc(h, bucket_count);
+}
+
+/* Move all entries to a new array of slots, dropping DELETED markers. */
+
+static int open_rehash(struct hash_table *h, int slot_count)
+{
+	unsigned char *old_control = h->control;
+	struct slot *old_slots = h->slots;
+	int old_count = h->bucket_count;
+
+	if (!open_alloc(h, slot_count))
+		return 0;
+
+	unsigned mask = h->bucket_count - 1;
+	int i;
+
+	for (i = 0; i < old_count; i++) {
+		if (!OPEN_IS_FULL(old_control[i]))
+			continue;
+
+		unsigned j = open_mix(old_slots[i].hash) >> h->shift;
+		while (h->control[j] != OPEN_EMPTY)
+			j = (j + 1) & mask;
+
+		h->control[j] = old_control[i];
+		h->slots[j] = old_slots[i];
+	}
+
+	h->used = h->size;
+
+	free(old_control);
+	free(old_slots);
+
+	return 1;
+}
+
+static int open_find(struct hash_table *h, const char *key, unsigned hash)
+{
+	unsigned mixed = open_mix(hash);
+	unsigned char tag = mixed & 0x7f;
+	unsigned mask = h->bucket_count - 1;
+	unsigned i = mixed >> h->shift;
+
+	while (h->control[i] != OPEN_EMPTY) {
+		if (h->control[i] == tag) {
+			struct slot *s = &h->slots[i];
+			if (s->hash == hash && !strcmp(key, open_slot_key(s)))
+				return i;
+		}
+		i = (i + 1) & mask;
+	}
+
+	return -1;
+}
+
+static void open_clear(struct hash_table *h, void (*delete_func)(void *))
+{
+	int i;
+
+	for (i = 0; i < h->bucket_count; i++) {
+		if (!OPEN_IS_FULL(h->control[i]))
+			continue;
+		if (delete_func)
+			delete_func(h->slots[i].value);
+		if (!h->slots[i].inline_key)
+			free(h->slots[i].key.ptr);
+	}
+
+	memset(h->control, OPEN_EMPTY, h->bucket_count);
+	h->size = 0;
+	h->used = 0;
+}
+
+static void open_delete(struct hash_table *h)
+{
+	open_clear(h, 0);
+	free(h->control);
+	free(h->slots);
+	free(h);
+}
+
+static void *open_lookup(struct hash_table *h, const char *key)
+{
+	int i = open_find(h, key, h->hash_func(key));
+	return i < 0 ? 0 : h->slots[i].value;
+}
+
+static int open_insert(struct hash_table *h, const char *key, const void *value)
+{
+	if (h->used + 1 > OPEN_MAX_USED(h->bucket_count)) {
+		/* Double the slots, unless most of the used ones are only DELETED markers. */
+		int slot_count = OPEN_MIN_SLOTS;
+		while (OPEN_MAX_USED(slot_count) < 2 * (h->size + 1))
+			slot_count *= 2;
+		if (!open_rehash(h, slot_count))
+			return 0;
+	}
+
+	unsigned hash = h->hash_func(key);
+	unsigned mixed = open_mix(hash);
+	unsigned char tag = mixed & 0x7f;
+	unsigned mask = h->bucket_count - 1;
+	unsigned i = mixed >> h->shift;
+	int deleted = -1;
+
+	while (h->control[i] != OPEN_EMPTY) {
+		if (h->control[i] == tag) {
+			struct slot *s = &h->slots[i];
+			if (s->hash == hash && !strcmp(key, open_slot_key(s)))
+				return 0;
+		} else if (h->control[i] == OPEN_DELETED && deleted < 0) {
+			deleted = i;
+		}
+		i = (i + 1) & mask;
+	}
+
+	if (deleted >= 0) {
+		i = deleted;
+	} else {
+		h->used++;
+	}
+
+	struct slot *s = &h->slots[i];
+	size_t length = strlen(key);
+
+	if (length < OPEN_KEY_INLINE) {
+		memcpy(s->key.str, key, length + 1);
+		s->inline_key = 1;
+	} else {
+		s->key.ptr = strdup(key);
+		if (!s->key.ptr) {
+			if (deleted < 0)
+				h->used--;
+			return 0;
+		}
+		s->inline_key = 0;
+	}
+
+	s->hash = hash;
+	s->value = (void *)value;
+	h->control[i] = tag;
+	h->size++;
+
+	return 1;
+}
+
+static void *open_remove(struct hash_table *h, const char *key)
+{
+	int i = open_find(h, key, h->hash_func(key));
+	if (i < 0)
+		return 0;
+
+	struct slot *s = &h->slots[i];
+	void *value = s->value;
+
+	if (!s->inline_key)
+		free(s->key.ptr);
+
+	/* No probe can go past an empty successor, so the slot can be empty too. */
+	if (h->control[(i + 1) & (h->bucket_count - 1)] == OPEN_EMPTY) {
+		h->control[i] = OPEN_EMPTY;
+		h->used--;
+	} else {
+		h->control[i] = OPEN_DELETED;
+	}
+
+	h->size--;
+
+	return value;
+}
+
+static int open_fromkey(struct hash_table *h, const char *key)
+{
+	if (!key) {
+		open_firstkey(h);
+		return 1;
+	}
+
+	int i = open_find(h, key, h->hash_func(key));
+	if (i < 0) {
+		open_firstkey(h);
+		return 0;
+	}
+
+	h->ibucket = i;
+	return 1;
+}
+
+static void open_firstkey(struct hash_table *h)
+{
+	h->ibucket = 0;
+}
+
+static int open_nextkey(struct hash_table *h, char **key, void **value)
+{
+	for (; h->ibucket < h->bucket_count; h->ibucket++) {
+		if (OPEN_IS_FULL(h->control[h->ibucket])) {
+			struct slot *s = &h->slots[h->ibucket++];
+			*key = open_slot_key(s);
+			*value = s->value;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void open_randomkey(struct hash_table *h, int *offset_bookkeep)
+{
+	*offset_bookkeep = random() % h->bucket_count;
+	h->icount = 0;
+}
+
+static int open_nextkey_with_offset(struct hash_table *h, int offset_bookkeep, char **key, void **value)
+{
+	unsigned mask = h->bucket_count - 1;
+
+	while (h->icount < h->bucket_count) {
+		unsigned i = (offset_bookkeep + h->icount++) & mask;
+		if (OPEN_IS_FULL(h->control[i])) {
+			*key = open_slot_key(&h->slots[i]);
+			*value = h->slots[i].value;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 typedef unsigned long int ub4; /* unsigned 4-byte quantities */
 typedef unsigned char ub1;     /* unsigned 1-byte quantities */
 
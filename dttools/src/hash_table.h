@@ -48,6 +48,19 @@ typedef unsigned (*hash_func_t) (const char *key);
 
 struct hash_table *hash_table_create(int buckets, hash_func_t func);
 
+/** Create a new hash table using open addressing.
+The table has the same interface and iteration macros as one made by @ref hash_table_create,
+but keeps its entries in a single array instead of chained buckets, and stores short keys inline
+without a separate allocation. It uses less memory and is faster for large tables.
+As with chained buckets, the current entry may be removed while iterating, but no entry may be inserted.
+Iteration order differs from a chained table, and a key returned by an iteration is only valid until the table is next modified.
+@param buckets The initial number of slots in the table.  If zero, a default value will be used.
+@param func The default hash function to be used.  If zero, @ref hash_string will be used.
+@return A pointer to a new hash table.
+*/
+
+struct hash_table *hash_table_create_open(int buckets, hash_func_t func);
+
 /** Remove all entries from an hash table.
 @param h The hash table to delete.
 @param delete_func If non-null, will be invoked on each object to delete it.
@@ -0,0 +1,168 @@
+/*
+Copyright (C) 2024 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Compare the throughput of insert, lookup, iteration and removal,
+and the memory used per entry, of chained and open addressing
+hash tables. Each kind of table is measured in its own process,
+so that the memory left over by one does not count against the other.
+*/
+
+#include "hash_table.h"
+#include "timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static void show_help(const char *cmd)
+{
+	printf("Use: %s <keys> [key_length]\n", cmd);
+}
+
+/* Resident memory of this process in bytes, or zero if unknown. */
+
+static long resident_bytes()
+{
+	long size, resident = 0;
+
+	FILE *file = fopen("/proc/self/statm", "r");
+	if (!file)
+		return 0;
+
+	if (fscanf(file, "%ld %ld", &size, &resident) != 2)
+		resident = 0;
+
+	fclose(file);
+
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+static char **make_keys(const char *prefix, int n, int length)
+{
+	char **keys = malloc(n * sizeof(char *));
+	int i;
+
+	for (i = 0; i < n; i++) {
+		keys[i] = malloc(length + 32);
+		int actual = sprintf(keys[i], "%s%d", prefix, i);
+		while (actual < length)
+			keys[i][actual++] = '.';
+		keys[i][actual] = 0;
+	}
+
+	return keys;
+}
+
+static void report(const char *what, timestamp_t elapsed, int n)
+{
+	printf("  %-8s %8.3f s %8.2f Mops/s\n", what, elapsed / 1000000.0, n / (double)elapsed);
+}
+
+static void run(const char *name, struct hash_table *(*create)(int, hash_func_t), char **keys, char **missing, int n)
+{
+	long resident = resident_bytes();
+	timestamp_t start;
+	long found = 0;
+	int i;
+
+	printf("%s:\n", name);
+
+	start = timestamp_get();
+	struct hash_table *h = create(0, 0);
+	for (i = 0; i < n; i++) {
+		hash_table_insert(h, keys[i], (void *)(long)(i + 1));
+	}
+	report("insert", timestamp_get() - start, n);
+
+	long memory = resident_bytes() - resident;
+
+	start = timestamp_get();
+	for (i = 0; i < n; i++) {
+		found += (long)hash_table_lookup(h, keys[i]);
+	}
+	report("hit", timestamp_get() - start, n);
+
+	start = timestamp_get();
+	for (i = 0; i < n; i++) {
+		found += (long)hash_table_lookup(h, missing[i]);
+	}
+	report("miss", timestamp_get() - start, n);
+
+	char *key;
+	long value;
+	int rounds = 10;
+
+	start = timestamp_get();
+	for (i = 0; i < rounds; i++) {
+		HASH_TABLE_ITERATE(h, key, value) {
+			found -= value;
+		}
+	}
+	report("iterate", timestamp_get() - start, n * rounds);
+
+	start = timestamp_get();
+	for (i = 0; i < n; i++) {
+		hash_table_remove(h, keys[i]);
+	}
+	report("remove", timestamp_get() - start, n);
+
+	hash_table_delete(h);
+
+	if (found != -(long)(rounds - 1) * n * (n + 1) / 2) {
+		printf("  wrong results!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (memory > 0) {
+		printf("  memory   %8.1f bytes/entry\n", memory / (double)n);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		show_help(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int n = atoi(argv[1]);
+	int length = argc > 2 ? atoi(argv[2]) : 0;
+
+	char **keys = make_keys("key-", n, length);
+	char **missing = make_keys("missing-", n, length);
+
+	printf("%d keys of %d bytes\n", n, (int)strlen(keys[n - 1]));
+
+	int open;
+	for (open = 0; open <= 1; open++) {
+		fflush(stdout);
+		pid_t pid = fork();
+		if (pid == 0) {
+			if (open) {
+				run("open", hash_table_create_open, keys, missing, n);
+			} else {
+				run("chained", hash_table_create, keys, missing, n);
+			}
+			fflush(stdout);
+			_exit(0);
+		} else if (pid > 0) {
+			int status;
+			waitpid(pid, &status, 0);
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				return EXIT_FAILURE;
+		} else {
+			printf("could not fork!\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* vim: set noexpandtab tabstop=8: */
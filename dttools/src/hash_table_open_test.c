@@ -0,0 +1,146 @@
+/*
+Copyright (C) 2024 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "hash_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NKEYS 10000
+
+/* Alternate short keys, stored inline, with long keys, stored apart. */
+
+static void make_key(char *name, int i)
+{
+	if (i % 2) {
+		sprintf(name, "k%d", i);
+	} else {
+		sprintf(name, "a-much-longer-key-that-is-not-inline-%d", i);
+	}
+}
+
+static int check_sum(struct hash_table *h, long expected)
+{
+	char *key;
+	long value;
+	long sum = 0;
+	int offset;
+
+	HASH_TABLE_ITERATE(h, key, value) {
+		sum += value;
+	}
+	if (sum != expected) {
+		fprintf(stdout, "error in sum: %ld != %ld\n", sum, expected);
+		return 0;
+	}
+
+	sum = 0;
+	HASH_TABLE_ITERATE_RANDOM_START(h, offset, key, value) {
+		sum += value;
+	}
+	if (sum != expected) {
+		fprintf(stdout, "error in sum from random start: %ld != %ld\n", sum, expected);
+		return 0;
+	}
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct hash_table *h = hash_table_create_open(0, 0);
+	char name[64];
+	long expected = 0;
+	int i;
+
+	for (i = 1; i <= NKEYS; i++) {
+		make_key(name, i);
+		if (!hash_table_insert(h, name, (void *)(long)i)) {
+			fprintf(stdout, "could not insert %s\n", name);
+			return 1;
+		}
+		expected += i;
+	}
+
+	make_key(name, 1);
+	if (hash_table_insert(h, name, (void *)1L)) {
+		fprintf(stdout, "duplicate insert of %s succeeded\n", name);
+		return 1;
+	}
+
+	for (i = 1; i <= NKEYS; i++) {
+		make_key(name, i);
+		if ((long)hash_table_lookup(h, name) != i) {
+			fprintf(stdout, "lookup of %s failed\n", name);
+			return 1;
+		}
+	}
+
+	if (hash_table_size(h) != NKEYS || !check_sum(h, expected))
+		return 1;
+
+	/* Remove the multiples of three while iterating. */
+	char *key;
+	long value;
+	HASH_TABLE_ITERATE(h, key, value) {
+		if (value % 3 == 0) {
+			hash_table_remove(h, key);
+			expected -= value;
+		}
+	}
+
+	for (i = 1; i <= NKEYS; i++) {
+		make_key(name, i);
+		long found = (long)hash_table_lookup(h, name);
+		if ((i % 3 == 0 && found) || (i % 3 != 0 && found != i)) {
+			fprintf(stdout, "lookup of %s after removal failed\n", name);
+			return 1;
+		}
+	}
+
+	if (hash_table_size(h) != NKEYS - NKEYS / 3 || !check_sum(h, expected))
+		return 1;
+
+	/* Iterating from a key visits the rest of the table. */
+	make_key(name, 1);
+	if (!hash_table_fromkey(h, name) || !hash_table_nextkey(h, &key, (void **)&value) || value != 1) {
+		fprintf(stdout, "iteration from %s failed\n", name);
+		return 1;
+	}
+
+	int iter_control, iter_count_var;
+	long sum = 0;
+	HASH_TABLE_ITERATE_FROM_KEY(h, iter_control, iter_count_var, name, key, value) {
+		sum += value;
+	}
+	if (sum != expected) {
+		fprintf(stdout, "error in sum from key %s: %ld != %ld\n", name, sum, expected);
+		return 1;
+	}
+
+	/* Reinsert over the removed entries. */
+	for (i = 3; i <= NKEYS; i += 3) {
+		make_key(name, i);
+		hash_table_insert(h, name, (void *)(long)i);
+		expected += i;
+	}
+
+	if (hash_table_size(h) != NKEYS || !check_sum(h, expected))
+		return 1;
+
+	hash_table_clear(h, 0);
+	if (hash_table_size(h) != 0 || !check_sum(h, 0))
+		return 1;
+
+	hash_table_delete(h);
+
+	fprintf(stdout, "open hash table passed\n");
+
+	return 0;
+}
+
+/* vim: set noexpandtab tabstop=8: */
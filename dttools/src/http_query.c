@@ -23,6 +23,9 @@ See the file COPYING for details.
 #define HTTP_LINE_MAX 4096
 #define HTTP_PORT 80
 
+/* How far into a response that ignored the range we read to reach the offset. */
+#define HTTP_SOAK_MAX (1<<20)
+
 static int http_response_to_errno(int response)
 {
 	if (response <= 299) {
@@ -63,9 +66,19 @@ struct link *http_query(const char *url, const char *action, time_t stoptime)
 }
 
 struct link *http_query_size(const char *url, const char *action, INT64_T *size, time_t stoptime, int cache_reload)
+{
+	return http_query_range(url, action, 0, 0, size, stoptime, cache_reload);
+}
+
+struct link *http_query_size_via_proxy(const char *proxy, const char *url, const char *action, INT64_T *size, time_t stoptime, int cache_reload)
+{
+	return http_query_range_via_proxy(proxy, url, action, 0, 0, size, stoptime, cache_reload);
+}
+
+struct link *http_query_range(const char *url, const char *action, INT64_T offset, INT64_T end, INT64_T *size, time_t stoptime, int cache_reload)
 {
 	if (!getenv("HTTP_PROXY")) {
-		return http_query_size_via_proxy(0, url, action, size, stoptime, cache_reload);
+		return http_query_range_via_proxy(0, url, action, offset, end, size, stoptime, cache_reload);
 	} else {
 		char proxies[HTTP_LINE_MAX];
 		char *proxy;
@@ -75,7 +88,7 @@ struct link *http_query_size(const char *url, const char *action, INT64_T *size,
 
 		while (proxy) {
 			struct link *result;
-			result = http_query_size_via_proxy(proxy, url, action, size, stoptime, cache_reload);
+			result = http_query_range_via_proxy(proxy, url, action, offset, end, size, stoptime, cache_reload);
 			if (result)
 				return result;
 			proxy = strtok(0, ";");
@@ -84,7 +97,7 @@ struct link *http_query_size(const char *url, const char *action, INT64_T *size,
 	}
 }
 
-struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, const char *action, INT64_T *size, time_t stoptime, int cache_reload)
+struct link *http_query_range_via_proxy(const char *proxy, const char *urlin, const char *action, INT64_T offset, INT64_T end, INT64_T *size, time_t stoptime, int cache_reload)
 {
 	char url[HTTP_LINE_MAX];
 	char newurl[HTTP_LINE_MAX];
@@ -153,6 +166,10 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 		buffer_printf(&B, "%s %s HTTP/1.1\r\n", action, url);
 		if (cache_reload)
 			buffer_putliteral(&B, "Cache-Control: max-age=0\r\n");
+		if (end > offset)
+			buffer_printf(&B, "Range: bytes=%" PRId64 "-%" PRId64 "\r\n", offset, end - 1);
+		else if (offset > 0)
+			buffer_printf(&B, "Range: bytes=%" PRId64 "-\r\n", offset);
 		buffer_putliteral(&B, "Connection: close\r\n");
 		buffer_printf(&B, "Host: %s\r\n", actual_host);
 		if (getenv("HTTP_USER_AGENT"))
@@ -184,6 +201,26 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 
 			switch (response) {
 			case 200:
+				/* The server may ignore the range, and send the whole object.
+				 * Skipping to the offset is only done when it is cheap, so that
+				 * callers reading all over a large object can tell with ESPIPE,
+				 * and read it in order instead. */
+				if (offset > HTTP_SOAK_MAX) {
+					debug(D_HTTP, "server ignored the range, not skipping %" PRId64 " bytes", offset);
+					link_close(link);
+					errno = ESPIPE;
+					return 0;
+				} else if (offset > 0) {
+					if (link_soak(link, offset, stoptime) != offset) {
+						link_close(link);
+						errno = EIO;
+						return 0;
+					}
+					*size -= offset;
+				}
+				return link;
+				break;
+			case 206:
 				return link;
 				break;
 			case 301:
@@ -197,7 +234,7 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 						errno = EIO;
 						return 0;
 					} else {
-						return http_query_size_via_proxy(proxy, newurl, action, size, stoptime, cache_reload);
+						return http_query_range_via_proxy(proxy, newurl, action, offset, end, size, stoptime, cache_reload);
 					}
 				} else {
 					errno = ENOENT;
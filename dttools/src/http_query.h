@@ -16,6 +16,15 @@ struct link *http_query_no_cache(const char *url, const char *action, time_t sto
 struct link *http_query_size(const char *url, const char *action, INT64_T * size, time_t stoptime, int cache_reload);
 struct link *http_query_size_via_proxy(const char *proxy, const char *url, const char *action, INT64_T * size, time_t stoptime, int cache_reload);
 
+/*
+As http_query_size, but the data starts at offset, and ends before end,
+or at the end of the object if end is not past offset. size is set to
+the number of bytes sent from offset. If the server ignores the range
+and offset is too far to skip to, fails with errno ESPIPE.
+*/
+struct link *http_query_range(const char *url, const char *action, INT64_T offset, INT64_T end, INT64_T * size, time_t stoptime, int cache_reload);
+struct link *http_query_range_via_proxy(const char *proxy, const char *url, const char *action, INT64_T offset, INT64_T end, INT64_T * size, time_t stoptime, int cache_reload);
+
 INT64_T http_fetch_to_file(const char *url, const char *filename, time_t stoptime);
 
 #endif
@@ -6,6 +6,7 @@ See the file COPYING for details.
 
 #include "jx.h"
 #include "buffer.h"
+#include "hash_table.h"
 #include "stringtools.h"
 #include "xxmalloc.h"
 
@@ -15,6 +16,108 @@ See the file COPYING for details.
 #include <stdlib.h>
 #include <string.h>
 
+/*
+Lookups in an object are a linear search of its pairs, which is
+fine for the small objects that make up most JX documents.
+Once a search visits JX_INDEX_MIN pairs, the object gets an index
+from each string key to the link that points to the first pair
+with that key: either the head of the pair list or the next field
+of the previous pair.  Keeping the link, rather than the pair,
+allows jx_remove to unlink a pair without searching for it.
+jx_insert and jx_remove keep the index up to date, so objects that
+have an index must not have their pairs modified in any other way.
+*/
+
+#define JX_INDEX_MIN 16
+
+struct jx_index {
+	struct hash_table *table;
+	int duplicates;
+};
+
+static void jx_index_delete(struct jx *j)
+{
+	if (!j->index)
+		return;
+	hash_table_delete(j->index->table);
+	free(j->index);
+	j->index = 0;
+}
+
+static int jx_pair_has_string_key(struct jx_pair *p)
+{
+	return p && p->key && p->key->type == JX_STRING;
+}
+
+static void jx_index_build(struct jx *j)
+{
+	struct jx_pair **link;
+
+	j->index = xxcalloc(1, sizeof(*j->index));
+	j->index->table = hash_table_create_open(0, 0);
+
+	for (link = &j->u.pairs; *link; link = &(*link)->next) {
+		if (jx_pair_has_string_key(*link)) {
+			if (!hash_table_insert(j->index->table, (*link)->key->u.string_value, link)) {
+				j->index->duplicates = 1;
+			}
+		}
+	}
+}
+
+/* Record that the pair p, if indexed, is now pointed to by new_link instead of old_link. */
+
+static void jx_index_relink(struct jx *j, struct jx_pair *p, struct jx_pair **old_link, struct jx_pair **new_link)
+{
+	if (!jx_pair_has_string_key(p))
+		return;
+
+	const char *key = p->key->u.string_value;
+	if (hash_table_lookup(j->index->table, key) == old_link) {
+		hash_table_remove(j->index->table, key);
+		hash_table_insert(j->index->table, key, new_link);
+	}
+}
+
+/* Unlink the pair pointed to by link, delete it, and return its value. */
+
+static struct jx *jx_unlink_pair(struct jx *j, struct jx_pair **link)
+{
+	struct jx_pair *p = *link;
+	int was_first = 0;
+
+	if (j->index && jx_pair_has_string_key(p)) {
+		if (hash_table_lookup(j->index->table, p->key->u.string_value) == link) {
+			hash_table_remove(j->index->table, p->key->u.string_value);
+			was_first = 1;
+		}
+	}
+
+	*link = p->next;
+
+	if (j->index) {
+		jx_index_relink(j, p->next, &p->next, link);
+
+		/* A later pair with the same key is now the first one. */
+		if (was_first && j->index->duplicates) {
+			struct jx_pair **l;
+			for (l = link; *l; l = &(*l)->next) {
+				if (jx_pair_has_string_key(*l) && !strcmp((*l)->key->u.string_value, p->key->u.string_value)) {
+					hash_table_insert(j->index->table, p->key->u.string_value, l);
+					break;
+				}
+			}
+		}
+	}
+
+	struct jx *value = p->value;
+	p->value = 0;
+	p->next = 0;
+	jx_pair_delete(p);
+
+	return value;
+}
+
 struct jx_pair *jx_pair(struct jx *key, struct jx *value, struct jx_pair *next)
 {
 	struct jx_pair *pair = calloc(1, sizeof(*pair));
@@ -186,6 +289,7 @@ struct jx *jx_arrayv(struct jx *value, ...)
 struct jx *jx_lookup_guard(struct jx *j, const char *key, int *found)
 {
 	struct jx_pair *p;
+	int count = 0;
 
 	if (found)
 		*found = 0;
@@ -193,16 +297,32 @@ struct jx *jx_lookup_guard(struct jx *j, const char *key, int *found)
 	if (!j || j->type != JX_OBJECT)
 		return 0;
 
+	if (j->index) {
+		struct jx_pair **link = hash_table_lookup(j->index->table, key);
+		if (link) {
+			if (found)
+				*found = 1;
+			return (*link)->value;
+		}
+		return 0;
+	}
+
 	for (p = j->u.pairs; p; p = p->next) {
 		if (p && p->key && p->key->type == JX_STRING) {
 			if (!strcmp(p->key->u.string_value, key)) {
 				if (found)
 					*found = 1;
+				if (count >= JX_INDEX_MIN)
+					jx_index_build(j);
 				return p->value;
 			}
 		}
+		count++;
 	}
 
+	if (count >= JX_INDEX_MIN)
+		jx_index_build(j);
+
 	return 0;
 }
 
@@ -266,33 +386,46 @@ struct jx *jx_remove(struct jx *object, struct jx *key)
 	if (!object || object->type != JX_OBJECT)
 		return 0;
 
-	struct jx_pair *p;
-	struct jx_pair *last = 0;
-
-	for (p = object->u.pairs; p; p = p->next) {
-		if (jx_equals(key, p->key)) {
-			struct jx *value = p->value;
-			if (last) {
-				last->next = p->next;
-			} else {
-				object->u.pairs = p->next;
-			}
-			p->value = 0;
-			p->next = 0;
-			jx_pair_delete(p);
-			return value;
+	if (object->index && key && key->type == JX_STRING) {
+		struct jx_pair **link = hash_table_lookup(object->index->table, key->u.string_value);
+		return link ? jx_unlink_pair(object, link) : 0;
+	}
+
+	struct jx_pair **link;
+	struct jx *value = 0;
+	int count = 0;
+
+	for (link = &object->u.pairs; *link; link = &(*link)->next) {
+		if (jx_equals(key, (*link)->key)) {
+			value = jx_unlink_pair(object, link);
+			break;
 		}
-		last = p;
+		count++;
 	}
 
-	return 0;
+	if (!object->index && count >= JX_INDEX_MIN && key && key->type == JX_STRING)
+		jx_index_build(object);
+
+	return value;
 }
 
 int jx_insert(struct jx *j, struct jx *key, struct jx *value)
 {
 	if (!j || j->type != JX_OBJECT)
 		return 0;
-	j->u.pairs = jx_pair(key, value, j->u.pairs);
+
+	struct jx_pair *p = jx_pair(key, value, j->u.pairs);
+	j->u.pairs = p;
+
+	if (j->index) {
+		jx_index_relink(j, p->next, &j->u.pairs, &p->next);
+		if (jx_pair_has_string_key(p)) {
+			if (hash_table_remove(j->index->table, key->u.string_value))
+				j->index->duplicates = 1;
+			hash_table_insert(j->index->table, key->u.string_value, &j->u.pairs);
+		}
+	}
+
 	return 1;
 }
 
@@ -462,6 +595,7 @@ void jx_delete(struct jx *j)
 		jx_item_delete(j->u.items);
 		break;
 	case JX_OBJECT:
+		jx_index_delete(j);
 		jx_pair_delete(j->u.pairs);
 		break;
 	case JX_OPERATOR:
@@ -128,6 +128,7 @@ struct jx {
 		struct jx_operator oper; /**< value of @ref JX_OPERATOR */
 		struct jx *err;  /**< error value of @ref JX_ERROR */
 	} u;
+	struct jx_index *index;     /**< index of the pairs of a large @ref JX_OBJECT by key, built on demand */
 };
 
 /** Create a JX null value. @return A JX expression. */
@@ -0,0 +1,117 @@
+/*
+Copyright (C) 2024 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Check that lookups in large objects, which are answered by an index,
+agree with a linear search of the pairs, as keys are inserted
+(including duplicates) and removed in random order.
+*/
+
+#include "jx.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NKEYS 200
+#define NOPS 100000
+
+static struct jx *linear_lookup(struct jx *j, const char *key)
+{
+	struct jx_pair *p;
+	for (p = j->u.pairs; p; p = p->next) {
+		if (!strcmp(p->key->u.string_value, key))
+			return p->value;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct jx *j = jx_object(0);
+	char key[32];
+	int i;
+
+	srandom(42);
+
+	for (i = 0; i < NOPS; i++) {
+		sprintf(key, "key%ld", random() % NKEYS);
+		struct jx *expected = linear_lookup(j, key);
+
+		switch (random() % 3) {
+		case 0:
+			jx_insert_integer(j, key, i);
+			break;
+		case 1: {
+			struct jx *k = jx_string(key);
+			struct jx *removed = jx_remove(j, k);
+			jx_delete(k);
+			if (removed != expected) {
+				printf("removal of %s returned the wrong value\n", key);
+				return 1;
+			}
+			jx_delete(removed);
+			break;
+		}
+		default: {
+			int found;
+			struct jx *value = jx_lookup_guard(j, key, &found);
+			if (value != expected || found != (expected != 0)) {
+				printf("lookup of %s returned the wrong value\n", key);
+				return 1;
+			}
+			break;
+		}
+		}
+	}
+
+	for (i = 0; i < NKEYS; i++) {
+		sprintf(key, "key%d", i);
+		if (jx_lookup(j, key) != linear_lookup(j, key)) {
+			printf("final lookup of %s returned the wrong value\n", key);
+			return 1;
+		}
+	}
+
+	/* Collapse duplicate keys, which jx_merge resolves in favor of the oldest. */
+	for (i = 0; i < NKEYS; i++) {
+		sprintf(key, "key%d", i);
+		struct jx *value = linear_lookup(j, key);
+		if (!value)
+			continue;
+		value = jx_copy(value);
+
+		struct jx *k = jx_string(key);
+		struct jx *removed;
+		while ((removed = jx_remove(j, k)))
+			jx_delete(removed);
+		jx_delete(k);
+
+		if (jx_lookup(j, key) || linear_lookup(j, key)) {
+			printf("removal of all copies of %s failed\n", key);
+			return 1;
+		}
+		jx_insert(j, jx_string(key), value);
+	}
+
+	struct jx *c = jx_merge(j, j, NULL);
+	for (i = 0; i < NKEYS; i++) {
+		sprintf(key, "key%d", i);
+		if (!jx_equals(jx_lookup(c, key), linear_lookup(j, key))) {
+			printf("merged lookup of %s returned the wrong value\n", key);
+			return 1;
+		}
+	}
+
+	jx_delete(c);
+	jx_delete(j);
+
+	printf("jx index passed\n");
+
+	return 0;
+}
+
+/* vim: set noexpandtab tabstop=8: */
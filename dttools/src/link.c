@@ -11,7 +11,9 @@ See the file COPYING for details.
 #include "debug.h"
 #include "domain_name.h"
 #include "full_io.h"
+#include "itable.h"
 #include "macros.h"
+#include "set.h"
 #include "stringtools.h"
 
 #include <arpa/inet.h>
@@ -26,6 +28,11 @@ See the file COPYING for details.
 #include <sys/un.h>
 #include <sys/utsname.h>
 
+#ifdef CCTOOLS_OPSYS_LINUX
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#endif
+
 #include <fcntl.h>
 #include <netdb.h>
 #include <unistd.h>
@@ -73,12 +80,28 @@ struct link {
 	char raddr[LINK_ADDRESS_MAX];
 	int rport;
 
+	struct link_poller *poller;
+
 #ifdef HAS_OPENSSL
 	SSL_CTX *ctx;
 	SSL *ssl;
 #endif
 };
 
+struct link_poller {
+	int epoll_fd;             /* epoll descriptor, or -1 if falling back to poll. */
+	struct itable *links;     /* Maps link -> struct link_info of each registered link. */
+	struct set *buffered;     /* Registered links that may hold data in their read buffer. */
+	struct pollfd *fds;       /* Fallback only: poll array, rebuilt only when registrations change. */
+	struct link_info **infos; /* Fallback only: the link_info matching each entry of fds. */
+	int fds_size;
+	int fds_dirty;
+#ifdef CCTOOLS_OPSYS_LINUX
+	struct epoll_event *events; /* Array filled by epoll_wait, kept across calls. */
+	int events_size;
+#endif
+};
+
 static int link_send_window = 65536;
 static int link_recv_window = 65536;
 static int link_override_window = 0;
@@ -248,6 +271,10 @@ int link_sleep(struct link *link, time_t stoptime, int reading, int writing)
 {
 	struct timeval tm, *tptr;
 
+	/* A reply will not arrive while the request is still in the output buffer. */
+	if (reading && link_flush_output(link) < 0)
+		return 0;
+
 	if (stoptime == LINK_FOREVER) {
 		tptr = 0;
 	} else {
@@ -310,6 +337,7 @@ static struct link *link_create()
 	link->raddr[0] = 0;
 	link->rport = 0;
 	link->type = LINK_TYPE_STANDARD;
+	link->poller = 0;
 
 #ifdef HAS_OPENSSL
 	link->ctx = 0;
@@ -833,6 +861,10 @@ static ssize_t fill_buffer(struct link *link, time_t stoptime)
 			link->read += chunk;
 			link->buffer_start = link->buffer;
 			link->buffer_length = chunk;
+			/* The kernel may have no more data for this link, so tell the poller to look at the buffer. */
+			if (link->poller) {
+				set_insert(link->poller->buffered, link);
+			}
 			return chunk;
 		} else if (chunk == 0) {
 			link->buffer_start = link->buffer;
@@ -996,14 +1028,11 @@ int link_readline(struct link *link, char *line, size_t length, time_t stoptime)
 	return 0;
 }
 
-ssize_t link_write(struct link *link, const char *data, size_t count, time_t stoptime)
+static ssize_t write_direct(struct link *link, const char *data, size_t count, time_t stoptime)
 {
 	ssize_t total = 0;
 	ssize_t chunk = 0;
 
-	if (!link)
-		return errno = EINVAL, -1;
-
 	while (count > 0) {
 		chunk = write_aux(link, data, count);
 		if (chunk < 0) {
@@ -1037,16 +1066,13 @@ ssize_t link_write(struct link *link, const char *data, size_t count, time_t sto
 	}
 }
 
-ssize_t link_putlstring(struct link *link, const char *data, size_t count, time_t stoptime)
+static ssize_t putlstring_direct(struct link *link, const char *data, size_t count, time_t stoptime)
 {
 	ssize_t total = 0;
 
-	if (!link)
-		return errno = EINVAL, -1;
-
 	/* Loop because, unlike link_write, we do not allow partial writes. */
 	while (count > 0) {
-		ssize_t w = link_write(link, data, count, stoptime);
+		ssize_t w = write_direct(link, data, count, stoptime);
 		if (w == -1)
 			return -1;
 		count -= w;
@@ -1057,6 +1083,43 @@ ssize_t link_putlstring(struct link *link, const char *data, size_t count, time_
 	return total;
 }
 
+/*
+Output buffered by link_printf or link_putlstring must go out
+before anything written directly, so that messages stay in order.
+*/
+
+ssize_t link_write(struct link *link, const char *data, size_t count, time_t stoptime)
+{
+	if (!link)
+		return errno = EINVAL, -1;
+
+	if (link_flush_output(link) < 0)
+		return -1;
+
+	return write_direct(link, data, count, stoptime);
+}
+
+ssize_t link_putlstring(struct link *link, const char *data, size_t count, time_t stoptime)
+{
+	if (!link)
+		return errno = EINVAL, -1;
+
+	if (link->output_buffer_size > 0) {
+		if (buffer_putlstring(&link->output_buffer, data, count) < 0)
+			return -1;
+		if (buffer_pos(&link->output_buffer) > link->output_buffer_size) {
+			if (link_flush_output(link) < 0)
+				return -1;
+		}
+		return count;
+	}
+
+	if (link_flush_output(link) < 0)
+		return -1;
+
+	return putlstring_direct(link, data, count, stoptime);
+}
+
 int link_buffer_output(struct link *link, size_t size)
 {
 	link->output_buffer_size = size;
@@ -1074,7 +1137,7 @@ int link_flush_output(struct link *link)
 
 	size_t len;
 	const char *str = buffer_tolstring(&link->output_buffer, &len);
-	int rc = link_putlstring(link, str, len, time(0) + 60);
+	int rc = putlstring_direct(link, str, len, time(0) + 60);
 	buffer_free(&link->output_buffer);
 	buffer_init(&link->output_buffer);
 	return rc;
@@ -1107,6 +1170,10 @@ ssize_t link_printf(struct link *link, time_t stoptime, const char *fmt, ...)
 void link_close(struct link *link)
 {
 	if (link) {
+		if (link->poller) {
+			link_poller_remove(link->poller, link);
+		}
+
 		link_flush_output(link);
 		buffer_free(&link->output_buffer);
 
@@ -1137,6 +1204,9 @@ void link_close(struct link *link)
 void link_detach(struct link *link)
 {
 	if (link) {
+		if (link->poller) {
+			link_poller_remove(link->poller, link);
+		}
 		free(link);
 	}
 }
@@ -1236,10 +1306,166 @@ ssize_t link_stream_to_buffer(struct link *link, char **buffer, time_t stoptime)
 	return total;
 }
 
+/*
+Zero-copy transfers between a link and a file descriptor.
+They apply only to plain TCP links: SSL requires the data to pass through
+user space, and data already buffered by the link must go out in order.
+Each returns the bytes moved, or -1 on error. If the kernel refuses the
+operation for these descriptors before any data is moved, *fallback is set,
+and the caller continues with the buffered loop.
+*/
+
+#ifdef CCTOOLS_OPSYS_LINUX
+
+static int link_zero_copy_ok(struct link *link)
+{
+#ifdef HAS_OPENSSL
+	if (link->ssl)
+		return 0;
+#endif
+	return link->type == LINK_TYPE_STANDARD;
+}
+
+static int errno_is_unsupported(int e)
+{
+	return e == EINVAL || e == ENOSYS || e == EOPNOTSUPP || e == EBADF || e == ESPIPE;
+}
+
+static int64_t link_splice_to_fd(struct link *link, int fd, int64_t length, time_t stoptime, int *fallback)
+{
+	int64_t total = 0;
+	int pipefd[2];
+
+	if (pipe(pipefd) < 0) {
+		*fallback = 1;
+		return 0;
+	}
+
+	/* A larger pipe means fewer round trips through the kernel; the default works too. */
+	fcntl(pipefd[1], F_SETPIPE_SZ, 1 << 20);
+
+	while (length > 0) {
+		ssize_t ractual = splice(link->fd, NULL, pipefd[1], NULL, MIN(length, 1 << 20), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (ractual < 0) {
+			if (errno_is_temporary(errno)) {
+				if (link_sleep(link, stoptime, 1, 0)) {
+					continue;
+				}
+			} else if (total == 0 && errno_is_unsupported(errno)) {
+				*fallback = 1;
+			}
+			break;
+		} else if (ractual == 0) {
+			break;
+		}
+
+		link->read += ractual;
+
+		/* Drain the pipe into the file. */
+		ssize_t pending = ractual;
+		while (pending > 0) {
+			ssize_t wactual = splice(pipefd[0], NULL, fd, NULL, pending, SPLICE_F_MOVE);
+			if (wactual < 0 && errno == EINTR) {
+				continue;
+			} else if (wactual < 0 && errno_is_unsupported(errno)) {
+				/* The file does not accept splice: copy out what is in the pipe, and let the caller continue. */
+				char buffer[1 << 16];
+				while (pending > 0) {
+					ssize_t chunk = read(pipefd[0], buffer, MIN(pending, (ssize_t)sizeof(buffer)));
+					if (chunk <= 0 || full_write(fd, buffer, chunk) != chunk) {
+						break;
+					}
+					pending -= chunk;
+				}
+				*fallback = 1;
+				break;
+			} else if (wactual <= 0) {
+				break;
+			}
+			pending -= wactual;
+		}
+
+		if (pending > 0) {
+			total = -1;
+			break;
+		}
+
+		total += ractual;
+		length -= ractual;
+
+		if (*fallback)
+			break;
+	}
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+
+	return total;
+}
+
+static int64_t link_sendfile_from_fd(struct link *link, int fd, int64_t length, time_t stoptime, int *fallback)
+{
+	int64_t total = 0;
+
+	while (length > 0) {
+		ssize_t wactual = sendfile(link->fd, fd, NULL, MIN(length, 1 << 30));
+		if (wactual < 0) {
+			if (errno_is_temporary(errno)) {
+				if (link_sleep(link, stoptime, 0, 1)) {
+					continue;
+				}
+				total = -1;
+			} else if (total == 0 && errno_is_unsupported(errno)) {
+				*fallback = 1;
+			} else {
+				total = -1;
+			}
+			break;
+		} else if (wactual == 0) {
+			break;
+		}
+
+		link->written += wactual;
+		total += wactual;
+		length -= wactual;
+	}
+
+	return total;
+}
+
+#endif
+
 int64_t link_stream_to_fd(struct link *link, int fd, int64_t length, time_t stoptime)
 {
 	int64_t total = 0;
 
+#ifdef CCTOOLS_OPSYS_LINUX
+	if (link_zero_copy_ok(link)) {
+		/* Data already buffered by the link must be written out first. */
+		while (length > 0 && link->buffer_length > 0) {
+			size_t chunk = MIN(link->buffer_length, (size_t)length);
+			ssize_t wactual = full_write(fd, link->buffer_start, chunk);
+			if (wactual != (ssize_t)chunk)
+				return -1;
+			link->buffer_start += chunk;
+			link->buffer_length -= chunk;
+			total += chunk;
+			length -= chunk;
+		}
+
+		int fallback = 0;
+		int64_t moved = link_splice_to_fd(link, fd, length, stoptime, &fallback);
+		if (moved < 0)
+			return -1;
+
+		total += moved;
+		length -= moved;
+
+		if (!fallback)
+			return total;
+	}
+#endif
+
 	while (length > 0) {
 		char buffer[1 << 16];
 		size_t chunk = MIN(sizeof(buffer), (size_t)length);
@@ -1290,6 +1516,15 @@ int64_t link_stream_from_fd(struct link *link, int fd, int64_t length, time_t st
 {
 	int64_t total = 0;
 
+#ifdef CCTOOLS_OPSYS_LINUX
+	if (link_zero_copy_ok(link) && buffer_pos(&link->output_buffer) == 0) {
+		int fallback = 0;
+		total = link_sendfile_from_fd(link, fd, length, stoptime, &fallback);
+		if (!fallback)
+			return total;
+	}
+#endif
+
 	while (length > 0) {
 		char buffer[1 << 16];
 		size_t chunk = MIN(sizeof(buffer), (size_t)length);
@@ -1437,6 +1672,281 @@ int link_poll(struct link_info *links, int nlinks, int msec)
 	return result;
 }
 
+struct link_poller *link_poller_create()
+{
+	struct link_poller *p = malloc(sizeof(*p));
+	if (!p)
+		return 0;
+
+	memset(p, 0, sizeof(*p));
+	p->epoll_fd = -1;
+
+#ifdef CCTOOLS_OPSYS_LINUX
+	p->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (p->epoll_fd < 0) {
+		debug(D_TCP, "epoll unavailable (%s), falling back to poll", strerror(errno));
+	}
+#endif
+
+	p->links = itable_create(0);
+	p->buffered = set_create(0);
+	p->fds_dirty = 1;
+
+	return p;
+}
+
+void link_poller_delete(struct link_poller *p)
+{
+	if (!p)
+		return;
+
+	uint64_t key;
+	struct link_info *info;
+	ITABLE_ITERATE(p->links, key, info)
+	{
+		info->link->poller = 0;
+		free(info);
+	}
+
+	itable_delete(p->links);
+	set_delete(p->buffered);
+
+	if (p->epoll_fd >= 0)
+		close(p->epoll_fd);
+
+	free(p->fds);
+	free(p->infos);
+#ifdef CCTOOLS_OPSYS_LINUX
+	free(p->events);
+#endif
+	free(p);
+}
+
+#ifdef CCTOOLS_OPSYS_LINUX
+static uint32_t link_to_epoll(int events)
+{
+	uint32_t r = 0;
+	if (events & LINK_READ)
+		r |= EPOLLIN | EPOLLRDHUP;
+	if (events & LINK_WRITE)
+		r |= EPOLLOUT;
+	if (events & LINK_EDGE)
+		r |= EPOLLET;
+	return r;
+}
+
+static int epoll_to_link(uint32_t events)
+{
+	int r = 0;
+	if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+		r |= LINK_READ;
+	if (events & EPOLLOUT)
+		r |= LINK_WRITE;
+	return r;
+}
+#endif
+
+int link_poller_add(struct link_poller *p, struct link *link, int events)
+{
+	if (link->poller && link->poller != p) {
+		errno = EBUSY;
+		return 0;
+	}
+
+	struct link_info *info = itable_lookup(p->links, (uintptr_t)link);
+	int op_existing = info ? 1 : 0;
+
+	if (!info) {
+		info = malloc(sizeof(*info));
+		if (!info)
+			return 0;
+		info->link = link;
+	}
+
+	info->events = events;
+	info->revents = 0;
+
+#ifdef CCTOOLS_OPSYS_LINUX
+	if (p->epoll_fd >= 0) {
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = link_to_epoll(events);
+		ev.data.ptr = info;
+
+		if (epoll_ctl(p->epoll_fd, op_existing ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, link->fd, &ev) < 0) {
+			debug(D_TCP, "couldn't register fd %d for polling: %s", link->fd, strerror(errno));
+			if (!op_existing)
+				free(info);
+			return 0;
+		}
+	}
+#endif
+
+	if (!op_existing) {
+		itable_insert(p->links, (uintptr_t)link, info);
+		link->poller = p;
+	}
+
+	/* Data read before registration is still waiting in the buffer. */
+	if (link->buffer_length > 0) {
+		set_insert(p->buffered, link);
+	}
+
+	p->fds_dirty = 1;
+
+	return 1;
+}
+
+void link_poller_remove(struct link_poller *p, struct link *link)
+{
+	struct link_info *info = itable_remove(p->links, (uintptr_t)link);
+	if (!info)
+		return;
+
+#ifdef CCTOOLS_OPSYS_LINUX
+	if (p->epoll_fd >= 0 && link->fd >= 0) {
+		epoll_ctl(p->epoll_fd, EPOLL_CTL_DEL, link->fd, 0);
+	}
+#endif
+
+	set_remove(p->buffered, link);
+	link->poller = 0;
+	p->fds_dirty = 1;
+
+	free(info);
+}
+
+int link_poller_size(struct link_poller *p)
+{
+	return itable_size(p->links);
+}
+
+/* Fallback for systems without epoll: keep a persistent poll array, rebuilt only when registrations change. */
+
+static int link_poller_wait_poll(struct link_poller *p, struct link_info *ready, int nready, int msec)
+{
+	int nlinks = itable_size(p->links);
+
+	if (p->fds_dirty) {
+		if (nlinks > p->fds_size) {
+			p->fds_size = MAX(nlinks, 2 * p->fds_size);
+			p->fds = realloc(p->fds, p->fds_size * sizeof(*p->fds));
+			p->infos = realloc(p->infos, p->fds_size * sizeof(*p->infos));
+		}
+
+		int i = 0;
+		uint64_t key;
+		struct link_info *info;
+		ITABLE_ITERATE(p->links, key, info)
+		{
+			p->fds[i].fd = info->link->fd;
+			p->fds[i].events = link_to_poll(info->events);
+			p->infos[i] = info;
+			i++;
+		}
+		p->fds_dirty = 0;
+	}
+
+	int result = poll(p->fds, nlinks, msec);
+	if (result <= 0)
+		return result;
+
+	int i, n = 0;
+	for (i = 0; i < nlinks && n < nready; i++) {
+		if (p->fds[i].revents) {
+			ready[n].link = p->infos[i]->link;
+			ready[n].events = p->infos[i]->events;
+			ready[n].revents = poll_to_link(p->fds[i].revents);
+			n++;
+		}
+	}
+
+	return n;
+}
+
+int link_poller_wait(struct link_poller *p, struct link_info *ready, int nready, int msec)
+{
+	int n = 0;
+	int nbuffered = 0;
+
+	/* Links with data already waiting in their buffers are ready right away. */
+	if (set_size(p->buffered) > 0) {
+		int count = set_size(p->buffered);
+		struct link **links = (struct link **)set_values(p->buffered);
+		int i;
+		for (i = 0; i < count; i++) {
+			struct link *link = links[i];
+			if (link->buffer_length > 0 && n < nready) {
+				struct link_info *info = itable_lookup(p->links, (uintptr_t)link);
+				ready[n].link = link;
+				ready[n].events = info->events;
+				ready[n].revents = LINK_READ;
+				n++;
+			} else if (link->buffer_length == 0) {
+				set_remove(p->buffered, link);
+			}
+		}
+		free(links);
+		nbuffered = n;
+	}
+
+	if (n > 0) {
+		msec = 0;
+	}
+
+	if (n >= nready) {
+		return n;
+	}
+
+	int result;
+	struct link_info *events = ready + n;
+	int nevents = nready - n;
+
+#ifdef CCTOOLS_OPSYS_LINUX
+	if (p->epoll_fd >= 0) {
+		if (nevents > p->events_size) {
+			p->events_size = nevents;
+			p->events = realloc(p->events, p->events_size * sizeof(*p->events));
+		}
+
+		result = epoll_wait(p->epoll_fd, p->events, nevents, msec);
+
+		int i;
+		for (i = 0; i < result; i++) {
+			struct link_info *info = p->events[i].data.ptr;
+			events[i].link = info->link;
+			events[i].events = info->events;
+			events[i].revents = epoll_to_link(p->events[i].events);
+		}
+	} else {
+		result = link_poller_wait_poll(p, events, nevents, msec);
+	}
+#else
+	result = link_poller_wait_poll(p, events, nevents, msec);
+#endif
+
+	if (result < 0) {
+		return nbuffered > 0 ? nbuffered : result;
+	}
+
+	/* Merge links reported twice, once for buffered data and once by the kernel. */
+	int i, j;
+	for (i = 0; i < result; i++) {
+		struct link_info *e = &events[i];
+		for (j = 0; j < nbuffered; j++) {
+			if (ready[j].link == e->link) {
+				ready[j].revents |= e->revents;
+				break;
+			}
+		}
+		if (j == nbuffered) {
+			ready[n++] = *e;
+		}
+	}
+
+	return n;
+}
+
 int link_get_buffer_bytes(struct link *link)
 {
 	int bytes;
@@ -1444,4 +1954,14 @@ int link_get_buffer_bytes(struct link *link)
 	return bytes;
 }
 
+uint64_t link_bytes_read(struct link *link)
+{
+	return link->read;
+}
+
+uint64_t link_bytes_written(struct link *link)
+{
+	return link->written;
+}
+
 /* vim: set noexpandtab tabstop=8: */
@@ -300,7 +300,10 @@ int link_readline(struct link *link, char *line, size_t length, time_t stoptime)
 */
 int link_fd(struct link *link);
 
-/** Enable output buffering for link_printf.
+/** Enable output buffering for link_printf and link_putlstring.
+Output is sent once more than size bytes are pending, or when it is flushed.
+Pending output is always sent before data written with @ref link_write,
+and before waiting for data to read from the link.
 @param link The link to modify.
 @param size The number of bytes to buffer.  Zero disables buffering and flushes pending output.
 */
@@ -374,6 +377,9 @@ int link_tune(struct link *link, link_tune_t mode);
 /** Indicates a link is ready to write via @ref link_poll.*/
 #define LINK_WRITE 2
 
+/** Requests edge-triggered notification from @ref link_poller_add, where supported. */
+#define LINK_EDGE 4
+
 /** Activity structure passed to @ref link_poll. */
 struct link_info {
 	struct link *link;  /**< The link to be polled. */
@@ -391,12 +397,74 @@ Wait for a activity on a an array of links.
 
 int link_poll(struct link_info *array, int nlinks, int msec);
 
+/*
+A link poller keeps a set of links registered across calls, so that
+waiting for activity costs in proportion to the links that are ready,
+rather than to all the links of interest. It uses epoll where available
+and falls back to a persistent poll array elsewhere.
+Data already read into the buffer of a link is reported as @ref LINK_READ,
+just like @ref link_poll. A link belongs to at most one poller, and it is
+removed from it automatically by @ref link_close and @ref link_detach.
+*/
+
+/** Create a new link poller.
+@return A pointer to a new poller, or null on failure.
+*/
+struct link_poller *link_poller_create();
+
+/** Delete a link poller. Registered links are not closed.
+@param p The poller to delete.
+*/
+void link_poller_delete(struct link_poller *p);
+
+/** Register a link with a poller, or change the events of a link already registered.
+@param p The poller.
+@param link The link to watch.
+@param events The events of interest: @ref LINK_READ or @ref LINK_WRITE, optionally with @ref LINK_EDGE.
+With @ref LINK_EDGE the caller must consume all available data once a link is reported ready.
+@return True on success, false on failure with errno set appropriately.
+*/
+int link_poller_add(struct link_poller *p, struct link *link, int events);
+
+/** Stop watching a link. Does nothing if the link is not registered.
+@param p The poller.
+@param link The link to remove.
+*/
+void link_poller_remove(struct link_poller *p, struct link *link);
+
+/** Return the number of links registered with a poller.
+@param p The poller.
+@return The number of registered links.
+*/
+int link_poller_size(struct link_poller *p);
+
+/** Wait for activity on the links registered with a poller.
+@param p The poller.
+@param ready Array filled with one @ref link_info for each link that is ready, with revents set.
+@param nready The length of the ready array.
+@param msec The number of milliseconds to wait for activity.  Zero indicates do not wait at all, while -1 indicates wait forever.
+@return The number of entries filled in ready, or -1 on error.
+*/
+int link_poller_wait(struct link_poller *p, struct link_info *ready, int nready, int msec);
+
 /** Get the number of bytes in the output buffer of a link.
 @param link The link to examine.
 @return The number of bytes in the output buffer of a link.
 */
 int link_get_buffer_bytes(struct link *link);
 
+/** Get the total number of bytes read from a link since it was created.
+@param link The link to examine.
+@return The number of bytes read.
+*/
+uint64_t link_bytes_read(struct link *link);
+
+/** Get the total number of bytes written to a link since it was created.
+@param link The link to examine.
+@return The number of bytes written.
+*/
+uint64_t link_bytes_written(struct link *link);
+
 
 int errno_is_temporary(int e);
 
@@ -0,0 +1,187 @@
+/*
+Copyright (C) 2022 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Measure the throughput of link_stream_from_fd and link_stream_to_fd
+over a local TCP connection, against the plain read/write loop that
+copies every byte through a user space buffer.
+*/
+
+#include "full_io.h"
+#include "link.h"
+#include "macros.h"
+#include "timestamp.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BUFFER_SIZE (1 << 16)
+
+static void show_help(const char *cmd)
+{
+	printf("Use: %s <megabytes> <runs>\n", cmd);
+}
+
+static int64_t copy_from_fd(struct link *link, int fd, int64_t length, time_t stoptime)
+{
+	char buffer[BUFFER_SIZE];
+	int64_t total = 0;
+
+	while (length > 0) {
+		ssize_t ractual = full_read(fd, buffer, MIN(BUFFER_SIZE, length));
+		if (ractual <= 0)
+			break;
+		if (link_write(link, buffer, ractual, stoptime) != ractual)
+			return -1;
+		total += ractual;
+		length -= ractual;
+	}
+
+	return total;
+}
+
+static int64_t copy_to_fd(struct link *link, int fd, int64_t length, time_t stoptime)
+{
+	char buffer[BUFFER_SIZE];
+	int64_t total = 0;
+
+	while (length > 0) {
+		ssize_t ractual = link_read(link, buffer, MIN(BUFFER_SIZE, length), stoptime);
+		if (ractual <= 0)
+			break;
+		if (full_write(fd, buffer, ractual) != ractual)
+			return -1;
+		total += ractual;
+		length -= ractual;
+	}
+
+	return total;
+}
+
+static void make_source_file(const char *path, int64_t length)
+{
+	char buffer[BUFFER_SIZE];
+	memset(buffer, 'x', sizeof(buffer));
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		printf("could not create %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	while (length > 0) {
+		ssize_t chunk = MIN(BUFFER_SIZE, length);
+		if (full_write(fd, buffer, chunk) != chunk) {
+			printf("could not write %s: %s\n", path, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		length -= chunk;
+	}
+
+	close(fd);
+}
+
+/* Send length bytes of path to a child process that stores them into sink, and return the elapsed seconds. */
+
+static double run_once(const char *path, const char *sink, int64_t length, int zero_copy)
+{
+	struct link *server = link_serve(0);
+	if (!server) {
+		printf("could not listen: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	char addr[LINK_ADDRESS_MAX];
+	int port;
+	link_address_local(server, addr, &port);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		printf("could not fork: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	} else if (pid == 0) {
+		link_close(server);
+		struct link *l = link_connect("127.0.0.1", port, time(0) + 60);
+		int fd = open(sink, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (!l || fd < 0)
+			_exit(1);
+		int64_t received = zero_copy ? link_stream_to_fd(l, fd, length, time(0) + 600) : copy_to_fd(l, fd, length, time(0) + 600);
+		link_putliteral(l, "ok\n", time(0) + 60);
+		link_close(l);
+		close(fd);
+		_exit(received == length ? 0 : 1);
+	}
+
+	struct link *l = link_accept(server, time(0) + 60);
+	int fd = open(path, O_RDONLY);
+	if (!l || fd < 0) {
+		printf("could not set up transfer: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	timestamp_t start = timestamp_get();
+	int64_t sent = zero_copy ? link_stream_from_fd(l, fd, length, time(0) + 600) : copy_from_fd(l, fd, length, time(0) + 600);
+
+	char line[16];
+	link_readline(l, line, sizeof(line), time(0) + 600);
+	timestamp_t stop = timestamp_get();
+
+	int status;
+	waitpid(pid, &status, 0);
+
+	close(fd);
+	link_close(l);
+	link_close(server);
+
+	if (sent != length || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		printf("transfer failed: sent %lld of %lld bytes\n", (long long)sent, (long long)length);
+		exit(EXIT_FAILURE);
+	}
+
+	return (stop - start) / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		show_help(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int64_t length = atoll(argv[1]) * 1024 * 1024;
+	int runs = atoi(argv[2]);
+
+	char path[] = "link_stream_bench.src.XXXXXX";
+	char sink[] = "link_stream_bench.dst.XXXXXX";
+	close(mkstemp(path));
+	close(mkstemp(sink));
+
+	make_source_file(path, length);
+
+	int zero_copy;
+	for (zero_copy = 0; zero_copy <= 1; zero_copy++) {
+		double elapsed = 0;
+		int i;
+		for (i = 0; i < runs; i++) {
+			elapsed += run_once(path, sink, length, zero_copy);
+		}
+		printf("%-10s %8.3f s/run %10.2f MB/s\n", zero_copy ? "zero-copy" : "buffered", elapsed / runs, (length * runs / (1024.0 * 1024.0)) / elapsed);
+	}
+
+	unlink(path);
+	unlink(sink);
+
+	return EXIT_SUCCESS;
+}
+
+/* vim: set noexpandtab tabstop=8: */
@@ -398,6 +398,8 @@ int md5_file(const char *filename, unsigned char digest[MD5_DIGEST_LENGTH])
 		}
 		free(buffer);
 		close(fd);
+		if (n < 0)
+			return 0;
 	} else {
 		close(fd);
 		posix_madvise(data, buf.st_size, POSIX_MADV_SEQUENTIAL);
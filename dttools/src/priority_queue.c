@@ -5,7 +5,9 @@ See the file COPYING for details.
 */
 
 #include "priority_queue.h"
+#include "itable.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +21,7 @@ See the file COPYING for details.
 struct element {
 	void *data;
 	double priority; // In this implementation, elements with bigger priorities are considered to be privileged.
+	int idx;         // Current position of the element in the heap.
 };
 
 struct priority_queue {
@@ -32,6 +35,9 @@ struct priority_queue {
 	int base_cursor;   // Used in PRIORITY_QUEUE_BASE_ITERATE. It iterates from the first position and never be reset automatically.
 	int static_cursor; // Used in PRIORITY_QUEUE_STATIC_ITERATE. It iterates from the last position and never be reset automatically.
 	int rotate_cursor; // Used in PRIORITY_QUEUE_ROTATE_ITERATE. It iterates from the last position and can be reset when certain events happen.
+
+	/* If not null, maps each data pointer to its element, so that elements can be found without a scan. */
+	struct itable *index;
 };
 
 /****** Static Methods ******/
@@ -41,6 +47,26 @@ static void swap_elements(struct priority_queue *pq, int i, int j)
 	struct element *temp = pq->elements[i];
 	pq->elements[i] = pq->elements[j];
 	pq->elements[j] = temp;
+	pq->elements[i]->idx = i;
+	pq->elements[j]->idx = j;
+}
+
+/* Return the index of the element holding data, or -1 if not present. */
+
+static int find_element(struct priority_queue *pq, void *data)
+{
+	if (pq->index) {
+		struct element *e = itable_lookup(pq->index, (uintptr_t)data);
+		return e ? e->idx : -1;
+	}
+
+	for (int i = 0; i < pq->size; i++) {
+		if (pq->elements[i]->data == data) {
+			return i;
+		}
+	}
+
+	return -1;
 }
 
 static int swim(struct priority_queue *pq, int k)
@@ -127,6 +153,17 @@ struct priority_queue *priority_queue_create(double init_capacity)
 	pq->base_cursor = 0;
 	pq->rotate_cursor = 0;
 
+	pq->index = NULL;
+
+	return pq;
+}
+
+struct priority_queue *priority_queue_create_indexed(double init_capacity)
+{
+	struct priority_queue *pq = priority_queue_create(init_capacity);
+	if (pq) {
+		pq->index = itable_create(0);
+	}
 	return pq;
 }
 
@@ -156,9 +193,14 @@ int priority_queue_push(struct priority_queue *pq, void *data, double priority)
 	}
 	e->data = data;
 	e->priority = priority;
+	e->idx = pq->size;
 
 	pq->elements[pq->size++] = e;
 
+	if (pq->index) {
+		itable_insert(pq->index, (uintptr_t)data, e);
+	}
+
 	int new_idx = swim(pq, pq->size - 1);
 
 	if (new_idx <= pq->rotate_cursor) {
@@ -178,8 +220,13 @@ void *priority_queue_pop(struct priority_queue *pq)
 	struct element *e = pq->elements[0];
 	void *data = e->data;
 	pq->elements[0] = pq->elements[--pq->size];
+	pq->elements[0]->idx = 0;
 	pq->elements[pq->size] = NULL;
 	sink(pq, 0);
+
+	if (pq->index) {
+		itable_remove(pq->index, (uintptr_t)data);
+	}
 	free(e);
 
 	return data;
@@ -218,14 +265,7 @@ int priority_queue_update_priority(struct priority_queue *pq, void *data, double
 		return 0;
 	}
 
-	int idx = -1;
-	for (int i = 0; i < pq->size; i++) {
-		if (pq->elements[i]->data == data) {
-			idx = i;
-			break;
-		}
-	}
-
+	int idx = find_element(pq, data);
 	if (idx == -1) {
 		return 0;
 	}
@@ -247,16 +287,10 @@ int priority_queue_update_priority(struct priority_queue *pq, void *data, double
 int priority_queue_find_idx(struct priority_queue *pq, void *data)
 {
 	if (!pq) {
-		return 0;
-	}
-
-	for (int i = 0; i < pq->size; i++) {
-		if (pq->elements[i]->data == data) {
-			return i;
-		}
+		return -1;
 	}
 
-	return 0;
+	return find_element(pq, data);
 }
 
 int priority_queue_static_next(struct priority_queue *pq)
@@ -340,7 +374,13 @@ int priority_queue_remove(struct priority_queue *pq, int idx)
 	pq->elements[idx] = pq->elements[pq->size];
 	pq->elements[pq->size] = NULL;
 
-	sink(pq, idx);
+	/* The element moved into the hole may belong either above or below it. */
+	if (idx < pq->size) {
+		pq->elements[idx]->idx = idx;
+		if (swim(pq, idx) == idx) {
+			sink(pq, idx);
+		}
+	}
 
 	if (pq->static_cursor == idx) {
 		pq->static_cursor--;
@@ -351,6 +391,10 @@ int priority_queue_remove(struct priority_queue *pq, int idx)
 	if (pq->rotate_cursor == idx) {
 		pq->rotate_cursor--;
 	}
+
+	if (pq->index) {
+		itable_remove(pq->index, (uintptr_t)e->data);
+	}
 	free(e);
 
 	if (idx <= pq->rotate_cursor) {
@@ -370,6 +414,9 @@ void priority_queue_delete(struct priority_queue *pq)
 	for (int i = 0; i < pq->size; i++) {
 		free(pq->elements[i]);
 	}
+	if (pq->index) {
+		itable_delete(pq->index);
+	}
 	free(pq->elements);
 	free(pq);
 }
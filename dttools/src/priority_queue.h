@@ -96,6 +96,15 @@ Element with a higher priority is at the top of the heap.
 */
 struct priority_queue *priority_queue_create(double init_capacity);
 
+/** Create a new priority queue that can find its elements without a scan.
+Like @ref priority_queue_create, but also keeps an index from each data pointer to its position,
+so that @ref priority_queue_find_idx and @ref priority_queue_update_priority take constant
+and logarithmic time, respectively. A data pointer may be stored in an indexed queue at most once.
+@param init_capacity The initial number of elements in the queue. If zero, a default value will be used.
+@return A pointer to a new priority queue.
+*/
+struct priority_queue *priority_queue_create_indexed(double init_capacity);
+
 /** Count the elements in a priority queue.
 @param pq A pointer to a priority queue.
 @return The number of elements in the queue.
@@ -150,7 +159,7 @@ int priority_queue_update_priority(struct priority_queue *pq, void *data, double
 /** Find the index of an element in a priority queue.
 @param pq A pointer to a priority queue.
 @param data The pointer to the element to find.
-@return The index of the element if found, 0 on failure.
+@return The index of the element if found, -1 on failure.
 */
 int priority_queue_find_idx(struct priority_queue *pq, void *data);
 
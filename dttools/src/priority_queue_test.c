@@ -175,5 +175,55 @@ int main()
 
 	priority_queue_delete(pq);
 
+	// An indexed queue must find and remove arbitrary elements and keep the heap in order.
+	printf("\nChecking an indexed priority queue:\n");
+	struct priority_queue *ipq = priority_queue_create_indexed(0);
+	int values[1000];
+	srand(17);
+	for (int i = 0; i < 1000; i++) {
+		values[i] = rand() % 100;
+		priority_queue_push(ipq, &values[i], values[i]);
+	}
+
+	for (int i = 0; i < 1000; i += 3) {
+		int found = priority_queue_find_idx(ipq, &values[i]);
+		if (found < 0 || priority_queue_peak_at(ipq, found) != &values[i]) {
+			printf("Element %d not found in the indexed queue.\n", i);
+			return EXIT_FAILURE;
+		}
+		priority_queue_remove(ipq, found);
+		if (priority_queue_find_idx(ipq, &values[i]) != -1) {
+			printf("Element %d still found after removal.\n", i);
+			return EXIT_FAILURE;
+		}
+	}
+
+	priority_queue_update_priority(ipq, &values[1], 1000);
+	if (priority_queue_peak_top(ipq) != &values[1]) {
+		printf("Updated element is not at the top of the indexed queue.\n");
+		return EXIT_FAILURE;
+	}
+
+	double last = priority_queue_get_priority(ipq, 0);
+	int count = 0;
+	while (priority_queue_size(ipq) > 0) {
+		double p = priority_queue_get_priority(ipq, 0);
+		if (p > last) {
+			printf("Indexed queue popped priority %.1f after %.1f.\n", p, last);
+			return EXIT_FAILURE;
+		}
+		last = p;
+		priority_queue_pop(ipq);
+		count++;
+	}
+
+	if (count != 666) {
+		printf("Indexed queue held %d elements instead of 666.\n", count);
+		return EXIT_FAILURE;
+	}
+	printf("Indexed queue is consistent.\n");
+
+	priority_queue_delete(ipq);
+
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,337 @@
+/*
+Copyright (C) 2022 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "rmonitor_cgroup.h"
+
+#include "debug.h"
+#include "full_io.h"
+#include "stringtools.h"
+#include "xxmalloc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct rmonitor_cgroup {
+	char *path;         /* cgroup of the process tree. */
+	char *parent;       /* cgroup of the caller when the cgroup was created. */
+	char *leaf;         /* cgroup the caller was moved to, if it had to leave parent. */
+	int io_enabled;     /* whether we enabled the io controller in parent. */
+	int dirfd;
+};
+
+/* Find where the cgroup v2 hierarchy is mounted, either by itself or next to v1 controllers. */
+static char *cgroup2_mount_point(void)
+{
+	char line[PATH_MAX + 256];
+	char mount_point[PATH_MAX];
+	char *result = 0;
+
+	FILE *f = fopen("/proc/self/mountinfo", "r");
+	if (!f)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		/* mountinfo: id parent major:minor root mount_point options ... - fstype source options */
+		char *sep = strstr(line, " - ");
+		if (!sep || !string_prefix_is(sep + 3, "cgroup2 "))
+			continue;
+
+		if (sscanf(line, "%*s %*s %*s %*s %s", mount_point) == 1) {
+			result = xxstrdup(mount_point);
+			break;
+		}
+	}
+
+	fclose(f);
+	return result;
+}
+
+/* Find the cgroup v2 path of the calling process, relative to the mount point. */
+static char *cgroup2_self_path(void)
+{
+	char line[PATH_MAX + 16];
+	char *result = 0;
+
+	FILE *f = fopen("/proc/self/cgroup", "r");
+	if (!f)
+		return 0;
+
+	/* The v2 hierarchy has id 0 and no controllers: 0::/path */
+	while (fgets(line, sizeof(line), f)) {
+		if (string_prefix_is(line, "0::")) {
+			string_chomp(line);
+			result = xxstrdup(line + 3);
+			break;
+		}
+	}
+
+	fclose(f);
+	return result;
+}
+
+static int write_file(const char *path, const char *value)
+{
+	int fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return 0;
+
+	ssize_t n = full_write(fd, value, strlen(value));
+	int saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+
+	return n == (ssize_t)strlen(value);
+}
+
+/* Read the file open at fd into buffer, and close fd. Returns the number of bytes read, or -1 if fd could not be opened. */
+static ssize_t read_fd(int fd, char *buffer, size_t size)
+{
+	if (fd < 0)
+		return -1;
+
+	ssize_t n = full_read(fd, buffer, size - 1);
+	close(fd);
+
+	if (n < 0)
+		return -1;
+
+	buffer[n] = 0;
+	return n;
+}
+
+/* Read the file name of the cgroup into buffer. Returns the number of bytes read, or -1 if the file does not exist. */
+static ssize_t read_file(struct rmonitor_cgroup *cg, const char *name, char *buffer, size_t size)
+{
+	return read_fd(openat(cg->dirfd, name, O_RDONLY), buffer, size);
+}
+
+/* Whether the space separated list of controllers in the file dir/name includes controller. */
+static int has_controller(const char *dir, const char *name, const char *controller)
+{
+	char buffer[256];
+	char *word, *saveptr;
+
+	char *path = string_format("%s/%s", dir, name);
+	ssize_t n = read_fd(open(path, O_RDONLY), buffer, sizeof(buffer));
+	free(path);
+
+	if (n < 0)
+		return 0;
+
+	for (word = strtok_r(buffer, " \n", &saveptr); word; word = strtok_r(NULL, " \n", &saveptr)) {
+		if (!strcmp(word, controller))
+			return 1;
+	}
+
+	return 0;
+}
+
+static int move_pid(const char *dir, pid_t pid)
+{
+	char *procs = string_format("%s/cgroup.procs", dir);
+	char *value = string_format("%d", (int)pid);
+
+	int result = write_file(procs, value);
+	if (!result) {
+		debug(D_RMON, "could not move %d to cgroup %s: %s", (int)pid, dir, strerror(errno));
+	}
+
+	free(procs);
+	free(value);
+
+	return result;
+}
+
+/* Enable the io controller for the children of parent, which io.stat needs. cpu.stat is there without any controller.
+ * Returns 1 if the controller is enabled, and 0 with errno set otherwise. */
+static int enable_io(struct rmonitor_cgroup *cg)
+{
+	if (!has_controller(cg->parent, "cgroup.controllers", "io")) {
+		errno = ENOENT;
+		return 0;
+	}
+
+	if (has_controller(cg->parent, "cgroup.subtree_control", "io"))
+		return 1;
+
+	char *control = string_format("%s/cgroup.subtree_control", cg->parent);
+	int result = write_file(control, "+io");
+	int saved_errno = errno;
+	free(control);
+	errno = saved_errno;
+
+	if (result)
+		cg->io_enabled = 1;
+
+	return result;
+}
+
+struct rmonitor_cgroup *rmonitor_cgroup_create(const char *name)
+{
+	char *mount_point = cgroup2_mount_point();
+	char *self = cgroup2_self_path();
+
+	if (!mount_point || !self) {
+		debug(D_RMON, "cgroups v2 are not available.");
+		free(mount_point);
+		free(self);
+		return 0;
+	}
+
+	struct rmonitor_cgroup *cg = xxcalloc(1, sizeof(*cg));
+	cg->dirfd = -1;
+
+	/* At the root of the hierarchy, self is just "/". */
+	cg->parent = string_format("%s%s", mount_point, strcmp(self, "/") ? self : "");
+	cg->path = string_format("%s/%s", cg->parent, name);
+	free(mount_point);
+	free(self);
+
+	if (mkdir(cg->path, 0755) < 0) {
+		debug(D_RMON, "could not create cgroup %s: %s", cg->path, strerror(errno));
+		free(cg->path);
+		free(cg->parent);
+		free(cg);
+		return 0;
+	}
+
+	/* Outside the root, a cgroup with processes in it cannot enable controllers for its children. We are one of those
+	 * processes, so we move to a leaf of our own and try again. This still fails if parent has other processes. */
+	if (!enable_io(cg) && errno == EBUSY) {
+		cg->leaf = string_format("%s.monitor", cg->path);
+		if (mkdir(cg->leaf, 0755) == 0 && move_pid(cg->leaf, getpid())) {
+			enable_io(cg);
+		}
+
+		if (!cg->io_enabled) {
+			move_pid(cg->parent, getpid());
+			rmdir(cg->leaf);
+			free(cg->leaf);
+			cg->leaf = 0;
+		}
+	}
+
+	if (!cg->io_enabled && !has_controller(cg->parent, "cgroup.subtree_control", "io")) {
+		debug(D_RMON, "io controller not available in %s, io is measured from /proc.", cg->parent);
+	}
+
+	cg->dirfd = open(cg->path, O_RDONLY | O_DIRECTORY);
+	if (cg->dirfd < 0) {
+		debug(D_RMON, "could not open cgroup %s: %s", cg->path, strerror(errno));
+		rmonitor_cgroup_delete(cg);
+		return 0;
+	}
+
+	debug(D_RMON, "created cgroup %s", cg->path);
+
+	return cg;
+}
+
+void rmonitor_cgroup_delete(struct rmonitor_cgroup *cg)
+{
+	if (!cg)
+		return;
+
+	if (cg->dirfd >= 0)
+		close(cg->dirfd);
+
+	/* Processes killed with cgroup.kill leave the cgroup only once they are reaped, which may take a moment. */
+	int tries;
+	int result = -1;
+	for (tries = 0; tries < 10; tries++) {
+		result = rmdir(cg->path);
+		if (result == 0 || errno != EBUSY)
+			break;
+		usleep(10000);
+	}
+
+	if (result < 0) {
+		debug(D_RMON, "could not remove cgroup %s: %s", cg->path, strerror(errno));
+	}
+
+	/* Leave parent as we found it. We cannot move back into it while it passes controllers to its children. */
+	if (cg->io_enabled) {
+		char *control = string_format("%s/cgroup.subtree_control", cg->parent);
+		if (!write_file(control, "-io")) {
+			debug(D_RMON, "could not disable io in %s: %s", cg->parent, strerror(errno));
+		}
+		free(control);
+	}
+
+	if (cg->leaf) {
+		move_pid(cg->parent, getpid());
+		if (rmdir(cg->leaf) < 0) {
+			debug(D_RMON, "could not remove cgroup %s: %s", cg->leaf, strerror(errno));
+		}
+	}
+
+	free(cg->path);
+	free(cg->parent);
+	free(cg->leaf);
+	free(cg);
+}
+
+int rmonitor_cgroup_join(struct rmonitor_cgroup *cg, pid_t pid)
+{
+	return move_pid(cg->path, pid);
+}
+
+int rmonitor_cgroup_kill(struct rmonitor_cgroup *cg)
+{
+	/* cgroup.kill appeared in linux 5.14. */
+	char *kill_path = string_format("%s/cgroup.kill", cg->path);
+	int result = write_file(kill_path, "1");
+	free(kill_path);
+
+	return result;
+}
+
+int rmonitor_cgroup_measure(struct rmonitor_cgroup *cg, struct rmonitor_cgroup_info *info)
+{
+	char buffer[16384];
+	char *line, *saveptr;
+	int found = 0;
+
+	info->cpu_time = -1;
+	info->bytes_read = -1;
+	info->bytes_written = -1;
+
+	/* cpu.stat is always present in v2, even without the cpu controller. */
+	if (read_file(cg, "cpu.stat", buffer, sizeof(buffer)) > 0) {
+		for (line = strtok_r(buffer, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr)) {
+			if (sscanf(line, "usage_usec %" SCNd64, &info->cpu_time) == 1) {
+				found = 1;
+				break;
+			}
+		}
+	}
+
+	/* io.stat is there only if the io controller is enabled. It has a line per device: major:minor rbytes=... wbytes=... rios=... wios=... */
+	if (read_file(cg, "io.stat", buffer, sizeof(buffer)) >= 0) {
+		info->bytes_read = 0;
+		info->bytes_written = 0;
+		found = 1;
+
+		for (line = strtok_r(buffer, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr)) {
+			int64_t rbytes, wbytes;
+			if (sscanf(line, "%*s rbytes=%" SCNd64 " wbytes=%" SCNd64, &rbytes, &wbytes) == 2) {
+				info->bytes_read += rbytes;
+				info->bytes_written += wbytes;
+			}
+		}
+	}
+
+	return found;
+}
+
+/* vim: set noexpandtab tabstop=8: */
@@ -0,0 +1,54 @@
+/*
+Copyright (C) 2022 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef RMONITOR_CGROUP_H
+#define RMONITOR_CGROUP_H
+
+/*
+Accounting of a process tree through its own cgroup v2 subtree.
+The kernel keeps the totals of every process that ever ran in the
+cgroup, including children that exit between two polls, and kills
+every process in it at once, including those that escaped the tree.
+
+A cgroup can only be created where the cgroup of the caller has been
+delegated to its user. A cgroup with processes cannot enable controllers
+for its children, so the caller is moved to a leaf cgroup of its own
+next to the one created, and moved back when the cgroup is deleted.
+Measurements of controllers that could not be enabled are reported
+as -1, so that the caller can fall back to polling /proc for them.
+
+Memory is not measured here. memory.peak and memory.current include
+the page cache charged to the cgroup, which is not what the resident
+memory of the processes reported from /proc means.
+*/
+
+#include <stdint.h>
+#include <sys/types.h>
+
+struct rmonitor_cgroup;
+
+struct rmonitor_cgroup_info {
+	int64_t cpu_time;       /* usecs of cpu used, from cpu.stat. */
+	int64_t bytes_read;     /* bytes read from block devices, from io.stat. */
+	int64_t bytes_written;  /* bytes written to block devices, from io.stat. */
+};
+
+/* Create a cgroup named name below the cgroup of the calling process. Returns 0 if cgroups v2 are not available or not delegated. */
+struct rmonitor_cgroup *rmonitor_cgroup_create(const char *name);
+
+/* Remove the cgroup, which should not have any processes left, and move the caller back to its original cgroup. */
+void rmonitor_cgroup_delete(struct rmonitor_cgroup *cg);
+
+/* Move pid into the cgroup. Its children will be created in the cgroup too. Returns 1 on success, 0 on failure. */
+int rmonitor_cgroup_join(struct rmonitor_cgroup *cg, pid_t pid);
+
+/* Kill every process in the cgroup, including those that escaped the process tree. Returns 1 on success, 0 on failure. */
+int rmonitor_cgroup_kill(struct rmonitor_cgroup *cg);
+
+/* Fill info with the current measurements of the cgroup. Returns 1 if any measurement is available. */
+int rmonitor_cgroup_measure(struct rmonitor_cgroup *cg, struct rmonitor_cgroup_info *info);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+Copyright (C) 2022 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Runs a process tree in a cgroup, and checks that the cgroup accounts for
+the cpu of a child that already exited, that it kills a grandchild that
+escaped the tree, and that the caller is back in its cgroup at the end.
+
+With the argument "check", only tells with the exit status whether a
+cgroup can be created here.
+*/
+
+#include "rmonitor_cgroup.h"
+#include "full_io.h"
+#include "stringtools.h"
+#include "timestamp.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char *self_cgroup(void)
+{
+	char line[4096];
+	char *result = 0;
+
+	FILE *f = fopen("/proc/self/cgroup", "r");
+	if (!f)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (string_prefix_is(line, "0::")) {
+			result = strdup(line);
+			break;
+		}
+	}
+
+	fclose(f);
+	return result;
+}
+
+/* A process is gone once it has been reaped, or it is a zombie waiting for it. */
+static int process_is_gone(pid_t pid)
+{
+	char state = 0;
+
+	char *path = string_format("/proc/%d/stat", (int)pid);
+	FILE *f = fopen(path, "r");
+	free(path);
+
+	if (!f)
+		return 1;
+
+	if (fscanf(f, "%*d %*s %c", &state) != 1)
+		state = 0;
+	fclose(f);
+
+	return state == 'Z';
+}
+
+static void child(int sync_fd, int report_fd)
+{
+	char c;
+	full_read(sync_fd, &c, 1);
+
+	/* Escape the tree: the grandchild is reparented when we exit. */
+	pid_t grandchild = fork();
+	if (grandchild == 0) {
+		while (1)
+			pause();
+	}
+	full_write(report_fd, &grandchild, sizeof(grandchild));
+
+	timestamp_t stop = timestamp_get() + 200000;
+	volatile unsigned long spin = 0;
+	while (timestamp_get() < stop)
+		spin++;
+
+	_exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	int check_only = argc > 1 && !strcmp(argv[1], "check");
+
+	char *name = string_format("rmonitor_cgroup_test-%d", (int)getpid());
+	char *before = self_cgroup();
+
+	struct rmonitor_cgroup *cg = rmonitor_cgroup_create(name);
+	if (!cg) {
+		fprintf(stdout, "could not create a cgroup here.\n");
+		return 1;
+	}
+
+	if (check_only) {
+		rmonitor_cgroup_delete(cg);
+		return 0;
+	}
+
+	int sync_pipe[2], report_pipe[2];
+	if (pipe(sync_pipe) < 0 || pipe(report_pipe) < 0) {
+		perror("pipe");
+		return 1;
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	} else if (pid == 0) {
+		child(sync_pipe[0], report_pipe[1]);
+	}
+
+	if (!rmonitor_cgroup_join(cg, pid)) {
+		fprintf(stdout, "could not move %d to the cgroup.\n", (int)pid);
+		kill(pid, SIGKILL);
+		return 1;
+	}
+	full_write(sync_pipe[1], "x", 1);
+
+	pid_t grandchild = 0;
+	full_read(report_pipe[0], &grandchild, sizeof(grandchild));
+	waitpid(pid, NULL, 0);
+
+	int errors = 0;
+
+	struct rmonitor_cgroup_info info;
+	if (!rmonitor_cgroup_measure(cg, &info) || info.cpu_time < 100000) {
+		fprintf(stdout, "cpu time of the exited child not accounted: %lld usecs.\n", (long long)info.cpu_time);
+		errors++;
+	}
+
+	if (!rmonitor_cgroup_kill(cg)) {
+		fprintf(stdout, "could not kill the cgroup.\n");
+		kill(grandchild, SIGKILL);
+		errors++;
+	}
+
+	int tries;
+	for (tries = 0; tries < 100 && !process_is_gone(grandchild); tries++) {
+		usleep(10000);
+	}
+	if (!process_is_gone(grandchild)) {
+		fprintf(stdout, "grandchild %d escaped the kill.\n", (int)grandchild);
+		kill(grandchild, SIGKILL);
+		errors++;
+	}
+
+	rmonitor_cgroup_delete(cg);
+
+	char *after = self_cgroup();
+	if (!before || !after || strcmp(before, after)) {
+		fprintf(stdout, "not back in the original cgroup: %s", after ? after : "none\n");
+		errors++;
+	}
+
+	free(name);
+	free(before);
+	free(after);
+
+	return errors ? 1 : 0;
+}
+
+/* vim: set noexpandtab tabstop=8: */
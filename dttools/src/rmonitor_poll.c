@@ -6,14 +6,18 @@ See the file COPYING for details.
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 #include "debug.h"
+#include "full_io.h"
 #include "load_average.h"
 #include "macros.h"
 #include "path_disk_size_info.h"
@@ -31,6 +35,20 @@ See the file COPYING for details.
 
 #define ANON_MAPS_NAME "[anon]"
 
+/* Large enough for /proc/pid/status, whose Cpus_allowed and Mems_allowed lines grow with the machine. */
+#define PROC_BUFFER_SIZE 16384
+
+struct proc_attribute {
+	const char *name;
+	uint64_t *value;
+};
+
+static int read_proc_file(pid_t pid, const char *filename, char *buffer, int size);
+static int get_int_attributes(const char *buffer, struct proc_attribute *attributes, int count);
+static int get_stat_fields(const char *buffer, int first, int count, uint64_t *values);
+static int get_ctxsw_from_status(const char *status, struct rmonitor_ctxsw_info *switches);
+static int get_mem_from_status(const char *status, struct rmonitor_mem_info *mem);
+
 uint64_t usecs_since_epoch()
 {
 	uint64_t usecs;
@@ -128,12 +146,20 @@ void rmonitor_poll_all_fss_once(struct itable *filesysms, struct rmonitor_filesy
 int rmonitor_poll_process_once(struct rmonitor_process_info *p)
 {
 	int status = 0;
+	char buffer[PROC_BUFFER_SIZE];
 
 	debug(D_RMON, "monitoring process: %d\n", p->pid);
 
 	status |= rmonitor_get_cpu_time_usage(p->pid, &p->cpu);
-	status |= rmonitor_get_ctxsw_usage(p->pid, &p->ctx);
-	status |= rmonitor_get_mem_usage(p->pid, &p->mem);
+
+	/* status is read once for both the context switches and the memory. */
+	if (read_proc_file(p->pid, "status", buffer, sizeof(buffer)) < 0) {
+		status |= 1;
+	} else {
+		status |= get_ctxsw_from_status(buffer, &p->ctx);
+		status |= get_mem_from_status(buffer, &p->mem);
+	}
+
 	status |= rmonitor_get_sys_io_usage(p->pid, &p->io);
 
 	return status;
@@ -188,6 +214,109 @@ FILE *open_proc_file(pid_t pid, char *filename)
 	return fproc;
 }
 
+/*
+Read the whole /proc file into buffer, with a single open and no
+allocations, so that a poll does not go through stdio for each file.
+Returns the number of bytes read, or -1 on error.
+*/
+static int read_proc_file(pid_t pid, const char *filename, char *buffer, int size)
+{
+	char path[PATH_MAX];
+
+#if defined(CCTOOLS_OPSYS_DARWIN) || defined(CCTOOLS_OPSYS_FREEBSD)
+	return -1;
+#endif
+
+	if (pid > -1) {
+		snprintf(path, sizeof(path), "/proc/%d/%s", pid, filename);
+	} else {
+		snprintf(path, sizeof(path), "/proc/%s", filename);
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		debug(D_RMON, "could not process file %s : %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	ssize_t n = full_read(fd, buffer, size - 1);
+	close(fd);
+
+	if (n < 0) {
+		debug(D_RMON, "could not read file %s : %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	buffer[n] = '\0';
+
+	return n;
+}
+
+/*
+Fill the values of the lines "name value" of buffer, in a single pass.
+Attributes not found keep their previous values.
+Returns the number of attributes not found.
+*/
+static int get_int_attributes(const char *buffer, struct proc_attribute *attributes, int count)
+{
+	int missing = count;
+	const char *line = buffer;
+
+	while (line && *line && missing > 0) {
+		int i;
+		for (i = 0; i < count; i++) {
+			size_t n = strlen(attributes[i].name);
+			if (strncmp(line, attributes[i].name, n) == 0) {
+				*attributes[i].value = strtoull(line + n, NULL, 10);
+				missing--;
+				break;
+			}
+		}
+
+		line = strchr(line, '\n');
+		if (line)
+			line++;
+	}
+
+	return missing;
+}
+
+/*
+Read count consecutive fields of /proc/pid/stat, starting with field
+first, numbered from 1 as in proc(5). The command name in field 2 may
+have spaces and parentheses, so fields are counted from the last closing
+parenthesis. Returns 0 on success.
+*/
+static int get_stat_fields(const char *buffer, int first, int count, uint64_t *values)
+{
+	const char *c = strrchr(buffer, ')');
+	if (!c || first < 3)
+		return 1;
+	c++;
+
+	int field;
+	for (field = 3; field < first + count; field++) {
+		while (*c == ' ')
+			c++;
+
+		if (!*c)
+			return 1;
+
+		if (field >= first) {
+			char *end;
+			values[field - first] = strtoull(c, &end, 10);
+			if (end == c)
+				return 1;
+			c = end;
+		}
+
+		while (*c && *c != ' ')
+			c++;
+	}
+
+	return 0;
+}
+
 /* Parse a /proc file looking for line attribute: value */
 int rmonitor_get_int_attribute(FILE *fstatus, char *attribute, uint64_t *value, int rewind_flag)
 {
@@ -275,38 +404,18 @@ int rmonitor_get_start_time(pid_t pid, uint64_t *start_time)
 
 	uint64_t start_clicks;
 	double uptime;
+	char buffer[PROC_BUFFER_SIZE];
 
-	FILE *fstat = open_proc_file(pid, "stat");
-	if (!fstat)
+	/* clock ticks since boot when the process started (field 22) */
+	if (read_proc_file(pid, "stat", buffer, sizeof(buffer)) < 0 || get_stat_fields(buffer, 22, 1, &start_clicks))
 		return 1;
 
-	int n;
-	n = fscanf(fstat,
-			"%*s" /* pid */ "%*s" /* cmd line */ "%*s" /* state */ "%*s"	      /* pid of parent */
-			"%*s" /* group ID */ "%*s" /* session id */ "%*s" /* tty pid */ "%*s" /* tty group ID */
-			"%*s" /* linux/sched.h flags */ "%*s %*s %*s %*s"		      /* faults */
-			"%*s"								      /* user mode time (in clock ticks)   (field 14)  */
-			"%*s"								      /* kernel mode time (in clock ticks) (field 15) */
-			"%*s"								      /* time (clock ticks) waiting for children in user mode */
-			"%*s"								      /* time (clock ticks) waiting for children in kernel mode */
-			"%*s" /* priority */ "%*s"					      /* nice */
-			"%*s" /* num threads */ "%*s"					      /* always 0 */
-			"%" SCNu64							      /* clock ticks since start     (field 22) */
-			/* .... */,
-			&start_clicks);
-	fclose(fstat);
-
-	if (n != 1)
-		return 1;
-
-	FILE *fuptime = open_proc_file(-1, "uptime");
-	if (!fuptime)
+	if (read_proc_file(-1, "uptime", buffer, sizeof(buffer)) < 0)
 		return 1;
 
-	n = fscanf(fuptime, "%lf %*s", &uptime);
-	fclose(fuptime);
-
-	if (n != 1)
+	char *end;
+	uptime = strtod(buffer, &end);
+	if (end == buffer)
 		return 1;
 
 	uint64_t origin = usecs_since_epoch() - (uptime * ONE_SECOND);
@@ -319,28 +428,14 @@ int rmonitor_get_cpu_time_usage(pid_t pid, struct rmonitor_cpu_time_info *cpu)
 {
 	/* /proc/[pid]/stat */
 
-	uint64_t kernel, user;
+	/* user and kernel mode time, in clock ticks (fields 14 and 15) */
+	uint64_t times[2];
+	char buffer[PROC_BUFFER_SIZE];
 
-	FILE *fstat = open_proc_file(pid, "stat");
-	if (!fstat)
+	if (read_proc_file(pid, "stat", buffer, sizeof(buffer)) < 0 || get_stat_fields(buffer, 14, 2, times))
 		return 1;
 
-	int n;
-	n = fscanf(fstat,
-			"%*s" /* pid */ "%*s" /* cmd line */ "%*s" /* state */ "%*s"	      /* pid of parent */
-			"%*s" /* group ID */ "%*s" /* session id */ "%*s" /* tty pid */ "%*s" /* tty group ID */
-			"%*s" /* linux/sched.h flags */ "%*s %*s %*s %*s"		      /* faults */
-			"%" SCNu64							      /* user mode time (in clock ticks) */
-			"%" SCNu64							      /* kernel mode time (in clock ticks) */
-			/* .... */,
-			&kernel,
-			&user);
-	fclose(fstat);
-
-	if (n != 2)
-		return 1;
-
-	uint64_t accum = clicks_to_usecs(kernel) + clicks_to_usecs(user);
+	uint64_t accum = clicks_to_usecs(times[0]) + clicks_to_usecs(times[1]);
 
 	cpu->delta = 0;
 	if (cpu->accumulated < accum) {
@@ -356,33 +451,39 @@ void acc_cpu_time_usage(struct rmonitor_cpu_time_info *acc, struct rmonitor_cpu_
 	acc->delta += other->delta;
 }
 
-int rmonitor_get_ctxsw_usage(pid_t pid, struct rmonitor_ctxsw_info *switches)
+static int get_ctxsw_from_status(const char *status, struct rmonitor_ctxsw_info *switches)
 {
-	/* /proc/[pid]/stat */
-
-	int notfound;
 	uint64_t vol_switches = 0;
 	uint64_t nonvol_switches = 0;
 
-	FILE *fstat = open_proc_file(pid, "status");
-	if (!fstat) {
-		return 0;
-	}
-
-	notfound = 0;
+	struct proc_attribute attributes[] = {
+			{"voluntary_ctxt_switches:", &vol_switches},
+			{"nonvoluntary_ctxt_switches:", &nonvol_switches},
+	};
 
-	notfound |= rmonitor_get_int_attribute(fstat, "voluntary_ctxt_switches:", &vol_switches, 1);
-	notfound |= rmonitor_get_int_attribute(fstat, "nonvoluntary_ctxt_switches:", &nonvol_switches, 0);
+	int notfound = get_int_attributes(status, attributes, 2) > 0;
 
 	uint64_t accum = vol_switches + nonvol_switches;
 
 	switches->delta = accum - switches->accumulated;
 	switches->accumulated = accum;
 
-	fclose(fstat);
 	return notfound;
 }
 
+int rmonitor_get_ctxsw_usage(pid_t pid, struct rmonitor_ctxsw_info *switches)
+{
+	/* /proc/[pid]/status */
+
+	char buffer[PROC_BUFFER_SIZE];
+
+	if (read_proc_file(pid, "status", buffer, sizeof(buffer)) < 0) {
+		return 0;
+	}
+
+	return get_ctxsw_from_status(buffer, switches);
+}
+
 void acc_ctxsw_usage(struct rmonitor_ctxsw_info *acc, struct rmonitor_ctxsw_info *other)
 {
 	acc->delta += other->delta;
@@ -403,27 +504,22 @@ int rmonitor_get_loadavg(struct rmonitor_load_info *load)
 	return 0;
 }
 
-int rmonitor_get_mem_usage(pid_t pid, struct rmonitor_mem_info *mem)
+static int get_mem_from_status(const char *status, struct rmonitor_mem_info *mem)
 {
-	// /proc/[pid]/status:
-
-	FILE *fmem = open_proc_file(pid, "status");
-	if (!fmem)
-		return 1;
-
-	int status = 0;
 	/* in kB */
-	status |= rmonitor_get_int_attribute(fmem, "VmPeak:", &mem->virtual, 1);
-	status |= rmonitor_get_int_attribute(fmem, "VmHWM:", &mem->resident, 1);
-	status |= rmonitor_get_int_attribute(fmem, "VmLib:", &mem->shared, 1);
-	status |= rmonitor_get_int_attribute(fmem, "VmExe:", &mem->text, 1);
-	status |= rmonitor_get_int_attribute(fmem, "VmData:", &mem->data, 1);
+	struct proc_attribute attributes[] = {
+			{"VmPeak:", &mem->virtual},
+			{"VmHWM:", &mem->resident},
+			{"VmLib:", &mem->shared},
+			{"VmExe:", &mem->text},
+			{"VmData:", &mem->data},
+	};
+
+	int notfound = get_int_attributes(status, attributes, 5) > 0;
 
 	/* from smaps when reading maps. */
 	mem->swap = 0;
 
-	fclose(fmem);
-
 	/* in MB */
 	mem->virtual = DIV_INT_ROUND_UP(mem->virtual, 1024);
 	mem->resident = DIV_INT_ROUND_UP(mem->resident, 1024);
@@ -431,7 +527,19 @@ int rmonitor_get_mem_usage(pid_t pid, struct rmonitor_mem_info *mem)
 	mem->data = DIV_INT_ROUND_UP(mem->data, 1024);
 	mem->shared = DIV_INT_ROUND_UP(mem->shared, 1024);
 
-	return status;
+	return notfound;
+}
+
+int rmonitor_get_mem_usage(pid_t pid, struct rmonitor_mem_info *mem)
+{
+	// /proc/[pid]/status:
+
+	char buffer[PROC_BUFFER_SIZE];
+
+	if (read_proc_file(pid, "status", buffer, sizeof(buffer)) < 0)
+		return 1;
+
+	return get_mem_from_status(buffer, mem);
 }
 
 void acc_mem_usage(struct rmonitor_mem_info *acc, struct rmonitor_mem_info *other)
@@ -561,7 +669,60 @@ int rmonitor_get_mmaps_usage(pid_t pid, struct hash_table *maps)
 	return 0;
 }
 
-int rmonitor_poll_maps_once(struct itable *processes, struct rmonitor_mem_info *mem)
+/*
+Fill mem with the totals of all the maps of the process, in kB, from
+/proc/pid/smaps_rollup (linux 4.14). The kernel adds up the maps as it
+generates the file, which makes it much cheaper to read than smaps for
+processes with many maps. Resident memory is the proportional set size,
+so that the pages shared by the processes of a tree add up to their
+size only once. The current virtual size comes from VmSize in status,
+as the rollup does not have it. Returns 1 if it is not available.
+*/
+int rmonitor_get_smaps_rollup(pid_t pid, struct rmonitor_mem_info *mem)
+{
+	char buffer[PROC_BUFFER_SIZE];
+	uint64_t rss, pss, swap, ref, size;
+	uint64_t private_dirty, private_clean;
+
+	if (read_proc_file(pid, "smaps_rollup", buffer, sizeof(buffer)) < 0)
+		return 1;
+
+	struct proc_attribute attributes[] = {
+			{"Rss:", &rss},
+			{"Pss:", &pss},
+			{"Private_Clean:", &private_clean},
+			{"Private_Dirty:", &private_dirty},
+			{"Referenced:", &ref},
+			{"Swap:", &swap},
+	};
+
+	if (get_int_attributes(buffer, attributes, 6) > 0)
+		return 1;
+
+	struct proc_attribute status_attributes[] = {
+			{"VmSize:", &size},
+	};
+
+	if (read_proc_file(pid, "status", buffer, sizeof(buffer)) < 0 || get_int_attributes(buffer, status_attributes, 1) > 0)
+		return 1;
+
+	bzero(mem, sizeof(struct rmonitor_mem_info));
+
+	mem->virtual = size;
+	mem->resident = pss;
+	mem->referenced = ref;
+	mem->swap = swap;
+
+	/* as in rmonitor_get_mmaps_usage, we assume that all private pages are
+	 * resident. Pss counts them whole, and a share of each of the other
+	 * pages, which is what this process contributes to shared. */
+	mem->private = MIN(private_dirty + private_clean, pss);
+	mem->shared = pss - mem->private;
+
+	return 0;
+}
+
+static int poll_maps_once(struct itable *processes, struct rmonitor_mem_info *mem, int use_rollup)
 {
 	/* set result to 0. */
 	bzero(mem, sizeof(struct rmonitor_mem_info));
@@ -572,7 +733,20 @@ int rmonitor_poll_maps_once(struct itable *processes, struct rmonitor_mem_info *
 	struct rmonitor_process_info *pinfo;
 	itable_firstkey(processes);
 	while (itable_nextkey(processes, &pid, (void *)&pinfo)) {
-		rmonitor_get_mmaps_usage(pid, maps_per_file);
+		/* smaps_rollup has the totals already, so the maps of the process do
+		 * not need to be merged below. smaps is only read for the processes
+		 * without it. */
+		struct rmonitor_mem_info rollup;
+		if (use_rollup && rmonitor_get_smaps_rollup(pid, &rollup) == 0) {
+			mem->virtual += rollup.virtual;
+			mem->referenced += rollup.referenced;
+			mem->shared += rollup.shared;
+			mem->private += rollup.private;
+			mem->resident += rollup.private + rollup.shared;
+			mem->swap += rollup.swap;
+		} else {
+			rmonitor_get_mmaps_usage(pid, maps_per_file);
+		}
 	}
 
 	/* Accumulate the maps we just found per file. First, we merge together all
@@ -591,8 +765,8 @@ int rmonitor_poll_maps_once(struct itable *processes, struct rmonitor_mem_info *
 	 * shared, rather than the resident reported originally as this would
 	 * overcount shared.
 	 *
-	 * There could be a way to use Pss (proportional resident) to improve these
-	 * bounds.
+	 * The processes read from smaps_rollup are already accounted above with
+	 * their Pss (proportional resident).
 	 */
 
 	char *map_name;
@@ -644,6 +818,7 @@ int rmonitor_poll_maps_once(struct itable *processes, struct rmonitor_mem_info *
 			mem->referenced += info->referenced;
 			mem->shared += info->shared;
 			mem->private += info->private;
+			mem->swap += info->swap;
 
 			/* note that we add private + shared, rather than resident,
 			 * otherwise we will overcount shared. */
@@ -664,10 +839,21 @@ int rmonitor_poll_maps_once(struct itable *processes, struct rmonitor_mem_info *
 	mem->shared = DIV_INT_ROUND_UP(mem->shared, 1024);
 	mem->private = DIV_INT_ROUND_UP(mem->private, 1024);
 	mem->resident = DIV_INT_ROUND_UP(mem->resident, 1024);
+	mem->swap = DIV_INT_ROUND_UP(mem->swap, 1024);
 
 	return 0;
 }
 
+int rmonitor_poll_maps_once(struct itable *processes, struct rmonitor_mem_info *mem)
+{
+	return poll_maps_once(processes, mem, 1);
+}
+
+int rmonitor_poll_maps_smaps_once(struct itable *processes, struct rmonitor_mem_info *mem)
+{
+	return poll_maps_once(processes, mem, 0);
+}
+
 int rmonitor_get_sys_io_usage(pid_t pid, struct rmonitor_io_info *io)
 {
 	/* /proc/[pid]/io: if process dies before we read the file,
@@ -675,25 +861,24 @@ int rmonitor_get_sys_io_usage(pid_t pid, struct rmonitor_io_info *io)
 	   any characters.
 	*/
 
-	FILE *fio = open_proc_file(pid, "io");
+	char buffer[PROC_BUFFER_SIZE];
 	uint64_t cread, cwritten;
-	int rstatus, wstatus;
 
 	io->delta_chars_read = 0;
 	io->delta_chars_written = 0;
 
-	if (!fio)
+	if (read_proc_file(pid, "io", buffer, sizeof(buffer)) < 0)
 		return 1;
 
 	/* We really want "bytes_read", but there are issues with
 	 * distributed filesystems. Instead, we also count page
 	 * faulting in another function below. */
-	rstatus = rmonitor_get_int_attribute(fio, "rchar", &cread, 1);
-	wstatus = rmonitor_get_int_attribute(fio, "write_bytes", &cwritten, 1);
-
-	fclose(fio);
+	struct proc_attribute attributes[] = {
+			{"rchar:", &cread},
+			{"write_bytes:", &cwritten},
+	};
 
-	if (rstatus || wstatus)
+	if (get_int_attributes(buffer, attributes, 2) > 0)
 		return 1;
 
 	io->delta_chars_read = cread - io->chars_read;
@@ -0,0 +1,205 @@
+/*
+Copyright (C) 2022 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Measure the cost of polling a process tree in which every process has
+many memory maps, as a JVM or a python with many modules would. The
+single read parsers of stat, status and io are compared against the
+stdio parsers that rmonitor_poll used before, and smaps_rollup is
+compared against reading every map from smaps.
+*/
+
+#include "hash_table.h"
+#include "list.h"
+#include "rmonitor_poll_internal.h"
+#include "timestamp.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static void show_help(const char *cmd)
+{
+	printf("Use: %s <maps> [processes] [polls]\n", cmd);
+}
+
+/* The parsers of stat, status and io that rmonitor_poll_process_once used, one stdio pass per attribute. */
+
+static int stdio_poll_process_once(struct rmonitor_process_info *p)
+{
+	uint64_t kernel, user, value;
+	int status = 0;
+
+	FILE *f = open_proc_file(p->pid, "stat");
+	if (!f)
+		return 1;
+	if (fscanf(f, "%*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %" SCNu64 " %" SCNu64, &kernel, &user) != 2)
+		status = 1;
+	fclose(f);
+	p->cpu.accumulated = kernel + user;
+
+	f = open_proc_file(p->pid, "status");
+	if (!f)
+		return 1;
+	status |= rmonitor_get_int_attribute(f, "voluntary_ctxt_switches:", &value, 1);
+	status |= rmonitor_get_int_attribute(f, "nonvoluntary_ctxt_switches:", &value, 0);
+	fclose(f);
+
+	f = open_proc_file(p->pid, "status");
+	if (!f)
+		return 1;
+	status |= rmonitor_get_int_attribute(f, "VmPeak:", &p->mem.virtual, 1);
+	status |= rmonitor_get_int_attribute(f, "VmHWM:", &p->mem.resident, 1);
+	status |= rmonitor_get_int_attribute(f, "VmLib:", &p->mem.shared, 1);
+	status |= rmonitor_get_int_attribute(f, "VmExe:", &p->mem.text, 1);
+	status |= rmonitor_get_int_attribute(f, "VmData:", &p->mem.data, 1);
+	fclose(f);
+
+	f = open_proc_file(p->pid, "io");
+	if (!f)
+		return 1;
+	status |= rmonitor_get_int_attribute(f, "rchar", &p->io.chars_read, 1);
+	status |= rmonitor_get_int_attribute(f, "write_bytes", &p->io.chars_written, 1);
+	fclose(f);
+
+	return status;
+}
+
+static int smaps_poll_once(pid_t pid)
+{
+	struct hash_table *maps = hash_table_create(0, 0);
+
+	int status = rmonitor_get_mmaps_usage(pid, maps);
+
+	char *name;
+	struct list *infos;
+	HASH_TABLE_ITERATE(maps, name, infos) {
+		struct rmonitor_mem_info *info;
+		while ((info = list_pop_head(infos))) {
+			free(info->map_name);
+			free(info);
+		}
+		list_delete(infos);
+	}
+	hash_table_delete(maps);
+
+	return status;
+}
+
+static int rollup_poll_once(pid_t pid)
+{
+	struct rmonitor_mem_info mem;
+	return rmonitor_get_smaps_rollup(pid, &mem);
+}
+
+/* Map n pages one by one, alternating their permissions so that the kernel cannot merge them into fewer maps. */
+
+static void make_maps(int n)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	int i;
+
+	for (i = 0; i < n; i++) {
+		int prot = (i % 2) ? PROT_READ : PROT_READ | PROT_WRITE;
+		char *p = mmap(NULL, page, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			printf("could not map %d pages: %s\n", n, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		if (prot & PROT_WRITE)
+			p[0] = 1;
+	}
+}
+
+static void report(const char *what, timestamp_t elapsed, int polls, int failures)
+{
+	printf("  %-14s %10.1f us/poll%s\n", what, elapsed / (double)polls, failures ? " (some reads failed)" : "");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		show_help(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int maps = atoi(argv[1]);
+	int nprocs = argc > 2 ? atoi(argv[2]) : 1;
+	int polls = argc > 3 ? atoi(argv[3]) : 10;
+
+	if (maps < 0 || nprocs < 1 || polls < 1) {
+		show_help(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	make_maps(maps);
+
+	/* the children inherit the maps, and wait to be polled. */
+	struct rmonitor_process_info *procs = calloc(nprocs, sizeof(*procs));
+	procs[0].pid = getpid();
+
+	int i, j;
+	for (i = 1; i < nprocs; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			pause();
+			_exit(0);
+		} else if (pid < 0) {
+			printf("could not fork!\n");
+			return EXIT_FAILURE;
+		}
+		procs[i].pid = pid;
+	}
+
+	printf("%d processes with %d maps each, %d polls\n", nprocs, maps, polls);
+
+	timestamp_t start;
+	int failures;
+
+	printf("stat, status and io:\n");
+
+	start = timestamp_get();
+	for (failures = 0, j = 0; j < polls; j++)
+		for (i = 0; i < nprocs; i++)
+			failures += stdio_poll_process_once(&procs[i]) != 0;
+	report("stdio", timestamp_get() - start, polls, failures);
+
+	start = timestamp_get();
+	for (failures = 0, j = 0; j < polls; j++)
+		for (i = 0; i < nprocs; i++)
+			failures += rmonitor_poll_process_once(&procs[i]) != 0;
+	report("single read", timestamp_get() - start, polls, failures);
+
+	printf("memory maps:\n");
+
+	start = timestamp_get();
+	for (failures = 0, j = 0; j < polls; j++)
+		for (i = 0; i < nprocs; i++)
+			failures += smaps_poll_once(procs[i].pid) != 0;
+	report("smaps", timestamp_get() - start, polls, failures);
+
+	start = timestamp_get();
+	for (failures = 0, j = 0; j < polls; j++)
+		for (i = 0; i < nprocs; i++)
+			failures += rollup_poll_once(procs[i].pid) != 0;
+	report("smaps_rollup", timestamp_get() - start, polls, failures);
+
+	for (i = 1; i < nprocs; i++) {
+		kill(procs[i].pid, SIGKILL);
+		waitpid(procs[i].pid, NULL, 0);
+	}
+
+	free(procs);
+
+	return EXIT_SUCCESS;
+}
+
+/* vim: set noexpandtab tabstop=8: */
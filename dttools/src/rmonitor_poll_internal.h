@@ -44,6 +44,7 @@ int rmonitor_poll_process_once(struct rmonitor_process_info *p);
 int rmonitor_poll_wd_once(     struct rmonitor_wdir_info    *d, int max_time_for_measurement);
 int rmonitor_poll_fs_once(     struct rmonitor_filesys_info *f);
 int rmonitor_poll_maps_once(   struct itable *processes, struct rmonitor_mem_info *mem);
+int rmonitor_poll_maps_smaps_once(struct itable *processes, struct rmonitor_mem_info *mem);
 
 void rmonitor_info_to_rmsummary(struct rmsummary *tr, struct rmonitor_process_info *p, struct rmonitor_wdir_info *d, struct rmonitor_filesys_info *f, uint64_t start_time);
 
@@ -52,6 +53,8 @@ int rmonitor_get_ctxsw_usage(   pid_t pid,        struct rmonitor_ctxsw_info *ct
 int rmonitor_get_mem_usage(     pid_t pid,        struct rmonitor_mem_info *mem);
 int rmonitor_get_sys_io_usage(  pid_t pid,        struct rmonitor_io_info *io);
 int rmonitor_get_map_io_usage(  pid_t pid,        struct rmonitor_io_info *io);
+int rmonitor_get_mmaps_usage(   pid_t pid,        struct hash_table *maps);
+int rmonitor_get_smaps_rollup(  pid_t pid,        struct rmonitor_mem_info *mem);
 int rmonitor_get_dsk_usage(     const char *path, struct statfs *disk);
 
 int rmonitor_get_loadavg(struct rmonitor_load_info *load);
@@ -67,7 +70,7 @@ void acc_dsk_usage(      struct statfs *acc,                 struct statfs *othe
 void acc_wd_usage(       struct rmonitor_wdir_info *acc,     struct rmonitor_wdir_info *other);
 
 FILE *open_proc_file(pid_t pid, char *filename);
-int get_int_attribute(FILE *fstatus, char *attribute, uint64_t *value, int rewind_flag);
+int rmonitor_get_int_attribute(FILE *fstatus, char *attribute, uint64_t *value, int rewind_flag);
 
 uint64_t usecs_since_epoch();
 
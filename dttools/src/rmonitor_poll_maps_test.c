@@ -0,0 +1,98 @@
+/*
+Copyright (C) 2022 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Forks a tree of processes that share the pages of a large buffer, and
+checks that the memory measured with smaps_rollup counts the buffer only
+once, as the merged maps from smaps do at most.
+*/
+
+#include "itable.h"
+#include "rmonitor_poll_internal.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BUFFER_MB 64
+#define CHILDREN 4
+
+static void show(const char *what, struct rmonitor_mem_info *mem)
+{
+	printf("%-12s resident %4" PRIu64 " MB, private %4" PRIu64 " MB, shared %4" PRIu64 " MB\n", what, mem->resident, mem->private, mem->shared);
+}
+
+int main(int argc, char **argv)
+{
+	size_t size = ((size_t)BUFFER_MB) << 20;
+
+	char *buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buffer == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memset(buffer, 1, size);
+
+	struct itable *processes = itable_create(0);
+	itable_insert(processes, getpid(), buffer);
+
+	pid_t children[CHILDREN];
+	int i;
+	for (i = 0; i < CHILDREN; i++) {
+		children[i] = fork();
+		if (children[i] == 0) {
+			while (1)
+				pause();
+		} else if (children[i] < 0) {
+			perror("fork");
+			return 1;
+		}
+		itable_insert(processes, children[i], buffer);
+	}
+
+	struct rmonitor_mem_info rollup, smaps;
+	int errors = 0;
+
+	if (rmonitor_poll_maps_once(processes, &rollup) || rmonitor_poll_maps_smaps_once(processes, &smaps)) {
+		printf("could not read the maps of the tree.\n");
+		errors++;
+	} else {
+		show("smaps_rollup", &rollup);
+		show("smaps", &smaps);
+
+		if (rollup.resident < BUFFER_MB) {
+			printf("smaps_rollup does not account for the buffer.\n");
+			errors++;
+		}
+
+		/* the buffer counted once per process would be about (CHILDREN + 1) * BUFFER_MB. */
+		if (rollup.resident > 2 * BUFFER_MB) {
+			printf("smaps_rollup counts the shared buffer more than once.\n");
+			errors++;
+		}
+
+		if (llabs((long long)rollup.resident - (long long)smaps.resident) > BUFFER_MB / 4) {
+			printf("smaps_rollup and smaps do not agree.\n");
+			errors++;
+		}
+	}
+
+	for (i = 0; i < CHILDREN; i++) {
+		kill(children[i], SIGKILL);
+		waitpid(children[i], NULL, 0);
+	}
+
+	itable_delete(processes);
+	munmap(buffer, size);
+
+	return errors ? 1 : 0;
+}
+
+/* vim: set noexpandtab tabstop=8: */
@@ -0,0 +1,313 @@
+/*
+Copyright (C) 2022 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "rmonitor_tasks.h"
+
+#include "debug.h"
+#include "itable.h"
+#include "list.h"
+#include "macros.h"
+#include "rmonitor_poll_internal.h"
+#include "xxmalloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Wall time in seconds of the window used to compute the peak of cores, as in resource_monitor. */
+#define PEAK_CORES_INTERVAL 180
+
+struct cores_sample {
+	double wall_time;
+	double cpu_time;
+};
+
+struct tree {
+	pid_t pid;
+	uint64_t start;			/* usecs since epoch when the tree was added. */
+	struct itable *processes;	/* pid -> rmonitor_process_info of the live processes of the tree. */
+
+	/* Totals of the processes that already left the tree, as of their last poll. */
+	uint64_t cpu_exited;
+	uint64_t ctx_exited;
+	uint64_t read_exited;
+	uint64_t written_exited;
+
+	int64_t total_processes;
+	struct list *samples;		/* cores_sample within the last PEAK_CORES_INTERVAL seconds. */
+
+	struct rmsummary *peak;
+	struct rmsummary *limits;
+	struct rmsummary *exceeded;	/* The limits broken, once the tree goes over them. */
+};
+
+struct rmonitor_tasks {
+	struct itable *trees;		/* id -> tree */
+};
+
+struct rmonitor_tasks *rmonitor_tasks_create(void)
+{
+	struct rmonitor_tasks *m = xxmalloc(sizeof(*m));
+	m->trees = itable_create(0);
+	return m;
+}
+
+static void tree_delete(struct tree *t)
+{
+	uint64_t pid;
+	struct rmonitor_process_info *p;
+
+	ITABLE_ITERATE(t->processes, pid, p)
+	{
+		free(p);
+	}
+	itable_delete(t->processes);
+
+	list_clear(t->samples, free);
+	list_delete(t->samples);
+
+	rmsummary_delete(t->peak);
+	rmsummary_delete(t->limits);
+	rmsummary_delete(t->exceeded);
+	free(t);
+}
+
+void rmonitor_tasks_delete(struct rmonitor_tasks *m)
+{
+	if (!m)
+		return;
+
+	uint64_t id;
+	struct tree *t;
+
+	ITABLE_ITERATE(m->trees, id, t)
+	{
+		tree_delete(t);
+	}
+	itable_delete(m->trees);
+	free(m);
+}
+
+void rmonitor_tasks_add(struct rmonitor_tasks *m, uint64_t id, pid_t pid, const struct rmsummary *limits)
+{
+	struct tree *t = itable_remove(m->trees, id);
+	if (t)
+		tree_delete(t);
+
+	t = xxmalloc(sizeof(*t));
+	memset(t, 0, sizeof(*t));
+
+	t->pid = pid;
+	t->start = usecs_since_epoch();
+	t->processes = itable_create(0);
+	t->samples = list_create();
+	t->peak = rmsummary_create(-1);
+	t->limits = limits ? rmsummary_copy(limits, 0) : NULL;
+
+	itable_insert(m->trees, id, t);
+}
+
+/* Peak cores in the last PEAK_CORES_INTERVAL seconds, following peak_cores() of resource_monitor. */
+static double tree_peak_cores(struct tree *t, double wall_time, double cpu_time)
+{
+	struct cores_sample *tail = xxmalloc(sizeof(*tail));
+	tail->wall_time = wall_time;
+	tail->cpu_time = cpu_time;
+	list_push_tail(t->samples, tail);
+
+	struct cores_sample *head;
+	while ((head = list_peek_head(t->samples)) && list_size(t->samples) > 2 && head->wall_time + PEAK_CORES_INTERVAL < tail->wall_time) {
+		free(list_pop_head(t->samples));
+	}
+
+	/* Before a full window has passed, divide by the whole window to ignore short bursts at the start. */
+	double diff_wall = PEAK_CORES_INTERVAL;
+	double diff_cpu = cpu_time;
+
+	if (wall_time >= PEAK_CORES_INTERVAL) {
+		diff_wall = MAX(0, tail->wall_time - head->wall_time);
+		diff_cpu = MAX(0, tail->cpu_time - head->cpu_time);
+	}
+
+	return diff_wall > 0 ? diff_cpu / diff_wall : 0;
+}
+
+/* Move the totals of a process that left the tree to the tree itself. */
+static void tree_retire_process(struct tree *t, struct rmonitor_process_info *p)
+{
+	t->cpu_exited += p->cpu.accumulated;
+	t->ctx_exited += p->ctx.accumulated;
+	t->read_exited += p->io.chars_read;
+	t->written_exited += p->io.chars_written;
+	free(p);
+}
+
+/* Find the current processes of the tree, walking down from the root, and measure each of them. */
+static int tree_poll(struct tree *t)
+{
+	struct itable *current = itable_create(0);
+
+	int size = 1;
+	int max = 64;
+	uint64_t *pending = xxmalloc(max * sizeof(*pending));
+	pending[0] = t->pid;
+
+	while (size > 0) {
+		pid_t pid = pending[--size];
+
+		/* A pid seen twice in the same walk was reused while walking. */
+		if (itable_lookup(current, pid))
+			continue;
+
+		struct rmonitor_process_info *p = itable_remove(t->processes, pid);
+		if (!p) {
+			p = xxmalloc(sizeof(*p));
+			memset(p, 0, sizeof(*p));
+			p->pid = pid;
+			t->total_processes++;
+		}
+
+		/* Keep the previous values if the process exited just now. It is retired at the next poll. */
+		rmonitor_poll_process_once(p);
+		itable_insert(current, pid, p);
+
+		uint64_t *children = NULL;
+		int count = rmonitor_get_children(pid, &children);
+		if (size + count > max) {
+			max = 2 * (size + count);
+			pending = realloc(pending, max * sizeof(*pending));
+		}
+		if (count > 0) {
+			memcpy(pending + size, children, count * sizeof(*pending));
+			size += count;
+		}
+		free(children);
+	}
+	free(pending);
+
+	/* Whatever is left in the old table exited since the last poll. */
+	uint64_t pid;
+	struct rmonitor_process_info *p;
+	ITABLE_ITERATE(t->processes, pid, p)
+	{
+		tree_retire_process(t, p);
+	}
+	itable_delete(t->processes);
+	t->processes = current;
+
+	uint64_t cpu = t->cpu_exited;
+	uint64_t ctx = t->ctx_exited;
+	uint64_t chars_read = t->read_exited;
+	uint64_t chars_written = t->written_exited;
+	uint64_t memory = 0;
+	uint64_t virtual = 0;
+
+	ITABLE_ITERATE(t->processes, pid, p)
+	{
+		cpu += p->cpu.accumulated;
+		ctx += p->ctx.accumulated;
+		chars_read += p->io.chars_read;
+		chars_written += p->io.chars_written;
+		memory += p->mem.resident;
+		virtual += p->mem.virtual;
+	}
+
+	struct rmsummary *now = rmsummary_create(-1);
+
+	now->start = ((double)t->start) / ONE_SECOND;
+	now->end = ((double)usecs_since_epoch()) / ONE_SECOND;
+	now->wall_time = now->end - now->start;
+	now->cpu_time = ((double)cpu) / ONE_SECOND;
+	now->cores = tree_peak_cores(t, now->wall_time, now->cpu_time);
+	now->cores_avg = now->wall_time > 0 ? now->cpu_time / now->wall_time : 0;
+	now->context_switches = ctx;
+	now->max_concurrent_processes = itable_size(t->processes);
+	now->total_processes = t->total_processes;
+	now->memory = memory;
+	now->virtual_memory = virtual;
+	now->bytes_read = ((double)chars_read) / ONE_MEGABYTE;
+	now->bytes_written = ((double)chars_written) / ONE_MEGABYTE;
+
+	int over = 0;
+	if (t->limits && !t->exceeded && !rmsummary_check_limits(now, t->limits)) {
+		t->exceeded = now->limits_exceeded;
+		now->limits_exceeded = NULL;
+		over = 1;
+	}
+
+	rmsummary_merge_max(t->peak, now);
+	rmsummary_delete(now);
+
+	return over;
+}
+
+int rmonitor_tasks_poll(struct rmonitor_tasks *m)
+{
+	uint64_t id;
+	struct tree *t;
+	int over = 0;
+
+	ITABLE_ITERATE(m->trees, id, t)
+	{
+		if (tree_poll(t)) {
+			debug(D_RMON, "process tree %" PRIu64 " (pid %d) went over its limits.", id, (int)t->pid);
+			over++;
+		}
+	}
+
+	return over;
+}
+
+int rmonitor_tasks_exceeded(struct rmonitor_tasks *m, uint64_t id)
+{
+	struct tree *t = itable_lookup(m->trees, id);
+	return t && t->exceeded;
+}
+
+int rmonitor_tasks_size(struct rmonitor_tasks *m)
+{
+	return itable_size(m->trees);
+}
+
+struct rmsummary *rmonitor_tasks_remove(struct rmonitor_tasks *m, uint64_t id, const struct rusage *ru)
+{
+	struct tree *t = itable_remove(m->trees, id);
+	if (!t)
+		return NULL;
+
+	struct rmsummary *s = t->peak;
+	t->peak = NULL;
+
+	s->start = ((double)t->start) / ONE_SECOND;
+	s->end = ((double)usecs_since_epoch()) / ONE_SECOND;
+	s->wall_time = s->end - s->start;
+
+	/* The rusage of the root also covers the descendants it waited for, even those that were never polled. */
+	if (ru) {
+		double cpu_time = ru->ru_utime.tv_sec + ru->ru_stime.tv_sec + ((double)(ru->ru_utime.tv_usec + ru->ru_stime.tv_usec)) / ONE_SECOND;
+		s->cpu_time = MAX(s->cpu_time, cpu_time);
+
+		/* ru_maxrss is in kB, and only covers the largest single process. */
+		s->memory = MAX(s->memory, DIV_INT_ROUND_UP((int64_t)ru->ru_maxrss, 1024));
+	}
+
+	if (s->wall_time > 0 && s->cpu_time >= 0) {
+		s->cores_avg = s->cpu_time / s->wall_time;
+		s->cores = MAX(s->cores, s->cores_avg);
+	}
+
+	/* As in the summaries of resource_monitor, the limits broken are only reported with this exit type. */
+	if (t->exceeded) {
+		s->exit_type = xxstrdup("limits");
+		s->limits_exceeded = t->exceeded;
+		t->exceeded = NULL;
+	}
+
+	tree_delete(t);
+
+	return s;
+}
+
+/* vim: set noexpandtab tabstop=8: */
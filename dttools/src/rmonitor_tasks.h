@@ -0,0 +1,52 @@
+/*
+Copyright (C) 2022 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef RMONITOR_TASKS_H
+#define RMONITOR_TASKS_H
+
+/*
+Measurement of many process trees from a single poller.
+A worker adds the root of each task it starts, and polls all of them
+at once from its own loop, rather than wrapping each task in its own
+resource_monitor. The descendants of each root are found through
+/proc/pid/task/pid/children, so no helper library is preloaded into
+the tasks, and processes that exit between two polls are only
+accounted for up to the last poll, or through the rusage of the root
+given when the tree is removed.
+*/
+
+#include "rmsummary.h"
+
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+struct rmonitor_tasks;
+
+struct rmonitor_tasks *rmonitor_tasks_create(void);
+void rmonitor_tasks_delete(struct rmonitor_tasks *m);
+
+/* Start measuring the process tree rooted at pid under the given id. If limits is not NULL, the tree is checked against a copy of limits at every poll. */
+void rmonitor_tasks_add(struct rmonitor_tasks *m, uint64_t id, pid_t pid, const struct rmsummary *limits);
+
+/*
+Stop measuring the tree id, and return the peak of its measurements,
+with limits_exceeded set if the tree went over its limits. ru is the
+rusage of the root, if it has been waited for, or NULL.
+Returns NULL if id is not being measured. The caller should delete the summary.
+*/
+struct rmsummary *rmonitor_tasks_remove(struct rmonitor_tasks *m, uint64_t id, const struct rusage *ru);
+
+/* Measure every tree once. Returns the number of trees that went over their limits in this poll. */
+int rmonitor_tasks_poll(struct rmonitor_tasks *m);
+
+/* Return 1 if the tree id has gone over its limits, 0 otherwise. */
+int rmonitor_tasks_exceeded(struct rmonitor_tasks *m, uint64_t id);
+
+/* Return the number of trees being measured. */
+int rmonitor_tasks_size(struct rmonitor_tasks *m);
+
+#endif
@@ -0,0 +1,156 @@
+/*
+Copyright (C) 2024 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "shape_index.h"
+#include "hash_table.h"
+#include "itable.h"
+#include "priority_queue.h"
+#include "xxmalloc.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+struct shape {
+	char *key;
+	struct priority_queue *items; // Indexed queue of the items of this shape.
+	void *data;                   // Made by data_create from the first item of the shape.
+};
+
+struct shape_index {
+	struct hash_table *shapes; // key -> shape
+	struct itable *item_shapes; // item pointer -> shape
+	int size;
+
+	shape_index_data_create_t data_create;
+	shape_index_data_delete_t data_delete;
+};
+
+struct shape_index *shape_index_create(shape_index_data_create_t data_create, shape_index_data_delete_t data_delete)
+{
+	struct shape_index *x = xxmalloc(sizeof(*x));
+
+	x->shapes = hash_table_create(0, 0);
+	x->item_shapes = itable_create(0);
+	x->size = 0;
+	x->data_create = data_create;
+	x->data_delete = data_delete;
+
+	return x;
+}
+
+static void shape_delete(struct shape_index *x, struct shape *s)
+{
+	if (x->data_delete && s->data)
+		x->data_delete(s->data);
+	priority_queue_delete(s->items);
+	free(s->key);
+	free(s);
+}
+
+void shape_index_delete(struct shape_index *x)
+{
+	char *key;
+	struct shape *s;
+
+	if (!x)
+		return;
+
+	HASH_TABLE_ITERATE(x->shapes, key, s)
+	{
+		shape_delete(x, s);
+	}
+
+	hash_table_delete(x->shapes);
+	itable_delete(x->item_shapes);
+	free(x);
+}
+
+void shape_index_insert(struct shape_index *x, void *item, const char *key, double priority)
+{
+	shape_index_remove(x, item);
+
+	struct shape *s = hash_table_lookup(x->shapes, key);
+	if (!s) {
+		s = xxmalloc(sizeof(*s));
+		s->key = xxstrdup(key);
+		s->items = priority_queue_create_indexed(0);
+		s->data = x->data_create ? x->data_create(item) : 0;
+		hash_table_insert(x->shapes, key, s);
+	}
+
+	priority_queue_push(s->items, item, priority);
+	itable_insert(x->item_shapes, (uintptr_t)item, s);
+	x->size++;
+}
+
+int shape_index_remove(struct shape_index *x, void *item)
+{
+	struct shape *s = itable_remove(x->item_shapes, (uintptr_t)item);
+	if (!s)
+		return 0;
+
+	priority_queue_remove(s->items, priority_queue_find_idx(s->items, item));
+	x->size--;
+
+	/* Drop shapes without items, so that tops only visits live shapes. */
+	if (priority_queue_size(s->items) == 0) {
+		hash_table_remove(x->shapes, s->key);
+		shape_delete(x, s);
+	}
+
+	return 1;
+}
+
+void *shape_index_data(struct shape_index *x, void *item)
+{
+	struct shape *s = itable_lookup(x->item_shapes, (uintptr_t)item);
+	return s ? s->data : 0;
+}
+
+int shape_index_size(struct shape_index *x)
+{
+	return x->size;
+}
+
+int shape_index_shapes(struct shape_index *x)
+{
+	return hash_table_size(x->shapes);
+}
+
+int shape_index_tops(struct shape_index *x, void **tops, int max)
+{
+	char *key;
+	struct shape *s;
+	double priorities[max > 0 ? max : 1];
+	int n = 0;
+
+	if (max < 1)
+		return 0;
+
+	/* Insertion sort, as the number of shapes considered is small. */
+	HASH_TABLE_ITERATE(x->shapes, key, s)
+	{
+		double p = priority_queue_get_priority(s->items, 0);
+
+		int i = n < max ? n++ : max;
+		while (i > 0 && priorities[i - 1] < p) {
+			if (i < max) {
+				priorities[i] = priorities[i - 1];
+				tops[i] = tops[i - 1];
+			}
+			i--;
+		}
+
+		if (i < max) {
+			priorities[i] = p;
+			tops[i] = priority_queue_peak_top(s->items);
+		}
+	}
+
+	return n;
+}
+
+/* vim: set noexpandtab tabstop=8: */
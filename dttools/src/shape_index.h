@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2024 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef SHAPE_INDEX_H
+#define SHAPE_INDEX_H
+
+/** @file shape_index.h
+Groups items waiting to be scheduled by shape.
+
+Each item is indexed under a shape key chosen by the caller, and each
+shape keeps its items in an indexed @ref priority_queue.h "priority queue".
+Items of the same shape make the same demands, so when the highest
+priority item of a shape cannot be placed, neither can the others,
+and a scheduler only needs to look at the top item of each shape.
+
+Each shape can also carry data made from its first item, such as the
+resources that all the items of the shape request, which stays the
+same while the shape has items.
+
+<pre>
+struct shape_index *x = shape_index_create(0, 0);
+shape_index_insert(x, task, "cores=1 memory=100", 5);
+
+struct task *tops[shape_index_shapes(x)];
+int n = shape_index_tops(x, (void **) tops, shape_index_shapes(x));
+</pre>
+*/
+
+/** Create data for a new shape, from the first item inserted in it. */
+typedef void *(*shape_index_data_create_t)(void *item);
+
+/** Delete the data of a shape once it has no items left. */
+typedef void (*shape_index_data_delete_t)(void *data);
+
+/** Create an empty shape index.
+@param data_create If not null, called to create the data of each new shape.
+@param data_delete If not null, called to delete the data of each shape that runs out of items.
+@return A pointer to a new shape index.
+*/
+struct shape_index *shape_index_create(shape_index_data_create_t data_create, shape_index_data_delete_t data_delete);
+
+/** Delete a shape index, and the data of its shapes. The items are not deleted.
+@param x A pointer to a shape index.
+*/
+void shape_index_delete(struct shape_index *x);
+
+/** Add an item to the queue of its shape.
+If the item is already in the index, it is moved to the given shape and priority.
+@param x A pointer to a shape index.
+@param item The item to add.
+@param key The shape of the item.
+@param priority The priority of the item among the items of its shape.
+*/
+void shape_index_insert(struct shape_index *x, void *item, const char *key, double priority);
+
+/** Remove an item from the index.
+@param x A pointer to a shape index.
+@param item The item to remove.
+@return One if the item was in the index, zero otherwise.
+*/
+int shape_index_remove(struct shape_index *x, void *item);
+
+/** Get the data of the shape of an item.
+@param x A pointer to a shape index.
+@param item An item in the index.
+@return The data of the shape of the item, or null if the item is not in the index.
+*/
+void *shape_index_data(struct shape_index *x, void *item);
+
+/** Count the items in the index.
+@param x A pointer to a shape index.
+@return The number of items in the index.
+*/
+int shape_index_size(struct shape_index *x);
+
+/** Count the shapes in the index.
+@param x A pointer to a shape index.
+@return The number of distinct shapes among the items in the index.
+*/
+int shape_index_shapes(struct shape_index *x);
+
+/** Get the highest priority item of each shape.
+@param x A pointer to a shape index.
+@param tops An array to fill with the highest priority item of up to max shapes, from the highest to the lowest priority.
+@param max The number of entries of tops.
+@return The number of items placed in tops.
+*/
+int shape_index_tops(struct shape_index *x, void **tops, int max);
+
+#endif
@@ -0,0 +1,89 @@
+/*
+Copyright (C) 2024 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "shape_index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int shapes_alive = 0;
+
+static void *data_create(void *item)
+{
+	shapes_alive++;
+	return strdup(item);
+}
+
+static void data_delete(void *data)
+{
+	shapes_alive--;
+	free(data);
+}
+
+#define CHECK(cond)                                                         \
+	do {                                                                    \
+		if (!(cond)) {                                                      \
+			fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #cond); \
+			return EXIT_FAILURE;                                            \
+		}                                                                   \
+	} while (0)
+
+int main()
+{
+	struct shape_index *x = shape_index_create(data_create, data_delete);
+
+	char *items[] = {"a1", "a2", "b1", "b2", "c1"};
+	const char *keys[] = {"a", "a", "b", "b", "c"};
+	double priorities[] = {1, 5, 3, 2, 4};
+	void *tops[3];
+	int i;
+
+	for (i = 0; i < 5; i++) {
+		shape_index_insert(x, items[i], keys[i], priorities[i]);
+	}
+
+	CHECK(shape_index_size(x) == 5);
+	CHECK(shape_index_shapes(x) == 3);
+	CHECK(shapes_alive == 3);
+	CHECK(!strcmp(shape_index_data(x, items[1]), "a1"));
+
+	/* the top of each shape, from the highest priority. */
+	CHECK(shape_index_tops(x, tops, 3) == 3);
+	CHECK(tops[0] == items[1] && tops[1] == items[4] && tops[2] == items[2]);
+
+	/* fewer entries than shapes keep the highest. */
+	CHECK(shape_index_tops(x, tops, 2) == 2);
+	CHECK(tops[0] == items[1] && tops[1] == items[4]);
+
+	/* removing the top of a shape exposes the next one. */
+	CHECK(shape_index_remove(x, items[1]));
+	CHECK(!shape_index_remove(x, items[1]));
+	CHECK(shape_index_data(x, items[1]) == 0);
+	CHECK(shape_index_tops(x, tops, 3) == 3);
+	CHECK(tops[0] == items[4] && tops[1] == items[2] && tops[2] == items[0]);
+
+	/* inserting again moves an item to its new shape and priority. */
+	shape_index_insert(x, items[4], "b", 0);
+	CHECK(shape_index_size(x) == 4);
+	CHECK(shape_index_shapes(x) == 2);
+	CHECK(shapes_alive == 2);
+	CHECK(!strcmp(shape_index_data(x, items[4]), "b1"));
+
+	/* shapes go away with their last item. */
+	CHECK(shape_index_remove(x, items[0]));
+	CHECK(shape_index_shapes(x) == 1);
+	CHECK(shapes_alive == 1);
+
+	shape_index_delete(x);
+	CHECK(shapes_alive == 0);
+
+	printf("shape index tests passed.\n");
+
+	return EXIT_SUCCESS;
+}
+
+/* vim: set noexpandtab tabstop=8: */
@@ -7,33 +7,61 @@ See the file COPYING for details.
 
 #include "sort_dir.h"
 #include "string_array.h"
+#include "buffer.h"
 
 #include <dirent.h>
 #include <stdlib.h>
 #include <string.h>
 
+/*
+qsort passes pointers to the elements of the array, which are themselves
+pointers to the names, so the comparison function of the caller is applied
+through this wrapper.
+*/
+
+static int (*sort_dir_compare)(const char *a, const char *b) = 0;
+
+static int sort_dir_compare_entries(const void *a, const void *b)
+{
+	return sort_dir_compare(*(const char **)a, *(const char **)b);
+}
+
+/*
+The names are gathered in a buffer first and then made into a string
+array at once, as appending to a string array one name at a time
+takes time quadratic in the number of entries.
+*/
+
 int sort_dir(const char *dirname, char ***list, int (*sort)(const char *a, const char *b))
 {
 	DIR *dir;
 	size_t n = 0;
-
-	*list = string_array_new();
+	size_t length;
+	buffer_t names;
 
 	dir = opendir(dirname);
-	if (dir) {
-		struct dirent *d;
-
-		while ((d = readdir(dir))) {
-			*list = string_array_append(*list, d->d_name);
-			n += 1;
-		}
-		closedir(dir);
-	} else {
+	if (!dir) {
+		*list = string_array_new();
 		return 0;
 	}
 
+	buffer_init(&names);
+
+	struct dirent *d;
+	while ((d = readdir(dir))) {
+		buffer_putlstring(&names, d->d_name, strlen(d->d_name) + 1);
+		n += 1;
+	}
+	closedir(dir);
+
+	const char *name = buffer_tolstring(&names, &length);
+	*list = string_array_new_from_block(name, length);
+
+	buffer_free(&names);
+
 	if (sort) {
-		qsort(*list, n, sizeof(char *), (int (*)(const void *, const void *))sort);
+		sort_dir_compare = sort;
+		qsort(*list, n, sizeof(char *), sort_dir_compare_entries);
 	}
 
 	return 1;
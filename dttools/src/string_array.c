@@ -4,6 +4,7 @@ This software is distributed under the GNU General Public License.
 See the file COPYING for details.
 */
 
+#include "string_array.h"
 #include "xxmalloc.h"
 
 #include <assert.h>
@@ -49,4 +50,27 @@ char **string_array_append(char **oarray, const char *str)
 	return narray;
 }
 
+char **string_array_new_from_block(const char *strings, size_t length)
+{
+	size_t i, n = 0;
+	for (i = 0; i < length; i++) {
+		if (strings[i] == '\0')
+			n++;
+	}
+
+	size_t header = (n + 1) * sizeof(char *) + sizeof(size_t);
+	char **array = xxrealloc(NULL, header + length);
+	*((size_t *)(array + n + 1)) = header + length;
+
+	char *data = ((char *)array) + header;
+	memcpy(data, strings, length);
+	for (i = 0; i < n; i++) {
+		array[i] = data;
+		data += strlen(data) + 1;
+	}
+	array[n] = NULL;
+
+	return array;
+}
+
 /* vim: set noexpandtab tabstop=8: */
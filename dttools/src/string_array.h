@@ -7,6 +7,8 @@ See the file COPYING for details.
 #ifndef STRING_ARRAY_H
 #define STRING_ARRAY_H
 
+#include <stddef.h>
+
 /** @file string_array.h Single Memory Block String Array.
 	Allows the creation of string array inside a single memory block that can
 	be therefore freed using free().  Pointers in the string array may move
@@ -26,4 +28,14 @@ char **string_array_new (void);
   */
 char **string_array_append (char **oarray, const char *str);
 
+/** Create a string array from a block of strings laid end to end, each
+	terminated by a NUL, in a single allocation. This is much faster than
+	appending the strings one at a time when there are many of them.
+
+	@param strings The strings, one after the other.
+	@param length The total length of strings in bytes, including the NULs.
+	@return New string array.
+  */
+char **string_array_new_from_block (const char *strings, size_t length);
+
 #endif /* STRING_ARRAY_H */
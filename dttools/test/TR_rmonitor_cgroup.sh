@@ -0,0 +1,30 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+exe="../src/rmonitor_cgroup_test"
+
+check_needed()
+{
+	# cgroups v2 must be delegated to us for the test to mean anything.
+	"$exe" check >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	return 0
+}
+
+run()
+{
+	exec "$exe"
+}
+
+clean()
+{
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -0,0 +1,29 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+exe="../src/rmonitor_poll_maps_test"
+
+check_needed()
+{
+	[ -r /proc/self/smaps_rollup ] || return 1
+}
+
+prepare()
+{
+	return 0
+}
+
+run()
+{
+	exec "$exe"
+}
+
+clean()
+{
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
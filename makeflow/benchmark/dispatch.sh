@@ -0,0 +1,63 @@
+#!/bin/bash
+
+# Measures how fast makeflow itself can dispatch rules, independent of any
+# batch system. Generates a synthetic DAG of <width> independent chains, each
+# <depth> rules long, and runs it with the dryrun batch system, which
+# completes every job as soon as it is submitted. The outputs are created
+# beforehand, so that makeflow finds them when each rule completes.
+#
+# For example, to time a workflow of one million rules:
+#     ./dispatch.sh 10000 100
+#
+# Set makeflow to run a makeflow other than the one in $PATH.
+
+if [ "$#" -lt 2 ]; then
+	echo "usage: $0 <width> <depth> [makeflow options]"
+	exit 1
+fi
+
+width=$1
+depth=$2
+shift 2
+
+makeflow=${makeflow:-makeflow}
+
+unset TESTDIR
+function cleanup {
+	rm -rf "$TESTDIR"
+}
+trap cleanup EXIT
+TESTDIR=$(mktemp -d)
+
+cd "$TESTDIR" || exit 1
+
+awk -v width="$width" -v depth="$depth" 'BEGIN {
+	for(i = 0; i < width; i++) {
+		printf("c.%d.0:\n\ttrue\n", i);
+		for(j = 1; j < depth; j++) {
+			printf("c.%d.%d: c.%d.%d\n\ttrue\n", i, j, i, j - 1);
+		}
+	}
+}' > dispatch.mf
+
+awk -v width="$width" -v depth="$depth" 'BEGIN {
+	for(i = 0; i < width; i++) for(j = 0; j < depth; j++) printf("c.%d.%d\n", i, j);
+}' | xargs touch
+
+rules=$((width * depth))
+
+start=$(date +%s.%N)
+"$makeflow" -T dryrun "$@" dispatch.mf > makeflow.out 2>&1
+status=$?
+end=$(date +%s.%N)
+
+if [ $status -ne 0 ]; then
+	tail makeflow.out
+	echo "makeflow failed with status $status"
+	exit $status
+fi
+
+awk -v rules="$rules" -v start="$start" -v end="$end" 'BEGIN {
+	elapsed = end - start;
+	printf("%d rules in %.2f s: %.0f rules/s\n", rules, elapsed, rules / elapsed);
+}'
@@ -191,6 +191,72 @@ void dag_count_states(struct dag *d)
 	}
 }
 
+/*
+The ready list is the frontier of the dag: the nodes that are waiting and
+whose sources should all exist. Rather than checking every node of the dag
+for each dispatch, each node counts its sources that should not exist yet,
+and the count is updated only as the files it needs change state.
+*/
+
+void dag_ready_init(struct dag *d)
+{
+	struct dag_node *n;
+	struct dag_file *f;
+
+	if(d->ready_nodes) {
+		list_delete(d->ready_nodes);
+	}
+	d->ready_nodes = list_create();
+
+	for(n = d->nodes; n; n = n->next) {
+		n->sources_pending = 0;
+		n->ready_listed = 0;
+
+		list_first_item(n->source_files);
+		while((f = list_next_item(n->source_files))) {
+			if(!dag_file_should_exist(f)) {
+				n->sources_pending++;
+			}
+		}
+
+		dag_ready_node_update(d, n);
+	}
+}
+
+void dag_ready_node_update(struct dag *d, struct dag_node *n)
+{
+	if(!d->ready_nodes || n->ready_listed) {
+		return;
+	}
+
+	if(n->state == DAG_NODE_STATE_WAITING && n->sources_pending == 0) {
+		list_push_tail(d->ready_nodes, n);
+		n->ready_listed = 1;
+	}
+}
+
+void dag_ready_file_update(struct dag *d, struct dag_file *f, int existed)
+{
+	struct dag_node *n;
+
+	if(!d->ready_nodes) {
+		return;
+	}
+
+	int exists = dag_file_should_exist(f);
+	if(exists == existed) {
+		return;
+	}
+
+	/* Use a cursor, as callers may be iterating over needed_by themselves. */
+	struct list_cursor *cur = list_cursor_create(f->needed_by);
+	for(list_seek(cur, 0); list_get(cur, (void **) &n); list_next(cur)) {
+		n->sources_pending += exists ? -1 : 1;
+		dag_ready_node_update(d, n);
+	}
+	list_cursor_destroy(cur);
+}
+
 /**
  * If the return value is x, a positive integer, that means at least x tasks
  * can be run in parallel during a certain point of the execution of the
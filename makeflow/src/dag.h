@@ -42,6 +42,7 @@ struct dag {
 
 	struct itable *local_job_table;     /* Mapping from unique integers dag_node->jobid to nodes, rules with prefix LOCAL. */
 	struct itable *remote_job_table;    /* Mapping from unique integers dag_node->jobid to nodes. */
+	struct list *ready_nodes;           /* Waiting nodes whose sources should all exist, in the order they became ready. */
 	int completed_files;                /* Keeps a count of the rules in state recieved or beyond. */
 	int deleted_files;                  /* Keeps a count of the files delete in GC. */
 
@@ -58,6 +59,14 @@ void dag_compile_ancestors(struct dag *d);
 void dag_find_ancestor_depth(struct dag *d);
 void dag_count_states(struct dag *d);
 
+/* Build the list of ready nodes, and from then on keep it up to date as nodes and files change state. */
+void dag_ready_init(struct dag *d);
+/* Add n to the ready list if it is waiting and all its sources should exist. */
+void dag_ready_node_update(struct dag *d, struct dag_node *n);
+struct dag_file;
+/* Account for a change of state of f, which should (existed=1) or should not (existed=0) have existed before. */
+void dag_ready_file_update(struct dag *d, struct dag_file *f, int existed);
+
 struct dag_file *dag_file_lookup_or_create(struct dag *d, const char *filename);
 struct dag_file *dag_file_from_name(struct dag *d, const char *filename);
 
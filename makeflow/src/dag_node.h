@@ -87,6 +87,8 @@ struct dag_node {
 	dag_node_state_t state;             /* Enum: DAG_NODE_STATE_{WAITING,RUNNING,...} */
 	int failure_count;                  /* How many times has this rule failed? (see -R and -r) */
 	time_t previous_completion;
+	int sources_pending;                /* Number of source files that should not exist yet. (see dag_ready_init) */
+	int ready_listed;                   /* Non-zero if the node is in dag->ready_nodes. */
 
 	const char *umbrella_spec;          /* the umbrella spec file for executing this job */
 	
@@ -64,6 +64,7 @@ See the file COPYING for details.
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 /*
 Code organization notes:
@@ -179,6 +180,21 @@ before starting the dag, instead proceed under optimistic assumptions.
 
 static int skip_file_check = 0;
 
+/*
+Number of threads that stat files at once when checking files.
+On a shared filesystem each stat waits on a server, so issuing
+many at once hides most of that latency.
+*/
+
+static int file_check_threads = 16;
+
+/*
+Seconds between checkpoints of the makeflow log, or zero to not
+write checkpoints.  Default to 300s.
+*/
+
+static unsigned int log_checkpoint_interval = 300;
+
 /*
 Control caching within the underlying batch system, if supported.
 May be "task", "workflow", or "worker", or "forever".
@@ -728,6 +744,8 @@ int makeflow_nodes_remote_waiting_count(const struct dag *d) {
 
 /*
 Find all jobs ready to be run, then submit them.
+Only the nodes in d->ready_nodes are considered, as the
+other nodes still wait for some of their sources.
 */
 
 static void makeflow_dispatch_ready_jobs(struct dag *d)
@@ -744,17 +762,39 @@ static void makeflow_dispatch_ready_jobs(struct dag *d)
 	 */
 	int submission_timeout = 0;
 
-	for(n = d->nodes; n; n = n->next) {
-		if(dag_remote_jobs_running(d) >= remote_jobs_max && dag_local_jobs_running(d) >= local_jobs_max) {
+	struct list_cursor *cur = list_cursor_create(d->ready_nodes);
+	for(list_seek(cur, 0); list_get(cur, (void **) &n); list_next(cur)) {
+		/* Without a local queue, local jobs go to the remote queue. */
+		int remote_full = dag_remote_jobs_running(d) >= remote_jobs_max;
+		int local_full = !local_queue || dag_local_jobs_running(d) >= local_jobs_max;
+
+		if(remote_full && local_full) {
 			break;
 		}
 
+		/* Nodes that are no longer ready are listed again once they are. */
+		if(n->state != DAG_NODE_STATE_WAITING || n->sources_pending > 0) {
+			list_drop(cur);
+			n->ready_listed = 0;
+			continue;
+		}
+
+		/* Skip the nodes whose queue is full before computing their resources. */
+		if(n->local_job && local_queue ? local_full : remote_full) {
+			continue;
+		}
+
 		const struct rmsummary *resources = dag_node_dynamic_label(n);
 
 		if(makeflow_node_ready(d, n, resources)) {
 			if(is_local_job(n) || !submission_timeout) {
 				enum job_submit_status status = makeflow_node_submit(d, n, resources);
 
+				if(n->state != DAG_NODE_STATE_WAITING) {
+					list_drop(cur);
+					n->ready_listed = 0;
+				}
+
 				if(status == JOB_SUBMISSION_ABORTED) {
 					break;
 				} else if(status == JOB_SUBMISSION_TIMEOUT) {
@@ -764,6 +804,7 @@ static void makeflow_dispatch_ready_jobs(struct dag *d)
 			}
 		}
 	}
+	list_cursor_destroy(cur);
 }
 
 /*
@@ -939,16 +980,79 @@ whether provided by the user, or created by
 a prior run that was logged.
 */
 
+struct file_check {
+	struct dag_file **files;
+	struct stat *info;
+	int *result;
+	int count;
+	int next;
+	pthread_mutex_t mutex;
+};
+
+static void *makeflow_check_files_thread(void *arg)
+{
+	struct file_check *c = arg;
+
+	while(1) {
+		pthread_mutex_lock(&c->mutex);
+		int i = c->next++;
+		pthread_mutex_unlock(&c->mutex);
+
+		if(i >= c->count) break;
+
+		c->result[i] = stat(c->files[i]->filename, &c->info[i]);
+	}
+
+	return 0;
+}
+
+/*
+Stat the files of c with up to nthreads threads, including the calling one.
+*/
+
+static void makeflow_check_files_stat(struct file_check *c, int nthreads)
+{
+	nthreads = MAX(1, MIN(nthreads, c->count));
+
+	pthread_t *threads = xxmalloc(sizeof(*threads) * nthreads);
+	int i, started = 0;
+
+	for(i = 1; i < nthreads; i++) {
+		if(pthread_create(&threads[started], NULL, makeflow_check_files_thread, c) != 0) {
+			debug(D_MAKEFLOW_RUN, "couldn't start file check thread: %s", strerror(errno));
+			break;
+		}
+		started++;
+	}
+
+	makeflow_check_files_thread(c);
+
+	for(i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	free(threads);
+}
+
 static int makeflow_check_files(struct dag *d)
 {
-	struct stat buf;
 	struct dag_file *f;
 	char *name;
 	int errors = 0;
 	int warnings = 0;
+	int i;
 
 	printf("checking files for unexpected changes...  (use --skip-file-check to skip this step)\n");
 
+	struct file_check c;
+	int size = hash_table_size(d->files);
+	c.files = xxmalloc(sizeof(*c.files) * MAX(size, 1));
+	c.info = xxmalloc(sizeof(*c.info) * MAX(size, 1));
+	c.result = xxmalloc(sizeof(*c.result) * MAX(size, 1));
+	c.count = 0;
+	c.next = 0;
+	pthread_mutex_init(&c.mutex, NULL);
+
 	hash_table_firstkey(d->files);
 	while(hash_table_nextkey(d->files, &name, (void **) &f)) {
 
@@ -958,8 +1062,19 @@ static int makeflow_check_files(struct dag *d)
 		/* Skip any file that should not exist yet. */
 		if(!dag_file_should_exist(f)) continue;
 
-		/* Check for the presence of the file. */
-		int result = stat(f->filename, &buf );
+		c.files[c.count++] = f;
+	}
+
+	/* Check for the presence of the files all at once. */
+	makeflow_check_files_stat(&c, file_check_threads);
+
+	for(i = 0; i < c.count; i++) {
+		f = c.files[i];
+		struct stat *buf = &c.info[i];
+		int result = c.result[i];
+
+		/* Resetting an earlier node may have reset this file too. */
+		if(!dag_file_should_exist(f)) continue;
 
 		if(dag_file_is_source(f)) {
 			/* Source files must exist before running */
@@ -975,7 +1090,7 @@ static int makeflow_check_files(struct dag *d)
 				makeflow_log_file_state_change(d, f, DAG_FILE_STATE_UNKNOWN);
 				makeflow_node_reset(d,f->created_by);
 				warnings++;
-			} else if(!S_ISDIR(buf.st_mode) && difftime(buf.st_mtime, f->creation_logged) > 0) {
+			} else if(!S_ISDIR(buf->st_mode) && difftime(buf->st_mtime, f->creation_logged) > 0) {
 				/* Recreate descendants by resetting all nodes that consume this file. */
 				printf("warning: %s was previously created by makeflow, but someone else modified it!\n",f->filename);
 				makeflow_node_reset_by_file(d,f);
@@ -984,6 +1099,11 @@ static int makeflow_check_files(struct dag *d)
 		}
 	}
 
+	pthread_mutex_destroy(&c.mutex);
+	free(c.files);
+	free(c.info);
+	free(c.result);
+
 	if(errors>0 || warnings>0) {
 		printf("found %d errors and %d warnings during consistency check.\n", errors,warnings);
 	}
@@ -1052,6 +1172,10 @@ static void makeflow_run( struct dag *d )
 	if(file_status_on){
 		makeflow_file_summary(d, project, batch_queue_type, start, file_status_name);
 	}
+
+	dag_ready_init(d);
+
+	time_t last_checkpoint = time(0);
 	
 	while(!makeflow_abort_flag) {
 		makeflow_dispatch_ready_jobs(d);
@@ -1069,10 +1193,19 @@ static void makeflow_run( struct dag *d )
 			break;
 		}
 
+		/*
+			Wait for the first job to complete, and then collect
+			every other job that has already completed, so that the
+			rules they enable are all dispatched in the next pass.
+			Work Queue waits at least a second even when the stoptime
+			has passed, so with it only one job is collected per pass.
+		*/
 		if(dag_remote_jobs_running(d)) {
 			int tmp_timeout = 5;
-			jobid = batch_queue_wait_timeout(remote_queue, &info, time(0) + tmp_timeout);
-			if(jobid > 0) {
+			time_t stoptime = time(0) + tmp_timeout;
+			int drain = batch_queue_get_type(remote_queue) != BATCH_QUEUE_TYPE_WORK_QUEUE;
+
+			while(dag_remote_jobs_running(d) && (jobid = batch_queue_wait_timeout(remote_queue, &info, stoptime)) > 0) {
 				printf("job %"PRIbjid" completed\n",jobid);
 				debug(D_MAKEFLOW_RUN, "Job %" PRIbjid " has returned.\n", jobid);
 				n = itable_remove(d->remote_job_table, jobid);
@@ -1081,6 +1214,10 @@ static void makeflow_run( struct dag *d )
 					batch_job_set_info(n->task, &info);
 					makeflow_node_complete(d, n, remote_queue, n->task);
 				}
+				if(!drain) {
+					break;
+				}
+				stoptime = time(0);
 			}
 		}
 
@@ -1094,8 +1231,7 @@ static void makeflow_run( struct dag *d )
 				stoptime = time(0) + tmp_timeout;
 			}
 
-			jobid = batch_queue_wait_timeout(local_queue, &info, stoptime);
-			if(jobid > 0) {
+			while(dag_local_jobs_running(d) && (jobid = batch_queue_wait_timeout(local_queue, &info, stoptime)) > 0) {
 				debug(D_MAKEFLOW_RUN, "Job %" PRIbjid " has returned.\n", jobid);
 				n = itable_remove(d->local_job_table, jobid);
 				if(n){
@@ -1103,6 +1239,7 @@ static void makeflow_run( struct dag *d )
 					batch_job_set_info(n->task, &info);
 					makeflow_node_complete(d, n, local_queue, n->task);
 				}
+				stoptime = time(0);
 			}
 		}
 
@@ -1122,6 +1259,12 @@ static void makeflow_run( struct dag *d )
 			last_time = now; 
 		}
 
+		/* Checkpoint the log, so that a restart need not read all of it. */
+		if(log_checkpoint_interval > 0 && (time(0) - last_checkpoint) >= log_checkpoint_interval) {
+			makeflow_log_checkpoint(d);
+			last_checkpoint = time(0);
+		}
+
 		/* Rather than try to garbage collect after each time in this
 		 * wait loop, perform garbage collection after a proportional
 		 * amount of tasks have passed. */
@@ -1196,6 +1339,8 @@ static void show_help_run(const char *cmd)
 	printf("    --jx-args=<file>            File defining JX variables for JX workflow.\n");
 	printf("    --jx-define=<VAR>=<EXPR>	Set the JX variable VAR to JX expression EXPR.\n");
 	printf("    --log-verbose               Add node id symbol tags in the makeflow log.\n");
+	printf("    --log-checkpoint-interval=<n> Checkpoint the makeflow log every <n> seconds.\n");
+	printf("                                  (default is 300, 0 disables checkpoints)\n");
 	printf(" -j,--max-local=<#>             Max number of local jobs to run at once.\n");
 	printf(" -J,--max-remote=<#>            Max number of remote jobs to run at once.\n");
 	printf(" -R,--retry                     Retry failed batch jobs up to 5 times.\n");
@@ -1224,6 +1369,7 @@ static void show_help_run(const char *cmd)
 	printf(" -G,--gc-count=<int>            Set number of files to trigger GC.(ref_cnt only)\n");
 	printf("    --mounts=<mountfile>        Use this file as a mountlist\n");
 	printf("    --skip-file-check           Do not check for file existence before running.\n");
+	printf("    --file-check-threads=<n>    Check up to <n> files at once. (default is 16)\n");
 	printf("    --do-not-save-failed-output Disables saving failed nodes to directory.\n"); 
 	printf("    --shared-fs=<dir>           Assume that <dir> is in a shared filesystem.\n");
 	printf("    --storage-limit=<int>       Set storage limit for Makeflow.(default is off)\n");
@@ -1486,6 +1632,8 @@ int main(int argc, char *argv[])
 		LONG_OPT_TLQ,
 		LONG_OPT_FILE_STATUS,
 		LONG_OPT_FILE_STATUS_INTERVAL,
+		LONG_OPT_FILE_CHECK_THREADS,
+		LONG_OPT_LOG_CHECKPOINT_INTERVAL,
 		LONG_OPT_DISABLE_HEARTBEAT
 	};
 
@@ -1604,6 +1752,8 @@ int main(int argc, char *argv[])
 		{"tlq", required_argument, 0, LONG_OPT_TLQ},
 		{"file-status", required_argument, 0, LONG_OPT_FILE_STATUS},
 		{"file-status-interval", required_argument, 0, LONG_OPT_FILE_STATUS_INTERVAL},
+		{"file-check-threads", required_argument, 0, LONG_OPT_FILE_CHECK_THREADS},
+		{"log-checkpoint-interval", required_argument, 0, LONG_OPT_LOG_CHECKPOINT_INTERVAL},
 		{0, 0, 0, 0}
 	};
 
@@ -2121,6 +2271,12 @@ int main(int argc, char *argv[])
 			case LONG_OPT_FILE_STATUS_INTERVAL:
 				file_status_on = 1;
 				file_status_interval = atoi(optarg);
+				break;
+			case LONG_OPT_FILE_CHECK_THREADS:
+				file_check_threads = MAX(1, atoi(optarg));
+				break;
+			case LONG_OPT_LOG_CHECKPOINT_INTERVAL:
+				log_checkpoint_interval = atoi(optarg);
 				break;			
 			default:
 				show_help_run(argv[0]);
@@ -2459,6 +2615,9 @@ int main(int argc, char *argv[])
 		}
 
 		if(clean_mode == MAKEFLOW_CLEAN_ALL) {
+			char *checkpointname = makeflow_log_checkpoint_name(logfilename);
+			unlink(checkpointname);
+			free(checkpointname);
 			unlink(logfilename);
 			unlink(batchlogfilename);
 		}
@@ -9,12 +9,15 @@ See the file COPYING for details.
 #include "makeflow_gc.h"
 #include "dag.h"
 #include "get_line.h"
+#include "md5.h"
+#include "macros.h"
 #include "makeflow_mounts.h"
 
 #include "timestamp.h"
 #include "list.h"
 #include "debug.h"
 #include "xxmalloc.h"
+#include "stringtools.h"
 
 #include <limits.h>
 #include <stdio.h>
@@ -22,6 +25,7 @@ See the file COPYING for details.
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 #define MAX_BUFFER_SIZE 4096
 
@@ -195,7 +199,12 @@ void makeflow_log_state_change( struct dag *d, struct dag_node *n, int newstate
 	n->state = newstate;
 	d->node_states[n->state]++;
 
-	fprintf(d->logfile, "%" PRIu64 " %d %d %" PRIbjid " %d %d %d %d %d %d\n", timestamp_get(), n->nodeid, newstate, n->jobid, d->node_states[0], d->node_states[1], d->node_states[2], d->node_states[3], d->node_states[4], d->nodeid_counter);
+	dag_ready_node_update(d, n);
+
+	timestamp_t time = timestamp_get();
+	n->previous_completion = (time_t) (time / 1000000);
+
+	fprintf(d->logfile, "%" PRIu64 " %d %d %" PRIbjid " %d %d %d %d %d %d\n", time, n->nodeid, newstate, n->jobid, d->node_states[0], d->node_states[1], d->node_states[2], d->node_states[3], d->node_states[4], d->nodeid_counter);
 
 	makeflow_log_sync(d,0);
 }
@@ -204,7 +213,9 @@ void makeflow_log_file_state_change( struct dag *d, struct dag_file *f, int news
 {
 	debug(D_MAKEFLOW_RUN, "file %s %s -> %s\n", f->filename, dag_file_state_name(f->state), dag_file_state_name(newstate));
 
+	int existed = dag_file_should_exist(f);
 	f->state = newstate;
+	dag_ready_file_update(d, f, existed);
 
 	/* If a file is a wrapper global file do not log to avoid cleaning floating global files. */
 	if(f->type == DAG_FILE_TYPE_GLOBAL) return;
@@ -312,6 +323,249 @@ void makeflow_log_dag_structure( struct dag *d )
 	}
 }
 
+/*
+Apply one line of the log (or of a checkpoint) to the dag.
+Returns 1 on success, 0 if the line cannot be parsed,
+and -1 if it conflicts with the current configuration.
+*/
+
+static int makeflow_log_recover_line( struct dag *d, const char *line )
+{
+	char file[MAX_BUFFER_SIZE], source[PATH_MAX], cache_dir[NAME_MAX], cache_name[NAME_MAX];
+	int nodeid, state, jobid, file_state, type;
+	struct dag_node *n;
+	struct dag_file *f;
+	timestamp_t previous_completion_time;
+	uint64_t size;
+
+	if(sscanf(line, "# FILE %" SCNu64 " %s %d %" SCNu64 "", &previous_completion_time, file, &file_state, &size) == 4) {
+		f = dag_file_lookup_or_create(d, file);
+		f->state = file_state;
+		if(file_state == DAG_FILE_STATE_EXISTS){
+			d->completed_files += 1;
+			f->creation_logged = (time_t) (previous_completion_time / 1000000);
+		} else if(file_state == DAG_FILE_STATE_DELETE){
+			d->deleted_files += 1;
+		}
+	} else if(sscanf(line, "# CACHE %" SCNu64 " %s", &previous_completion_time, cache_dir) == 2) {
+		/* if the user specifies a cache dir using --cache dir, ignore the info from the log file */
+		if(!d->cache_dir) {
+			d->cache_dir = xxstrdup(cache_dir);
+		} else {
+			/* There are two possible reasons for the inconsistency:
+			 * 1) the cache dir specified via the --cache opt and in the log file mismatch;
+			 * 2) the log file includes multiple different CACHE entries.
+			 */
+			if(strcmp(cache_dir, d->cache_dir)) {
+				fprintf(stderr, "The --cache option (%s) does not match the cache dir (%s) in the log file!\n", d->cache_dir, cache_dir);
+				return -1;
+			}
+		}
+	} else if(sscanf(line, "# MOUNT %" SCNu64 " %s %s %s %d", &previous_completion_time, file, source, cache_name, &type) == 5) {
+		f = dag_file_lookup_or_create(d, file);
+
+		if(!f->source) {
+			f->source = xxstrdup(source);
+			f->cache_name = xxstrdup(cache_name);
+			f->type = type;
+		} else {
+			/* If a mount entry is specified in the mountfile and logged in a log file at the same time, they must not conflict with each other. */
+			/* If a mount entry is logged in a log file multiple times deliberately or not, they must not conflict with each other. */
+			if(makeflow_mount_check_consistency(file, f->source, source, d->cache_dir, cache_name)) {
+				return -1;
+			}
+		}
+	} else if(line[0] == '#') {
+		/* Ignore any other comment lines */
+	} else if(sscanf(line, "%" SCNu64 " %d %d %d", &previous_completion_time, &nodeid, &state, &jobid) == 4) {
+		n = itable_lookup(d->node_table, nodeid);
+		if(n) {
+			n->state = state;
+			n->jobid = jobid;
+			/* Log timestamp is in microseconds, we need seconds for diff. */
+			n->previous_completion = (time_t) (previous_completion_time / 1000000);
+		}
+	} else {
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+A checkpoint is a compact copy of the state recorded by the log,
+written in the same line format, so that a restart reads it and
+then only the part of the log written after it, instead of every
+transition of every node since the workflow began.  The header
+names the log it summarizes, how many bytes of it, and a digest of
+the first and last bytes of that part of the log:
+
+# CHECKPOINT timestamp log_device log_inode log_offset log_digest completed_files deleted_files
+
+The checkpoint is ignored if the log has since been replaced, even by
+a log of another run that happens to reuse the same inode.
+*/
+
+#define CHECKPOINT_DIGEST_BYTES 4096
+
+static char *checkpoint_filename = 0;
+
+/* Digest the first and the last CHECKPOINT_DIGEST_BYTES of the first offset bytes of the log. Returns 0 if they cannot be read. */
+static int makeflow_log_digest( FILE *log, off_t offset, char *digest )
+{
+	char buffer[CHECKPOINT_DIGEST_BYTES];
+	unsigned char md5[MD5_DIGEST_LENGTH];
+	md5_context_t context;
+	off_t starts[2];
+	int i;
+
+	starts[0] = 0;
+	starts[1] = MAX(0, offset - CHECKPOINT_DIGEST_BYTES);
+
+	md5_init(&context);
+	for(i = 0; i < 2; i++) {
+		size_t length = MIN(offset - starts[i], CHECKPOINT_DIGEST_BYTES);
+		if(pread(fileno(log), buffer, length, starts[i]) != (ssize_t) length) return 0;
+		md5_update(&context, buffer, length);
+	}
+	md5_final(md5, &context);
+
+	strcpy(digest, md5_to_string(md5));
+	return 1;
+}
+
+char *makeflow_log_checkpoint_name( const char *logfilename )
+{
+	return string_format("%s.checkpoint", logfilename);
+}
+
+void makeflow_log_checkpoint( struct dag *d )
+{
+	struct dag_node *n;
+	struct dag_file *f;
+	struct stat info;
+	char *name;
+
+	if(!d || !d->logfile || !checkpoint_filename) return;
+
+	/* The checkpoint must not refer to log data that could still be lost. */
+	makeflow_log_sync(d,1);
+
+	char digest[MD5_DIGEST_LENGTH_HEX + 1];
+	off_t offset = ftello(d->logfile);
+	if(offset <= 0 || fstat(fileno(d->logfile), &info) < 0 || !makeflow_log_digest(d->logfile, offset, digest)) return;
+
+	char *tmpname = string_format("%s.tmp", checkpoint_filename);
+	FILE *file = fopen(tmpname, "w");
+	if(!file) {
+		debug(D_MAKEFLOW_RUN, "couldn't write checkpoint %s: %s", tmpname, strerror(errno));
+		free(tmpname);
+		return;
+	}
+
+	timestamp_t now = timestamp_get();
+
+	fprintf(file, "# CHECKPOINT %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %s %d %d\n", now, (uint64_t) info.st_dev, (uint64_t) info.st_ino, (uint64_t) offset, digest, d->completed_files, d->deleted_files);
+
+	if(d->cache_dir) {
+		fprintf(file, "# CACHE %" PRIu64 " %s\n", now, d->cache_dir);
+	}
+
+	hash_table_firstkey(d->files);
+	while(hash_table_nextkey(d->files, &name, (void **) &f)) {
+		if(f->source) {
+			fprintf(file, "# MOUNT %" PRIu64 " %s %s %s %d\n", now, f->filename, f->source, f->cache_name, f->source_type);
+		}
+
+		if(f->type == DAG_FILE_TYPE_GLOBAL) continue;
+
+		/* Keep the creation time of files that exist, even if they moved on to another state. */
+		if(f->creation_logged && f->state != DAG_FILE_STATE_EXISTS) {
+			fprintf(file, "# FILE %" PRIu64 " %s %d %" PRIu64 "\n", (uint64_t) f->creation_logged * 1000000, f->filename, DAG_FILE_STATE_EXISTS, dag_file_size(f));
+		}
+
+		if(f->creation_logged || f->state != DAG_FILE_STATE_UNKNOWN) {
+			timestamp_t time = f->state == DAG_FILE_STATE_EXISTS ? (timestamp_t) f->creation_logged * 1000000 : now;
+			fprintf(file, "# FILE %" PRIu64 " %s %d %" PRIu64 "\n", time, f->filename, f->state, dag_file_size(f));
+		}
+	}
+
+	for(n = d->nodes; n; n = n->next) {
+		if(n->state == DAG_NODE_STATE_WAITING && !n->jobid && !n->previous_completion) continue;
+		fprintf(file, "%" PRIu64 " %d %d %" PRIbjid "\n", (uint64_t) n->previous_completion * 1000000, n->nodeid, n->state, n->jobid);
+	}
+
+	int ok = !ferror(file) && fflush(file) == 0 && fsync(fileno(file)) == 0;
+	ok = (fclose(file) == 0) && ok;
+
+	if(ok && rename(tmpname, checkpoint_filename) == 0) {
+		debug(D_MAKEFLOW_RUN, "checkpoint %s covers %" PRIu64 " bytes of the log", checkpoint_filename, (uint64_t) offset);
+	} else {
+		debug(D_MAKEFLOW_RUN, "couldn't write checkpoint %s: %s", checkpoint_filename, strerror(errno));
+		unlink(tmpname);
+	}
+
+	free(tmpname);
+}
+
+/*
+Load the checkpoint of the log, if there is a valid one, and return
+the offset of the log from which to continue the recovery.
+Returns 0 if the whole log must be read, and -1 on a conflict.
+*/
+
+static off_t makeflow_log_recover_checkpoint( struct dag *d, FILE *log )
+{
+	uint64_t device, inode, offset;
+	char digest[MD5_DIGEST_LENGTH_HEX + 1];
+	char log_digest[MD5_DIGEST_LENGTH_HEX + 1];
+	int completed_files, deleted_files;
+	struct stat info;
+	char *line;
+
+	FILE *file = fopen(checkpoint_filename, "r");
+	if(!file) return 0;
+
+	line = get_line(file);
+	int valid = line && sscanf(line, "# CHECKPOINT %*s %" SCNu64 " %" SCNu64 " %" SCNu64 " %32s %d %d", &device, &inode, &offset, digest, &completed_files, &deleted_files) == 6;
+	free(line);
+
+	/* The checkpoint must describe a prefix of this very log, ending at a complete line. */
+	valid = valid && fstat(fileno(log), &info) == 0 && info.st_dev == (dev_t) device && info.st_ino == (ino_t) inode && (uint64_t) info.st_size >= offset && offset > 0;
+	valid = valid && makeflow_log_digest(log, offset, log_digest) && !strcmp(digest, log_digest);
+	valid = valid && fseeko(log, offset - 1, SEEK_SET) == 0 && fgetc(log) == '\n';
+
+	if(!valid) {
+		printf("ignoring stale checkpoint %s\n", checkpoint_filename);
+		fclose(file);
+		fseeko(log, 0, SEEK_SET);
+		return 0;
+	}
+
+	printf("recovering from checkpoint %s...\n", checkpoint_filename);
+
+	int linenum = 1;
+	while((line = get_line(file))) {
+		linenum++;
+		int result = makeflow_log_recover_line(d, line);
+		free(line);
+		if(result < 0) {
+			fclose(file);
+			return -1;
+		} else if(result == 0) {
+			fprintf(stderr, "makeflow: %s appears to be corrupted on line %d\n", checkpoint_filename, linenum);
+			exit(1);
+		}
+	}
+	fclose(file);
+
+	/* The checkpoint replays each file once, so restore the totals of the log. */
+	d->completed_files = completed_files;
+	d->deleted_files = deleted_files;
+
+	return offset;
+}
+
 /*
 Recover the state of the workflow so far by reading back the state
 from the log file, if it exists.  (If not, create a new log.)
@@ -319,13 +573,12 @@ from the log file, if it exists.  (If not, create a new log.)
 
 int makeflow_log_recover(struct dag *d, const char *filename, int verbose_mode, struct batch_queue *queue, makeflow_clean_depth clean_mode )
 {
-	char *line, file[MAX_BUFFER_SIZE];
-	int nodeid, state, jobid, file_state;
+	char *line;
 	int first_run = 1;
 	struct dag_node *n;
-	struct dag_file *f;
-	timestamp_t previous_completion_time;
-	uint64_t size;
+
+	free(checkpoint_filename);
+	checkpoint_filename = makeflow_log_checkpoint_name(filename);
 
 	d->logfile = fopen(filename, "r");
 	if(d->logfile) {
@@ -334,73 +587,38 @@ int makeflow_log_recover(struct dag *d, const char *filename, int verbose_mode,
 
 		printf("recovering from log file %s...\n",filename);
 
+		off_t offset = makeflow_log_recover_checkpoint(d, d->logfile);
+		if(offset < 0) {
+			fclose(d->logfile);
+			return -1;
+		}
+
 		while((line = get_line(d->logfile))) {
-			char source[PATH_MAX], cache_dir[NAME_MAX], cache_name[NAME_MAX];
-			int type;
 			linenum++;
 
-			if(sscanf(line, "# FILE %" SCNu64 " %s %d %" SCNu64 "", &previous_completion_time, file, &file_state, &size) == 4) {
-				f = dag_file_lookup_or_create(d, file);
-				f->state = file_state;
-				if(file_state == DAG_FILE_STATE_EXISTS){
-					d->completed_files += 1;
-					f->creation_logged = (time_t) (previous_completion_time / 1000000);
-				} else if(file_state == DAG_FILE_STATE_DELETE){
-					d->deleted_files += 1;
-				}
-			} else if(sscanf(line, "# CACHE %" SCNu64 " %s", &previous_completion_time, cache_dir) == 2) {
-				/* if the user specifies a cache dir using --cache dir, ignore the info from the log file */
-				if(!d->cache_dir) {
-					d->cache_dir = xxstrdup(cache_dir);
-				} else {
-					/* There are two possible reasons for the inconsistency:
-					 * 1) the cache dir specified via the --cache opt and in the log file mismatch;
-					 * 2) the log file includes multiple different CACHE entries.
-					 */
-					if(strcmp(cache_dir, d->cache_dir)) {
-						fprintf(stderr, "The --cache option (%s) does not match the cache dir (%s) in the log file!\n", d->cache_dir, cache_dir);
-						free(line);
-						return -1;
-					}
-				}
-			} else if(sscanf(line, "# MOUNT %" SCNu64 " %s %s %s %d", &previous_completion_time, file, source, cache_name, &type) == 5) {
-				f = dag_file_lookup_or_create(d, file);
-
-				if(!f->source) {
-					f->source = xxstrdup(source);
-					f->cache_name = xxstrdup(cache_name);
-					f->type = type;
-				} else {
-					/* If a mount entry is specified in the mountfile and logged in a log file at the same time, they must not conflict with each other. */
-					/* If a mount entry is logged in a log file multiple times deliberately or not, they must not conflict with each other. */
-					if(makeflow_mount_check_consistency(file, f->source, source, d->cache_dir, cache_name)) {
-						free(line);
-						return -1;
-					}
-				}
-			} else if(line[0] == '#') {
-				/* Ignore any other comment lines */
-			} else if(sscanf(line, "%" SCNu64 " %d %d %d", &previous_completion_time, &nodeid, &state, &jobid) == 4) {
-				n = itable_lookup(d->node_table, nodeid);
-				if(n) {
-					n->state = state;
-					n->jobid = jobid;
-					/* Log timestamp is in microseconds, we need seconds for diff. */
-					n->previous_completion = (time_t) (previous_completion_time / 1000000);
-				}
-			} else {
+			int result = makeflow_log_recover_line(d, line);
+			free(line);
+
+			if(result < 0) {
+				return -1;
+			} else if(result == 0) {
 				fprintf(stderr, "makeflow: %s appears to be corrupted on line %d\n", filename, linenum);
 				exit(1);
 			}
-			free(line);
 		}
 		fclose(d->logfile);
 	} else {
 		printf("creating new log file %s...\n",filename);
+
+		/* A checkpoint left by an earlier run describes some other log. */
+		if(unlink(checkpoint_filename) == 0) {
+			debug(D_MAKEFLOW_RUN, "removed old checkpoint %s", checkpoint_filename);
+		}
 	}
 
-	d->logfile = fopen(filename, "a");
-	if(!d->logfile) {
+	/* Also readable, so that checkpoints can digest what was logged. */
+	d->logfile = fopen(filename, "a+");
+	if(!d->logfile || fseeko(d->logfile, 0, SEEK_END) < 0) {
 		fprintf(stderr, "makeflow: couldn't open logfile %s: %s\n", filename, strerror(errno));
 		exit(1);
 	}
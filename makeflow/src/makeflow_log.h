@@ -35,6 +35,12 @@ void makeflow_log_alloc_event( struct dag *d, struct makeflow_alloc *alloc );
 void makeflow_log_gc_event( struct dag *d, int collected, timestamp_t elapsed, int total_collected );
 void makeflow_log_close(struct dag *d );
 
+/* Write a compact copy of the state recorded in the log, so that a later recovery can skip most of the log. */
+void makeflow_log_checkpoint( struct dag *d );
+
+/* Return the name of the checkpoint kept beside the given log. Must be freed by the caller. */
+char *makeflow_log_checkpoint_name( const char *logfilename );
+
 /* return 0 on success, return non-zero on failure. */
 int makeflow_log_recover( struct dag *d, const char *filename, int verbose_mode, struct batch_queue *queue, makeflow_clean_depth clean_mode );
 
@@ -0,0 +1,105 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+test_dir=`basename $0 .sh`.dir
+test_output=`basename $0 .sh`.output
+
+prepare()
+{
+	mkdir $test_dir
+	cd $test_dir
+	ln -sf ../../src/makeflow .
+	echo "hello" > file.1
+
+cat > test.jx << EOF
+{
+	"rules" :
+	[
+		{
+			"command" : format("sleep 1; cp file.%d file.%d",i,i+1),
+			"inputs"  : [ "file."+i ],
+			"outputs" : [ "file."+(i+1) ]
+		} for i in range(1,6)
+	]
+}
+EOF
+	exit 0
+}
+
+run()
+{
+	cd $test_dir
+
+	echo "+++++ first run: should make 6 files and a checkpoint +++++"
+	./makeflow --jx test.jx --log-checkpoint-interval 1 | tee output.1
+
+	if [ ! -f test.jx.makeflowlog.checkpoint ]
+	then
+		echo "+++++ no checkpoint was written +++++"
+		exit 1
+	fi
+
+	echo "+++++ deleting file.3 manually +++++"
+	rm file.3
+
+	echo "+++++ second run: should recover from the checkpoint and rebuild 4 files +++++"
+	./makeflow --jx test.jx --log-checkpoint-interval 1 | tee output.2
+
+	if ! grep -q "^recovering from checkpoint" output.2
+	then
+		exit 1
+	fi
+
+	count=`grep "^deleted file." output.2 | wc -l`
+
+	echo "+++++ $count files deleted, expecting 4 +++++"
+	if [ $count -ne 4 ]
+	then
+		exit 1
+	fi
+
+	echo "+++++ third run: should have nothing left to do +++++"
+	./makeflow --jx test.jx | tee output.3
+
+	if ! grep -q "^nothing left to do" output.3
+	then
+		exit 1
+	fi
+
+	echo "+++++ fourth run: a new log should remove the old checkpoint +++++"
+	mv test.jx.makeflowlog log.1
+	cp test.jx.makeflowlog.checkpoint checkpoint.1
+	rm file.6
+	./makeflow --jx test.jx | tee output.4
+
+	if grep -q "^recovering from checkpoint" output.4 || [ ! -f file.6 ] || [ -f test.jx.makeflowlog.checkpoint ]
+	then
+		exit 1
+	fi
+
+	echo "+++++ fifth run: the old checkpoint should not apply to another log in the same file +++++"
+	cat test.jx.makeflowlog > log.2
+	mv log.1 test.jx.makeflowlog
+	cat log.2 > test.jx.makeflowlog
+	cp checkpoint.1 test.jx.makeflowlog.checkpoint
+	rm file.6
+	./makeflow --jx test.jx | tee output.5
+
+	if ! grep -q "^ignoring stale checkpoint" output.5 || [ ! -f file.6 ]
+	then
+		exit 1
+	fi
+
+	exit 0
+}
+
+clean()
+{
+	rm -fr $test_dir $test_output
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
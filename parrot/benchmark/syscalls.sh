@@ -0,0 +1,124 @@
+#!/bin/bash
+
+# Measures the overhead of Parrot on syscall-heavy programs, with and without
+# --seccomp. Builds a small program that times <iterations> rounds of each of
+# these kinds of system calls, and runs it natively, under parrot_run, and
+# under parrot_run --seccomp:
+#
+#     passthrough: futex, sched_yield and rt_sigprocmask, which Parrot sends
+#                  along to the kernel untouched.
+#     anonymous:   mmap and munmap of anonymous memory. With --seccomp, only
+#                  the munmap stops the program.
+#     file:        fstat and lseek on a file, which Parrot always inspects.
+#
+# For example:
+#     ./syscalls.sh 100000
+#
+# Set parrot_run to run a parrot_run other than the one in $PATH, and CFLAGS
+# to build the program differently, e.g. CFLAGS=-static.
+
+if [ "$#" -lt 1 ]; then
+	echo "usage: $0 <iterations> [parrot_run options]"
+	exit 1
+fi
+
+iterations=$1
+shift
+
+parrot_run=${parrot_run:-parrot_run}
+if [ -x "$parrot_run" ]; then
+	parrot_run=$(readlink -f "$parrot_run")
+fi
+
+unset TESTDIR
+function cleanup {
+	rm -rf "$TESTDIR"
+}
+trap cleanup EXIT
+TESTDIR=$(mktemp -d)
+
+cd "$TESTDIR" || exit 1
+
+${CC:-gcc} $CFLAGS -O2 -o syscalls -x c - <<'EOF'
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	long iterations = atol(argv[1]);
+	sigset_t mask;
+	struct stat info;
+	int word = 0;
+	long i;
+
+	sigemptyset(&mask);
+
+	int fd = open(argv[0], O_RDONLY);
+	if (fd < 0) {
+		perror(argv[0]);
+		return 1;
+	}
+
+	double start = now();
+	for (i = 0; i < iterations; i++) {
+		syscall(SYS_futex, &word, FUTEX_WAKE, 1, NULL, NULL, 0);
+		sched_yield();
+		sigprocmask(SIG_BLOCK, &mask, NULL);
+	}
+	double passthrough = now() - start;
+
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		void *p = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		munmap(p, 4096);
+	}
+	double anonymous = now() - start;
+
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		fstat(fd, &info);
+		lseek(fd, 0, SEEK_SET);
+	}
+	double file = now() - start;
+
+	printf("%-12s %8.2f us/iteration\n", "passthrough", passthrough * 1e6 / iterations);
+	printf("%-12s %8.2f us/iteration\n", "anonymous", anonymous * 1e6 / iterations);
+	printf("%-12s %8.2f us/iteration\n", "file", file * 1e6 / iterations);
+
+	return 0;
+}
+EOF
+
+if [ $? -ne 0 ]; then
+	echo "could not build the benchmark"
+	exit 1
+fi
+
+echo "native:"
+./syscalls "$iterations" || exit 1
+
+echo "parrot_run:"
+"$parrot_run" "$@" -- ./syscalls "$iterations" 2> parrot.err || { cat parrot.err; exit 1; }
+
+echo "parrot_run --seccomp:"
+"$parrot_run" --seccomp "$@" -- ./syscalls "$iterations" 2> parrot.err || { cat parrot.err; exit 1; }
@@ -3612,7 +3612,7 @@ void pfs_dispatch32( struct pfs_process *p )
 	switch(p->state) {
 		case PFS_PROCESS_STATE_KERNEL:
 		case PFS_PROCESS_STATE_USER:
-			tracer_continue(p->tracer,0);
+			tracer_continue(p->tracer,0,p->state==PFS_PROCESS_STATE_KERNEL);
 			break;
 		default:
 			assert(0);
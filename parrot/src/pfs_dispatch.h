@@ -14,4 +14,7 @@ void pfs_dispatch( struct pfs_process *p );
 void pfs_dispatch32( struct pfs_process *p );
 void pfs_dispatch64( struct pfs_process *p );
 
+/* Set syscalls to the x86_64 system calls passed through untouched, and return how many there are. */
+int pfs_dispatch64_passthrough( const int **syscalls );
+
 #endif
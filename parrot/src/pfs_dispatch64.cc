@@ -14,6 +14,12 @@ int pfs_dispatch64( struct pfs_process *p )
 	return 0;
 }
 
+int pfs_dispatch64_passthrough( const int **syscalls )
+{
+	*syscalls = 0;
+	return 0;
+}
+
 #else /* CCTOOLS_CPU_I386 */
 
 /* Must come first as other headers include the 32 bit version. */
@@ -143,6 +149,134 @@ int pfs_dispatch_isexe( const char *path, uid_t *uid, gid_t *gid );
 
 #define POINTER( i ) ((void *)(uintptr_t)(i))
 
+/*
+System calls that have no relation to file access, and are simply sent
+along to the underlying OS. The same list makes the cases of the switch
+in decode_syscall and the seccomp filter of tracees, so that the system
+calls we pass through never stop the tracee when the filter is in use.
+*/
+
+#define PFS_DISPATCH64_PASSTHROUGH(X) \
+	X(SYSCALL64__sysctl) \
+	X(SYSCALL64_adjtimex) \
+	X(SYSCALL64_afs_syscall) \
+	X(SYSCALL64_alarm) \
+	X(SYSCALL64_arch_prctl) \
+	X(SYSCALL64_brk) \
+	X(SYSCALL64_capget) \
+	X(SYSCALL64_capset) \
+	X(SYSCALL64_clock_getres) \
+	X(SYSCALL64_clock_nanosleep) \
+	X(SYSCALL64_clock_settime) \
+	X(SYSCALL64_create_module) \
+	X(SYSCALL64_delete_module) \
+	X(SYSCALL64_exit) \
+	X(SYSCALL64_exit_group) \
+	X(SYSCALL64_futex) \
+	X(SYSCALL64_get_kernel_syms) \
+	X(SYSCALL64_get_robust_list) \
+	X(SYSCALL64_get_thread_area) \
+	X(SYSCALL64_getcpu) \
+	X(SYSCALL64_getitimer) \
+	X(SYSCALL64_getpgid) \
+	X(SYSCALL64_getpgrp) \
+	X(SYSCALL64_getpriority) \
+	X(SYSCALL64_getrandom) \
+	X(SYSCALL64_getrlimit) \
+	X(SYSCALL64_getrusage) \
+	X(SYSCALL64_getsid) \
+	X(SYSCALL64_gettid) \
+	X(SYSCALL64_init_module) \
+	X(SYSCALL64_ioperm) \
+	X(SYSCALL64_iopl) \
+	X(SYSCALL64_kcmp) \
+	X(SYSCALL64_madvise) \
+	X(SYSCALL64_membarrier) \
+	X(SYSCALL64_migrate_pages) \
+	X(SYSCALL64_mincore) \
+	X(SYSCALL64_mlock) \
+	X(SYSCALL64_mlockall) \
+	X(SYSCALL64_modify_ldt) \
+	X(SYSCALL64_move_pages) \
+	X(SYSCALL64_mprotect) \
+	X(SYSCALL64_mremap) \
+	X(SYSCALL64_msync) \
+	X(SYSCALL64_munlock) \
+	X(SYSCALL64_munlockall) \
+	X(SYSCALL64_nanosleep) \
+	X(SYSCALL64_pause) \
+	X(SYSCALL64_prctl) \
+	X(SYSCALL64_prlimit64) \
+	X(SYSCALL64_process_vm_readv) \
+	X(SYSCALL64_process_vm_writev) \
+	X(SYSCALL64_query_module) \
+	X(SYSCALL64_quotactl) \
+	X(SYSCALL64_reboot) \
+	X(SYSCALL64_restart_syscall) \
+	X(SYSCALL64_rt_sigaction) \
+	X(SYSCALL64_rt_sigpending) \
+	X(SYSCALL64_rt_sigprocmask) \
+	X(SYSCALL64_rt_sigqueueinfo) \
+	X(SYSCALL64_rt_sigreturn) \
+	X(SYSCALL64_rt_sigsuspend) \
+	X(SYSCALL64_rt_sigtimedwait) \
+	X(SYSCALL64_sched_get_priority_max) \
+	X(SYSCALL64_sched_get_priority_min) \
+	X(SYSCALL64_sched_getaffinity) \
+	X(SYSCALL64_sched_getattr) \
+	X(SYSCALL64_sched_getparam) \
+	X(SYSCALL64_sched_getscheduler) \
+	X(SYSCALL64_sched_rr_get_interval) \
+	X(SYSCALL64_sched_setaffinity) \
+	X(SYSCALL64_sched_setattr) \
+	X(SYSCALL64_sched_setparam) \
+	X(SYSCALL64_sched_setscheduler) \
+	X(SYSCALL64_sched_yield) \
+	X(SYSCALL64_set_robust_list) \
+	X(SYSCALL64_set_thread_area) \
+	X(SYSCALL64_set_tid_address) \
+	X(SYSCALL64_setdomainname) \
+	X(SYSCALL64_sethostname) \
+	X(SYSCALL64_setitimer) \
+	X(SYSCALL64_setpgid) \
+	X(SYSCALL64_setpriority) \
+	X(SYSCALL64_setrlimit) \
+	X(SYSCALL64_setsid) \
+	X(SYSCALL64_settimeofday) \
+	X(SYSCALL64_shmat) \
+	X(SYSCALL64_shmctl) \
+	X(SYSCALL64_shmdt) \
+	X(SYSCALL64_shmget) \
+	X(SYSCALL64_sigaltstack) \
+	X(SYSCALL64_swapoff) \
+	X(SYSCALL64_swapon) \
+	X(SYSCALL64_sync) \
+	X(SYSCALL64_sysinfo) \
+	X(SYSCALL64_syslog) \
+	X(SYSCALL64_timer_create) \
+	X(SYSCALL64_timer_delete) \
+	X(SYSCALL64_timer_getoverrun) \
+	X(SYSCALL64_timer_gettime) \
+	X(SYSCALL64_timer_settime) \
+	X(SYSCALL64_times) \
+	X(SYSCALL64_ustat) \
+	X(SYSCALL64_vhangup) \
+	X(SYSCALL64_wait4) \
+	X(SYSCALL64_waitid)
+
+#define PASSTHROUGH_CASE(syscall) case syscall:
+#define PASSTHROUGH_ELEMENT(syscall) syscall,
+
+static const int passthrough_syscalls[] = {
+	PFS_DISPATCH64_PASSTHROUGH(PASSTHROUGH_ELEMENT)
+};
+
+int pfs_dispatch64_passthrough( const int **syscalls )
+{
+	*syscalls = passthrough_syscalls;
+	return sizeof(passthrough_syscalls)/sizeof(passthrough_syscalls[0]);
+}
+
 /*
 Divert this incoming system call to a read or write on the I/O channel
 */
@@ -1052,119 +1186,14 @@ static void decode_syscall( struct pfs_process *p, int entering )
 	args = p->syscall_args;
 
 	/* To get syscalls not in this switch:
-		(getsyscalls() { grep "$1" | grep -oE 'SYSCALL64_[[:alnum:]_]+' | grep -v MAX | sort | uniq; };  cat <(getsyscalls 'case SYSCALL64' < pfs_dispatch64.cc) <(getsyscalls '#define SYS' < tracer.table64.h)) | sort | uniq -c | grep '1 SYSCALL' | awk '{printf "\t\tcase %s:\n", $2}'
+		(getsyscalls() { grep -E "$1" | grep -oE 'SYSCALL64_[[:alnum:]_]+' | grep -v MAX | sort | uniq; };  cat <(getsyscalls 'case SYSCALL64|X\(SYSCALL64' < pfs_dispatch64.cc) <(getsyscalls '#define SYS' < tracer.table64.h)) | sort | uniq -c | grep '1 SYSCALL' | awk '{printf "\t\tcase %s:\n", $2}'
 	*/
 	switch(p->syscall) {
 		/* A wide variety of calls have no relation to file access, so we
-		 * simply send them along to the underlying OS.
+		 * simply send them along to the underlying OS. See PFS_DISPATCH64_PASSTHROUGH.
 		 */
 
-		case SYSCALL64__sysctl:
-		case SYSCALL64_adjtimex:
-		case SYSCALL64_afs_syscall:
-		case SYSCALL64_alarm:
-		case SYSCALL64_arch_prctl:
-		case SYSCALL64_brk:
-		case SYSCALL64_capget:
-		case SYSCALL64_capset:
-		case SYSCALL64_clock_getres:
-		case SYSCALL64_clock_nanosleep:
-		case SYSCALL64_clock_settime:
-		case SYSCALL64_create_module:
-		case SYSCALL64_delete_module:
-		case SYSCALL64_exit:
-		case SYSCALL64_exit_group:
-		case SYSCALL64_futex:
-		case SYSCALL64_get_kernel_syms:
-		case SYSCALL64_get_robust_list:
-		case SYSCALL64_get_thread_area:
-		case SYSCALL64_getcpu:
-		case SYSCALL64_getitimer:
-		case SYSCALL64_getpgid:
-		case SYSCALL64_getpgrp:
-		case SYSCALL64_getpriority:
-		case SYSCALL64_getrandom:
-		case SYSCALL64_getrlimit:
-		case SYSCALL64_getrusage:
-		case SYSCALL64_getsid:
-		case SYSCALL64_gettid:
-		case SYSCALL64_init_module:
-		case SYSCALL64_ioperm:
-		case SYSCALL64_iopl:
-		case SYSCALL64_kcmp:
-		case SYSCALL64_madvise:
-		case SYSCALL64_membarrier:
-		case SYSCALL64_migrate_pages:
-		case SYSCALL64_mincore:
-		case SYSCALL64_mlock:
-		case SYSCALL64_mlockall:
-		case SYSCALL64_modify_ldt:
-		case SYSCALL64_move_pages:
-		case SYSCALL64_mprotect:
-		case SYSCALL64_mremap:
-		case SYSCALL64_msync:
-		case SYSCALL64_munlock:
-		case SYSCALL64_munlockall:
-		case SYSCALL64_nanosleep:
-		case SYSCALL64_pause:
-		case SYSCALL64_prctl:
-		case SYSCALL64_prlimit64:
-		case SYSCALL64_process_vm_readv:
-		case SYSCALL64_process_vm_writev:
-		case SYSCALL64_query_module:
-		case SYSCALL64_quotactl:
-		case SYSCALL64_reboot:
-		case SYSCALL64_restart_syscall:
-		case SYSCALL64_rt_sigaction:
-		case SYSCALL64_rt_sigpending:
-		case SYSCALL64_rt_sigprocmask:
-		case SYSCALL64_rt_sigqueueinfo:
-		case SYSCALL64_rt_sigreturn:
-		case SYSCALL64_rt_sigsuspend:
-		case SYSCALL64_rt_sigtimedwait:
-		case SYSCALL64_sched_get_priority_max:
-		case SYSCALL64_sched_get_priority_min:
-		case SYSCALL64_sched_getaffinity:
-		case SYSCALL64_sched_getattr:
-		case SYSCALL64_sched_getparam:
-		case SYSCALL64_sched_getscheduler:
-		case SYSCALL64_sched_rr_get_interval:
-		case SYSCALL64_sched_setaffinity:
-		case SYSCALL64_sched_setattr:
-		case SYSCALL64_sched_setparam:
-		case SYSCALL64_sched_setscheduler:
-		case SYSCALL64_sched_yield:
-		case SYSCALL64_set_robust_list:
-		case SYSCALL64_set_thread_area:
-		case SYSCALL64_set_tid_address:
-		case SYSCALL64_setdomainname:
-		case SYSCALL64_sethostname:
-		case SYSCALL64_setitimer:
-		case SYSCALL64_setpgid:
-		case SYSCALL64_setpriority:
-		case SYSCALL64_setrlimit:
-		case SYSCALL64_setsid:
-		case SYSCALL64_settimeofday:
-		case SYSCALL64_shmat:
-		case SYSCALL64_shmctl:
-		case SYSCALL64_shmdt:
-		case SYSCALL64_shmget:
-		case SYSCALL64_sigaltstack:
-		case SYSCALL64_swapoff:
-		case SYSCALL64_swapon:
-		case SYSCALL64_sync:
-		case SYSCALL64_sysinfo:
-		case SYSCALL64_syslog:
-		case SYSCALL64_timer_create:
-		case SYSCALL64_timer_delete:
-		case SYSCALL64_timer_getoverrun:
-		case SYSCALL64_timer_gettime:
-		case SYSCALL64_timer_settime:
-		case SYSCALL64_times:
-		case SYSCALL64_ustat:
-		case SYSCALL64_vhangup:
-		case SYSCALL64_wait4:
-		case SYSCALL64_waitid:
+		PFS_DISPATCH64_PASSTHROUGH(PASSTHROUGH_CASE)
 			break;
 
 		case SYSCALL64_time:
@@ -3325,7 +3354,7 @@ void pfs_dispatch64( struct pfs_process *p )
 	switch(p->state) {
 		case PFS_PROCESS_STATE_KERNEL:
 		case PFS_PROCESS_STATE_USER:
-			tracer_continue(p->tracer,0);
+			tracer_continue(p->tracer,0,p->state==PFS_PROCESS_STATE_KERNEL);
 			break;
 		default:
 			assert(0);
@@ -16,6 +16,9 @@ extern "C" {
 #include "file_cache.h"
 #include "full_io.h"
 #include "hash_table.h"
+#include "itable.h"
+#include "macros.h"
+#include "stats.h"
 }
 
 #include <unistd.h>
@@ -28,10 +31,14 @@ extern "C" {
 #include <stdlib.h>
 #include <utime.h>
 #include <time.h>
+#include <limits.h>
 
 extern struct file_cache *pfs_file_cache;
 extern int pfs_session_cache;
 extern int pfs_main_timeout;
+extern INT64_T pfs_cache_block_size;
+extern INT64_T pfs_cache_max_size;
+extern char pfs_temp_per_instance_dir[PATH_MAX];
 
 static struct hash_table * not_found_table = 0;
 
@@ -170,7 +177,7 @@ public:
 	}
 };
 
-pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
+static pfs_file * open_whole_file( pfs_name *name, int flags, mode_t mode )
 {
 	struct pfs_stat buf;
 	char txn[PFS_PATH_MAX];
@@ -285,6 +292,490 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 	}
 }
 
+/*
+In the block cache, remote files are fetched in blocks of
+pfs_cache_block_size bytes, only as they are read, and each object
+keeps the blocks it has in a sparse local file. When an open file is
+read sequentially, each miss fetches more blocks ahead in the same
+request, doubling up to READAHEAD_MAX blocks. The blocks of all the
+objects are kept in a single LRU list, and the least recently used
+are dropped, punching holes in their local files, so that the cache
+stays under pfs_cache_max_size bytes.
+
+A local file is only kept open while its object is open in parrot,
+so that caching many small files does not use up descriptors. The
+blocks of closed objects are punched out by opening their files again.
+
+If the server cannot send a range without sending everything before it,
+as an HTTP server that ignores ranges, the object is read in order from
+then on, and every block passed on the way is kept.
+
+The local files are private to this instance of parrot, and the cache
+is only used to read files from services that support reads at any
+offset. Files that are written, or executed, go through the whole
+file cache above.
+*/
+
+#define READAHEAD_MAX 16
+
+struct cache_object;
+
+struct cache_block {
+	struct cache_object *object;
+	INT64_T number;
+	pfs_size_t length;
+	struct cache_block *prev;
+	struct cache_block *next;
+};
+
+struct cache_object {
+	char *path;
+	char *local_path;
+	int fd;
+	int refcount;
+	int in_order;
+	struct pfs_stat info;
+	struct itable *blocks;
+};
+
+static struct hash_table *cache_objects = 0;
+static struct cache_block *lru_oldest = 0;
+static struct cache_block *lru_newest = 0;
+static INT64_T cache_size = 0;
+
+static void lru_remove( struct cache_block *b )
+{
+	if(b->prev) b->prev->next = b->next; else lru_oldest = b->next;
+	if(b->next) b->next->prev = b->prev; else lru_newest = b->prev;
+	b->prev = b->next = 0;
+}
+
+static void lru_append( struct cache_block *b )
+{
+	b->prev = lru_newest;
+	b->next = 0;
+	if(lru_newest) lru_newest->next = b; else lru_oldest = b;
+	lru_newest = b;
+}
+
+static struct cache_object * cache_object_create( pfs_name *name, struct pfs_stat *info )
+{
+	char *local_path = string_format("%s/blocks.XXXXXX",pfs_temp_per_instance_dir);
+
+	int fd = mkstemp(local_path);
+	if(fd<0) {
+		free(local_path);
+		return 0;
+	}
+
+	/* Only the blocks written take up space in the local file. */
+	if(::ftruncate64(fd,info->st_size)<0) {
+		int save_errno = errno;
+		::close(fd);
+		unlink(local_path);
+		free(local_path);
+		errno = save_errno;
+		return 0;
+	}
+
+	struct cache_object *o = (struct cache_object *) malloc(sizeof(*o));
+	o->path = strdup(name->path);
+	o->local_path = local_path;
+	o->fd = fd;
+	o->refcount = 0;
+	o->in_order = 0;
+	o->info = *info;
+	o->blocks = itable_create(0);
+
+	if(!cache_objects) cache_objects = hash_table_create(0,0);
+	hash_table_insert(cache_objects,o->path,o);
+
+	debug(D_CACHE,"blocks of %s in %s",name->path,local_path);
+
+	return o;
+}
+
+/* Take a reference to the object, opening its local file if it was closed. */
+static int cache_object_ref( struct cache_object *o )
+{
+	if(o->fd<0) {
+		o->fd = ::open(o->local_path,O_RDWR);
+		if(o->fd<0) return 0;
+	}
+	o->refcount++;
+	return 1;
+}
+
+/* Forget the block. If fd is valid, its data is also punched out of the local file. */
+static void cache_object_drop_block( struct cache_object *o, struct cache_block *b, int fd )
+{
+	/* If holes cannot be punched here, the data stays in the local file until the object is deleted. */
+	if(fd>=0 && fallocate(fd,FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,b->number*pfs_cache_block_size,b->length)<0) {
+		debug(D_CACHE,"couldn't punch hole in blocks of %s: %s",o->path,strerror(errno));
+	}
+
+	itable_remove(o->blocks,b->number);
+	lru_remove(b);
+	cache_size -= b->length;
+	free(b);
+}
+
+/* Forget every block of the object. If punch is set, their data is also punched out of the local file. */
+static void cache_object_clear( struct cache_object *o, int punch )
+{
+	uint64_t number;
+	struct cache_block *b;
+
+	int fd = o->fd;
+	if(punch && fd<0 && itable_size(o->blocks)>0) {
+		fd = ::open(o->local_path,O_WRONLY);
+	} else if(!punch) {
+		fd = -1;
+	}
+
+	itable_firstkey(o->blocks);
+	while(itable_nextkey(o->blocks,&number,(void**)&b)) {
+		cache_object_drop_block(o,b,fd);
+		itable_firstkey(o->blocks);
+	}
+
+	if(fd>=0 && fd!=o->fd) ::close(fd);
+}
+
+static void cache_object_delete( struct cache_object *o )
+{
+	cache_object_clear(o,0);
+	hash_table_remove(cache_objects,o->path);
+	itable_delete(o->blocks);
+	if(o->fd>=0) ::close(o->fd);
+	unlink(o->local_path);
+	free(o->local_path);
+	free(o->path);
+	free(o);
+}
+
+/* Release a reference to the object. The local file is closed with the last one, and deleted if it has no blocks left. */
+static void cache_object_unref( struct cache_object *o )
+{
+	o->refcount--;
+	if(o->refcount>0) return;
+
+	if(itable_size(o->blocks)==0) {
+		cache_object_delete(o);
+	} else {
+		::close(o->fd);
+		o->fd = -1;
+	}
+}
+
+/* Drop the least recently used blocks until length more bytes fit in the cache. */
+static void cache_make_room( pfs_size_t length )
+{
+	while(lru_oldest && cache_size+length>pfs_cache_max_size) {
+		struct cache_block *b = lru_oldest;
+		struct cache_object *o = b->object;
+		stats_inc("parrot.cache.blocks_evicted",1);
+		if(o->fd>=0) {
+			cache_object_drop_block(o,b,o->fd);
+		} else if(itable_size(o->blocks)==1) {
+			cache_object_delete(o);
+		} else {
+			int fd = ::open(o->local_path,O_WRONLY);
+			if(fd<0) debug(D_CACHE,"couldn't open blocks of %s: %s",o->path,strerror(errno));
+			cache_object_drop_block(o,b,fd);
+			if(fd>=0) ::close(fd);
+		}
+	}
+}
+
+class pfs_file_blocks : public pfs_file
+{
+private:
+	struct cache_object *object;
+	pfs_file *remote;
+	pfs_off_t next_offset;
+	pfs_off_t remote_offset;
+	int readahead;
+
+	/* Read length bytes at offset from the remote file into buffer. */
+	pfs_ssize_t fetch_range( char *buffer, pfs_off_t offset, pfs_size_t length ) {
+		pfs_size_t total = 0;
+
+		if(!remote) {
+			remote = name.service->open(&name,O_RDONLY,0);
+			if(!remote) return -1;
+			remote_offset = 0;
+		}
+
+		while(total<length) {
+			pfs_ssize_t actual = remote->read(buffer+total,length-total,offset+total);
+			if(actual>0) {
+				total += actual;
+			} else if(actual==0) {
+				break;
+			} else {
+				/* The next read starts a new request, which can always be from the start. */
+				remote_offset = 0;
+				return -1;
+			}
+		}
+
+		remote_offset = offset+total;
+		stats_inc("parrot.cache.bytes_fetched",total);
+		return total;
+	}
+
+	/* Keep the length bytes in buffer as the blocks from number on that are not cached yet. */
+	int store( INT64_T number, const char *buffer, pfs_size_t length ) {
+		INT64_T i;
+		for(i=0;i*pfs_cache_block_size<length;i++) {
+			if(itable_lookup(object->blocks,number+i)) continue;
+
+			pfs_size_t blength = MIN(pfs_cache_block_size,length-i*pfs_cache_block_size);
+			pfs_off_t offset = (number+i)*pfs_cache_block_size;
+
+			cache_make_room(blength);
+			if(full_pwrite64(object->fd,buffer+i*pfs_cache_block_size,blength,offset)!=blength) return 0;
+
+			struct cache_block *b = (struct cache_block *) malloc(sizeof(*b));
+			b->object = object;
+			b->number = number+i;
+			b->length = blength;
+			itable_insert(object->blocks,b->number,b);
+			lru_append(b);
+			cache_size += b->length;
+			stats_inc("parrot.cache.blocks_fetched",1);
+		}
+		return 1;
+	}
+
+	/* Fetch the blocks from number to number+count by reading the object in order, from where the remote file is at if it is not past them, or else from the start. */
+	int fetch_in_order( INT64_T number, INT64_T count ) {
+		INT64_T first = 0;
+		if(remote && remote_offset<=number*pfs_cache_block_size && remote_offset%pfs_cache_block_size==0) {
+			first = remote_offset/pfs_cache_block_size;
+		}
+
+		char *buffer = (char *) malloc(pfs_cache_block_size);
+		if(!buffer) return 0;
+
+		INT64_T i;
+		for(i=first;i<number+count;i++) {
+			pfs_off_t offset = i*pfs_cache_block_size;
+			pfs_ssize_t actual = fetch_range(buffer,offset,MIN(pfs_cache_block_size,object->info.st_size-offset));
+			if(actual<=0 || !store(i,buffer,actual)) {
+				int save_errno = actual==0 ? EIO : errno;
+				free(buffer);
+				errno = save_errno;
+				return 0;
+			}
+		}
+
+		free(buffer);
+		return 1;
+	}
+
+	/* Fetch block number, and up to readahead blocks after it that are not cached yet. */
+	struct cache_block * fetch( INT64_T number, INT64_T needed ) {
+		INT64_T nblocks = (object->info.st_size+pfs_cache_block_size-1)/pfs_cache_block_size;
+		INT64_T limit = MAX(1,pfs_cache_max_size/pfs_cache_block_size/2);
+		INT64_T count = MIN(MAX(needed,readahead),limit);
+		count = MIN(count,nblocks-number);
+
+		INT64_T i;
+		for(i=1;i<count;i++) {
+			if(itable_lookup(object->blocks,number+i)) break;
+		}
+		count = i;
+
+		if(!object->in_order) {
+			pfs_off_t offset = number*pfs_cache_block_size;
+			pfs_size_t length = MIN(count*pfs_cache_block_size,object->info.st_size-offset);
+			char *buffer = (char *) malloc(length);
+			if(!buffer) return 0;
+
+			pfs_ssize_t actual = fetch_range(buffer,offset,length);
+			if(actual<0 && errno==ESPIPE) {
+				debug(D_CACHE,"reading %s in order, as it cannot be read at %lld",name.path,(long long)offset);
+				object->in_order = 1;
+			} else if(actual<=0 || !store(number,buffer,actual)) {
+				int save_errno = actual==0 ? EIO : errno;
+				free(buffer);
+				errno = save_errno;
+				return 0;
+			} else {
+				debug(D_CACHE,"fetched %lld bytes at %lld of %s",(long long)actual,(long long)offset,name.path);
+			}
+			free(buffer);
+		}
+
+		if(object->in_order && !fetch_in_order(number,count)) return 0;
+
+		return (struct cache_block *) itable_lookup(object->blocks,number);
+	}
+
+public:
+	/* The caller has already taken a reference to o. */
+	pfs_file_blocks( pfs_name *n, struct cache_object *o ) : pfs_file(n) {
+		object = o;
+		remote = 0;
+		next_offset = 0;
+		remote_offset = 0;
+		readahead = 1;
+	}
+
+	virtual int close() {
+		int result = 0;
+		if(remote) {
+			result = remote->close();
+			delete remote;
+			remote = 0;
+		}
+		cache_object_unref(object);
+		return result;
+	}
+
+	virtual pfs_ssize_t read( void *d, pfs_size_t length, pfs_off_t offset ) {
+		pfs_size_t total = 0;
+		int failed = 0;
+
+		if(offset>=object->info.st_size) return 0;
+		length = MIN(length,object->info.st_size-offset);
+
+		if(offset==next_offset) {
+			readahead = MIN(readahead*2,READAHEAD_MAX);
+		} else {
+			readahead = 1;
+		}
+
+		while(total<length) {
+			pfs_off_t position = offset+total;
+			INT64_T number = position/pfs_cache_block_size;
+			INT64_T last = (offset+length-1)/pfs_cache_block_size;
+
+			struct cache_block *b = (struct cache_block *) itable_lookup(object->blocks,number);
+			if(b) {
+				stats_inc("parrot.cache.block_hits",1);
+				lru_remove(b);
+				lru_append(b);
+			} else {
+				stats_inc("parrot.cache.block_misses",1);
+				b = fetch(number,last-number+1);
+				if(!b) {
+					failed = 1;
+					break;
+				}
+			}
+
+			pfs_off_t start = position-number*pfs_cache_block_size;
+			if(start>=b->length) break;
+
+			pfs_size_t chunk = MIN(length-total,b->length-start);
+			pfs_ssize_t actual = full_pread64(object->fd,(char*)d+total,chunk,position);
+			if(actual<=0) {
+				failed = actual<0;
+				break;
+			}
+			total += actual;
+		}
+
+		next_offset = offset+total;
+
+		if(total==0 && failed) return -1;
+		return total;
+	}
+
+	virtual int fstat( struct pfs_stat *buf ) {
+		*buf = object->info;
+		return 0;
+	}
+
+	virtual int fstatfs( struct pfs_statfs *buf ) {
+		struct statfs64 lbuf;
+		int result = ::fstatfs64(object->fd,&lbuf);
+		if(result>=0){
+			COPY_STATFS(lbuf,*buf);
+		}
+		return result;
+	}
+
+	virtual pfs_ssize_t get_size() {
+		return object->info.st_size;
+	}
+
+	/* Programs are executed from whole local files, which are never punched out from under them. */
+	virtual int get_local_name( char *n ) {
+		pfs_file *file = open_whole_file(&name,O_RDONLY,0);
+		if(!file) return -1;
+		int result = file->get_local_name(n);
+		file->close();
+		delete file;
+		return result;
+	}
+
+	virtual int is_seekable() {
+		return 1;
+	}
+};
+
+static pfs_file * open_blocks( pfs_name *name )
+{
+	struct pfs_stat info;
+	struct cache_object *o = 0;
+
+	if(cache_objects) o = (struct cache_object *) hash_table_lookup(cache_objects,name->path);
+
+	/* With session caching, objects already in the cache are not checked again. */
+	if(o && pfs_session_cache) {
+		if(!cache_object_ref(o)) return 0;
+		return new pfs_file_blocks(name,o);
+	}
+
+	if(pfs_session_cache) {
+		if(!not_found_table) not_found_table = hash_table_create(0,0);
+		if(hash_table_lookup(not_found_table,name->path)) {
+			errno = ENOENT;
+			return 0;
+		}
+	}
+
+	if(name->service->stat(name,&info)!=0) {
+		if(pfs_session_cache && errno==ENOENT) {
+			hash_table_insert(not_found_table,name->path,(void*)1);
+		}
+		return 0;
+	}
+
+	if(S_ISDIR(info.st_mode)) {
+		errno = EISDIR;
+		return 0;
+	}
+
+	if(o && (o->info.st_size!=info.st_size || o->info.st_mtime!=info.st_mtime)) {
+		debug(D_CACHE,"stale blocks of %s",name->path);
+		cache_object_clear(o,1);
+		if(::truncate64(o->local_path,info.st_size)<0) return 0;
+		o->info = info;
+	}
+
+	if(!o) {
+		o = cache_object_create(name,&info);
+		if(!o) return 0;
+	}
+
+	if(!cache_object_ref(o)) return 0;
+	return new pfs_file_blocks(name,o);
+}
+
+pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
+{
+	if(pfs_cache_block_size>0 && (flags&O_ACCMODE)==O_RDONLY && !(flags&(O_CREAT|O_TRUNC)) && name->service->has_range_reads()) {
+		return open_blocks(name);
+	} else {
+		return open_whole_file(name,flags,mode);
+	}
+}
+
 int pfs_cache_invalidate( pfs_name *name )
 {
 	if(!name->is_local) {
@@ -292,6 +783,16 @@ int pfs_cache_invalidate( pfs_name *name )
 			if(!not_found_table) not_found_table = hash_table_create(0,0);
 			hash_table_remove(not_found_table,name->path);
 		}
+		if(cache_objects) {
+			struct cache_object *o = (struct cache_object *) hash_table_lookup(cache_objects,name->path);
+			if(o) {
+				if(o->refcount==0) {
+					cache_object_delete(o);
+				} else {
+					cache_object_clear(o,1);
+				}
+			}
+		}
 		return file_cache_delete(pfs_file_cache,name->path);
 	} else {
 		return 0;
@@ -94,6 +94,8 @@ int pfs_force_cache = 0;
 int pfs_force_sync = 0;
 int pfs_follow_symlinks = 1;
 int pfs_session_cache = 0;
+INT64_T pfs_cache_block_size = 0;
+INT64_T pfs_cache_max_size = 1024*1024*1024;
 int pfs_use_helper = 0;
 int pfs_checksum_files = 1;
 int pfs_write_rval = 0;
@@ -180,6 +182,9 @@ enum {
 	LONG_OPT_DISABLE_SERVICE,
 	LONG_OPT_NO_FLOCK,
 	LONG_OPT_EXT_IMAGE,
+	LONG_OPT_SECCOMP,
+	LONG_OPT_CACHE_BLOCK_SIZE,
+	LONG_OPT_CACHE_MAX_SIZE,
 };
 
 static void get_linux_version(const char *cmd)
@@ -275,11 +280,14 @@ static void show_help( const char *cmd )
 	printf( " %-30s Fake this unix uid; Real uid stays the same.     (PARROT_UID)\n", "-U,--uid=<num>");
 	printf( " %-30s Use this extended username.                 (PARROT_USERNAME)\n", "-u,--username=<name>");
 	printf( " %-30s Enable valgrind support for Parrot.\n", "   --valgrind");
+	printf( " %-30s Only stop at system calls that Parrot must inspect (seccomp-BPF).\n", "   --seccomp");
 	printf( " %-30s Initial working directory.\n", "-w,--work-dir=<dir>");
 	printf( " %-30s Display table of system calls trapped.\n", "-W,--syscall-table");
 	printf("\n");
 	printf("Performance and consistency options:\n");
 	printf( " %-30s Set the I/O block size hint.              (PARROT_BLOCK_SIZE)\n", "-b,--block-size=<bytes>");
+	printf( " %-30s Cache remote files in blocks of this size.(PARROT_CACHE_BLOCK_SIZE)\n", "--cache-block-size=<bytes>");
+	printf( " %-30s Max size of the block cache. (1G)        (PARROT_CACHE_MAX_SIZE)\n", "--cache-max-size=<bytes>");
 	printf( " %-30s Disable small file optimizations.\n", "-D,--no-optimize");
 	printf( " %-30s Enable file snapshot caching for all protocols.\n", "-F,--with-snapshots");
 	printf( " %-30s Disable following symlinks.\n", "-f,--no-follow-symlinks");
@@ -398,6 +406,10 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 	if (WIFSTOPPED(status) && WSTOPSIG(status) == (SIGTRAP|0x80)) {
 		/* The common case, a syscall delivery stop. */
 		pfs_dispatch(p);
+	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP<<8))) {
+		/* With --seccomp, the entry to a system call trapped by the filter. Its exit is a syscall delivery stop. */
+		assert(p->state == PFS_PROCESS_STATE_USER);
+		pfs_dispatch(p);
 	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_CLONE<<8)) || status>>8 == (SIGTRAP | (PTRACE_EVENT_FORK<<8)) || status>>8 == (SIGTRAP | (PTRACE_EVENT_VFORK<<8))) {
 		pid_t cpid;
 		struct pfs_process *child;
@@ -416,11 +428,11 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 		}
 		child = pfs_process_create(cpid,p,p->syscall_args[0]&CLONE_THREAD,clone_files);
 		child->syscall_result = 0;
-		if (tracer_continue(p->tracer,0) == -1) /* child starts stopped. */
+		if (tracer_continue(p->tracer,0,p->state==PFS_PROCESS_STATE_KERNEL) == -1) /* child starts stopped. */
 			return;
 	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_EXEC<<8))) {
 		pfs_process_exec(p);
-		if (tracer_continue(p->tracer,0) == -1)
+		if (tracer_continue(p->tracer,0,p->state==PFS_PROCESS_STATE_KERNEL) == -1)
 			return;
 	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_EXIT<<8)) || WIFEXITED(status) || WIFSIGNALED(status)) {
 		/* In my own testing, if we use PTRACE_O_TRACEEXIT then we never get
@@ -462,7 +474,7 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 			 *     PTRACE_SEIZE was used.
 			 */
 			debug(D_DEBUG, "%d received PTRACE_EVENT_STOP, continuing...", (int)pid);
-			if (tracer_continue(p->tracer, 0) == -1)
+			if (tracer_continue(p->tracer,0,p->state==PFS_PROCESS_STATE_KERNEL) == -1)
 				return;
 		} else if((linux_available(3,4,0) && ((status>>16) == PTRACE_EVENT_STOP)) || (!linux_available(3,4,0) && SIG_ISSTOP(signum) && ptrace(PTRACE_GETSIGINFO, pid, 0, &info) == -1 && errno == EINVAL)) {
 			/* group-stop, `man ptrace` for more information */
@@ -516,7 +528,7 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 					break;
 				}
 			}
-			if (tracer_continue(p->tracer,signum) == -1) /* deliver (or not) the signal */
+			if (tracer_continue(p->tracer,signum,p->state==PFS_PROCESS_STATE_KERNEL) == -1) /* deliver (or not) the signal */
 				return;
 		}
 	} else {
@@ -602,6 +614,7 @@ int main( int argc, char *argv[] )
 	struct pfs_process *p;
 	char envlist[PATH_MAX] = "";
 	int valgrind = 0;
+	int seccomp = 0;
 	int envdebug = 0;
 	int envauth = 0;
 	std::vector<pfs_service *> service_instances;
@@ -708,6 +721,12 @@ int main( int argc, char *argv[] )
 	s = getenv("PARROT_BLOCK_SIZE");
 	if(s) pfs_service_set_block_size(string_metric_parse(s));
 
+	s = getenv("PARROT_CACHE_BLOCK_SIZE");
+	if(s) pfs_cache_block_size = string_metric_parse(s);
+
+	s = getenv("PARROT_CACHE_MAX_SIZE");
+	if(s) pfs_cache_max_size = string_metric_parse(s);
+
 	s = getenv("PARROT_MOUNT_FILE");
 	if(s) pfs_mountfile_parse_file(s);
 
@@ -815,6 +834,8 @@ int main( int argc, char *argv[] )
 	static const struct option long_options[] = {
 		{"auto-decompress", no_argument, 0, 'Z'},
 		{"block-size", required_argument, 0, 'b'},
+		{"cache-block-size", required_argument, 0, LONG_OPT_CACHE_BLOCK_SIZE},
+		{"cache-max-size", required_argument, 0, LONG_OPT_CACHE_MAX_SIZE},
 		{"channel-auth", no_argument, 0, 'C'},
 		{"check-driver", required_argument, 0, LONG_OPT_CHECK_DRIVER },
 		{"chirp-auth",  required_argument, 0, 'a'},
@@ -870,6 +891,7 @@ int main( int argc, char *argv[] )
 		{"uid", required_argument, 0, 'U'},
 		{"username", required_argument, 0, 'u'},
 		{"valgrind", no_argument, 0, LONG_OPT_VALGRIND},
+		{"seccomp", no_argument, 0, LONG_OPT_SECCOMP},
 		{"version", no_argument, 0, 'v'},
 		{"is-running", no_argument, 0, LONG_OPT_IS_RUNNING},
 		{"with-checksums", no_argument, 0, 'K'},
@@ -1071,6 +1093,15 @@ int main( int argc, char *argv[] )
 		case LONG_OPT_VALGRIND:
 			valgrind = 1;
 			break;
+		case LONG_OPT_SECCOMP:
+			seccomp = 1;
+			break;
+		case LONG_OPT_CACHE_BLOCK_SIZE:
+			pfs_cache_block_size = string_metric_parse(optarg);
+			break;
+		case LONG_OPT_CACHE_MAX_SIZE:
+			pfs_cache_max_size = string_metric_parse(optarg);
+			break;
 		case LONG_OPT_CHECK_DRIVER:
 			if(pfs_service_lookup(optarg)) {
 				printf("%s is enabled\n",optarg);
@@ -1200,6 +1231,15 @@ int main( int argc, char *argv[] )
 
 	get_linux_version(argv[0]);
 
+	if(seccomp && !linux_available(4,8,0)) {
+		debug(D_NOTICE, "--seccomp needs at least kernel version 4.8, tracing every system call instead.");
+		seccomp = 0;
+	} else if(seccomp && valgrind) {
+		/* With valgrind, the child runs a shell before it is traced, and trapped system calls would fail. */
+		debug(D_NOTICE, "--seccomp cannot be used with --valgrind, tracing every system call instead.");
+		seccomp = 0;
+	}
+
 	if (envlist[0]) {
 		extern char **environ;
 		if(access(envlist, F_OK) == 0)
@@ -1338,6 +1378,16 @@ int main( int argc, char *argv[] )
 			signal(SIGUSR1, set_attached_and_ready);
 			raise(SIGSTOP); /* synchronize with parent, above */
 			while (!attached_and_ready) ; /* spin waiting to be traced (NO SLEEPING/STOPPING) */
+			if (seccomp) {
+				const int *syscalls;
+				int nsyscalls = pfs_dispatch64_passthrough(&syscalls);
+				if (tracer_seccomp_install(syscalls, nsyscalls) == -1) {
+					/* We are resumed without syscall-stops, so we cannot run untrapped. */
+					fprintf(stderr, "unable to install seccomp filter: %s\n", strerror(errno));
+					fflush(stderr);
+					_exit(1);
+				}
+			}
 			execvp(argv[optind],&argv[optind]);
 		}
 		fprintf(stderr, "unable to execute %s: %s\n", argv[optind], strerror(errno));
@@ -1358,7 +1408,7 @@ int main( int argc, char *argv[] )
 
 	root_pid = pid;
 	debug(D_PROCESS,"attaching to pid %d",pid);
-	if (tracer_attach(pid) == -1) {
+	if (tracer_attach(pid, seccomp) == -1) {
 		if (errno == EPERM) {
 			fprintf(stderr,
 				"The `ptrace` system call appears to be disabled.\n"
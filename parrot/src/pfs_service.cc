@@ -51,6 +51,11 @@ int pfs_service::is_local()
 	return 0;
 }
 
+int pfs_service::has_range_reads()
+{
+	return is_seekable();
+}
+
 pfs_file * pfs_service::open( pfs_name *name, int flags, mode_t mode )
 {
 	errno = ENOENT;
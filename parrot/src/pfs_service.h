@@ -24,6 +24,8 @@ public:
 	virtual int get_block_size();
 	virtual int tilde_is_special();
 	virtual int is_seekable() = 0;
+	/* Whether a file can be read at any offset without reading what comes before it, as in the block cache. */
+	virtual int has_range_reads();
 	virtual int is_local();
 
 	virtual pfs_file * open( pfs_name *name, int flags, mode_t mode );
@@ -15,6 +15,7 @@ extern "C" {
 #include "file_cache.h"
 #include "full_io.h"
 #include "http_query.h"
+#include "macros.h"
 }
 
 #include <unistd.h>
@@ -32,7 +33,7 @@ extern "C" {
 
 extern int pfs_main_timeout;
 
-static struct link * http_fetch( pfs_name *name, const char *action, INT64_T *size )
+static struct link * http_fetch( pfs_name *name, const char *action, INT64_T offset, INT64_T end, INT64_T *size )
 {
 	char url[HTTP_LINE_MAX];
 
@@ -42,7 +43,7 @@ static struct link * http_fetch( pfs_name *name, const char *action, INT64_T *si
 	}
 
 	sprintf(url,"http://%s:%d%s",name->host,name->port,name->rest);
-	return http_query_size(url,action,size,time(0)+pfs_main_timeout,0);
+	return http_query_range(url,action,offset,end,size,time(0)+pfs_main_timeout,0);
 }
 
 class pfs_file_http : public pfs_file
@@ -50,20 +51,40 @@ class pfs_file_http : public pfs_file
 private:
 	struct link *link;
 	INT64_T size;
+	INT64_T position;
+	INT64_T end;
 
 public:
 	pfs_file_http( pfs_name *n, struct link *l, INT64_T s ) : pfs_file(n) {
 		link = l;
 		size = s;
+		position = 0;
+		end = s;
 	}
 
 	virtual int close() {
-		link_close(link);
+		if(link) link_close(link);
 		return 0;
 	}
 
 	virtual pfs_ssize_t read( void *d, pfs_size_t length, pfs_off_t offset ) {
-		return link_read(link,(char*)d,length,LINK_FOREVER);
+		if(offset>=size) return 0;
+
+		/* Reading anywhere but where the response is at starts a new request for just the bytes asked. */
+		if(offset!=position || position>=end || !link) {
+			INT64_T sent;
+			if(link) link_close(link);
+			link = 0;
+			debug(D_HTTP,"seeking to %" PRId64 " in %s",(INT64_T)offset,name.path);
+			link = http_fetch(&name,"GET",offset,MIN(offset+length,size),&sent);
+			if(!link) return -1;
+			position = offset;
+			end = offset+sent;
+		}
+
+		pfs_ssize_t actual = link_read(link,(char*)d,MIN(length,end-position),LINK_FOREVER);
+		if(actual>0) position += actual;
+		return actual;
 	}
 
 	virtual int fstat( struct pfs_stat *buf ) {
@@ -94,7 +115,7 @@ public:
 			return 0;
 		}
 
-		link = http_fetch(name,"GET",&size);
+		link = http_fetch(name,"GET",0,0,&size);
 		if(link) {
 			return new pfs_file_http(name,link,size);
 		} else {
@@ -106,7 +127,7 @@ public:
 		struct link *link;
 		INT64_T size;
 
-		link = http_fetch(name,"HEAD",&size);
+		link = http_fetch(name,"HEAD",0,0,&size);
 		if(link) {
 			link_close(link);
 			pfs_service_emulate_stat(name,buf);
@@ -125,6 +146,10 @@ public:
 	virtual int is_seekable (void) {
 		return 0;
 	}
+
+	virtual int has_range_reads (void) {
+		return 1;
+	}
 };
 
 static pfs_service_http pfs_service_http_instance;
@@ -21,12 +21,19 @@ See the file COPYING for details.
 #include <syscall.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
+#include <sys/prctl.h>
 #include <sys/wait.h>
 
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -88,10 +95,20 @@ struct tracer {
 	int has_args5_bug;
 };
 
-int tracer_attach (pid_t pid)
+/* If set, tracees only stop at the entry of the system calls trapped by their seccomp filter. */
+static int tracer_seccomp = 0;
+
+int tracer_attach (pid_t pid, int seccomp)
 {
 	intptr_t options = PTRACE_O_TRACESYSGOOD|PTRACE_O_TRACEEXEC|PTRACE_O_TRACEEXIT|PTRACE_O_TRACECLONE|PTRACE_O_TRACEFORK|PTRACE_O_TRACEVFORK;
 
+	if (seccomp) {
+		/* Before 4.8, the seccomp stop came before the syscall-enter-stop, and the system calls changed by the tracer were not checked again by the filter. */
+		assert(linux_available(4,8,0));
+		options |= PTRACE_O_TRACESECCOMP;
+	}
+	tracer_seccomp = seccomp;
+
 	if (linux_available(3,8,0))
 		options |= PTRACE_O_EXITKILL;
 	assert(linux_available(2,5,60));
@@ -192,19 +209,78 @@ void tracer_detach( struct tracer *t )
 	free(t);
 }
 
-int tracer_continue( struct tracer *t, int signum )
+int tracer_continue( struct tracer *t, int signum, int in_syscall )
 {
+	/* With a seccomp filter, the filter stops the tracee at the next system
+	 * call of interest. We only ask for a syscall-stop to see the exit of a
+	 * system call that stopped at its entry.
+	 */
+	int request = (tracer_seccomp && !in_syscall) ? PTRACE_CONT : PTRACE_SYSCALL;
+
 	t->gotregs = 0;
 	if(t->setregs) {
 		if(ptrace(PTRACE_SETREGS,t->pid,0,&t->regs) == -1)
 			return -1;
 		t->setregs = 0;
 	}
-	if (ptrace(PTRACE_SYSCALL,t->pid,0,signum) == -1)
+	if (ptrace(request,t->pid,0,signum) == -1)
 		ERROR;
 	return 0;
 }
 
+int tracer_seccomp_install( const int *syscalls, int nsyscalls )
+{
+#if defined(CCTOOLS_CPU_X86_64) && defined(SECCOMP_RET_TRACE)
+	struct sock_filter *filter = xxmalloc((2*nsyscalls+16)*sizeof(*filter));
+	struct sock_fprog program;
+	int n = 0;
+	int i;
+
+#define STATEMENT(code,k) do { struct sock_filter f = BPF_STMT(code,k); filter[n++] = f; } while (0)
+#define JUMP(code,k,jt,jf) do { struct sock_filter f = BPF_JUMP(code,k,jt,jf); filter[n++] = f; } while (0)
+
+	/* Trace everything from i386 and x32 programs, as the list is only for x86_64 system call numbers. */
+	STATEMENT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, arch));
+	JUMP(BPF_JMP|BPF_JEQ|BPF_K, AUDIT_ARCH_X86_64, 1, 0);
+	STATEMENT(BPF_RET|BPF_K, SECCOMP_RET_TRACE);
+	STATEMENT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, nr));
+	JUMP(BPF_JMP|BPF_JGE|BPF_K, 0x40000000, 0, 1);
+	STATEMENT(BPF_RET|BPF_K, SECCOMP_RET_TRACE);
+
+	for(i = 0; i < nsyscalls; i++) {
+		JUMP(BPF_JMP|BPF_JEQ|BPF_K, syscalls[i], 0, 1);
+		STATEMENT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW);
+	}
+
+	/* Parrot leaves anonymous mmaps alone. Only the lower half of the flags is loaded, which is where MAP_ANONYMOUS is. */
+	JUMP(BPF_JMP|BPF_JEQ|BPF_K, SYSCALL64_mmap, 0, 3);
+	STATEMENT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, args[3]));
+	JUMP(BPF_JMP|BPF_JSET|BPF_K, MAP_ANONYMOUS, 0, 1);
+	STATEMENT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW);
+	STATEMENT(BPF_RET|BPF_K, SECCOMP_RET_TRACE);
+
+#undef STATEMENT
+#undef JUMP
+
+	program.len = n;
+	program.filter = filter;
+
+	/* Without CAP_SYS_ADMIN, a filter can only be installed if the process cannot gain privileges. Under ptrace, setuid programs do not gain them anyway. */
+	int result = -1;
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 && prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0)
+		result = 0;
+
+	int saved_errno = errno;
+	free(filter);
+	errno = saved_errno;
+
+	return result;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
 int tracer_args_get( struct tracer *t, INT64_T *syscall, INT64_T args[TRACER_ARGS_MAX] )
 {
 	if(!t->gotregs) {
@@ -15,10 +15,10 @@ See the file COPYING for details.
 
 struct tracer;
 
-int tracer_attach( pid_t pid );
+int tracer_attach( pid_t pid, int seccomp );
 void tracer_detach( struct tracer *t );
 struct tracer *tracer_init( pid_t pid );
-int tracer_continue( struct tracer *t, int signum );
+int tracer_continue( struct tracer *t, int signum, int in_syscall );
 int tracer_listen( struct tracer *t );
 int tracer_getevent( struct tracer *t, unsigned long *message );
 
@@ -27,6 +27,15 @@ int tracer_args_set( struct tracer *t, INT64_T syscall, const INT64_T args[], in
 
 void tracer_has_args5_bug( struct tracer *t );
 
+/*
+Install in the calling process a seccomp filter that lets the x86_64
+system calls in syscalls, and anonymous mmaps, run without stopping,
+and traps every other system call to the tracer. Must be called by the
+tracee once it is being traced by a tracer attached with seccomp set,
+as trapped system calls fail with ENOSYS when there is no tracer.
+*/
+int tracer_seccomp_install( const int *syscalls, int nsyscalls );
+
 int tracer_result_get( struct tracer *t, INT64_T *result );
 int tracer_result_set( struct tracer *t, INT64_T result );
 
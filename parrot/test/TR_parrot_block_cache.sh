@@ -0,0 +1,207 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+. ../../chirp/test/chirp-common.sh
+CHIRP_SERVER=../../chirp/src/chirp_server
+
+c="./hostport.$PPID"
+http_port="./http_port.$PPID"
+http_pid="./http_pid.$PPID"
+exe="block_cache.test"
+stats=block_cache.stats
+http_log=block_cache.http.log
+
+check_needed()
+{
+	[ "${PARROT_SKIP_TEST}" = yes ] && return 1
+	command -v python3 >/dev/null 2>&1 || return 1
+}
+
+prepare()
+{
+	mkdir -p fixtures
+	echo unix:* rwl > fixtures/.__acl
+
+	# 4MB of data that differs at every offset.
+	seq 1 600000 > fixtures/data
+	cp fixtures/data data.local
+
+	chirp_start ./fixtures
+	echo "$hostport" > "$c"
+
+	# Serves /data honoring "Range: bytes=N-M" with a 206, and /norange/data always with a 200 of the whole file.
+	cat > block_cache_http.py <<'EOF'
+import http.server, os, re, sys
+
+data = open(sys.argv[1], "rb").read()
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    def do_HEAD(self):
+        self.respond(False)
+
+    def do_GET(self):
+        self.respond(True)
+
+    def respond(self, body):
+        self.range = self.headers.get("Range", "-")
+        ranged = re.match(r"bytes=(\d+)-(\d*)$", self.range)
+        if self.path not in ("/data", "/norange/data"):
+            self.send_error(404)
+            return
+        start, end = 0, len(data)
+        if ranged and self.path == "/data":
+            start = int(ranged.group(1))
+            if ranged.group(2):
+                end = min(end, int(ranged.group(2)) + 1)
+            self.send_response(206)
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end - 1, len(data)))
+        else:
+            self.send_response(200)
+        self.send_header("Content-Length", str(end - start))
+        self.end_headers()
+        if body:
+            try:
+                self.wfile.write(data[start:end])
+            except (BrokenPipeError, ConnectionResetError):
+                pass
+
+    def log_message(self, format, *args):
+        with open(sys.argv[3], "a") as log:
+            log.write("%s %s %s\n" % (args[1], self.path, self.range))
+
+server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+with open(sys.argv[2] + ".tmp", "w") as f:
+    f.write(str(server.server_address[1]))
+os.rename(sys.argv[2] + ".tmp", sys.argv[2])
+server.serve_forever()
+EOF
+
+	python3 block_cache_http.py fixtures/data "$http_port" "$http_log" &
+	echo $! > "$http_pid"
+	wait_for_file_creation "$http_port" 5
+
+	gcc -g $CCTOOLS_TEST_CCFLAGS -o "$exe" -x c - -x none <<EOF
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char remote[65536];
+static char local[65536];
+
+static int compare(int rfd, int lfd, off_t offset, size_t length)
+{
+	ssize_t r = pread(rfd, remote, length, offset);
+	ssize_t l = pread(lfd, local, length, offset);
+	if (r != l || (r > 0 && memcmp(remote, local, r))) {
+		fprintf(stderr, "mismatch at %lld: %zd and %zd bytes\n", (long long)offset, r, l);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int rfd = open(argv[1], O_RDONLY);
+	int lfd = open(argv[2], O_RDONLY);
+	if (rfd < 0 || lfd < 0) {
+		perror("open");
+		return 1;
+	}
+
+	off_t size = lseek(lfd, 0, SEEK_END);
+	int reads = atoi(argv[3]);
+	int i;
+
+	/* Scattered reads, some crossing block boundaries, and some past the end. */
+	srand(1);
+	for (i = 0; i < reads; i++) {
+		off_t offset = rand() % (size + 1000);
+		if (compare(rfd, lfd, offset, 1 + rand() % sizeof(local)))
+			return 1;
+	}
+
+	if (argc > 4 && !strcmp(argv[4], "scattered"))
+		return 0;
+
+	/* A sequential read of the first half, twice, through the read ahead window and back. */
+	int pass;
+	for (pass = 0; pass < 2; pass++) {
+		off_t offset;
+		for (offset = 0; offset < size / 2; offset += 10000) {
+			if (compare(rfd, lfd, offset, 10000))
+				return 1;
+		}
+	}
+
+	struct stat info;
+	if (fstat(rfd, &info) < 0 || info.st_size != size) {
+		fprintf(stderr, "wrong size\n");
+		return 1;
+	}
+
+	return 0;
+}
+EOF
+}
+
+stat_value()
+{
+	sed -n "s/.*\"parrot.cache.$1\":\([0-9]*\).*/\1/p" "$stats"
+}
+
+run()
+{
+	hostport=$(cat "$c")
+
+	size=$(wc -c < data.local)
+
+	# A few scattered reads fetch only the blocks they touch.
+	parrot --no-chirp-catalog --timeout=5 -F --cache-block-size=64K --stats-file="$stats" -- ./"$exe" /chirp/$hostport/data data.local 10 scattered || return 1
+	fetched=$(stat_value bytes_fetched)
+	echo "fetched $fetched of $size bytes"
+	[ -n "$fetched" ] && [ "$fetched" -gt 0 ] && [ "$fetched" -lt "$size" ] || return 1
+
+	# With a cache smaller than the file, blocks are evicted and fetched again.
+	parrot --no-chirp-catalog --timeout=5 -F --cache-block-size=64K --cache-max-size=1M --stats-file="$stats" -- ./"$exe" /chirp/$hostport/data data.local 200 || return 1
+	evicted=$(stat_value blocks_evicted)
+	echo "evicted $evicted blocks"
+	[ -n "$evicted" ] && [ "$evicted" -gt 0 ] || return 1
+
+	# Over HTTP, blocks are fetched with range requests for just the blocks wanted, answered with 206.
+	unset HTTP_PROXY
+	port=$(cat "$http_port")
+	rm -f "$http_log"
+	parrot --timeout=5 --cache-block-size=64K --stats-file="$stats" -- ./"$exe" /http/127.0.0.1:$port/data data.local 20 scattered || return 1
+	fetched=$(stat_value bytes_fetched)
+	echo "fetched $fetched of $size bytes over http"
+	[ -n "$fetched" ] && [ "$fetched" -gt 0 ] && [ "$fetched" -lt "$size" ] || return 1
+	grep -q "^206 /data bytes=[0-9]*-[0-9]" "$http_log" || return 1
+	grep -q "^206 /data bytes=[0-9]*-$" "$http_log" && return 1
+
+	# A server that ignores the range answers 200. Near the start, the client skips ahead to the offset,
+	# and further on it reads the object in order, fetching each block about once.
+	parrot --timeout=5 --cache-block-size=64K --stats-file="$stats" -- ./"$exe" /http/127.0.0.1:$port/norange/data data.local 20 scattered || return 1
+	fetched=$(stat_value bytes_fetched)
+	echo "fetched $fetched of $size bytes over http without ranges"
+	[ -n "$fetched" ] && [ "$fetched" -lt $((2*size)) ] || return 1
+	grep -q "^200 /norange/data bytes=" "$http_log"
+}
+
+clean()
+{
+	chirp_clean
+	[ -f "$http_pid" ] && kill $(cat "$http_pid")
+	rm -rf "$c" "$http_port" "$http_pid" "$http_log" "$exe" "$stats" block_cache_http.py data.local fixtures
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
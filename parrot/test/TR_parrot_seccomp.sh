@@ -0,0 +1,169 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+exe="seccomp.test"
+
+check_needed()
+{
+	if [ "${PARROT_SKIP_TEST}" = yes ]
+	then
+		return 1
+	fi
+
+	# The seccomp stops used by --seccomp appeared in linux 4.8.
+	major=$(uname -r | cut -d. -f1)
+	minor=$(uname -r | cut -d. -f2)
+	if [ "$major" -lt 4 ] || { [ "$major" -eq 4 ] && [ "$minor" -lt 8 ]; }
+	then
+		return 1
+	fi
+
+	return 0
+}
+
+prepare()
+{
+	gcc -I../src/ -g $CCTOOLS_TEST_CCFLAGS -o "$exe" -x c - -x none -lpthread -lm <<EOF
+#define _GNU_SOURCE
+
+#include <pthread.h>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CATCH(expr) \\
+	do {\\
+		if (!(expr)) {\\
+			fprintf(stderr, "[%s:%d] ", __FILE__, __LINE__);\\
+			perror(#expr);\\
+			exit(EXIT_FAILURE);\\
+		}\\
+	} while (0)
+
+static void readfile (const char *path)
+{
+	char buf[64] = "";
+	int fd = open(path, O_RDONLY);
+	CATCH(fd >= 0);
+	CATCH(read(fd, buf, sizeof(buf)-1) > 0);
+	close(fd);
+	printf("read %s", buf);
+}
+
+static void *thread (void *arg)
+{
+	readfile(arg);
+	return NULL;
+}
+
+static void alarmed (int sig)
+{
+}
+
+int main (int argc, char *argv[])
+{
+	int i;
+	int word = 0;
+
+	if (argc > 1 && strcmp(argv[1], "exec") == 0)
+		return 0;
+
+	/* System calls passed through by the filter. */
+	for (i = 0; i < 1000; i++) {
+		sched_yield();
+		syscall(SYS_futex, &word, FUTEX_WAKE, 1, NULL, NULL, 0);
+	}
+
+	char *anonymous = mmap(NULL, 1<<20, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	CATCH(anonymous != MAP_FAILED);
+	memset(anonymous, 'a', 1<<20);
+	CATCH(munmap(anonymous, 1<<20) == 0);
+
+	/* System calls trapped by the filter still see the namespace of Parrot. */
+	readfile(argv[1]);
+
+	int fd = open(argv[1], O_RDONLY);
+	CATCH(fd >= 0);
+	char *mapped = mmap(NULL, 4096, PROT_READ, MAP_PRIVATE, fd, 0);
+	CATCH(mapped != MAP_FAILED);
+	printf("mapped %.*s", (int)(strchr(mapped, '\n') - mapped + 1), mapped);
+	munmap(mapped, 4096);
+	close(fd);
+
+	pthread_t id;
+	CATCH(pthread_create(&id, NULL, thread, argv[1]) == 0);
+	pthread_join(id, NULL);
+
+	/* A trapped read interrupted by a signal is restarted. */
+	int fds[2];
+	CATCH(pipe(fds) == 0);
+	pid_t pid = fork();
+	CATCH(pid >= 0);
+	if (pid == 0) {
+		usleep(200000);
+		CATCH(write(fds[1], "restarted\n", 10) == 10);
+		execl(argv[0], argv[0], "exec", NULL);
+		_exit(EXIT_FAILURE);
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = alarmed;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGALRM, &sa, NULL);
+	ualarm(50000, 0);
+
+	char buf[64] = "";
+	CATCH(read(fds[0], buf, sizeof(buf)-1) == 10);
+	printf("pipe %s", buf);
+
+	int status;
+	CATCH(waitpid(pid, &status, 0) == pid);
+	printf("child %d\n", WEXITSTATUS(status));
+
+	return 0;
+}
+EOF
+	cat > output.expected <<EOF
+read hello
+mapped hello
+read hello
+pipe restarted
+child 0
+EOF
+	echo hello > seccomp.input
+}
+
+run()
+{
+	if parrot --seccomp -M /seccomp/input="$PWD/seccomp.input" -- ./"$exe" /seccomp/input > output.actual
+	then
+		require_identical_files output.actual output.expected
+		return 0
+	else
+		return 1
+	fi
+}
+
+clean()
+{
+	rm -f "$exe" seccomp.input output.actual output.expected
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -28,6 +28,10 @@ from ndcctools.taskvine.utils import load_variable_from_library
 r, w = os.pipe()
 exec_method = None
 
+# results of forked function calls with inline arguments, by function id.
+# the child writes the result to this file, and the parent sends it to the worker.
+inline_result_files = {}
+
 
 # This class captures how results from FunctionCalls are conveyed from
 # the library to the manager.
@@ -84,10 +88,24 @@ def sigchld_handler(signum, frame):
     os.writev(w, [b"a"])
 
 
+# Read exactly size bytes from fd, as a pipe may return less than asked.
+def read_exactly(fd, size):
+    data = b""
+    while len(data) < size:
+        chunk = os.read(fd, size - len(data))
+        if chunk == b"":
+            stdout_timed_message(f"can't read {size} bytes from fd {fd}")
+            exit(1)
+        data += chunk
+    return data
+
+
 # Read data from worker, start function, and dump result to `outfile`.
+# If the arguments are sent inline, the result is returned along with
+# the function id rather than dumped to a file.
 def start_function(in_pipe_fd, thread_limit=1):
-    # read length of buffer to read
-    buffer_len = b""
+    # read length of buffer to read, and length of the inline arguments if any
+    header = b""
     while True:
         c = os.read(in_pipe_fd, 1)
         if c == b"":
@@ -96,10 +114,15 @@ def start_function(in_pipe_fd, thread_limit=1):
         elif c == b"\n":
             break
         else:
-            buffer_len += c
-    buffer_len = int(buffer_len)
+            header += c
+    header = header.split()
+    buffer_len = int(header[0])
+    input_len = int(header[1]) if len(header) > 1 else None
     # now read the buffer to get invocation details
-    line = str(os.read(in_pipe_fd, buffer_len), encoding="utf-8")
+    line = str(read_exactly(in_pipe_fd, buffer_len), encoding="utf-8")
+    function_input = None
+    if input_len is not None:
+        function_input = read_exactly(in_pipe_fd, input_len)
 
     try:
         (
@@ -123,6 +146,9 @@ def start_function(in_pipe_fd, thread_limit=1):
         stdout_timed_message(f"error: invalid function name, malformed message {line} from worker")
         exit(1)
 
+    if function_input is not None:
+        return start_inline_function(function_id, function_name, function_sandbox, function_input, thread_limit)
+
     with threadpool_limits(limits=thread_limit):
         global exec_method
         if exec_method == "direct":
@@ -242,12 +268,82 @@ def start_function(in_pipe_fd, thread_limit=1):
     return -1
 
 
+# Run a function call whose arguments were sent inline, without files in a sandbox.
+# In direct mode, return the exit code and the serialized result along with the function id.
+# In fork mode, return the pid of the child, which leaves the result in a file in the library's
+# sandbox to be sent by the parent when the child is reaped.
+def start_inline_function(function_id, function_name, function_sandbox, function_input, thread_limit=1):
+    with threadpool_limits(limits=thread_limit):
+        if exec_method == "direct":
+            library_sandbox = os.getcwd()
+            try:
+                if function_sandbox != "-":
+                    os.chdir(function_sandbox)
+                event = cloudpickle.loads(function_input)
+                result = globals()[function_name](event)
+                exit_code = 0 if result["Success"] else 1
+            except Exception as e:
+                stdout_timed_message(f"TASK {function_id} error: execution failed due to {e}")
+                result = LibraryResponse(None, False, traceback.format_exc()).generate()
+                exit_code = 1
+            finally:
+                os.chdir(library_sandbox)
+            return -1, function_id, exit_code, cloudpickle.dumps(result)
+
+        result_file = os.path.join(os.getcwd(), f".result.{function_id}")
+        p = os.fork()
+        if p == 0:
+            exit_status = 1
+            try:
+                if function_sandbox != "-":
+                    os.chdir(function_sandbox)
+                event = cloudpickle.loads(function_input)
+                result = globals()[function_name](event)
+                with open(result_file, "wb") as f:
+                    cloudpickle.dump(result, f)
+                exit_status = 0 if result["Success"] else 5
+            except Exception as e:
+                stdout_timed_message(f"TASK {function_id} error: execution failed due to {e}")
+            finally:
+                os._exit(exit_status)
+        elif p < 0:
+            stdout_timed_message(f"TASK {function_id} error: unable to fork to execute {function_name}")
+            return -1, function_id, 1, None
+
+        inline_result_files[function_id] = result_file
+        return p, function_id, None, None
+
+
+# Collect the result left by a forked function call with inline arguments, if any.
+def collect_inline_result(function_id):
+    result_file = inline_result_files.pop(function_id, None)
+    if not result_file:
+        return None
+    try:
+        with open(result_file, "rb") as f:
+            return f.read()
+    except Exception:
+        return cloudpickle.dumps(LibraryResponse(None, False, "function call did not produce a result").generate())
+    finally:
+        if os.path.exists(result_file):
+            os.remove(result_file)
+
+
 # Send result of a function execution to worker. Wake worker up to do work with SIGCHLD.
-def send_result(out_pipe_fd, worker_pid, task_id, exit_code):
+# If the function was called with inline arguments, its serialized result follows the message.
+def send_result(out_pipe_fd, worker_pid, task_id, exit_code, result=None):
     buff = bytes(f"{task_id} {exit_code}", "utf-8")
-    buff = bytes(str(len(buff)), "utf-8") + b"\n" + buff
-    os.writev(out_pipe_fd, [buff])
+    if result is None:
+        buff = bytes(str(len(buff)), "utf-8") + b"\n" + buff
+    else:
+        buff = bytes(f"{len(buff)} {len(result)}", "utf-8") + b"\n" + buff + result
+    # a large result does not fit in the pipe, so the worker is woken up
+    # as soon as the message starts rather than once it has been written.
+    head, rest = buff[:select.PIPE_BUF], buff[select.PIPE_BUF:]
+    os.writev(out_pipe_fd, [head])
     os.kill(worker_pid, signal.SIGCHLD)
+    while rest:
+        rest = rest[os.write(out_pipe_fd, rest):]
 
 
 # Self-identifying message to send back to the worker, including the name of this library.
@@ -423,16 +519,22 @@ def main():
             # worker has a function, run it
             if re == in_pipe_fd:
                 if exec_method == 'direct':
-                    _, func_id = start_function(in_pipe_fd, thread_limit)
+                    _, func_id, *inline = start_function(in_pipe_fd, thread_limit)
+                    exit_code, result = inline if inline else (0, None)
                     send_result(
                         out_pipe_fd,
                         args.worker_pid,
                         func_id,
-                        0,
+                        exit_code,
+                        result,
                     )
                 else:
-                    pid, func_id = start_function(in_pipe_fd, thread_limit)
-                    pid_to_func_id[pid] = func_id
+                    pid, func_id, *inline = start_function(in_pipe_fd, thread_limit)
+                    if pid > 0:
+                        pid_to_func_id[pid] = func_id
+                    elif inline:
+                        # the inline function call could not be started
+                        send_result(out_pipe_fd, args.worker_pid, func_id, inline[0], inline[1])
             else:
                 # at least 1 child exits, reap all.
                 # read only once as os.read is blocking if there's nothing to read.
@@ -447,6 +549,7 @@ def main():
                             args.worker_pid,
                             pid_to_func_id[c_pid],
                             c_exit_status,
+                            collect_inline_result(pid_to_func_id[c_pid]),
                         )
                         del pid_to_func_id[c_pid]
                     # no exited child to reap, break
@@ -151,6 +151,7 @@ See the file COPYING for details.
 #include "xxmalloc.h"
 
 #include "rmonitor.h"
+#include "rmonitor_cgroup.h"
 #include "rmonitor_file_watch.h"
 #include "rmonitor_poll_internal.h"
 
@@ -199,6 +200,9 @@ struct hash_table *wdirs; /* Maps paths to working directory structures. */
 struct itable *filesysms; /* Maps st_dev ids (from stat syscall) to filesystem structures. */
 struct hash_table *files; /* Keeps track of which files have been opened. */
 
+struct rmonitor_cgroup *cgroup = NULL; /* cgroup v2 of the process tree, if cgroups are delegated to us. */
+static int use_cgroup = 1;	       /* Whether to try to measure the process tree with a cgroup. */
+
 static int follow_chdir = 0;	 /* Keep track of all the working directories per process. */
 static int pprint_summaries = 1; /* Pretty-print json summaries. */
 
@@ -943,7 +947,7 @@ double peak_cores(double wall_time, double cpu_time)
 	return ((double)diff_cpu) / diff_wall;
 }
 
-void rmonitor_collate_tree(struct rmsummary *tr, struct rmonitor_process_info *p, struct rmonitor_mem_info *m, struct rmonitor_wdir_info *d, struct rmonitor_filesys_info *f)
+void rmonitor_collate_tree(struct rmsummary *tr, struct rmonitor_process_info *p, struct rmonitor_mem_info *m, struct rmonitor_wdir_info *d, struct rmonitor_filesys_info *f, struct rmonitor_cgroup_info *cg)
 {
 	tr->start = summary->start;
 	tr->end = ((double)usecs_since_epoch()) / ONE_SECOND;
@@ -951,8 +955,12 @@ void rmonitor_collate_tree(struct rmsummary *tr, struct rmonitor_process_info *p
 	tr->wall_time = tr->end - tr->start;
 
 	/* using .delta here because if we use .accumulated, then we lose information of processes that already
-	 * terminated. */
-	tr->cpu_time += ((double)p->cpu.delta) / ONE_SECOND;
+	 * terminated. The cgroup keeps the total of every process that ran in it, so when available it is used as is. */
+	if (cg && cg->cpu_time >= 0) {
+		tr->cpu_time = ((double)cg->cpu_time) / ONE_SECOND;
+	} else {
+		tr->cpu_time += ((double)p->cpu.delta) / ONE_SECOND;
+	}
 	tr->context_switches += p->ctx.delta;
 
 	tr->cores = 0;
@@ -1497,6 +1505,20 @@ struct rmsummary *rmonitor_final_usage_tree(void)
 	tr_usg->cpu_time = 0;
 	tr_usg->cpu_time += usg.ru_utime.tv_sec + (((double)usg.ru_utime.tv_usec) / ONE_SECOND);
 	tr_usg->cpu_time += usg.ru_stime.tv_sec + (((double)usg.ru_stime.tv_usec) / ONE_SECOND);
+	/* The cgroup also accounts for the processes that were not waited for, or that we never saw. */
+	struct rmonitor_cgroup_info cg;
+	if (cgroup && rmonitor_cgroup_measure(cgroup, &cg)) {
+		if (cg.cpu_time >= 0) {
+			tr_usg->cpu_time = MAX(tr_usg->cpu_time, ((double)cg.cpu_time) / ONE_SECOND);
+		}
+
+		/* io.stat only counts what reached the block devices, so it is a lower bound of what /proc reports. */
+		if (cg.bytes_read >= 0) {
+			tr_usg->bytes_read = MAX(tr_usg->bytes_read, ((double)cg.bytes_read) / ONE_MEGABYTE);
+			tr_usg->bytes_written = MAX(tr_usg->bytes_written, ((double)cg.bytes_written) / ONE_MEGABYTE);
+		}
+	}
+
 	tr_usg->start = summary->start;
 	tr_usg->end = ((double)usecs_since_epoch() / ONE_SECOND);
 	tr_usg->wall_time = tr_usg->end - tr_usg->start;
@@ -1609,6 +1631,11 @@ void rmonitor_final_cleanup()
 			kill(pid, SIGKILL);
 		}
 
+		/* also kill the processes we never saw, such as those started by static executables. */
+		if (cgroup) {
+			rmonitor_cgroup_kill(cgroup);
+		}
+
 		while (!first_process_already_waited) {
 			usleep((int)(0.1 * USECOND)); // 0.2s
 
@@ -1628,6 +1655,11 @@ void rmonitor_final_cleanup()
 
 	send_catalog_update(summary, 1);
 
+	if (cgroup) {
+		rmonitor_cgroup_delete(cgroup);
+		cgroup = NULL;
+	}
+
 	if (log_series)
 		fclose(log_series);
 	if (log_inotify)
@@ -1926,12 +1958,32 @@ struct rmonitor_process_info *spawn_first_process(const char *executable, char *
 {
 	pid_t pid;
 
+	/* The child waits on this pipe until it has been moved to the cgroup, so that all its descendants are created
+	 * in the cgroup. */
+	int cgroup_sync[2] = {-1, -1};
+	if (cgroup && pipe(cgroup_sync) < 0) {
+		debug(D_RMON, "could not create pipe: %s\n", strerror(errno));
+		rmonitor_cgroup_delete(cgroup);
+		cgroup = NULL;
+	}
+
 	pid = rmonitor_fork();
 
 	rmonitor_summary_header();
 
 	if (pid > 0) {
 		first_process_pid = pid;
+
+		if (cgroup) {
+			if (!rmonitor_cgroup_join(cgroup, pid)) {
+				rmonitor_cgroup_delete(cgroup);
+				cgroup = NULL;
+			}
+
+			close(cgroup_sync[0]);
+			close(cgroup_sync[1]);
+		}
+
 		close(STDIN_FILENO);
 		close(STDOUT_FILENO);
 
@@ -1963,6 +2015,15 @@ struct rmonitor_process_info *spawn_first_process(const char *executable, char *
 		exit(RM_MONITOR_ERROR);
 	} else // child
 	{
+		if (cgroup_sync[0] >= 0) {
+			char c;
+			close(cgroup_sync[1]);
+			/* returns at end of file, once the parent closes its end. */
+			while (read(cgroup_sync[0], &c, 1) < 0 && errno == EINTR) {
+			}
+			close(cgroup_sync[0]);
+		}
+
 		debug(D_RMON, "executing: %s\n", executable);
 
 		char *pid_s = string_format("%d", getpid());
@@ -2013,6 +2074,7 @@ static void show_help(const char *cmd)
 	fprintf(stdout, "%-30s execution is followed. Can be specified multiple times.\n", "");
 	fprintf(stdout, "%-30s See --without-disk-footprint below.\n", "");
 	fprintf(stdout, "%-30s Do not measure working directory footprint. Overrides --measure-dir and --follow-chdir.\n", "--without-disk-footprint");
+	fprintf(stdout, "%-30s Do not measure the command in its own cgroup, even if cgroups v2 are delegated.\n", "--without-cgroup");
 	fprintf(stdout, "\n");
 	fprintf(stdout, "%-30s Report measurements to catalog server with \"task\"=<task-name>.\n", "--catalog-task-name=<name>");
 	fprintf(stdout, "%-30s Set project name of catalog update to <project> (default=<task-name>).\n", "--catalog-project=<project>");
@@ -2051,6 +2113,9 @@ int rmonitor_resources(long int interval /*in seconds */)
 
 		ping_processes();
 
+		struct rmonitor_cgroup_info cg_now;
+		int cg_available = cgroup && rmonitor_cgroup_measure(cgroup, &cg_now);
+
 		rmonitor_poll_all_processes_once(processes, p_acc);
 		rmonitor_poll_maps_once(processes, m_acc);
 
@@ -2060,7 +2125,7 @@ int rmonitor_resources(long int interval /*in seconds */)
 
 		// rmonitor_fss_once(f); disabled until statfs fs id makes sense.
 
-		rmonitor_collate_tree(resources_now, p_acc, m_acc, d_acc, f_acc);
+		rmonitor_collate_tree(resources_now, p_acc, m_acc, d_acc, f_acc, cg_available ? &cg_now : NULL);
 		rmonitor_find_max_tree(summary, resources_now);
 		rmonitor_find_max_tree(snapshot, resources_now);
 		rmonitor_log_row(resources_now);
@@ -2175,6 +2240,7 @@ int main(int argc, char **argv)
 		LONG_OPT_OPENED_FILES,
 		LONG_OPT_DISK_FOOTPRINT,
 		LONG_OPT_NO_DISK_FOOTPRINT,
+		LONG_OPT_NO_CGROUP,
 		LONG_OPT_SH_CMDLINE,
 		LONG_OPT_WORKING_DIRECTORY,
 		LONG_OPT_FOLLOW_CHDIR,
@@ -2216,6 +2282,7 @@ int main(int argc, char **argv)
 			{"with-time-series", no_argument, 0, LONG_OPT_TIME_SERIES},
 			{"with-inotify", no_argument, 0, LONG_OPT_OPENED_FILES},
 			{"without-disk-footprint", no_argument, 0, LONG_OPT_NO_DISK_FOOTPRINT},
+			{"without-cgroup", no_argument, 0, LONG_OPT_NO_CGROUP},
 
 			{"snapshot-file", required_argument, 0, LONG_OPT_SNAPSHOT_FILE},
 			{"snapshot-events", required_argument, 0, LONG_OPT_SNAPSHOT_WATCH_CONF},
@@ -2288,6 +2355,9 @@ int main(int argc, char **argv)
 			resources_flags->disk = 0;
 			follow_chdir = 0;
 			break;
+		case LONG_OPT_NO_CGROUP:
+			use_cgroup = 0;
+			break;
 		case LONG_OPT_FOLLOW_CHDIR:
 			follow_chdir = 1;
 			break;
@@ -2504,6 +2574,12 @@ int main(int argc, char **argv)
 			exit(RM_MONITOR_ERROR);
 		}
 
+		if (use_cgroup) {
+			char *cgroup_name = string_format("resource_monitor-%d", getpid());
+			cgroup = rmonitor_cgroup_create(cgroup_name);
+			free(cgroup_name);
+		}
+
 		spawn_first_process(executable, argv + optind, child_in_foreground);
 	}
 
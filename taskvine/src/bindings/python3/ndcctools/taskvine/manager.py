@@ -554,6 +554,15 @@ class Manager(object):
     def set_property(self, name, value):
         cvine.vine_set_property(self._taskvine, name, value)
 
+    ##
+    # Keep the checksums of declared files in a file, so that unchanged files
+    # are not read again by later runs.
+    #
+    # @param self     Reference to the current manager object.
+    # @param filename The filename.
+    def enable_checksum_cache(self, filename):
+        return cvine.vine_enable_checksum_cache(self._taskvine, filename)
+
     ##
     # Specify a directory to write logs and staging files.
     #
@@ -845,6 +854,7 @@ class Manager(object):
     # - "keepalive-interval" Set the minimum number of seconds to wait before sending new keepalive checks to workers. (default=300)
     # - "keepalive-timeout" Set the minimum number of seconds to wait for a keepalive response from worker before marking it as dead. (default=30)
     # - "long-timeout" Set the minimum timeout in seconds when sending a large message to a single worker. (default=3600)
+    # - "max-dispatch-per-cycle" Maximum number of tasks to send to workers in one pass of the main loop before checking for results again. (default=100)
     # - "max-retrievals" Sets the max number of tasks to retrieve per manager wait(). If less than 1, the manager prefers to retrieve all completed tasks before dispatching new tasks to workers. (default=1)
     # - "min-transfer-timeout" Set the minimum number of seconds to wait for files to be transferred to or from a worker. (default=10)
     # - "monitor-interval" Parameter to change how frequently the resource monitor records resource consumption of a task in a times series, if this feature is enabled. See @ref enable_monitoring.
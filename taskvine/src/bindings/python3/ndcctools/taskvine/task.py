@@ -709,6 +709,7 @@ class Task(object):
     # - time_when_commit_end
     # - time_when_retrieval
     # - time_workers_execute_last
+    # - time_workers_stage_in_last
     # - time_workers_execute_all
     # - time_workers_execute_exhaustion
     # - time_workers_execute_failure
@@ -1090,8 +1091,20 @@ class FunctionCall(PythonTask):
         self._event["fn_kwargs"] = kwargs
 
         self._saved_output = None
+        self._inline = False
         self.set_library_required(library)
 
+    ##
+    # Send the arguments and the result of the function call inline with
+    # the messages between the manager, the worker, and the library, rather than
+    # as files. The call then runs without a sandbox directory at the worker,
+    # which suits many short calls with small arguments and results.
+    #
+    # @param self       Reference to the current FunctionCall object.
+    # @param inline     True to send the arguments and the result inline.
+    def set_inline(self, inline=True):
+        self._inline = inline
+
     ##
     # Finalizes the task definition once the manager that will execute is run.
     # This function is run by the manager before registering the task for
@@ -1103,6 +1116,11 @@ class FunctionCall(PythonTask):
         if not self.manager.check_library_exists(library_name):
             raise ValueError(f"invalid library name \'{library_name}\'")
 
+        if self._inline:
+            cvine.vine_task_set_function_input(self._task, cloudpickle.dumps(self._event))
+            self._event = None
+            return
+
         name = os.path.join(self.manager.staging_directory, "arguments", self._id)
         with open(name, "wb") as wf:
             cloudpickle.dump(self._event, wf)
@@ -1150,9 +1168,12 @@ class FunctionCall(PythonTask):
         if not self._output_loaded:
             if self.successful():
                 try:
-                    output = self._output_file.contents()
-                    if self._serialize_output:
-                        output = cloudpickle.loads(output)
+                    if self._inline:
+                        output = cloudpickle.loads(cvine.vine_task_stdout_as_bytes(self._task))
+                    else:
+                        output = self._output_file.contents()
+                        if self._serialize_output:
+                            output = cloudpickle.loads(output)
                 except Exception as e:
                     self._output = e
 
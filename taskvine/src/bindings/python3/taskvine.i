@@ -64,6 +64,14 @@ into a swig function f(data) */
     PyObject *vine_file_contents_as_bytes(struct vine_file *f) {
         return PyBytes_FromStringAndSize(vine_file_contents(f), vine_file_size(f));
     }
+
+    PyObject *vine_task_stdout_as_bytes(struct vine_task *t) {
+        const char *output = vine_task_get_stdout(t);
+        if (!output) {
+            Py_RETURN_NONE;
+        }
+        return PyBytes_FromStringAndSize(output, vine_task_get_stdout_length(t));
+    }
 %}
 
 %include "stdint.i"
@@ -219,6 +219,12 @@ struct vine_stats {
 				   the workers by the manager. */
 	double bandwidth; /**< Average network bandwidth in MB/S observed by the manager when transferring to workers.
 			   */
+	int64_t peer_transfers;	     /**< Total number of connections served by workers to their peers. */
+	int64_t bytes_peer_sent;     /**< Total number of file bytes sent by workers to their peers. */
+	timestamp_t time_peer_sent;  /**< Total time workers spent sending files to their peers. */
+	double peer_bandwidth_max;   /**< Highest bandwidth in MB/S of a single peer transfer reported by any worker. */
+	int peer_transfers_active;   /**< Number of peer transfers being served right now, across connected workers. */
+	double dispatch_rate;	     /**< Tasks sent to workers per second of time spent dispatching them. */
 
 	/* resources statistics */
 	int capacity_tasks;  /**< The estimated number of tasks that this manager can effectively support. */
@@ -322,6 +328,18 @@ Note that "direct" will limit the number of function slots in a library to 1.
 */
 void vine_task_set_function_exec_mode_from_string(struct vine_task *t, const char *exec_mode);
 
+/** Send the arguments of a function call inline with the task.
+The arguments are passed directly to the library along with the invocation,
+rather than as an input file, and the result of the function is returned
+as the output of the task (see @ref vine_task_get_stdout_length).
+A function call with inline arguments and no input or output files
+runs without a sandbox directory at the worker.
+@param t A task object that requires a library.
+@param buffer The serialized arguments of the function call.
+@param size The length of the arguments in bytes.
+*/
+void vine_task_set_function_input(struct vine_task *t, const char *buffer, size_t size);
+
 /** Add a general file object as a input to a task.
 @param t A task object.
 @param f A file object, created by @ref vine_declare_file, @ref vine_declare_url, @ref vine_declare_buffer, @ref
@@ -550,6 +568,15 @@ then this function returns null.
 
 const char *vine_task_get_stdout(struct vine_task *t);
 
+/** Get the length of the standard output of the task.
+The output of a task may contain binary data, such as
+the result of a function call with inline arguments.
+@param t A task object.
+@return The number of bytes retrieved in @ref vine_task_get_stdout.
+*/
+
+int64_t vine_task_get_stdout_length(struct vine_task *t);
+
 /** Get the address and port of the worker on which the task ran.
 @param t A task object.
 @return A null-terminated string containing the address
@@ -577,6 +604,7 @@ const char *vine_task_get_hostname(struct vine_task *t);
 - "time_when_commit_end"
 - "time_when_retrieval"
 - "time_workers_execute_last"
+- "time_workers_stage_in_last"
 - "time_workers_execute_all"
 - "time_workers_execute_exhaustion"
 - "time_workers_execute_failure"
@@ -1346,6 +1374,15 @@ int vine_enable_transactions_log(struct vine_manager *m, const char *logfile);
 */
 int vine_enable_taskgraph_log(struct vine_manager *m, const char *logfile);
 
+/** Keep the checksums of the files declared to the manager in a file, so that
+unchanged files are not read again by later runs. A file is considered unchanged
+if its path, inode, size, and modification time are the same.
+@param m A manager object
+@param filename The filename. It is created if it does not exist.
+@return 1 if the file was opened, 0 otherwise.
+*/
+int vine_enable_checksum_cache(struct vine_manager *m, const char *filename);
+
 /** Shut down workers connected to the manager. Gives a best effort and then returns the number of workers given the
 shut down order.
 @param m A manager object
@@ -1406,11 +1443,14 @@ as dead. (default=30)
  - "short-timeout" Set the minimum timeout when sending a brief message to a single worker. (default=5s)
  - "monitor-interval" Maximum number of seconds between resource monitor measurements. If less than 1, use default (5s).
 (default=5)
+ - "monitor-in-worker" When only summaries are monitored, measure tasks from a single monitor in each worker, rather than
+with a resource_monitor per task. (default=0)
  - "category-steady-n-tasks" Set the number of tasks considered when computing category buckets.
  - "hungry-minimum" Mimimum number of tasks to consider manager not hungry. (default=10)
  - "wait-for-workers" Mimimum number of workers to connect before starting dispatching tasks. (default=0)
  - "attempt-schedule-depth" The amount of tasks to attempt scheduling on each pass of send_one_task in the main loop.
 (default=100)
+ - "max-dispatch-per-cycle" The maximum number of tasks to send to workers in one pass of the main loop before checking for results again. (default=100)
  - "wait_retrieve_many" Parameter to alter how vine_wait works. If set to 0, vine_wait breaks out of the while loop
 whenever a task changes to VINE_TASK_DONE (wait_retrieve_one mode). If set to 1, vine_wait does not break, but continues
 recieving and dispatching tasks. This occurs until no task is sent or recieved, at which case it breaks out of the while
@@ -6,7 +6,12 @@ See the file COPYING for details.
 
 #include "vine_checksum.h"
 
+#include "buffer.h"
 #include "debug.h"
+#include "hash_table.h"
+#include "list.h"
+#include "load_average.h"
+#include "macros.h"
 #include "md5.h"
 #include "sort_dir.h"
 #include "string_array.h"
@@ -14,8 +19,332 @@ See the file COPYING for details.
 #include "xxmalloc.h"
 
 #include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+Checksums of regular files are remembered by path, along with the inode,
+size, and modification time of the file when it was hashed. A file whose
+properties still match is not read again. If a cache file is given,
+the entries are also appended to it, so that they survive across runs.
+When the file grows to more than twice the live entries, it is rewritten.
+*/
+
+struct vine_checksum_entry {
+	ino_t inode;
+	off_t size;
+	time_t mtime;
+	long mtime_nsec;
+	char hash[MD5_DIGEST_LENGTH * 2 + 1];
+};
+
+static struct hash_table *checksum_cache = 0;
+static FILE *checksum_cache_file = 0;
+
+/* Number of processes used to hash the files of a directory. Zero means one per cpu. */
+static int checksum_processes = 0;
+
+/* Hashes of the files of the directory tree being checksummed, computed in parallel. */
+static struct hash_table *checksum_precomputed = 0;
+
+/* Directories with fewer bytes than this to hash are hashed serially. */
+#define VINE_CHECKSUM_PARALLEL_MIN_BYTES (16 * 1024 * 1024)
+
+/* Upper limit on the processes chosen automatically. */
+#define VINE_CHECKSUM_PROCESSES_MAX 8
+
+/*
+A file modified within this many seconds of being hashed could change
+again without a visible change of mtime, so it is not cached.
+*/
+#define VINE_CHECKSUM_RACY_SECONDS 2
+
+void vine_checksum_set_processes(int n)
+{
+	checksum_processes = MAX(0, n);
+}
+
+static struct hash_table *checksum_cache_table()
+{
+	if (!checksum_cache) {
+		checksum_cache = hash_table_create(0, 0);
+	}
+	return checksum_cache;
+}
+
+static void checksum_cache_write_entry(FILE *file, const char *path, struct vine_checksum_entry *e)
+{
+	fprintf(file, "%llu %lld %lld %ld %s %s\n", (unsigned long long)e->inode, (long long)e->size, (long long)e->mtime, e->mtime_nsec, e->hash, path);
+}
+
+/* Rewrite the cache file with only the live entries, replacing it atomically. */
+
+static int checksum_cache_compact(const char *filename)
+{
+	char *tmpname = string_format("%s.XXXXXX", filename);
+	int fd = mkstemp(tmpname);
+	if (fd < 0) {
+		free(tmpname);
+		return 0;
+	}
+
+	FILE *file = fdopen(fd, "w");
+
+	char *path;
+	struct vine_checksum_entry *e;
+	HASH_TABLE_ITERATE(checksum_cache, path, e)
+	{
+		checksum_cache_write_entry(file, path, e);
+	}
+
+	int ok = fclose(file) == 0 && rename(tmpname, filename) == 0;
+	if (!ok) {
+		unlink(tmpname);
+	}
+
+	free(tmpname);
+	return ok;
+}
+
+int vine_checksum_set_cache(const char *filename)
+{
+	struct hash_table *table = checksum_cache_table();
+
+	if (checksum_cache_file) {
+		fclose(checksum_cache_file);
+		checksum_cache_file = 0;
+	}
+
+	int lines = 0;
+
+	FILE *file = fopen(filename, "r");
+	if (file) {
+		char line[PATH_MAX * 2];
+		while (fgets(line, sizeof(line), file)) {
+			unsigned long long inode;
+			long long size, mtime;
+			int n;
+
+			struct vine_checksum_entry *e = xxmalloc(sizeof(*e));
+			if (sscanf(line, "%llu %lld %lld %ld %32s %n", &inode, &size, &mtime, &e->mtime_nsec, e->hash, &n) != 5) {
+				free(e);
+				continue;
+			}
+
+			string_chomp(line);
+			e->inode = inode;
+			e->size = size;
+			e->mtime = mtime;
+
+			free(hash_table_remove(table, &line[n]));
+			hash_table_insert(table, &line[n], e);
+			lines++;
+		}
+		fclose(file);
+	}
+
+	debug(D_VINE, "checksum cache %s: loaded %d entries", filename, hash_table_size(table));
+
+	if (lines > 2 * hash_table_size(table)) {
+		checksum_cache_compact(filename);
+	}
+
+	checksum_cache_file = fopen(filename, "a");
+	if (!checksum_cache_file) {
+		debug(D_NOTICE | D_VINE, "couldn't open checksum cache %s: %s", filename, strerror(errno));
+		return 0;
+	}
+
+	return 1;
+}
+
+static const char *checksum_cache_lookup(const char *path, struct stat *info)
+{
+	struct vine_checksum_entry *e = hash_table_lookup(checksum_cache_table(), path);
+	if (!e)
+		return 0;
+
+	if (e->inode != info->st_ino || e->size != info->st_size || e->mtime != info->st_mtim.tv_sec || e->mtime_nsec != info->st_mtim.tv_nsec)
+		return 0;
+
+	return e->hash;
+}
+
+static void checksum_cache_insert(const char *path, struct stat *info, const char *hash)
+{
+	if (info->st_mtime >= time(0) - VINE_CHECKSUM_RACY_SECONDS)
+		return;
+
+	struct vine_checksum_entry *e = xxmalloc(sizeof(*e));
+	e->inode = info->st_ino;
+	e->size = info->st_size;
+	e->mtime = info->st_mtim.tv_sec;
+	e->mtime_nsec = info->st_mtim.tv_nsec;
+	strncpy(e->hash, hash, sizeof(e->hash) - 1);
+	e->hash[sizeof(e->hash) - 1] = 0;
+
+	struct hash_table *table = checksum_cache_table();
+	free(hash_table_remove(table, path));
+	hash_table_insert(table, path, e);
+
+	if (checksum_cache_file) {
+		checksum_cache_write_entry(checksum_cache_file, path, e);
+		fflush(checksum_cache_file);
+	}
+}
+
+/*
+A regular file in a directory tree that must still be hashed.
+*/
+
+struct checksum_job {
+	char *path;
+	struct stat info;
+};
+
+/* Collect the regular files under path that are not in the cache. */
+
+static void checksum_collect_jobs(const char *path, struct list *jobs, int64_t *bytes)
+{
+	DIR *dir = opendir(path);
+	if (!dir)
+		return;
+
+	struct dirent *d;
+	while ((d = readdir(dir))) {
+		if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+			continue;
+
+		char *subpath = string_format("%s/%s", path, d->d_name);
+		struct stat info;
+
+		if (lstat(subpath, &info) == 0) {
+			if (S_ISDIR(info.st_mode)) {
+				checksum_collect_jobs(subpath, jobs, bytes);
+			} else if (S_ISREG(info.st_mode) && !checksum_cache_lookup(subpath, &info)) {
+				struct checksum_job *j = xxmalloc(sizeof(*j));
+				j->path = subpath;
+				j->info = info;
+				list_push_tail(jobs, j);
+				*bytes += info.st_size;
+				continue;
+			}
+		}
+
+		free(subpath);
+	}
+
+	closedir(dir);
+}
+
+/*
+Hash the files of a directory tree with a pool of processes, and return a
+table of the results by path, which the serial walk consults before hashing.
+The files are handed out one at a time through a shared counter, so that
+a few large files do not leave the other processes idle.
+*/
+
+static struct hash_table *checksum_files_parallel(const char *path)
+{
+	struct hash_table *results = hash_table_create(0, 0);
+	struct checksum_job *j;
+
+	int nprocs = checksum_processes;
+	if (nprocs == 0) {
+		nprocs = MIN(load_average_get_cpus(), VINE_CHECKSUM_PROCESSES_MAX);
+	}
+	if (nprocs < 2)
+		return results;
+
+	struct list *jobs = list_create();
+	int64_t bytes = 0;
+
+	checksum_collect_jobs(path, jobs, &bytes);
+
+	int njobs = list_size(jobs);
+	if (njobs < 2 || bytes < VINE_CHECKSUM_PARALLEL_MIN_BYTES)
+		goto done;
+
+	nprocs = MIN(nprocs, njobs);
+
+	struct checksum_job **array = xxmalloc(njobs * sizeof(*array));
+	int i = 0;
+	LIST_ITERATE(jobs, j)
+	{
+		array[i++] = j;
+	}
+
+	/* Shared with the children: the next job to take, and the digest and status of each job. */
+	size_t shared_size = sizeof(int) + njobs * (MD5_DIGEST_LENGTH + 1);
+	char *shared = mmap(0, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		free(array);
+		goto done;
+	}
+	memset(shared, 0, shared_size);
+
+	int *next = (int *)shared;
+	unsigned char *digests = (unsigned char *)shared + sizeof(int);
+	char *finished = (char *)digests + njobs * MD5_DIGEST_LENGTH;
+
+	debug(D_VINE, "checksumming %d files (%" PRId64 " bytes) of %s with %d processes", njobs, bytes, path, nprocs);
+
+	pid_t *pids = xxmalloc(nprocs * sizeof(pid_t));
+	int started = 0;
+	for (i = 0; i < nprocs; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			int k;
+			while ((k = __sync_fetch_and_add(next, 1)) < njobs) {
+				if (md5_file(array[k]->path, &digests[k * MD5_DIGEST_LENGTH])) {
+					finished[k] = 1;
+				}
+			}
+			_exit(0);
+		} else if (pid > 0) {
+			pids[started++] = pid;
+		} else {
+			debug(D_VINE, "couldn't fork checksum process: %s", strerror(errno));
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++) {
+		while (waitpid(pids[i], 0, 0) < 0 && errno == EINTR) {
+		}
+	}
+
+	/* Jobs left over if some processes could not be started are hashed by the serial walk. */
+	for (i = 0; i < njobs; i++) {
+		if (finished[i]) {
+			const char *hash = md5_to_string(&digests[i * MD5_DIGEST_LENGTH]);
+			hash_table_insert(results, array[i]->path, xxstrdup(hash));
+			checksum_cache_insert(array[i]->path, &array[i]->info, hash);
+		}
+	}
+
+	munmap(shared, shared_size);
+	free(pids);
+	free(array);
+
+done:
+	while ((j = list_pop_head(jobs))) {
+		free(j->path);
+		free(j);
+	}
+	list_delete(jobs);
+
+	return results;
+}
 
 /*
 Compute the recursive hash of a directory by building up a string like this:
@@ -27,17 +356,18 @@ Compute the recursive hash of a directory by building up a string like this:
 And then compute the hash of that string.
 
 Returns an allocated string that must be freed.
-
-XXX For consistency, this should sort the directory entries before hashing.
 */
 
 static char *vine_checksum_dir(const char *path, ssize_t *totalsize)
 {
-	char *dirstring = xxstrdup("");
 	char **entries;
 	struct stat info;
 	if (!sort_dir(path, &entries, strcmp))
 		return 0;
+
+	buffer_t B;
+	buffer_init(&B);
+
 	int i;
 	for (i = 0; entries[i]; i++) {
 
@@ -47,32 +377,51 @@ static char *vine_checksum_dir(const char *path, ssize_t *totalsize)
 			continue;
 
 		char *subpath = string_format("%s/%s", path, entries[i]);
-		if (stat(subpath, &info))
+		if (stat(subpath, &info)) {
+			free(subpath);
+			sort_dir_free(entries);
+			buffer_free(&B);
 			return 0;
+		}
 
 		char *subhash = vine_checksum_any(subpath, totalsize);
-		char *line = string_format("%s:%o:%s:%s:\n", entries[i], info.st_mode, ctime(&info.st_mtime), subhash);
 
-		dirstring = string_combine(dirstring, line);
+		/* An entry that cannot be hashed has always been recorded as "(null)". */
+		buffer_putfstring(&B, "%s:%o:%s:%s:\n", entries[i], info.st_mode, ctime(&info.st_mtime), subhash ? subhash : "(null)");
 
 		free(subpath);
 		free(subhash);
-		free(line);
 	}
 
 	sort_dir_free(entries);
-	char *result = md5_of_string(dirstring);
+	char *result = md5_of_string(buffer_tostring(&B));
 
-	free(dirstring);
+	buffer_free(&B);
 
 	return result;
 }
 
-static char *vine_checksum_file(const char *path)
+static char *vine_checksum_file(const char *path, struct stat *info)
 {
+	const char *cached = 0;
+	if (checksum_precomputed) {
+		cached = hash_table_lookup(checksum_precomputed, path);
+	}
+	if (!cached) {
+		cached = checksum_cache_lookup(path, info);
+	}
+	if (cached)
+		return xxstrdup(cached);
+
+	/* A file that cannot be read has no checksum, and nothing is cached for it. */
 	unsigned char digest[MD5_DIGEST_LENGTH];
-	md5_file(path, digest);
-	return xxstrdup(md5_to_string(digest));
+	if (!md5_file(path, digest))
+		return 0;
+
+	const char *hash = md5_to_string(digest);
+	checksum_cache_insert(path, info, hash);
+
+	return xxstrdup(hash);
 }
 
 static char *vine_checksum_symlink(const char *path, ssize_t linklength)
@@ -90,7 +439,7 @@ static char *vine_checksum_symlink(const char *path, ssize_t linklength)
 	}
 }
 
-char *vine_checksum_any(const char *path, ssize_t *totalsize)
+static char *vine_checksum_internal(const char *path, ssize_t *totalsize)
 {
 	struct stat info;
 
@@ -101,7 +450,7 @@ char *vine_checksum_any(const char *path, ssize_t *totalsize)
 		return vine_checksum_dir(path, totalsize);
 	} else if (S_ISREG(info.st_mode)) {
 		*totalsize += info.st_size;
-		return vine_checksum_file(path);
+		return vine_checksum_file(path, &info);
 	} else if (S_ISLNK(info.st_mode)) {
 		return vine_checksum_symlink(path, info.st_size);
 	} else {
@@ -109,3 +458,27 @@ char *vine_checksum_any(const char *path, ssize_t *totalsize)
 		return 0;
 	}
 }
+
+char *vine_checksum_any(const char *path, ssize_t *totalsize)
+{
+	/* Within a directory walk, the files were already considered below. */
+	if (checksum_precomputed) {
+		return vine_checksum_internal(path, totalsize);
+	}
+
+	struct stat info;
+	if (lstat(path, &info) || !S_ISDIR(info.st_mode)) {
+		return vine_checksum_internal(path, totalsize);
+	}
+
+	/* At the top of a directory tree, hash the files in parallel before the walk that combines them. */
+	checksum_precomputed = checksum_files_parallel(path);
+
+	char *result = vine_checksum_internal(path, totalsize);
+
+	hash_table_clear(checksum_precomputed, free);
+	hash_table_delete(checksum_precomputed);
+	checksum_precomputed = 0;
+
+	return result;
+}
@@ -9,6 +9,19 @@ See the file COPYING for details.
 
 #include <sys/types.h>
 
+/*
+Compute the checksum of a file, directory, or symlink, adding the size
+of its regular files to totalsize. Returns a string that must be freed.
+*/
+
 char *vine_checksum_any( const char *path, ssize_t *totalsize );
 
+/* Set the number of processes used to hash large directories. Zero chooses one per cpu, one disables. */
+
+void vine_checksum_set_processes( int n );
+
+/* Load checksums from a cache file, and record new checksums there. Returns true if the file could be opened. */
+
+int vine_checksum_set_cache( const char *filename );
+
 #endif
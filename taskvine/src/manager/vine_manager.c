@@ -6,6 +6,7 @@ See the file COPYING for details.
 
 #include "vine_manager.h"
 #include "vine_blocklist.h"
+#include "vine_checksum.h"
 #include "vine_counters.h"
 #include "vine_current_transfers.h"
 #include "vine_factory_info.h"
@@ -27,6 +28,7 @@ See the file COPYING for details.
 #include "vine_task_info.h"
 #include "vine_taskgraph_log.h"
 #include "vine_txn_log.h"
+#include "vine_worker_index.h"
 #include "vine_worker_info.h"
 
 #include "address.h"
@@ -59,6 +61,7 @@ See the file COPYING for details.
 #include "rmonitor_poll.h"
 #include "rmonitor_types.h"
 #include "set.h"
+#include "shape_index.h"
 #include "shell.h"
 #include "stringtools.h"
 #include "unlink_recursive.h"
@@ -117,6 +120,9 @@ See the file COPYING for details.
 /* Default value for how frequently to allow calls to vine_hungry_computation. */
 #define VINE_HUNGRY_CHECK_INTERVAL 5000000 // 5 seconds in usecs
 
+/* Maximum size of the messages buffered for a worker while retrieving its tasks. */
+#define VINE_MANAGER_RECEIVE_BUFFER_MAX (64 * 1024)
+
 /* Default timeout for slow workers to come back to the pool, can be set prior to creating a manager. */
 double vine_option_blocklist_slow_workers_timeout = 900;
 
@@ -136,6 +142,7 @@ static void find_max_worker(struct vine_manager *q);
 static void update_max_worker(struct vine_manager *q, struct vine_worker_info *w);
 
 static vine_task_state_t change_task_state(struct vine_manager *q, struct vine_task *t, vine_task_state_t new_state);
+static void remove_from_ready_tasks(struct vine_manager *q, struct vine_task *t, int t_idx);
 
 static int task_request_count(struct vine_manager *q, const char *category, category_allocation_t request);
 
@@ -299,6 +306,33 @@ static void handle_worker_timeout(struct vine_manager *q, struct vine_worker_inf
 
 /* Handle an info message coming from the worker that provides a variety of metrics. */
 
+/*
+A peer-transfers message reports the cumulative counters of the transfers
+the worker served to its peers. Only the increments are added to the manager
+totals, so that the totals survive the disconnection of the worker.
+*/
+
+static void handle_peer_transfers(struct vine_manager *q, struct vine_worker_info *w, const char *value)
+{
+	long long connections, bytes, time_sent;
+	double max_bandwidth;
+	int active;
+
+	if (sscanf(value, "%lld %lld %lld %lf %d", &connections, &bytes, &time_sent, &max_bandwidth, &active) != 5)
+		return;
+
+	q->stats->peer_transfers += MAX(0, connections - w->peer_transfer_connections);
+	q->stats->bytes_peer_sent += MAX(0, bytes - w->peer_transfer_bytes);
+	q->stats->time_peer_sent += MAX(0, time_sent - (long long)w->peer_transfer_time);
+	q->stats->peer_bandwidth_max = MAX(q->stats->peer_bandwidth_max, max_bandwidth / MEGABYTE);
+
+	w->peer_transfer_connections = connections;
+	w->peer_transfer_bytes = bytes;
+	w->peer_transfer_time = time_sent;
+	w->peer_transfer_max_bandwidth = max_bandwidth;
+	w->peer_transfers_active = active;
+}
+
 static vine_msg_code_t handle_info(struct vine_manager *q, struct vine_worker_info *w, char *line)
 {
 	char field[VINE_LINE_MAX];
@@ -323,6 +357,8 @@ static vine_msg_code_t handle_info(struct vine_manager *q, struct vine_worker_in
 		vine_manager_factory_worker_arrive(q, w, value);
 	} else if (string_prefix_is(field, "library-update")) {
 		handle_library_update(q, w, value);
+	} else if (string_prefix_is(field, "peer-transfers")) {
+		handle_peer_transfers(q, w, value);
 	}
 
 	// Note we always mark info messages as processed, as they are optional.
@@ -496,7 +532,25 @@ static int handle_transfer_hostport(struct vine_manager *q, struct vine_worker_i
 	return VINE_MSG_PROCESSED;
 }
 
-static vine_result_code_t get_completion_result(struct vine_manager *q, struct vine_worker_info *w, const char *line)
+/*
+Keep the standard output of a task that came inline with its completion.
+*/
+
+static void set_stdout_from_buffer(struct vine_task *t, const char *output, int64_t length)
+{
+	t->output = malloc(length + 1);
+	memcpy(t->output, output, length);
+	t->output[length] = 0;
+	t->output_length = length;
+}
+
+/*
+Process the completion message of a task.  If output is given, the standard
+output of the task that came with the message is already in memory, as part of
+a frame of completions.  Otherwise it is read from the worker link.
+*/
+
+static vine_result_code_t get_completion_result(struct vine_manager *q, struct vine_worker_info *w, const char *line, const char *output)
 {
 	if (!q || !w || !line)
 		return VINE_WORKER_FAILURE;
@@ -508,11 +562,12 @@ static vine_result_code_t get_completion_result(struct vine_manager *q, struct v
 
 	timestamp_t execution_time, start_time, end_time;
 	timestamp_t observed_execution_time;
+	timestamp_t stage_in_time = 0;
 
 	// Format: task completion status, exit status (exit code or signal), output length, bytes_sent, execution time,
-	// task_id
+	// task_id, time to stage the inputs into the sandbox
 	int n = sscanf(line,
-			"complete %d %d %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64 "",
+			"complete %d %d %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64 "",
 			&task_status,
 			&exit_status,
 			&output_length,
@@ -520,7 +575,8 @@ static vine_result_code_t get_completion_result(struct vine_manager *q, struct v
 			&start_time,
 			&end_time,
 			&sandbox_used,
-			&task_id);
+			&task_id,
+			&stage_in_time);
 
 	if (n < 7) {
 		debug(D_VINE, "Invalid message from worker %s (%s): %s", w->hostname, w->addrport, line);
@@ -534,8 +590,10 @@ static vine_result_code_t get_completion_result(struct vine_manager *q, struct v
 	if (!t) {
 		debug(D_VINE, "Unknown task completion from worker %s (%s): no task %" PRId64 " assigned to worker. Ignoring result.", w->hostname, w->addrport, task_id);
 
-		time_t stoptime = time(0) + vine_manager_transfer_time(q, w, output_length);
-		link_soak(w->link, output_length, stoptime);
+		if (!output) {
+			time_t stoptime = time(0) + vine_manager_transfer_time(q, w, output_length);
+			link_soak(w->link, output_length, stoptime);
+		}
 		return VINE_SUCCESS;
 	}
 
@@ -566,6 +624,7 @@ static vine_result_code_t get_completion_result(struct vine_manager *q, struct v
 		t->time_workers_execute_last = observed_execution_time > execution_time ? execution_time : observed_execution_time;
 		t->time_workers_execute_last_start = start_time;
 		t->time_workers_execute_last_end = end_time;
+		t->time_workers_stage_in_last = stage_in_time;
 		t->time_workers_execute_all += t->time_workers_execute_last;
 		t->output_length = output_length;
 		t->result = task_status;
@@ -577,8 +636,22 @@ static vine_result_code_t get_completion_result(struct vine_manager *q, struct v
 		t->resources_measured->wall_time = ((double)t->time_workers_execute_last) / ONE_SECOND;
 		rmsummary_merge_override_basic(t->resources_measured, t->resources_allocated);
 
+		/* A worker that measured the task itself appends the summary to the completion line. */
+		const char *measured = strchr(line, '{');
+		if (t->monitor_in_worker && measured) {
+			struct rmsummary *s = rmsummary_parse_string(measured);
+			if (s) {
+				rmsummary_merge_default(s, t->resources_measured);
+				rmsummary_delete(t->resources_measured);
+				t->resources_measured = s;
+			}
+		}
+
 		/* If output is less than 1KB stdout is sent along with completion msg. retrieve it from the link. */
-		if (bytes_sent) {
+		if (output && (bytes_sent || !t->output_length)) {
+			set_stdout_from_buffer(t, output, bytes_sent);
+			t->output_received = 1;
+		} else if (bytes_sent) {
 			get_stdout(q, w, t, bytes_sent);
 			t->output_received = 1;
 			/* worker sent no bytes as output length is 0 */
@@ -594,7 +667,7 @@ static vine_result_code_t get_completion_result(struct vine_manager *q, struct v
 		w->finished_tasks++;
 
 		// Convert resource_monitor status into taskvine status if needed.
-		if (q->monitor_mode) {
+		if (q->monitor_mode && !t->monitor_in_worker) {
 			if (t->exit_code == RM_OVERFLOW) {
 				task_status = VINE_RESULT_RESOURCE_EXHAUSTION;
 			} else if (t->exit_code == RM_TIME_EXPIRE) {
@@ -628,13 +701,70 @@ The manager decides how to handle completion based on the task.
 
 static vine_msg_code_t handle_complete(struct vine_manager *q, struct vine_worker_info *w, const char *line)
 {
-	vine_result_code_t result = get_completion_result(q, w, line);
+	vine_result_code_t result = get_completion_result(q, w, line, 0);
 	if (result == VINE_SUCCESS) {
 		return VINE_MSG_PROCESSED;
 	}
 	return VINE_MSG_NOT_PROCESSED;
 }
 
+/*
+A frame of completions carries many completion messages, each one followed
+by the inline output of its task, so that the manager receives them all
+with a single read rather than one message at a time.
+*/
+
+static vine_msg_code_t handle_completed(struct vine_manager *q, struct vine_worker_info *w, const char *line)
+{
+	int count;
+	int64_t length;
+
+	if (sscanf(line, "completed %d %" SCNd64, &count, &length) != 2 || length < 0) {
+		debug(D_VINE, "Invalid message from worker %s (%s): %s", w->hostname, w->addrport, line);
+		return VINE_MSG_FAILURE;
+	}
+
+	char *frame = malloc(length + 1);
+	time_t stoptime = time(0) + vine_manager_transfer_time(q, w, length);
+	if (link_read(w->link, frame, length, stoptime) != length) {
+		free(frame);
+		return VINE_MSG_FAILURE;
+	}
+	frame[length] = 0;
+
+	char *pos = frame;
+	char *end = frame + length;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		char *newline = memchr(pos, '\n', end - pos);
+		if (!newline)
+			break;
+		*newline = 0;
+
+		int64_t output_sent = 0;
+		char *output = newline + 1;
+		if (sscanf(pos, "complete %*d %*d %*s %" SCNd64, &output_sent) != 1 || output_sent < 0 || output_sent > end - output)
+			break;
+
+		debug(D_VINE, "rx from %s (%s): %s", w->hostname, w->addrport, pos);
+
+		if (get_completion_result(q, w, pos, output) != VINE_SUCCESS)
+			break;
+
+		pos = output + output_sent;
+	}
+
+	free(frame);
+
+	if (i < count) {
+		debug(D_VINE, "Invalid completion %d of %d from worker %s (%s)", i, count, w->hostname, w->addrport);
+		return VINE_MSG_FAILURE;
+	}
+
+	return VINE_MSG_PROCESSED;
+}
+
 /*
 This function receives a message from worker and records the time a message is successfully
 received. This timestamp is used in keepalive timeout computations.
@@ -689,6 +819,8 @@ static vine_msg_code_t vine_manager_recv_no_retry(struct vine_manager *q, struct
 		result = handle_transfer_port(q, w, line);
 	} else if (sscanf(line, "GET %s HTTP/%*d.%*d", path) == 1) {
 		result = handle_http_request(q, w, path, stoptime);
+	} else if (string_prefix_is(line, "completed")) {
+		result = handle_completed(q, w, line);
 	} else if (string_prefix_is(line, "complete")) {
 		result = handle_complete(q, w, line);
 	} else {
@@ -1013,8 +1145,10 @@ void vine_manager_remove_worker(struct vine_manager *q, struct vine_worker_info
 	vine_txn_log_write_worker(q, w, 1, reason);
 
 	hash_table_remove(q->worker_table, w->hashkey);
+	vine_schedule_remove_worker(q, w);
 	hash_table_remove(q->workers_with_watched_file_updates, w->hashkey);
 	hash_table_remove(q->workers_with_complete_tasks, w->hashkey);
+	hash_table_remove(q->workers_with_pending_dispatch, w->hashkey);
 
 	if (q->transfer_temps_recovery) {
 		recall_worker_lost_temp_files(q, w);
@@ -1102,6 +1236,9 @@ static void add_worker(struct vine_manager *q)
 	w->addrport = string_format("%s:%d", addr, port);
 
 	hash_table_insert(q->worker_table, w->hashkey, w);
+
+	/* The link stays registered until it is closed in vine_worker_delete. */
+	link_poller_add(q->poller, link, LINK_READ);
 }
 
 /* Delete a single file on a remote worker except those with greater delete_upto_level cache level */
@@ -1203,6 +1340,30 @@ static void read_measured_resources(struct vine_manager *q, struct vine_task *t)
 	free(summary);
 }
 
+/* Complete the resources measured by the worker, which came with the completion of the task. */
+static void write_measured_resources(struct vine_manager *q, struct vine_task *t)
+{
+	t->resources_measured->exit_status = t->exit_code;
+
+	/* cleanup noise in cores value, as in read_measured_resources */
+	if (t->resources_measured->cores > 0) {
+		t->resources_measured->cores = MIN(t->resources_measured->cores, ceil(t->resources_measured->cores - 0.1));
+	}
+
+	/* keep the summary file only when the task asks for it explicitly */
+	if (t->monitor_output_directory) {
+		char *summary = monitor_file_name(q, t, ".summary", 0);
+		FILE *f = fopen(summary, "w");
+		if (f) {
+			rmsummary_print(f, t->resources_measured, /* pprint */ 0, NULL);
+			fclose(f);
+		} else {
+			debug(D_VINE, "could not write monitor summary %s: %s", summary, strerror(errno));
+		}
+		free(summary);
+	}
+}
+
 /* Compress old time series files so as to avoid accumulating infinite resource monitoring data. */
 static void resource_monitor_compress_logs(struct vine_manager *q, struct vine_task *t)
 {
@@ -1283,7 +1444,11 @@ static int fetch_outputs_from_worker(struct vine_manager *q, struct vine_worker_
 		break;
 	case VINE_RESULT_RESOURCE_EXHAUSTION:
 		/* On resource exhaustion, just get the monitor files to figure out what happened. */
-		result = vine_manager_get_monitor_output_file(q, w, t);
+		if (t->monitor_in_worker) {
+			result = VINE_SUCCESS;
+		} else {
+			result = vine_manager_get_monitor_output_file(q, w, t);
+		}
 		break;
 	default:
 		/* Otherwise get all of the output files. */
@@ -1310,7 +1475,9 @@ static int fetch_outputs_from_worker(struct vine_manager *q, struct vine_worker_
 
 	/* if q is monitoring, update t->resources_measured, and delete the task
 	 * summary. */
-	if (q->monitor_mode) {
+	if (t->monitor_in_worker) {
+		write_measured_resources(q, t);
+	} else if (q->monitor_mode) {
 		read_measured_resources(q, t);
 
 		/* Further, if we got debug and series files, gzip them. */
@@ -1379,7 +1546,7 @@ static int expire_waiting_tasks(struct vine_manager *q)
 	{
 		if (t->resources_requested->end > 0 && t->resources_requested->end <= current_time) {
 			vine_task_set_result(t, VINE_RESULT_MAX_END_TIME);
-			priority_queue_remove(q->ready_tasks, t_idx);
+			remove_from_ready_tasks(q, t, t_idx);
 			change_task_state(q, t, VINE_TASK_RETRIEVED);
 			expired++;
 		}
@@ -1406,7 +1573,7 @@ static int enforce_waiting_fixed_locations(struct vine_manager *q)
 		if (t->has_fixed_locations && !vine_schedule_check_fixed_location(q, t)) {
 			vine_task_set_result(t, VINE_RESULT_FIXED_LOCATION_MISSING);
 			change_task_state(q, t, VINE_TASK_RETRIEVED);
-			priority_queue_remove(q->ready_tasks, t_idx);
+			remove_from_ready_tasks(q, t, t_idx);
 			terminated++;
 		}
 	}
@@ -1708,6 +1875,9 @@ static vine_result_code_t get_stdout(struct vine_manager *q, struct vine_worker_
 	if (t->output)
 		t->output[actual] = 0;
 
+	/* Record how much was actually kept, which may be binary data with embedded nulls. */
+	t->output_length = actual;
+
 	return VINE_SUCCESS;
 }
 
@@ -2111,6 +2281,11 @@ static struct jx *manager_to_jx(struct vine_manager *q)
 
 	jx_insert_integer(j, "bytes_sent", info.bytes_sent);
 	jx_insert_integer(j, "bytes_received", info.bytes_received);
+	jx_insert_integer(j, "peer_transfers", info.peer_transfers);
+	jx_insert_integer(j, "bytes_peer_sent", info.bytes_peer_sent);
+	jx_insert_integer(j, "time_peer_sent", info.time_peer_sent);
+	jx_insert_integer(j, "peer_transfers_active", info.peer_transfers_active);
+	jx_insert_double(j, "dispatch_rate", info.dispatch_rate);
 
 	jx_insert_integer(j, "inuse_cache", info.inuse_cache);
 
@@ -2455,6 +2630,11 @@ static vine_result_code_t handle_worker(struct vine_manager *q, struct link *l)
 	w = hash_table_lookup(q->worker_table, key);
 	free(key);
 
+	/* The worker may have been removed while handling another link reported by the same poll. */
+	if (!w) {
+		return VINE_SUCCESS;
+	}
+
 	vine_msg_code_t mcode;
 	mcode = vine_manager_recv_no_retry(q, w, line, sizeof(line));
 
@@ -2488,55 +2668,6 @@ static vine_result_code_t handle_worker(struct vine_manager *q, struct link *l)
 	return VINE_SUCCESS;
 }
 
-/*
-Construct the table of network links to be considered,
-including the manager's accepting link, and one for
-each active worker.
-*/
-
-static int build_poll_table(struct vine_manager *q)
-{
-	int n = 0;
-	char *key;
-	struct vine_worker_info *w;
-
-	// Allocate a small table, if it hasn't been done yet.
-	if (!q->poll_table) {
-		q->poll_table = malloc(sizeof(*q->poll_table) * q->poll_table_size);
-		if (!q->poll_table) {
-			// if we can't allocate a poll table, we can't do anything else.
-			fatal("allocating memory for poll table failed.");
-		}
-	}
-
-	// The first item in the poll table is the manager link, which accepts new connections.
-	q->poll_table[0].link = q->manager_link;
-	q->poll_table[0].events = LINK_READ;
-	q->poll_table[0].revents = 0;
-	n = 1;
-
-	// For every worker in the hash table, add an item to the poll table
-	HASH_TABLE_ITERATE(q->worker_table, key, w)
-	{
-		// If poll table is not large enough, reallocate it
-		if (n >= q->poll_table_size) {
-			q->poll_table_size *= 2;
-			q->poll_table = realloc(q->poll_table, sizeof(*q->poll_table) * q->poll_table_size);
-			if (q->poll_table == NULL) {
-				// if we can't allocate a poll table, we can't do anything else.
-				fatal("reallocating memory for poll table failed.");
-			}
-		}
-
-		q->poll_table[n].link = w->link;
-		q->poll_table[n].events = LINK_READ;
-		q->poll_table[n].revents = 0;
-		n++;
-	}
-
-	return n;
-}
-
 static void vine_manager_compute_input_size(struct vine_manager *q, struct vine_task *t)
 {
 	t->input_files_size = -1;
@@ -2757,7 +2888,7 @@ static vine_result_code_t start_one_task(struct vine_manager *q, struct vine_wor
 
 	char *command_line;
 
-	if (q->monitor_mode && !t->needs_library) {
+	if (q->monitor_mode && !t->needs_library && !t->monitor_in_worker) {
 		command_line = vine_monitor_wrap(q, w, t, limits);
 	} else {
 		command_line = xxstrdup(t->command_line);
@@ -2788,6 +2919,7 @@ static void count_worker_resources(struct vine_manager *q, struct vine_worker_in
 	update_max_worker(q, w);
 
 	if (w->resources->workers.total < 1) {
+		vine_schedule_update_worker(q, w);
 		return;
 	}
 
@@ -2806,6 +2938,9 @@ static void count_worker_resources(struct vine_manager *q, struct vine_worker_in
 	}
 
 	w->resources->disk.inuse += ceil(BYTES_TO_MEGABYTES(w->inuse_cache));
+
+	/* Keep the worker index in sync with the resources just counted. */
+	vine_schedule_update_worker(q, w);
 }
 
 static void update_max_worker(struct vine_manager *q, struct vine_worker_info *w)
@@ -3331,10 +3466,10 @@ static struct vine_worker_info *consider_task(struct vine_manager *q, struct vin
 	// Find the best worker for the task
 	q->stats_measure->time_scheduling = timestamp_get();
 	struct vine_worker_info *w = vine_schedule_task_to_worker(q, t);
+	q->stats->time_scheduling += timestamp_get() - q->stats_measure->time_scheduling;
 	if (!w) {
 		return NULL;
 	}
-	q->stats->time_scheduling += timestamp_get() - q->stats_measure->time_scheduling;
 
 	// Check if there is transfer capacity available.
 	if (q->peer_transfers_enabled) {
@@ -3346,6 +3481,39 @@ static struct vine_worker_info *consider_task(struct vine_manager *q, struct vin
 	return w;
 }
 
+/*
+Offer the highest priority task of each shape of ready tasks
+to the workers, from the highest to the lowest priority.
+Tasks of the same shape need the same resources, so when the
+top task of a shape does not fit anywhere, neither do the
+others behind it, and the whole shape is skipped at once.
+This is skipped when there are so many shapes that it would
+cost more than rotating through the ready queue.
+*/
+
+static int send_one_task_by_shape(struct vine_manager *q)
+{
+	int nshapes = shape_index_shapes(q->ready_index);
+	if (nshapes == 0 || nshapes > q->attempt_schedule_depth)
+		return 0;
+
+	struct vine_task *tops[nshapes];
+	int ntops = shape_index_tops(q->ready_index, (void **)tops, nshapes);
+
+	int i;
+	for (i = 0; i < ntops; i++) {
+		struct vine_task *t = tops[i];
+		struct vine_worker_info *w = consider_task(q, t);
+		if (w) {
+			remove_from_ready_tasks(q, t, priority_queue_find_idx(q->ready_tasks, t));
+			commit_task_to_worker(q, w, t);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 /*
 Advance the state of the system by selecting one task available
 to run, finding the best worker for that task, and then committing
@@ -3358,6 +3526,9 @@ static int send_one_task(struct vine_manager *q)
 	struct vine_task *t;
 	struct vine_worker_info *w = NULL;
 
+	if (send_one_task_by_shape(q))
+		return 1;
+
 	int iter_count = 0;
 	int iter_depth = MIN(priority_queue_size(q->ready_tasks), q->attempt_schedule_depth);
 
@@ -3379,7 +3550,7 @@ static int send_one_task(struct vine_manager *q)
 	{
 		w = consider_task(q, t);
 		if (w) {
-			priority_queue_remove(q->ready_tasks, t_idx);
+			remove_from_ready_tasks(q, t, t_idx);
 			commit_task_to_worker(q, w, t);
 			return 1;
 		}
@@ -3388,6 +3559,55 @@ static int send_one_task(struct vine_manager *q)
 	return 0;
 }
 
+/*
+Send as many ready tasks as possible in one pass, up to max_dispatch_per_cycle.
+Each task is matched greedily to the best worker for it, and since committing
+a task charges its resources to the worker, later tasks in the pass only see
+the capacity that remains.  While the pass is in progress, the messages to
+each worker are held in its link buffer, and they are written out together
+at the end, so a pass costs one write per worker rather than one per task.
+Returns the number of tasks sent.
+*/
+
+static int send_tasks_in_bulk(struct vine_manager *q)
+{
+	timestamp_t start = timestamp_get();
+	int sent = 0;
+
+	q->dispatch_in_progress = 1;
+	while (sent < q->max_dispatch_per_cycle && send_one_task(q)) {
+		sent++;
+	}
+	q->dispatch_in_progress = 0;
+
+	/* Workers that fail to take their messages can only be removed once the table is no longer in use. */
+	struct list *failed = list_create();
+
+	char *key;
+	struct vine_worker_info *w;
+	HASH_TABLE_ITERATE(q->workers_with_pending_dispatch, key, w)
+	{
+		if (link_buffer_output(w->link, 0) < 0) {
+			list_push_tail(failed, w);
+		}
+	}
+	hash_table_clear(q->workers_with_pending_dispatch, 0);
+
+	while ((w = list_pop_head(failed))) {
+		debug(D_VINE, "Failed to send tasks to worker %s (%s).", w->hostname, w->addrport);
+		handle_worker_failure(q, w);
+	}
+	list_delete(failed);
+
+	if (sent > 0) {
+		q->tasks_dispatched_in_passes += sent;
+		q->time_dispatch_passes += timestamp_get() - start;
+		debug(D_VINE, "Dispatched %d tasks in one pass.", sent);
+	}
+
+	return sent;
+}
+
 /*
 get available results from a worker. This is typically used for signaling watched files.
 */
@@ -3425,6 +3645,9 @@ static int receive_tasks_from_worker(struct vine_manager *q, struct vine_worker_
 	hash_table_remove(q->workers_with_complete_tasks, w->hashkey);
 	hash_table_firstkey(q->workers_with_complete_tasks);
 
+	/* The messages that release each task at the worker are sent together at the end. */
+	link_buffer_output(w->link, VINE_MANAGER_RECEIVE_BUFFER_MAX);
+
 	/* Now consider all tasks assigned to that worker .*/
 	ITABLE_ITERATE(w->current_tasks, task_id, t)
 	{
@@ -3445,6 +3668,11 @@ static int receive_tasks_from_worker(struct vine_manager *q, struct vine_worker_
 		}
 	}
 
+	if (link_buffer_output(w->link, 0) < 0) {
+		handle_worker_failure(q, w);
+		return tasks_received;
+	}
+
 	/* Consider removing the worker if it is empty. */
 	vine_manager_factory_worker_prune(q, w);
 
@@ -3715,7 +3943,7 @@ static void reset_task_to_state(struct vine_manager *q, struct vine_task *t, vin
 
 	case VINE_TASK_READY:
 		t_idx = priority_queue_find_idx(q->ready_tasks, t);
-		priority_queue_remove(q->ready_tasks, t_idx);
+		remove_from_ready_tasks(q, t, t_idx);
 		change_task_state(q, t, new_state);
 		break;
 
@@ -3857,7 +4085,8 @@ struct vine_manager *vine_ssl_create(int port, const char *key, const char *cert
 	q->next_task_id = 1;
 	q->fixed_location_in_queue = 0;
 
-	q->ready_tasks = priority_queue_create(0);
+	q->ready_tasks = priority_queue_create_indexed(0);
+	q->ready_index = shape_index_create(0, 0);
 	q->running_table = itable_create(0);
 	q->waiting_retrieval_list = list_create();
 	q->retrieved_list = list_create();
@@ -3865,12 +4094,13 @@ struct vine_manager *vine_ssl_create(int port, const char *key, const char *cert
 	q->tasks = itable_create(0);
 	q->library_templates = hash_table_create(0, 0);
 
-	q->worker_table = hash_table_create(0, 0);
-	q->file_worker_table = hash_table_create(0, 0);
+	q->worker_table = hash_table_create_open(0, 0);
+	q->worker_index = vine_worker_index_create();
+	q->file_worker_table = hash_table_create_open(0, 0);
 	q->temp_files_to_replicate = hash_table_create(0, 0);
 	q->worker_blocklist = hash_table_create(0, 0);
 
-	q->file_table = hash_table_create(0, 0);
+	q->file_table = hash_table_create_open(0, 0);
 
 	q->factory_table = hash_table_create(0, 0);
 	q->current_transfer_table = hash_table_create(0, 0);
@@ -3887,10 +4117,18 @@ struct vine_manager *vine_ssl_create(int port, const char *key, const char *cert
 
 	q->workers_with_watched_file_updates = hash_table_create(0, 0);
 	q->workers_with_complete_tasks = hash_table_create(0, 0);
+	q->workers_with_pending_dispatch = hash_table_create(0, 0);
+
+	// The manager link and every worker link are registered with the poller
+	// once, and the poll table receives only the links that are ready.
+	q->poller = link_poller_create();
+	if (!q->poller) {
+		fatal("creating the link poller failed.");
+	}
+	link_poller_add(q->poller, q->manager_link, LINK_READ);
 
-	// The poll table is initially null, and will be created
-	// (and resized) as needed by build_poll_table.
 	q->poll_table_size = 8;
+	q->poll_table = malloc(sizeof(*q->poll_table) * q->poll_table_size);
 
 	q->worker_selection_algorithm = VINE_SCHEDULE_FILES;
 	q->process_pending_check = 0;
@@ -3911,12 +4149,14 @@ struct vine_manager *vine_ssl_create(int port, const char *key, const char *cert
 	q->keepalive_timeout = VINE_DEFAULT_KEEPALIVE_TIMEOUT;
 
 	q->monitor_mode = VINE_MON_DISABLED;
+	q->monitor_in_worker = 0;
 
 	q->hungry_minimum = 10;
 	q->hungry_minimum_factor = 2;
 
 	q->wait_for_workers = 0;
 	q->attempt_schedule_depth = 100;
+	q->max_dispatch_per_cycle = 100;
 
 	q->max_retrievals = 1;
 	q->worker_retrievals = 1;
@@ -4198,6 +4438,8 @@ void vine_delete(struct vine_manager *q)
 	if (q->catalog_hosts)
 		free(q->catalog_hosts);
 
+	vine_worker_index_delete(q->worker_index);
+
 	hash_table_clear(q->worker_table, (void *)vine_worker_delete);
 	hash_table_delete(q->worker_table);
 
@@ -4235,11 +4477,13 @@ void vine_delete(struct vine_manager *q)
 	hash_table_delete(q->categories);
 
 	priority_queue_delete(q->ready_tasks);
+	shape_index_delete(q->ready_index);
 	itable_delete(q->running_table);
 	list_delete(q->waiting_retrieval_list);
 	list_delete(q->retrieved_list);
 	hash_table_delete(q->workers_with_watched_file_updates);
 	hash_table_delete(q->workers_with_complete_tasks);
+	hash_table_delete(q->workers_with_pending_dispatch);
 
 	list_clear(q->task_info_list, (void *)vine_task_info_delete);
 	list_delete(q->task_info_list);
@@ -4263,6 +4507,7 @@ void vine_delete(struct vine_manager *q)
 	free(q->ssl_key);
 
 	link_close(q->manager_link);
+	link_poller_delete(q->poller);
 	if (q->perf_logfile) {
 		fclose(q->perf_logfile);
 	}
@@ -4384,8 +4629,18 @@ char *vine_monitor_wrap(struct vine_manager *q, struct vine_worker_info *w, stru
 
 /* Put a given task on the ready list, taking into account the task priority and the manager schedule. */
 
+/* The shape of a ready task: its category and the resources it requests. */
+
+static char *task_ready_shape(struct vine_task *t)
+{
+	const struct rmsummary *r = t->resources_requested;
+	return string_format("%s\t%g\t%g\t%g\t%g", t->category, r->cores, r->memory, r->disk, r->gpus);
+}
+
 static void push_task_to_ready_tasks(struct vine_manager *q, struct vine_task *t)
 {
+	char *key = task_ready_shape(t);
+
 	if (t->result == VINE_RESULT_RESOURCE_EXHAUSTION) {
 		/* when a task is resubmitted given resource exhaustion, we
 		 * increment its priority by 1, so it gets to run as soon
@@ -4393,14 +4648,26 @@ static void push_task_to_ready_tasks(struct vine_manager *q, struct vine_task *t
 		 * the issue in which all 'big' tasks fail because the first
 		 * allocation is too small. */
 		priority_queue_push(q->ready_tasks, t, t->priority + 1);
+		shape_index_insert(q->ready_index, t, key, t->priority + 1);
 	} else {
 		priority_queue_push(q->ready_tasks, t, t->priority);
+		shape_index_insert(q->ready_index, t, key, t->priority);
 	}
 
+	free(key);
+
 	/* If the task has been used before, clear out accumulated state. */
 	vine_task_clean(t);
 }
 
+/* Take a task off the ready queue, given its position, and off the ready index. */
+
+static void remove_from_ready_tasks(struct vine_manager *q, struct vine_task *t, int t_idx)
+{
+	priority_queue_remove(q->ready_tasks, t_idx);
+	shape_index_remove(q->ready_index, t);
+}
+
 /*
 Changes task to a target state, and performs the associated
 accounting needed to log the event and put the task into the
@@ -4599,8 +4866,15 @@ int vine_submit(struct vine_manager *q, struct vine_task *t)
 	t->time_when_submitted = timestamp_get();
 	q->stats->tasks_submitted++;
 
-	if (q->monitor_mode != VINE_MON_DISABLED)
-		vine_monitor_add_files(q, t);
+	/* A summary alone is measured by the worker, without any files. */
+	t->monitor_in_worker = 0;
+	if (q->monitor_mode != VINE_MON_DISABLED) {
+		if (q->monitor_in_worker && !(q->monitor_mode & VINE_MON_FULL) && !t->monitor_snapshot_file && !t->needs_library) {
+			t->monitor_in_worker = q->monitor_mode;
+		} else {
+			vine_monitor_add_files(q, t);
+		}
+	}
 
 	rmsummary_merge_max(q->max_task_resources_requested, t->resources_requested);
 
@@ -4816,7 +5090,18 @@ static int poll_active_workers(struct vine_manager *q, int stoptime)
 {
 	BEGIN_ACCUM_TIME(q, time_polling);
 
-	int n = build_poll_table(q);
+	// Make room for every registered link to be ready at once.
+	int nlinks = link_poller_size(q->poller);
+	if (nlinks > q->poll_table_size) {
+		q->poll_table_size = MAX(nlinks, 2 * q->poll_table_size);
+		q->poll_table = realloc(q->poll_table, sizeof(*q->poll_table) * q->poll_table_size);
+		if (q->poll_table == NULL) {
+			// if we can't allocate a poll table, we can't do anything else.
+			fatal("reallocating memory for poll table failed.");
+		}
+	}
+
+	q->manager_link_ready = 0;
 
 	// We poll in at most small time segments (of a second). This lets
 	// promptly dispatch tasks, while avoiding busy waiting.
@@ -4833,19 +5118,21 @@ static int poll_active_workers(struct vine_manager *q, int stoptime)
 
 	BEGIN_ACCUM_TIME(q, time_polling);
 
-	// Poll all links for activity.
-	link_poll(q->poll_table, n, msec);
+	// Wait for activity on any registered link.
+	int n = link_poller_wait(q->poller, q->poll_table, q->poll_table_size, msec);
 	q->link_poll_end = timestamp_get();
 
 	END_ACCUM_TIME(q, time_polling);
 
 	BEGIN_ACCUM_TIME(q, time_status_msgs);
 
-	int i, j = 1;
+	int i;
 	int workers_failed = 0;
-	// Then consider all existing active workers
-	for (i = j; i < n; i++) {
-		if (q->poll_table[i].revents) {
+	// Then consider the workers that are ready
+	for (i = 0; i < n; i++) {
+		if (q->poll_table[i].link == q->manager_link) {
+			q->manager_link_ready = 1;
+		} else if (q->poll_table[i].revents) {
 			if (handle_worker(q, q->poll_table[i].link) == VINE_WORKER_FAILURE) {
 				workers_failed++;
 			}
@@ -4864,7 +5151,8 @@ static int connect_new_workers(struct vine_manager *q, int stoptime, int max_new
 	// If the manager link was awake, then accept at most max_new_workers.
 	// Note we are using the information gathered in poll_active_workers, which
 	// is a little ugly.
-	if (q->poll_table[0].revents) {
+	if (q->manager_link_ready) {
+		q->manager_link_ready = 0;
 		do {
 			add_worker(q);
 			new_workers++;
@@ -5108,7 +5396,7 @@ static struct vine_task *vine_wait_internal(struct vine_manager *q, int timeout,
 			}
 			// tasks waiting to be dispatched?
 			BEGIN_ACCUM_TIME(q, time_send);
-			result = send_one_task(q);
+			result = send_tasks_in_bulk(q);
 			END_ACCUM_TIME(q, time_send);
 			if (result) {
 				// sent at least one task
@@ -5503,6 +5791,12 @@ int vine_tune(struct vine_manager *q, const char *name, double value)
 	if (!strcmp(name, "attempt-schedule-depth")) {
 		q->attempt_schedule_depth = MAX(1, (int)value);
 
+	} else if (!strcmp(name, "max-dispatch-per-cycle")) {
+		q->max_dispatch_per_cycle = MAX(1, (int)value);
+
+	} else if (!strcmp(name, "checksum-processes")) {
+		vine_checksum_set_processes((int)value);
+
 	} else if (!strcmp(name, "category-steady-n-tasks")) {
 		category_tune_bucket_size("category-steady-n-tasks", (int)value);
 
@@ -5540,6 +5834,9 @@ int vine_tune(struct vine_manager *q, const char *name, double value)
 		/* 0 means use monitor's default */
 		q->monitor_interval = MAX(0, (int)value);
 
+	} else if (!strcmp(name, "monitor-in-worker")) {
+		q->monitor_in_worker = !!((int)value);
+
 	} else if (!strcmp(name, "prefer-dispatch")) {
 		q->prefer_dispatch = !!((int)value);
 
@@ -5558,6 +5855,7 @@ int vine_tune(struct vine_manager *q, const char *name, double value)
 
 	} else if (!strcmp(name, "resource-submit-multiplier") || !strcmp(name, "asynchrony-multiplier")) {
 		q->resource_submit_multiplier = MAX(value, 1.0);
+		vine_schedule_update_all_workers(q);
 
 	} else if (!strcmp(name, "short-timeout")) {
 		q->short_timeout = MAX(1, (int)value);
@@ -5676,6 +5974,9 @@ void vine_get_stats(struct vine_manager *q, struct vine_stats *s)
 
 	// info about resources
 	s->bandwidth = vine_get_effective_bandwidth(q);
+	if (q->time_dispatch_passes > 0) {
+		s->dispatch_rate = q->tasks_dispatched_in_passes * 1000000.0 / q->time_dispatch_passes;
+	}
 	struct vine_resources rtotal, rmin, rmax;
 	int64_t inuse_cache = 0;
 	aggregate_workers_resources(q, &rtotal, &rmin, &rmax, &inuse_cache, NULL);
@@ -5702,6 +6003,14 @@ void vine_get_stats(struct vine_manager *q, struct vine_stats *s)
 	s->max_gpus = rmax.gpus.total;
 
 	s->workers_able = count_workers_for_waiting_tasks(q, largest_seen_resources(q, NULL));
+
+	s->peer_transfers_active = 0;
+	char *key;
+	struct vine_worker_info *w;
+	HASH_TABLE_ITERATE(q->worker_table, key, w)
+	{
+		s->peer_transfers_active += w->peer_transfers_active;
+	}
 }
 
 void vine_get_stats_category(struct vine_manager *q, const char *category, struct vine_stats *s)
@@ -5807,6 +6116,11 @@ int vine_enable_debug_log(const char *logfile)
 	return 1;
 }
 
+int vine_enable_checksum_cache(struct vine_manager *q, const char *filename)
+{
+	return vine_checksum_set_cache(filename);
+}
+
 int vine_enable_perf_log(struct vine_manager *q, const char *filename)
 {
 	char *logpath = vine_get_path_log(q, filename);
@@ -72,6 +72,8 @@ typedef enum {
 } vine_library_state_t;
 
 struct vine_worker_info;
+struct vine_worker_index;
+struct shape_index;
 struct vine_task;
 struct vine_file;
 
@@ -89,8 +91,10 @@ struct vine_manager {
 	struct hash_table *properties;   /* Set of additional properties to report to catalog server. */
 
 	struct link *manager_link;       /* Listening TCP connection for accepting new workers. */
-	struct link_info *poll_table;    /* Table for polling on all connected workers. */
+	struct link_poller *poller;      /* Persistent poller watching the manager link and all connected workers. */
+	struct link_info *poll_table;    /* Table filled with the links found ready by the poller. */
 	int poll_table_size;             /* Number of entries in poll_table. */
+	int manager_link_ready;          /* True if the last poll found new connections on manager_link. */
 
 	/* Security configuration */
 
@@ -103,6 +107,7 @@ struct vine_manager {
 
 	struct itable *tasks;           /* Maps task_id -> vine_task of all tasks in any state. */
 	struct priority_queue   *ready_tasks;       /* Priority queue of vine_task that are waiting to execute. */
+	struct shape_index *ready_index;       /* The same ready tasks, grouped by category and resources requested. */
 	struct itable   *running_table;      /* Table of vine_task that are running at workers. */
 	struct list   *waiting_retrieval_list;      /* List of vine_task that are waiting to be retrieved. */
 	struct list   *retrieved_list;      /* List of vine_task that have been retrieved. */
@@ -113,10 +118,12 @@ struct vine_manager {
 	/* Primary data structures for tracking worker state. */
 
 	struct hash_table *worker_table;     /* Maps link -> vine_worker_info */
+	struct vine_worker_index *worker_index; /* Workers with resources reported, bucketed by free cores. */
 	struct hash_table *worker_blocklist; /* Maps hostname -> vine_blocklist_info */
 	struct hash_table *factory_table;    /* Maps factory_name -> vine_factory_info */
 	struct hash_table *workers_with_watched_file_updates;  /* Maps link -> vine_worker_info */
 	struct hash_table *workers_with_complete_tasks;  /* Maps link -> vine_worker_info */
+	struct hash_table *workers_with_pending_dispatch;  /* Maps link -> vine_worker_info, for workers with task messages held during a dispatch pass. */
 	struct hash_table *current_transfer_table; 	/* Maps uuid -> struct transfer_pair */
 
 	/* Primary data structures for tracking files. */
@@ -166,6 +173,7 @@ struct vine_manager {
 	vine_monitoring_mode_t monitor_mode;
 	struct vine_file *monitor_exe;
     int monitor_interval;
+	int monitor_in_worker;     /* Whether the workers measure tasks that need only a summary, rather than a resource_monitor per task. */
 
 	struct rmsummary *measured_local_resources;
 	struct rmsummary *current_max_worker;
@@ -195,6 +203,10 @@ struct vine_manager {
 	int hungry_minimum_factor;    /* queue is hungry if number of waiting tasks is less than hungry_minimum_factor * number of connected workers. */
 	int wait_for_workers;         /* Wait for these many workers to connect before dispatching tasks at start of execution. */
 	int attempt_schedule_depth;   /* number of submitted tasks to attempt scheduling before we continue to retrievals */
+	int max_dispatch_per_cycle;   /* Maximum number of tasks to dispatch in one pass of the main loop. */
+	int dispatch_in_progress;     /* If true, messages to workers are held until the end of the current dispatch pass. */
+	int64_t tasks_dispatched_in_passes; /* Number of tasks sent by dispatch passes, for the dispatch rate. */
+	timestamp_t time_dispatch_passes;   /* Time spent in dispatch passes that sent at least one task. */
 	int max_retrievals;           /* Do at most this number of task retrievals of either receive_one_task or receive_all_tasks_from_worker. If less
                                      than 1, prefer to receive all completed tasks before submitting new tasks. */
 	int worker_retrievals;        /* retrieve all completed tasks from a worker as opposed to recieving one of any completed task*/
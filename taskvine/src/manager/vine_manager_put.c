@@ -466,33 +466,56 @@ vine_result_code_t vine_manager_put_input_files(struct vine_manager *q, struct v
 }
 
 /*
-Send the details of one task to a worker.
-Note that this function just performs serialization of the task definition.
-It does not perform any resource management.
-This allows it to be used for both regular tasks and mini tasks.
+Upper bound on the output buffered while sending task descriptions.
+A description larger than this (e.g. with a huge environment) is
+simply written out in several pieces.
 */
 
-vine_result_code_t vine_manager_put_task(
-		struct vine_manager *q, struct vine_worker_info *w, struct vine_task *t, const char *command_line, struct rmsummary *limits, struct vine_file *target)
+#define VINE_MANAGER_PUT_BUFFER_MAX (1 << 20)
+
+/*
+Begin buffering the task messages to a worker.
+During a dispatch pass, the buffer is left open until the manager
+flushes it at the end of the pass, so that all the tasks sent to
+the same worker in that pass go out together.
+*/
+
+static void vine_manager_put_begin(struct vine_manager *q, struct vine_worker_info *w)
 {
-	if (target) {
-		if (vine_file_replica_table_lookup(w, target->cached_name)) {
-			/* do nothing, file already at worker */
-			debug(D_NOTICE, "cannot put mini_task %s at %s. Already at worker.", target->cached_name, w->addrport);
-			return VINE_SUCCESS;
-		}
+	if (q->dispatch_in_progress) {
+		if (hash_table_lookup(q->workers_with_pending_dispatch, w->hashkey))
+			return;
+		hash_table_insert(q->workers_with_pending_dispatch, w->hashkey, w);
 	}
 
-	vine_result_code_t result = vine_manager_put_input_files(q, w, t);
-	if (result != VINE_SUCCESS)
-		return result;
+	link_buffer_output(w->link, VINE_MANAGER_PUT_BUFFER_MAX);
+}
 
-	if (target) {
-		vine_manager_send(q, w, "mini_task %s %s %d %lld %o\n", target->source, target->cached_name, target->cache_level, (long long)target->size, 0777);
-	} else {
-		vine_manager_send(q, w, "task %lld\n", (long long)t->task_id);
-	}
+/*
+Send the buffered task messages to a worker, unless a dispatch pass
+will do so later. Returns VINE_WORKER_FAILURE if the worker could not be reached.
+*/
+
+static vine_result_code_t vine_manager_put_end(struct vine_manager *q, struct vine_worker_info *w)
+{
+	if (q->dispatch_in_progress)
+		return VINE_SUCCESS;
 
+	if (link_buffer_output(w->link, 0) < 0)
+		return VINE_WORKER_FAILURE;
+
+	return VINE_SUCCESS;
+}
+
+/*
+Send the details of one task to a worker, following its header line.
+Note that this function just performs serialization of the task definition.
+It does not perform any resource management.
+This allows it to be used for both regular tasks and mini tasks.
+*/
+
+static void vine_manager_put_task_description(struct vine_manager *q, struct vine_worker_info *w, struct vine_task *t, const char *command_line, struct rmsummary *limits)
+{
 	if (!command_line) {
 		command_line = t->command_line;
 	}
@@ -506,6 +529,11 @@ vine_result_code_t vine_manager_put_task(
 		vine_manager_send(q, w, "needs_library %s\n", t->needs_library);
 	}
 
+	if (t->function_input) {
+		vine_manager_send(q, w, "function_input %lld\n", (long long)t->function_input_length);
+		link_putlstring(w->link, t->function_input, t->function_input_length, time(0) + q->short_timeout);
+	}
+
 	if (t->provides_library) {
 		vine_manager_send(q, w, "provides_library %s\n", t->provides_library);
 		vine_manager_send(q, w, "function_slots %d\n", t->function_slots_total);
@@ -514,6 +542,10 @@ vine_result_code_t vine_manager_put_task(
 
 	vine_manager_send(q, w, "category %s\n", t->category);
 
+	if (t->monitor_in_worker) {
+		vine_manager_send(q, w, "monitor %d %d\n", t->monitor_in_worker, q->monitor_interval);
+	}
+
 	if (limits) {
 		vine_manager_send(q, w, "cores %s\n", rmsummary_resource_to_str("cores", limits->cores, 0));
 		vine_manager_send(q, w, "gpus %s\n", rmsummary_resource_to_str("gpus", limits->gpus, 0));
@@ -521,8 +553,9 @@ vine_result_code_t vine_manager_put_task(
 		vine_manager_send(q, w, "disk %s\n", rmsummary_resource_to_str("disk", limits->disk, 0));
 
 		/* Do not set end, wall_time if running the resource monitor. We let the monitor police these resources.
+		 * A worker that measures the task itself polices them as the watchdog.
 		 */
-		if (q->monitor_mode == VINE_MON_DISABLED) {
+		if (q->monitor_mode == VINE_MON_DISABLED || (t->monitor_in_worker & VINE_MON_WATCHDOG)) {
 			if (limits->end > 0) {
 				vine_manager_send(q, w, "end_time %s\n", rmsummary_resource_to_str("end", limits->end, 0));
 			}
@@ -561,19 +594,46 @@ vine_result_code_t vine_manager_put_task(
 		}
 	}
 
-	// vine_manager_send returns the number of bytes sent, or a number less than
-	// zero to indicate errors. We are lazy here, we only check the last
-	// message we sent to the worker (other messages may have failed above).
+	vine_manager_send(q, w, "end\n");
+}
 
-	int r = vine_manager_send(q, w, "end\n");
-	if (r >= 0) {
-		if (target) {
-			struct vine_file_replica *replica = vine_file_replica_create(target->type, target->cache_level, target->size, target->mtime);
-			vine_file_replica_table_insert(q, w, target->cached_name, replica);
+/*
+Send one task to a worker, along with any input files it needs.
+If target is given, the task is a mini task that produces that file.
+*/
+
+vine_result_code_t vine_manager_put_task(
+		struct vine_manager *q, struct vine_worker_info *w, struct vine_task *t, const char *command_line, struct rmsummary *limits, struct vine_file *target)
+{
+	if (target) {
+		if (vine_file_replica_table_lookup(w, target->cached_name)) {
+			/* do nothing, file already at worker */
+			debug(D_NOTICE, "cannot put mini_task %s at %s. Already at worker.", target->cached_name, w->addrport);
+			return VINE_SUCCESS;
 		}
+	}
 
-		return VINE_SUCCESS;
+	vine_result_code_t result = vine_manager_put_input_files(q, w, t);
+	if (result != VINE_SUCCESS)
+		return result;
+
+	vine_manager_put_begin(q, w);
+
+	if (target) {
+		vine_manager_send(q, w, "mini_task %s %s %d %lld %o\n", target->source, target->cached_name, target->cache_level, (long long)target->size, 0777);
 	} else {
+		vine_manager_send(q, w, "task %lld\n", (long long)t->task_id);
+	}
+
+	vine_manager_put_task_description(q, w, t, command_line, limits);
+
+	if (vine_manager_put_end(q, w) != VINE_SUCCESS)
 		return VINE_WORKER_FAILURE;
+
+	if (target) {
+		struct vine_file_replica *replica = vine_file_replica_create(target->type, target->cache_level, target->size, target->mtime);
+		vine_file_replica_table_insert(q, w, target->cached_name, replica);
 	}
+
+	return VINE_SUCCESS;
 }
@@ -10,12 +10,14 @@ See the file COPYING for details.
 #include "vine_file.h"
 #include "vine_file_replica.h"
 #include "vine_mount.h"
+#include "vine_worker_index.h"
 
 #include "debug.h"
 #include "hash_table.h"
 #include "list.h"
 #include "priority_queue.h"
 #include "macros.h"
+#include "set.h"
 #include "rmonitor_types.h"
 #include "rmsummary.h"
 
@@ -289,6 +291,102 @@ struct vine_task *vine_schedule_find_library(struct vine_manager *q, struct vine
 	return 0;
 }
 
+/*
+Recompute the upper bound of the resources that a new task could claim
+at this worker, and move the worker to the matching bucket of the worker index.
+Mirrors the computation in check_worker_have_enough_resources: idle libraries
+are counted as free, as they are killed as needed to make room for other tasks.
+Must be called whenever the resources in use or total at the worker change.
+*/
+
+void vine_schedule_update_worker(struct vine_manager *q, struct vine_worker_info *w)
+{
+	if (w->resources->workers.total < 1) {
+		vine_worker_index_remove(q->worker_index, w);
+		return;
+	}
+
+	struct vine_resources *r = w->resources;
+
+	w->free_cores = overcommitted_resource_total(q, r->cores.total) - r->cores.inuse;
+	w->free_memory = overcommitted_resource_total(q, r->memory.total) - r->memory.inuse;
+	w->free_disk = r->disk.total - r->disk.inuse;
+	w->free_gpus = overcommitted_resource_total(q, r->gpus.total) - r->gpus.inuse;
+
+	uint64_t task_id;
+	struct vine_task *ti;
+	ITABLE_ITERATE(w->current_tasks, task_id, ti)
+	{
+		if (ti->provides_library && ti->function_slots_inuse == 0 && ti->current_resource_box) {
+			w->free_cores += ti->current_resource_box->cores;
+			w->free_memory += ti->current_resource_box->memory;
+			w->free_disk += ti->current_resource_box->disk;
+			w->free_gpus += ti->current_resource_box->gpus;
+		}
+	}
+
+	vine_worker_index_update(q->worker_index, w, w->free_cores);
+}
+
+/* Recompute all workers in the index, e.g. after the overcommit multiplier changes. */
+
+void vine_schedule_update_all_workers(struct vine_manager *q)
+{
+	char *key;
+	struct vine_worker_info *w;
+	HASH_TABLE_ITERATE(q->worker_table, key, w)
+	{
+		vine_schedule_update_worker(q, w);
+	}
+}
+
+/* Remove a worker from the index before it is disconnected. */
+
+void vine_schedule_remove_worker(struct vine_manager *q, struct vine_worker_info *w)
+{
+	vine_worker_index_remove(q->worker_index, w);
+}
+
+/*
+Only the resources explicitly requested by a task are known before a worker
+is chosen, as the rest depend on the worker. They are a lower bound of what
+the task needs at any worker, and so they are used to narrow the candidates.
+*/
+
+static int64_t task_min_cores(struct vine_task *t)
+{
+	if (t->needs_library) {
+		return 0;
+	}
+	return MAX(0, t->resources_requested->cores);
+}
+
+/* Quick test against the worker upper bound before the full check_worker_against_task. */
+
+static int worker_may_fit_task(struct vine_worker_info *w, struct vine_task *t)
+{
+	if (t->needs_library) {
+		return 1;
+	}
+
+	const struct rmsummary *r = t->resources_requested;
+
+	if (r->cores > 0 && r->cores > w->free_cores) {
+		return 0;
+	}
+	if (r->memory > 0 && r->memory > w->free_memory) {
+		return 0;
+	}
+	if (r->disk > 0 && r->disk > w->free_disk) {
+		return 0;
+	}
+	if (r->gpus > 0 && r->gpus > w->free_gpus) {
+		return 0;
+	}
+
+	return 1;
+}
+
 // 0 if current_best has more free resources than candidate, 1 else.
 static int candidate_has_worse_fit(struct vine_worker_info *current_best, struct vine_worker_info *candidate)
 {
@@ -323,54 +421,139 @@ static int candidate_has_worse_fit(struct vine_worker_info *current_best, struct
 	return 0;
 }
 
+/*
+Measure the bytes of the inputs of task t already cached at worker w,
+and whether w holds every input of t that is cached beyond the task.
+*/
+
+static int64_t task_cached_bytes_at_worker(struct vine_task *t, struct vine_worker_info *w, int *has_all_files)
+{
+	int64_t task_cached_bytes = 0;
+	struct vine_file_replica *replica;
+	struct vine_mount *m;
+
+	*has_all_files = 1;
+
+	LIST_ITERATE(t->input_mounts, m)
+	{
+		replica = hash_table_lookup(w->current_files, m->file->cached_name);
+
+		if (replica && m->file->type == VINE_FILE) {
+			task_cached_bytes += replica->size;
+		} else if (m->file->cache_level > VINE_CACHE_LEVEL_TASK) {
+			*has_all_files = 0;
+		}
+	}
+
+	return task_cached_bytes;
+}
+
+/*
+Consider worker w for task t in the files scheduler, updating the best
+worker found so far. Returns true if w holds all the cacheable inputs of t,
+in which case the search can stop right away.
+*/
+
+static int consider_worker_by_files(struct vine_manager *q, struct vine_task *t, struct vine_worker_info *w, int ramp_down, struct vine_worker_info **best_worker, int64_t *most_task_cached_bytes)
+{
+	if (!worker_may_fit_task(w, t)) {
+		return 0;
+	}
+
+	/* Careful: If check_worker_against task fails, then w may no longer be valid. */
+	if (!check_worker_against_task(q, w, t)) {
+		return 0;
+	}
+
+	int has_all_files;
+	int64_t task_cached_bytes = task_cached_bytes_at_worker(t, w, &has_all_files);
+
+	/* Return the worker if it was in possession of all cacheable files */
+	if (has_all_files && !ramp_down) {
+		*best_worker = w;
+		return 1;
+	}
+
+	if (!*best_worker || task_cached_bytes > *most_task_cached_bytes ||
+			(ramp_down && task_cached_bytes == *most_task_cached_bytes && candidate_has_worse_fit(*best_worker, w))) {
+		*best_worker = w;
+		*most_task_cached_bytes = task_cached_bytes;
+	}
+
+	return 0;
+}
+
+/*
+Collect the workers that hold a replica of any input of task t,
+using the manager's file_worker_table. Any worker with some cached
+data for t is in this set, so it is enough to score these workers
+unless none of them fits the task.
+Returns the number of workers collected.
+*/
+
+static int find_workers_with_inputs(struct vine_manager *q, struct vine_task *t, struct set *holders)
+{
+	struct vine_mount *m;
+	struct vine_worker_info *w;
+
+	LIST_ITERATE(t->input_mounts, m)
+	{
+		struct set *workers = hash_table_lookup(q->file_worker_table, m->file->cached_name);
+		if (!workers) {
+			continue;
+		}
+
+		SET_ITERATE(workers, w)
+		{
+			set_insert(holders, w);
+		}
+	}
+
+	return set_size(holders);
+}
+
 /*
 Find the worker that has the largest quantity of cached data needed
 by this task, so as to minimize transfer work that must be done
 by the manager.
+Only the workers that hold replicas of the task's inputs are scored,
+so the cost grows with the number of replicas rather than the number
+of workers. The whole pool is scanned only if none of them fits the task.
 */
 
 static struct vine_worker_info *find_worker_by_files(struct vine_manager *q, struct vine_task *t)
 {
-	char *key;
+	int bucket;
+	int offset_bookkeep;
 	struct vine_worker_info *w;
 	struct vine_worker_info *best_worker = 0;
-	int offset_bookkeep;
 	int64_t most_task_cached_bytes = 0;
-	int64_t task_cached_bytes;
-	uint8_t has_all_files;
-	struct vine_file_replica *replica;
-	struct vine_mount *m;
 
 	int ramp_down = vine_schedule_in_ramp_down(q);
 
-	HASH_TABLE_ITERATE_RANDOM_START(q->worker_table, offset_bookkeep, key, w)
-	{
-		/* Careful: If check_worker_against task fails, then w may no longer be valid. */
-		if (check_worker_against_task(q, w, t)) {
-			task_cached_bytes = 0;
-			has_all_files = 1;
+	if (t->input_mounts && list_size(t->input_mounts) > 0) {
+		struct set *holders = set_create(0);
 
-			LIST_ITERATE(t->input_mounts, m)
+		if (find_workers_with_inputs(q, t, holders) > 0) {
+			SET_ITERATE_RANDOM_START(holders, offset_bookkeep, w)
 			{
-				replica = hash_table_lookup(w->current_files, m->file->cached_name);
-
-				if (replica && m->file->type == VINE_FILE) {
-					task_cached_bytes += replica->size;
-				} else if (m->file->cache_level > VINE_CACHE_LEVEL_TASK) {
-					has_all_files = 0;
+				if (consider_worker_by_files(q, t, w, ramp_down, &best_worker, &most_task_cached_bytes)) {
+					break;
 				}
 			}
+		}
 
-			/* Return the worker if it was in possession of all cacheable files */
-			if (has_all_files && !ramp_down) {
-				return w;
-			}
+		set_delete(holders);
 
-			if (!best_worker || task_cached_bytes > most_task_cached_bytes ||
-					(ramp_down && task_cached_bytes == most_task_cached_bytes && candidate_has_worse_fit(best_worker, w))) {
-				best_worker = w;
-				most_task_cached_bytes = task_cached_bytes;
-			}
+		if (best_worker) {
+			return best_worker;
+		}
+	}
+
+	VINE_WORKER_INDEX_ITERATE(q->worker_index, task_min_cores(t), bucket, offset_bookkeep, w)
+	{
+		if (consider_worker_by_files(q, t, w, ramp_down, &best_worker, &most_task_cached_bytes)) {
+			return best_worker;
 		}
 	}
 
@@ -379,16 +562,21 @@ static struct vine_worker_info *find_worker_by_files(struct vine_manager *q, str
 
 /*
 Find the first available worker in first-come, first-served order.
-Since the order of workers in the hashtable is somewhat arbitrary,
+Since the order of workers in the worker index is somewhat arbitrary,
 this amounts to simply "find the first available worker".
 */
 
 static struct vine_worker_info *find_worker_by_fcfs(struct vine_manager *q, struct vine_task *t)
 {
-	char *key;
+	int bucket;
+	int offset_bookkeep;
 	struct vine_worker_info *w;
-	HASH_TABLE_ITERATE(q->worker_table, key, w)
+	VINE_WORKER_INDEX_ITERATE(q->worker_index, task_min_cores(t), bucket, offset_bookkeep, w)
 	{
+		if (!worker_may_fit_task(w, t)) {
+			continue;
+		}
+
 		/* Careful: If check_worker_against task fails, then w may no longer be valid. */
 		if (check_worker_against_task(q, w, t)) {
 			return w;
@@ -405,15 +593,20 @@ putting them in a list, and then choosing from the list at random.
 
 static struct vine_worker_info *find_worker_by_random(struct vine_manager *q, struct vine_task *t)
 {
-	char *key;
+	int bucket;
+	int offset_bookkeep;
 	struct vine_worker_info *w = NULL;
 	int random_worker;
 	struct list *valid_workers = list_create();
 
-	// avoid the temptation to use HASH_TABLE_ITERATE_RANDOM_START for this loop.
-	// HASH_TABLE_ITERATE_RANDOM_START would give preference to workers that appear first in a bucket.
-	HASH_TABLE_ITERATE(q->worker_table, key, w)
+	// all compatible workers are collected before choosing, so the
+	// iteration order of the index does not bias the choice.
+	VINE_WORKER_INDEX_ITERATE(q->worker_index, task_min_cores(t), bucket, offset_bookkeep, w)
 	{
+		if (!worker_may_fit_task(w, t)) {
+			continue;
+		}
+
 		/* Careful: If check_worker_against task fails, then w may no longer be valid. */
 		if (check_worker_against_task(q, w, t)) {
 			list_push_tail(valid_workers, w);
@@ -442,12 +635,17 @@ unused once this task is placed there.
 
 static struct vine_worker_info *find_worker_by_worst_fit(struct vine_manager *q, struct vine_task *t)
 {
-	char *key;
+	int bucket;
+	int offset_bookkeep;
 	struct vine_worker_info *w;
 	struct vine_worker_info *best_worker = NULL;
 
-	HASH_TABLE_ITERATE(q->worker_table, key, w)
+	VINE_WORKER_INDEX_ITERATE(q->worker_index, task_min_cores(t), bucket, offset_bookkeep, w)
 	{
+		if (!worker_may_fit_task(w, t)) {
+			continue;
+		}
+
 		/* Careful: If check_worker_against task fails, then w may no longer be valid. */
 		if (check_worker_against_task(q, w, t)) {
 			if (!best_worker || candidate_has_worse_fit(best_worker, w)) {
@@ -467,13 +665,18 @@ then pick one FCFS.
 
 static struct vine_worker_info *find_worker_by_time(struct vine_manager *q, struct vine_task *t)
 {
-	char *key;
+	int bucket;
+	int offset_bookkeep;
 	struct vine_worker_info *w;
 	struct vine_worker_info *best_worker = 0;
 	double best_time = HUGE_VAL;
 
-	HASH_TABLE_ITERATE(q->worker_table, key, w)
+	VINE_WORKER_INDEX_ITERATE(q->worker_index, task_min_cores(t), bucket, offset_bookkeep, w)
 	{
+		if (!worker_may_fit_task(w, t)) {
+			continue;
+		}
+
 		/* Careful: If check_worker_against task fails, then w may no longer be valid. */
 		if (check_worker_against_task(q, w, t)) {
 			if (w->total_tasks_complete > 0) {
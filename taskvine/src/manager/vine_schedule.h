@@ -24,4 +24,7 @@ int vine_schedule_check_fixed_location(struct vine_manager *q, struct vine_task
 int vine_schedule_in_ramp_down(struct vine_manager *q);
 struct vine_task *vine_schedule_find_library(struct vine_manager *q, struct vine_worker_info *w, const char *library_name);
 int check_worker_against_task(struct vine_manager *q, struct vine_worker_info *w, struct vine_task *t);
+void vine_schedule_update_worker(struct vine_manager *q, struct vine_worker_info *w);
+void vine_schedule_update_all_workers(struct vine_manager *q);
+void vine_schedule_remove_worker(struct vine_manager *q, struct vine_worker_info *w);
 #endif
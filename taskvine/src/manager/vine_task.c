@@ -95,6 +95,7 @@ void vine_task_clean(struct vine_task *t)
 	t->time_workers_execute_last = 0;
 	t->time_workers_execute_last_start = 0;
 	t->time_workers_execute_last_end = 0;
+	t->time_workers_stage_in_last = 0;
 
 	t->bytes_sent = 0;
 	t->bytes_received = 0;
@@ -216,6 +217,8 @@ struct vine_task *vine_task_copy(const struct vine_task *task)
 		vine_task_set_library_provided(new, task->provides_library);
 	if (task->func_exec_mode)
 		vine_task_set_function_exec_mode(new, task->func_exec_mode);
+	if (task->function_input)
+		vine_task_set_function_input(new, task->function_input, task->function_input_length);
 	if (task->tag)
 		vine_task_set_tag(new, task->tag);
 	if (task->category)
@@ -333,6 +336,20 @@ void vine_task_set_function_exec_mode_from_string(struct vine_task *t, const cha
 	}
 }
 
+void vine_task_set_function_input(struct vine_task *t, const char *buffer, size_t size)
+{
+	free(t->function_input);
+	t->function_input = NULL;
+	t->function_input_length = 0;
+
+	if (buffer) {
+		t->function_input = xxmalloc(size + 1);
+		memcpy(t->function_input, buffer, size);
+		t->function_input[size] = 0;
+		t->function_input_length = size;
+	}
+}
+
 void vine_task_set_env_var(struct vine_task *t, const char *name, const char *value)
 {
 	if (value) {
@@ -744,6 +761,7 @@ void vine_task_delete(struct vine_task *t)
 
 	free(t->needs_library);
 	free(t->provides_library);
+	free(t->function_input);
 
 	free(t->monitor_output_directory);
 
@@ -796,6 +814,11 @@ const char *vine_task_get_stdout(struct vine_task *t)
 	return t->output;
 }
 
+int64_t vine_task_get_stdout_length(struct vine_task *t)
+{
+	return t->output ? t->output_length : 0;
+}
+
 int vine_task_get_exit_code(struct vine_task *t)
 {
 	return t->exit_code;
@@ -832,6 +855,7 @@ int64_t vine_task_get_metric(struct vine_task *t, const char *name)
 	METRIC(time_when_commit_end);
 	METRIC(time_when_retrieval);
 	METRIC(time_workers_execute_last);
+	METRIC(time_workers_stage_in_last);
 	METRIC(time_workers_execute_all);
 	METRIC(time_workers_execute_exhaustion);
 	METRIC(time_workers_execute_failure);
@@ -54,11 +54,14 @@ struct vine_task {
 
 	char *monitor_output_directory;	     /**< Custom output directory for the monitoring output files. If NULL, save to directory from @ref vine_enable_monitoring */
 	struct vine_file *monitor_snapshot_file;  /**< Filename the monitor checks to produce snapshots. */
+	int monitor_in_worker;               /**< If not zero, the monitoring flags of the task when the worker measures it, instead of a resource_monitor wrapping its command. */
 
 	char *needs_library;         /**< If this is a FunctionTask, the name of the library used */
 	char *provides_library;      /**< If this is a LibraryTask, the name of the library provided. */
 	int   function_slots_requested; /**< If this is a LibraryTask, the number of function slots requested by the user. -1 causes the number of slots to match the number of cores. */
         vine_task_func_exec_mode_t func_exec_mode;    /**< If this a LibraryTask, the execution mode of its functions. */
+	char *function_input;        /**< If this is a FunctionCall, the arguments sent inline to the library, if any. */
+	int64_t function_input_length; /**< The length of function_input in bytes. */
 	
 	struct list *input_mounts;    /**< The mounted files expected as inputs. */
 	struct list *output_mounts;   /**< The mounted files expected as outputs. */
@@ -117,6 +120,7 @@ struct vine_task {
 	timestamp_t time_workers_execute_last_end;             /**< The time when the last complete execution for this task ended at a worker. */
 
 	timestamp_t time_workers_execute_last;                 /**< Duration of the last complete execution for this task. */
+	timestamp_t time_workers_stage_in_last;                /**< Time the worker took to stage the inputs of the last complete execution into its sandbox. */
 	timestamp_t time_workers_execute_all;                  /**< Accumulated time for executing the command on any worker, regardless of whether the task completed (i.e., this includes time running on workers that disconnected). */
 	timestamp_t time_workers_execute_exhaustion;           /**< Accumulated time spent in attempts that exhausted resources. */
 	timestamp_t time_workers_execute_failure;              /**< Accumulated time for runs that terminated in worker failure/disconnection. */
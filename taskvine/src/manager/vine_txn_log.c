@@ -80,6 +80,7 @@ static struct jx *resources_with_io_report(const struct vine_task *t, const stru
 		jx_insert(m, jx_string("time_output_mgr"), jx_arrayv(jx_double((t->time_when_done - t->time_when_retrieval) / ((double)ONE_SECOND)), jx_string("s"), NULL));
 		jx_insert(m, jx_string("time_worker_end"), jx_arrayv(jx_double(t->time_workers_execute_last_end / ((double)ONE_SECOND)), jx_string("s"), NULL));
 		jx_insert(m, jx_string("time_worker_start"), jx_arrayv(jx_double(t->time_workers_execute_last_start / ((double)ONE_SECOND)), jx_string("s"), NULL));
+		jx_insert(m, jx_string("time_stage_in_worker"), jx_arrayv(jx_double(t->time_workers_stage_in_last / ((double)ONE_SECOND)), jx_string("s"), NULL));
 	}
 
 	return m;
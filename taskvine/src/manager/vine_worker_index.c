@@ -0,0 +1,92 @@
+/*
+Copyright (C) 2022- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "vine_worker_index.h"
+
+#include "macros.h"
+#include "xxmalloc.h"
+
+#include <stdlib.h>
+
+struct vine_worker_index *vine_worker_index_create()
+{
+	struct vine_worker_index *x = xxmalloc(sizeof(*x));
+	x->buckets = 0;
+	x->nbuckets = 0;
+	x->size = 0;
+	return x;
+}
+
+void vine_worker_index_delete(struct vine_worker_index *x)
+{
+	if (!x)
+		return;
+
+	int i;
+	for (i = 0; i < x->nbuckets; i++) {
+		set_delete(x->buckets[i]);
+	}
+
+	free(x->buckets);
+	free(x);
+}
+
+/* Grow the bucket array so that bucket n is valid. */
+
+static void grow_buckets(struct vine_worker_index *x, int n)
+{
+	if (n < x->nbuckets)
+		return;
+
+	int nbuckets = MAX(n + 1, 2 * x->nbuckets);
+	x->buckets = xxrealloc(x->buckets, nbuckets * sizeof(struct set *));
+
+	int i;
+	for (i = x->nbuckets; i < nbuckets; i++) {
+		x->buckets[i] = set_create(0);
+	}
+
+	x->nbuckets = nbuckets;
+}
+
+void vine_worker_index_update(struct vine_worker_index *x, struct vine_worker_info *w, int64_t free_cores)
+{
+	int bucket = MAX(0, free_cores);
+
+	if (w->index_bucket == bucket)
+		return;
+
+	vine_worker_index_remove(x, w);
+
+	grow_buckets(x, bucket);
+	set_insert(x->buckets[bucket], w);
+	w->index_bucket = bucket;
+	x->size++;
+}
+
+void vine_worker_index_remove(struct vine_worker_index *x, struct vine_worker_info *w)
+{
+	if (w->index_bucket < 0)
+		return;
+
+	set_remove(x->buckets[w->index_bucket], w);
+	w->index_bucket = -1;
+	x->size--;
+}
+
+int vine_worker_index_size(struct vine_worker_index *x)
+{
+	return x->size;
+}
+
+int vine_worker_index_first_bucket(struct vine_worker_index *x, int64_t min_cores)
+{
+	if (min_cores < 0)
+		return 0;
+	if (min_cores >= x->nbuckets)
+		return x->nbuckets;
+	return min_cores;
+}
@@ -0,0 +1,55 @@
+/*
+Copyright (C) 2022- The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef VINE_WORKER_INDEX_H
+#define VINE_WORKER_INDEX_H
+
+/*
+A worker index groups connected workers into buckets according to
+the number of cores that a new task could still claim at each worker.
+The scheduler uses it to visit only the workers that could possibly
+fit a task, instead of scanning the complete worker table.
+The index only narrows the candidates: each candidate must still be
+checked in full with check_worker_against_task.
+This module is private to the manager and should not be invoked by the end user.
+*/
+
+#include "vine_worker_info.h"
+#include "set.h"
+
+struct vine_worker_index {
+	struct set **buckets; /* buckets[i] is the set of workers with exactly i free cores. */
+	int nbuckets;         /* Number of buckets currently allocated. */
+	int size;             /* Number of workers in the index. */
+};
+
+struct vine_worker_index *vine_worker_index_create();
+void vine_worker_index_delete(struct vine_worker_index *x);
+
+/* Place worker w into the bucket for free_cores, moving it if already indexed. */
+void vine_worker_index_update(struct vine_worker_index *x, struct vine_worker_info *w, int64_t free_cores);
+
+/* Remove worker w from the index. Does nothing if w is not indexed. */
+void vine_worker_index_remove(struct vine_worker_index *x, struct vine_worker_info *w);
+
+/* Return the number of workers in the index. */
+int vine_worker_index_size(struct vine_worker_index *x);
+
+/* Return the first bucket that holds workers with at least min_cores free cores. */
+int vine_worker_index_first_bucket(struct vine_worker_index *x, int64_t min_cores);
+
+/*
+Iterate over the workers that have at least min_cores free cores, from the
+least free to the most free bucket. Within each bucket the starting point
+is chosen at random to spread tasks among equivalent workers.
+*/
+
+#define VINE_WORKER_INDEX_ITERATE(x, min_cores, bucket, offset_bookkeep, w) \
+	for (bucket = vine_worker_index_first_bucket(x, min_cores); bucket < (x)->nbuckets; bucket++) \
+		if (set_size((x)->buckets[bucket]) > 0) \
+			for (set_random_element((x)->buckets[bucket], &offset_bookkeep); (w = set_next_element_with_offset((x)->buckets[bucket], offset_bookkeep));)
+
+#endif
@@ -32,7 +32,9 @@ struct vine_worker_info *vine_worker_create(struct link *lnk)
 	w->resources = vine_resources_create();
 	w->features = hash_table_create(4, 0);
 
-	w->current_files = hash_table_create(0, 0);
+	w->index_bucket = -1;
+
+	w->current_files = hash_table_create_open(0, 0);
 	w->current_tasks = itable_create(0);
 
 	w->start_time = timestamp_get();
@@ -122,6 +124,10 @@ struct jx *vine_worker_to_jx(struct vine_worker_info *w)
 	jx_insert_integer(j, "total_tasks_running", itable_size(w->current_tasks));
 	jx_insert_integer(j, "total_bytes_transferred", w->total_bytes_transferred);
 	jx_insert_integer(j, "total_transfer_time", w->total_transfer_time);
+	jx_insert_integer(j, "peer_transfer_connections", w->peer_transfer_connections);
+	jx_insert_integer(j, "peer_transfer_bytes", w->peer_transfer_bytes);
+	jx_insert_integer(j, "peer_transfer_time", w->peer_transfer_time);
+	jx_insert_integer(j, "peer_transfers_active", w->peer_transfers_active);
 
 	jx_insert_integer(j, "start_time", w->start_time);
 	jx_insert_integer(j, "current_time", timestamp_get());
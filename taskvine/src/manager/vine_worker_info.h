@@ -59,6 +59,15 @@ struct vine_worker_info {
 	struct vine_resources *resources;
 	struct hash_table     *features;
 
+	/* Upper bound of the resources a new task could claim at this worker, */
+	/* and the bucket of the manager's worker index where it is kept. */
+	/* Both are maintained by vine_schedule_update_worker. */
+	int64_t free_cores;
+	int64_t free_memory;
+	int64_t free_disk;
+	int64_t free_gpus;
+	int     index_bucket;
+
 	/* Current files and tasks that have been transfered to this worker */
 	struct hash_table   *current_files;
 	struct itable       *current_tasks;
@@ -92,6 +101,13 @@ struct vine_worker_info {
 	int xfer_total_bad_source_counter;
 	int xfer_total_good_destination_counter;
 	int xfer_total_bad_destination_counter;
+
+	/* Transfers served by the worker to its peers, as last reported by the worker. */
+	int64_t     peer_transfer_connections;
+	int64_t     peer_transfer_bytes;
+	timestamp_t peer_transfer_time;
+	double      peer_transfer_max_bandwidth;
+	int         peer_transfers_active;
 };
 
 struct vine_worker_info * vine_worker_create( struct link * lnk );
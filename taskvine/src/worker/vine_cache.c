@@ -20,6 +20,8 @@ See the file COPYING for details.
 #include "hash_table.h"
 #include "link.h"
 #include "link_auth.h"
+#include "list.h"
+#include "macros.h"
 #include "path_disk_size_info.h"
 #include "stringtools.h"
 #include "timestamp.h"
@@ -28,6 +30,7 @@ See the file COPYING for details.
 
 #include <dirent.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/fcntl.h>
@@ -36,13 +39,25 @@ See the file COPYING for details.
 #include <sys/wait.h>
 #include <unistd.h>
 
+/* How often to check the incremental disk accounting against a walk of the cache directory. */
+#define VINE_CACHE_RECONCILE_INTERVAL 3600
+
 struct vine_cache {
 	struct hash_table *table;
 	char *cache_dir;
 	int max_transfer_procs;
+
+	/* Bytes and files of the objects ready in the cache, kept up to date as objects come and go. */
+	int64_t bytes_inuse;
+	int64_t files_inuse;
+
+	/* State of the occasional walk of the cache directory that corrects the above. */
+	struct path_disk_size_info *reconcile_state;
+	time_t reconcile_last;
 };
 
 static void vine_cache_wait_for_file(struct vine_cache *c, struct vine_cache_file *f, const char *cachename, struct link *manager);
+static void vine_cache_finish_batch(struct vine_cache *c, struct vine_cache_file *f, pid_t pid, int status, struct link *manager);
 
 /*
 Create the cache manager structure for a given cache directory.
@@ -54,9 +69,28 @@ struct vine_cache *vine_cache_create(const char *cache_dir, int max_procs)
 	c->cache_dir = strdup(cache_dir);
 	c->table = hash_table_create(0, 0);
 	c->max_transfer_procs = max_procs;
+	c->bytes_inuse = 0;
+	c->files_inuse = 0;
+	c->reconcile_state = 0;
+	c->reconcile_last = time(0);
 	return c;
 }
 
+/*
+Add (sign=1) or remove (sign=-1) the disk usage of a ready object
+from the totals of the cache. Objects in any other state have not
+reached the cache directory, and so are not counted.
+*/
+
+static void vine_cache_account(struct vine_cache *c, struct vine_cache_file *f, int sign)
+{
+	if (f->status != VINE_CACHE_STATUS_READY)
+		return;
+
+	c->bytes_inuse += sign * (int64_t)f->size;
+	c->files_inuse += sign * f->file_count;
+}
+
 /*
 Load existing cache directory into cache structure.
 */
@@ -93,6 +127,7 @@ void vine_cache_load(struct vine_cache *c)
 					debug(D_VINE, "cache: %s has cache-level %d, keeping", d->d_name, f->cache_level);
 					hash_table_insert(c->table, d->d_name, f);
 					f->status = VINE_CACHE_STATUS_READY;
+					vine_cache_account(c, f, 1);
 				}
 			} else {
 				debug(D_VINE, "cache: %s has invalid metadata, deleting", d->d_name);
@@ -138,6 +173,81 @@ void vine_cache_prune(struct vine_cache *c, vine_cache_level_t level)
 	}
 }
 
+/*
+Take the batched file f out of the batch of the process that fetches it.
+The process goes on with the rest of the batch, and whatever it fetches
+for f is thrown away when the process is reaped.
+*/
+
+static void vine_cache_detach_batched(struct vine_cache *c, struct vine_cache_file *f, const char *cachename)
+{
+	debug(D_VINE, "cache: taking %s out of transfer process %d of %s", cachename, f->pid, f->batch_owner);
+
+	struct vine_cache_file *owner = hash_table_lookup(c->table, f->batch_owner);
+	if (owner && owner->batch) {
+		char *name;
+		LIST_ITERATE(owner->batch, name)
+		{
+			if (!strcmp(name, cachename))
+				break;
+		}
+		if (name) {
+			list_remove(owner->batch, name);
+			if (!owner->discard)
+				owner->discard = list_create();
+			list_push_tail(owner->discard, name);
+		}
+	}
+
+	free(f->batch_owner);
+	f->batch_owner = 0;
+	f->status = VINE_CACHE_STATUS_FAILED;
+	f->pid = 0;
+}
+
+/*
+Hand the process of f, along with the rest of its batch, over to the
+first file in the batch, so that removing f does not fail the others.
+Whatever the process fetches for f is thrown away when it is reaped.
+Returns false if there is nobody left to take over.
+*/
+
+static int vine_cache_handoff_batch(struct vine_cache *c, struct vine_cache_file *f, const char *cachename)
+{
+	char *heir_name = list_pop_head(f->batch);
+	struct vine_cache_file *heir = hash_table_lookup(c->table, heir_name);
+	if (!heir) {
+		free(heir_name);
+		return 0;
+	}
+
+	debug(D_VINE, "cache: handing transfer process %d of %s over to %s", f->pid, cachename, heir_name);
+
+	free(heir->batch_owner);
+	heir->batch_owner = 0;
+	heir->batch = f->batch;
+	heir->discard = f->discard ? f->discard : list_create();
+	list_push_tail(heir->discard, xxstrdup(cachename));
+	f->batch = 0;
+	f->discard = 0;
+
+	char *name;
+	LIST_ITERATE(heir->batch, name)
+	{
+		struct vine_cache_file *other = hash_table_lookup(c->table, name);
+		if (other) {
+			free(other->batch_owner);
+			other->batch_owner = xxstrdup(heir_name);
+		}
+	}
+	free(heir_name);
+
+	f->status = VINE_CACHE_STATUS_FAILED;
+	f->pid = 0;
+
+	return 1;
+}
+
 /*
 Kill off any process associated with this file object.
 Used by both vine_cache_remove and vine_cache_delete.
@@ -145,6 +255,17 @@ Used by both vine_cache_remove and vine_cache_delete.
 
 static void vine_cache_kill(struct vine_cache *c, struct vine_cache_file *f, const char *cachename, struct link *manager)
 {
+	/* A process shared by a batch is only killed along with the last file in it. */
+	if (f->status == VINE_CACHE_STATUS_PROCESSING) {
+		if (f->batch_owner) {
+			vine_cache_detach_batched(c, f, cachename);
+			return;
+		}
+		if (f->batch && list_size(f->batch) > 0 && vine_cache_handoff_batch(c, f, cachename)) {
+			return;
+		}
+	}
+
 	while (f->status == VINE_CACHE_STATUS_PROCESSING) {
 		debug(D_VINE, "cache: killing pending transfer process %d...", f->pid);
 		kill(f->pid, SIGKILL);
@@ -171,10 +292,63 @@ void vine_cache_delete(struct vine_cache *c)
 
 	hash_table_clear(c->table, (void *)vine_cache_file_delete);
 	hash_table_delete(c->table);
+	if (c->reconcile_state)
+		path_disk_size_info_delete_state(c->reconcile_state);
 	free(c->cache_dir);
 	free(c);
 }
 
+/*
+Report the disk space and number of files used by the objects ready in the cache.
+These are maintained as objects are added and removed, so this is cheap to call.
+*/
+
+void vine_cache_disk_usage(struct vine_cache *c, int64_t *bytes, int64_t *files)
+{
+	*bytes = MAX(c->bytes_inuse, 0);
+	*files = MAX(c->files_inuse, 0);
+}
+
+/*
+Every VINE_CACHE_RECONCILE_INTERVAL, walk the cache directory, at most max_secs
+per call, and when the walk is complete replace the running totals with what was found.
+This corrects for objects whose size was not known exactly when they were added,
+such as directories sent by the manager, which are counted as a single file.
+*/
+
+void vine_cache_reconcile(struct vine_cache *c, int max_secs)
+{
+	if (!c->reconcile_state && time(0) < c->reconcile_last + VINE_CACHE_RECONCILE_INTERVAL)
+		return;
+
+	path_disk_size_info_get_r(c->cache_dir, max_secs, &c->reconcile_state, NULL);
+
+	if (c->reconcile_state->complete_measurement) {
+		/* The walk also counts the cache directory itself and the metadata file of each ready object. */
+		int64_t extra_files = 1;
+
+		char *cachename;
+		struct vine_cache_file *f;
+		HASH_TABLE_ITERATE(c->table, cachename, f)
+		{
+			if (f->status == VINE_CACHE_STATUS_READY)
+				extra_files++;
+		}
+
+		int64_t bytes = c->reconcile_state->last_byte_size_complete;
+		int64_t files = c->reconcile_state->last_file_count_complete - extra_files;
+
+		debug(D_VINE, "cache: measured %" PRId64 " bytes in %" PRId64 " files, accounted %" PRId64 " bytes in %" PRId64 " files", bytes, files, c->bytes_inuse, c->files_inuse);
+
+		c->bytes_inuse = bytes;
+		c->files_inuse = files;
+
+		path_disk_size_info_delete_state(c->reconcile_state);
+		c->reconcile_state = 0;
+		c->reconcile_last = time(0);
+	}
+}
+
 /* Get the full path to the data of a cached file. This result must be freed. */
 
 char *vine_cache_data_path(struct vine_cache *c, const char *cachename)
@@ -208,8 +382,15 @@ Add a file to the cache manager by renaming it from its current location
 and writing out the metadata to the proper location.
 */
 
-int vine_cache_add_file(
-		struct vine_cache *c, const char *cachename, const char *transfer_path, vine_cache_level_t level, int mode, uint64_t size, time_t mtime, timestamp_t transfer_time)
+int vine_cache_add_file(struct vine_cache *c,
+		const char *cachename,
+		const char *transfer_path,
+		vine_cache_level_t level,
+		int mode,
+		uint64_t size,
+		int64_t nfiles,
+		time_t mtime,
+		timestamp_t transfer_time)
 {
 	char *data_path = vine_cache_data_path(c, cachename);
 	char *meta_path = vine_cache_meta_path(c, cachename);
@@ -220,6 +401,7 @@ int vine_cache_add_file(
 		struct vine_cache_file *f = hash_table_lookup(c->table, cachename);
 		if (f) {
 			/* If the file object is already present, we are providing the missing data. */
+			vine_cache_account(c, f, -1);
 		} else {
 			/* If not, we are declaring a completely new file. */
 			f = vine_cache_file_create(VINE_CACHE_FILE, "manager", 0);
@@ -230,11 +412,13 @@ int vine_cache_add_file(
 		f->cache_level = level;
 		f->mode = mode;
 		f->size = size;
+		f->file_count = MAX(nfiles, 1);
 		f->mtime = mtime;
 		f->transfer_time = transfer_time;
 
 		/* File has data and is ready to use. */
 		f->status = VINE_CACHE_STATUS_READY;
+		vine_cache_account(c, f, 1);
 
 		vine_cache_file_save_metadata(f, meta_path);
 
@@ -288,13 +472,15 @@ int vine_cache_add_transfer(struct vine_cache *c, const char *cachename, const c
 	f->size = size;
 	f->mtime = 0;
 	f->transfer_time = 0;
+	f->flags = flags;
 
 	hash_table_insert(c->table, cachename, f);
 
-	/* Note metadata is not saved here but when transfer is completed. */
-
-	if (flags & VINE_CACHE_FLAGS_NOW)
-		vine_cache_ensure(c, cachename);
+	/*
+	Note metadata is not saved here but when transfer is completed.
+	A transfer with VINE_CACHE_FLAGS_NOW is started by the next vine_cache_wait,
+	so that the requests that arrive together from the manager are fetched together.
+	*/
 
 	return 1;
 }
@@ -343,6 +529,8 @@ int vine_cache_remove(struct vine_cache *c, const char *cachename, struct link *
 	/* Ensure that any child process associated with the entry is stopped. */
 	vine_cache_kill(c, f, cachename, manager);
 
+	vine_cache_account(c, f, -1);
+
 	/* Then remove the disk state associated with the file. */
 	char *data_path = vine_cache_data_path(c, cachename);
 	char *meta_path = vine_cache_meta_path(c, cachename);
@@ -456,8 +644,73 @@ static int rewrite_source_to_ip(struct vine_cache_file *f, char **error_message)
 }
 
 /*
-Transfer a single input file from a worker url to a local file name.
+Return the length of the "worker://host:port/" prefix of a peer transfer source,
+or zero if the source does not name a peer.
+*/
+
+static int peer_source_prefix_length(const char *source)
+{
+	if (strncmp(source, "worker://", 9) && strncmp(source, "workerip://", 11))
+		return 0;
+
+	const char *slash = strchr(strstr(source, "://") + 3, '/');
+	if (!slash)
+		return 0;
+
+	return slash - source + 1;
+}
+
+/*
+Leave an error message for the parent process explaining why cachename was not created.
+*/
+
+static void vine_cache_write_error(struct vine_cache *c, const char *cachename, const char *error_message)
+{
+	char *error_path = vine_cache_error_path(c, cachename);
+	FILE *file = fopen(error_path, "w");
+	if (file) {
+		fprintf(file, "error creating file at worker: %s\n", error_message);
+		fclose(file);
+	}
+	free(error_path);
+}
+
+/*
+Remove the error message left by an earlier attempt to create cachename.
+*/
+
+static void vine_cache_clear_error(struct vine_cache *c, const char *cachename)
+{
+	char *error_path = vine_cache_error_path(c, cachename);
+	trash_file(error_path);
+	free(error_path);
+}
+
+/*
+Mark the batched files of f from position first onwards as failed.
 */
+
+static void vine_cache_fail_batch(struct vine_cache *c, struct vine_cache_file *f, int first, const char *error_message)
+{
+	if (!f->batch)
+		return;
+
+	int i = 0;
+	char *name;
+	LIST_ITERATE(f->batch, name)
+	{
+		if (i++ >= first) {
+			vine_cache_write_error(c, name, error_message);
+		}
+	}
+}
+
+/*
+Transfer an input file from a worker url to a local file name,
+along with any other files batched with it from the same peer.
+All of the files are requested over a single connection.
+*/
+
 static int do_worker_transfer(struct vine_cache *c, struct vine_cache_file *f, const char *cachename, char **error_message)
 {
 	int port_num;
@@ -475,35 +728,58 @@ static int do_worker_transfer(struct vine_cache *c, struct vine_cache_file *f, c
 
 	if (worker_link == NULL) {
 		*error_message = string_format("Could not establish connection with worker at: %s:%d", addr, port_num);
+		vine_cache_fail_batch(c, f, 0, *error_message);
 		return 0;
 	}
 
 	if (options->password) {
 		if (!link_auth_password(worker_link, options->password, time(0) + 5)) {
 			*error_message = string_format("Could not authenticate to peer worker at %s:%d", addr, port_num);
+			vine_cache_fail_batch(c, f, 0, *error_message);
 			link_close(worker_link);
 			return 0;
 		}
 	}
 
+	int nrequests = 1 + (f->batch ? list_size(f->batch) : 0);
+	const char **request_paths = xxmalloc(nrequests * sizeof(char *));
+	request_paths[0] = source_path;
+
+	if (f->batch) {
+		int i = 1;
+		char *name;
+		LIST_ITERATE(f->batch, name)
+		{
+			struct vine_cache_file *other = hash_table_lookup(c->table, name);
+			request_paths[i++] = other->source + peer_source_prefix_length(other->source);
+		}
+		debug(D_VINE, "cache: requesting %d files from %s:%d", nrequests, addr, port_num);
+	}
+
 	/* XXX A fixed timeout of 900 certainly can't be right! */
 
 	char *transfer_dir = vine_cache_transfer_path(c, ".");
-	int64_t totalsize;
-	int mode, mtime;
 
-	if (!vine_transfer_request_any(worker_link, source_path, transfer_dir, &totalsize, &mode, &mtime, time(0) + 900)) {
-		*error_message = string_format("Could not transfer file from %s", f->source);
-		link_close(worker_link);
-		return 0;
-	}
+	int received = vine_transfer_request_many(worker_link, request_paths, nrequests, transfer_dir, time(0) + 900);
 
 	free(transfer_dir);
+	free(request_paths);
 
-	/* At this point, the file is in the transfer path, but not yet in the cache. */
+	/* At this point, the files are in the transfer path, but not yet in the cache. */
 
 	link_close(worker_link);
 
+	if (received < nrequests) {
+		char *message = string_format("Could not transfer file from %s:%d", addr, port_num);
+		vine_cache_fail_batch(c, f, MAX(received - 1, 0), message);
+		free(message);
+	}
+
+	if (received < 1) {
+		*error_message = string_format("Could not transfer file from %s", f->source);
+		return 0;
+	}
+
 	return 1;
 }
 
@@ -569,14 +845,7 @@ static void vine_cache_worker_process(struct vine_cache_file *f, struct vine_cac
 
 	if (error_message) {
 		debug(D_VINE, "cache: error when creating %s via mini task: %s", cachename, error_message);
-
-		char *error_path = vine_cache_error_path(c, cachename);
-		FILE *file = fopen(error_path, "w");
-		if (file) {
-			fprintf(file, "error creating file at worker: %s\n", error_message);
-			fclose(file);
-		}
-		free(error_path);
+		vine_cache_write_error(c, cachename, error_message);
 		free(error_message);
 	}
 
@@ -586,6 +855,58 @@ static void vine_cache_worker_process(struct vine_cache_file *f, struct vine_cac
 	exit(result == 0);
 }
 
+/*
+Collect other pending transfers from the same peer as f that have been requested,
+so that the process for f requests all of them over one connection.
+*/
+
+static void vine_cache_gather_batch(struct vine_cache *c, struct vine_cache_file *f, const char *cachename)
+{
+	int prefix = peer_source_prefix_length(f->source);
+	if (!prefix)
+		return;
+
+	char *other_name;
+	struct vine_cache_file *other;
+	HASH_TABLE_ITERATE(c->table, other_name, other)
+	{
+		if (f->batch && list_size(f->batch) >= VINE_TRANSFER_PIPELINE_MAX - 1)
+			break;
+		if (other == f || other->cache_type != VINE_CACHE_TRANSFER || other->status != VINE_CACHE_STATUS_PENDING)
+			continue;
+		/* Files nobody has asked for yet are left to be fetched when they are needed. */
+		if (!other->requested && !(other->flags & VINE_CACHE_FLAGS_NOW))
+			continue;
+		if (strncmp(other->source, f->source, prefix) || peer_source_prefix_length(other->source) != prefix)
+			continue;
+
+		if (!f->batch)
+			f->batch = list_create();
+		list_push_tail(f->batch, xxstrdup(other_name));
+	}
+}
+
+/*
+Once the process for f is running, mark the files in its batch as in progress.
+*/
+
+static void vine_cache_start_batch(struct vine_cache *c, struct vine_cache_file *f, const char *cachename)
+{
+	if (!f->batch)
+		return;
+
+	char *name;
+	LIST_ITERATE(f->batch, name)
+	{
+		struct vine_cache_file *other = hash_table_lookup(c->table, name);
+		other->status = VINE_CACHE_STATUS_PROCESSING;
+		other->start_time = f->start_time;
+		other->pid = f->pid;
+		other->batch_owner = xxstrdup(cachename);
+		debug(D_VINE, "cache: transferring %s to %s along with %s", other->source, name, f->source);
+	}
+}
+
 /*
 Ensure that a given cached entry is fully materialized in the cache,
 downloading files or executing commands as needed.  If complete, return
@@ -616,6 +937,8 @@ vine_cache_status_t vine_cache_ensure(struct vine_cache *c, const char *cachenam
 		break;
 	}
 
+	f->requested = 1;
+
 	/* For a mini-task, we must also insure the inputs to the task exist. */
 	if (f->cache_type == VINE_CACHE_MINI_TASK) {
 		if (f->mini_task->input_mounts) {
@@ -651,7 +974,7 @@ vine_cache_status_t vine_cache_ensure(struct vine_cache *c, const char *cachenam
 	struct vine_cache_file *table_f;
 	HASH_TABLE_ITERATE(c->table, table_cachename, table_f)
 	{
-		if (table_f->status == VINE_CACHE_STATUS_PROCESSING) {
+		if (table_f->status == VINE_CACHE_STATUS_PROCESSING && !table_f->batch_owner) {
 			num_processing++;
 		}
 	}
@@ -659,17 +982,37 @@ vine_cache_status_t vine_cache_ensure(struct vine_cache *c, const char *cachenam
 		return VINE_CACHE_STATUS_PENDING;
 	}
 
+	if (f->cache_type == VINE_CACHE_TRANSFER) {
+		vine_cache_gather_batch(c, f, cachename);
+	}
+
+	/* The outcome of each file is also told by the error message left for it, so drop any from before. */
+	vine_cache_clear_error(c, cachename);
+	if (f->batch) {
+		char *name;
+		LIST_ITERATE(f->batch, name)
+		{
+			vine_cache_clear_error(c, name);
+		}
+	}
+
 	f->pid = fork();
 
 	if (f->pid < 0) {
 		debug(D_VINE, "cache: failed to fork transfer process");
 		f->status = VINE_CACHE_STATUS_FAILED;
+		if (f->batch) {
+			list_clear(f->batch, free);
+			list_delete(f->batch);
+			f->batch = 0;
+		}
 		return f->status;
 	} else if (f->pid > 0) {
 		f->status = VINE_CACHE_STATUS_PROCESSING;
 		switch (f->cache_type) {
 		case VINE_CACHE_TRANSFER:
 			debug(D_VINE, "cache: transferring %s to %s", f->source, cachename);
+			vine_cache_start_batch(c, f, cachename);
 			break;
 		case VINE_CACHE_MINI_TASK:
 			debug(D_VINE, "cache: creating %s via mini task", cachename);
@@ -730,13 +1073,14 @@ static void vine_cache_check_outputs(struct vine_cache *c, struct vine_cache_fil
 		int mode;
 		time_t mtime;
 		int64_t size;
+		int64_t nfiles;
 
 		chmod(cache_path, f->mode);
 
 		debug(D_VINE, "cache: measuring %s", transfer_path);
-		if (vine_cache_file_measure_metadata(transfer_path, &mode, &size, &mtime)) {
+		if (vine_cache_file_measure_metadata(transfer_path, &mode, &size, &nfiles, &mtime)) {
 			debug(D_VINE, "cache: created %s with size %lld in %lld usec", cachename, (long long)size, (long long)transfer_time);
-			if (vine_cache_add_file(c, cachename, transfer_path, f->cache_level, mode, size, mtime, transfer_time)) {
+			if (vine_cache_add_file(c, cachename, transfer_path, f->cache_level, mode, size, nfiles, mtime, transfer_time)) {
 				f->status = VINE_CACHE_STATUS_READY;
 			} else {
 				debug(D_VINE, "cache: unable to move %s to %s: %s\n", transfer_path, cache_path, strerror(errno));
@@ -796,7 +1140,11 @@ static void vine_cache_handle_exit_status(struct vine_cache *c, struct vine_cach
 	} else {
 		int exit_code = WEXITSTATUS(status);
 		debug(D_VINE, "cache: transfer process for %s (pid %d) exited normally with exit code %d", cachename, f->pid, exit_code);
-		if (exit_code == 0) {
+		char *error_path = vine_cache_error_path(c, cachename);
+		/* A file that took over a batch can fail on its own even if the process succeeded. */
+		int has_error = access(error_path, F_OK) == 0;
+		free(error_path);
+		if (exit_code == 0 && !has_error) {
 			debug(D_VINE, "cache: transfer process for %s completed", cachename);
 			f->status = VINE_CACHE_STATUS_TRANSFERRED;
 		} else {
@@ -816,8 +1164,9 @@ Consider one cache table entry to determine if the transfer process has complete
 static void vine_cache_wait_for_file(struct vine_cache *c, struct vine_cache_file *f, const char *cachename, struct link *manager)
 {
 	int status;
-	if (f->status == VINE_CACHE_STATUS_PROCESSING) {
-		int result = waitpid(f->pid, &status, WNOHANG);
+	if (f->status == VINE_CACHE_STATUS_PROCESSING && !f->batch_owner) {
+		pid_t pid = f->pid;
+		int result = waitpid(pid, &status, WNOHANG);
 		if (result == 0) {
 			// process still executing
 		} else if (result < 0) {
@@ -825,8 +1174,71 @@ static void vine_cache_wait_for_file(struct vine_cache *c, struct vine_cache_fil
 		} else if (result > 0) {
 			vine_cache_handle_exit_status(c, f, cachename, status, manager);
 			vine_cache_check_outputs(c, f, cachename, manager);
+			vine_cache_finish_batch(c, f, pid, status, manager);
+		}
+	}
+}
+
+/*
+When the process for f exits, decide the outcome of each file in its batch.
+A batched file was transferred if the process exited normally, produced the
+file, and did not leave an error message for it.
+*/
+
+static void vine_cache_finish_batch(struct vine_cache *c, struct vine_cache_file *f, pid_t pid, int status, struct link *manager)
+{
+	char *name;
+
+	/* Throw away what was fetched for files taken out of the batch, unless they are being fetched again. */
+	if (f->discard) {
+		while ((name = list_pop_head(f->discard))) {
+			struct vine_cache_file *other = hash_table_lookup(c->table, name);
+			if (!other || other->status != VINE_CACHE_STATUS_PROCESSING) {
+				char *transfer_path = vine_cache_transfer_path(c, name);
+				char *error_path = vine_cache_error_path(c, name);
+				trash_file(transfer_path);
+				trash_file(error_path);
+				free(transfer_path);
+				free(error_path);
+			}
+			free(name);
+		}
+		list_delete(f->discard);
+		f->discard = 0;
+	}
+
+	if (!f->batch)
+		return;
+
+	while ((name = list_pop_head(f->batch))) {
+		struct vine_cache_file *other = hash_table_lookup(c->table, name);
+		if (other && other->batch_owner && other->pid == pid && other->status == VINE_CACHE_STATUS_PROCESSING) {
+			char *transfer_path = vine_cache_transfer_path(c, name);
+			char *error_path = vine_cache_error_path(c, name);
+			struct stat info;
+
+			if (WIFEXITED(status) && access(error_path, F_OK) != 0 && lstat(transfer_path, &info) == 0) {
+				other->status = VINE_CACHE_STATUS_TRANSFERRED;
+			} else {
+				other->status = VINE_CACHE_STATUS_FAILED;
+				trash_file(transfer_path);
+			}
+
+			other->stop_time = f->stop_time;
+			free(other->batch_owner);
+			other->batch_owner = 0;
+			other->pid = 0;
+
+			free(transfer_path);
+			free(error_path);
+
+			vine_cache_check_outputs(c, other, name, manager);
 		}
+		free(name);
 	}
+
+	list_delete(f->batch);
+	f->batch = 0;
 }
 
 /*
@@ -837,6 +1249,21 @@ int vine_cache_wait(struct vine_cache *c, struct link *manager)
 {
 	struct vine_cache_file *f;
 	char *cachename;
+
+	/* Start the transfers requested for right now, after collecting them, as starting one may batch others. */
+	struct list *start = list_create();
+	HASH_TABLE_ITERATE(c->table, cachename, f)
+	{
+		if (f->status == VINE_CACHE_STATUS_PENDING && (f->flags & VINE_CACHE_FLAGS_NOW)) {
+			list_push_tail(start, xxstrdup(cachename));
+		}
+	}
+	while ((cachename = list_pop_head(start))) {
+		vine_cache_ensure(c, cachename);
+		free(cachename);
+	}
+	list_delete(start);
+
 	HASH_TABLE_ITERATE(c->table, cachename, f)
 	{
 		vine_cache_wait_for_file(c, f, cachename, manager);
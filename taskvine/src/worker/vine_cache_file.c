@@ -25,6 +25,7 @@ struct vine_cache_file *vine_cache_file_create(vine_cache_type_t cache_type, con
 	f->mini_task = mini_task;
 
 	f->status = VINE_CACHE_STATUS_PENDING;
+	f->file_count = 1;
 
 	/* Remaining items default to zero. */
 	return f;
@@ -38,6 +39,15 @@ void vine_cache_file_delete(struct vine_cache_file *f)
 	if (f->process) {
 		vine_process_delete(f->process);
 	}
+	if (f->batch) {
+		list_clear(f->batch, free);
+		list_delete(f->batch);
+	}
+	if (f->discard) {
+		list_clear(f->discard, free);
+		list_delete(f->discard);
+	}
+	free(f->batch_owner);
 	free(f->source);
 	free(f);
 }
@@ -106,12 +116,11 @@ int vine_cache_file_save_metadata(struct vine_cache_file *f, const char *filenam
 	return 1;
 }
 
-/* Observe the mode, size, and mtime of a file or directory tree. */
+/* Observe the mode, size, number of files, and mtime of a file or directory tree. */
 
-int vine_cache_file_measure_metadata(const char *path, int *mode, int64_t *size, time_t *mtime)
+int vine_cache_file_measure_metadata(const char *path, int *mode, int64_t *size, int64_t *nfiles, time_t *mtime)
 {
 	struct stat info;
-	int64_t nfiles = 0;
 
 	/* Get the basic metadata. */
 	int result = stat(path, &info);
@@ -119,7 +128,7 @@ int vine_cache_file_measure_metadata(const char *path, int *mode, int64_t *size,
 		return 0;
 
 	/* Measure the size of the item recursively, if a directory. */
-	result = path_disk_size_info_get(path, size, &nfiles, NULL);
+	result = path_disk_size_info_get(path, size, nfiles, NULL);
 	if (result < 0)
 		return 0;
 
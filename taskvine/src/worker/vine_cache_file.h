@@ -13,6 +13,7 @@ See the file COPYING for details.
 
 #include <unistd.h>
 
+#include "list.h"
 #include "timestamp.h"
 
 struct vine_cache_file {
@@ -27,12 +28,21 @@ struct vine_cache_file {
 	timestamp_t stop_time;
 	pid_t pid;
 	vine_cache_status_t status;
+	vine_cache_flags_t flags;
+
+	int requested;      // true once the file has been asked for with vine_cache_ensure.
+
+	/* Peer transfers from the same source are fetched together by one process. */
+	struct list *batch;   // cachenames of the other files fetched by this file's process.
+	struct list *discard; // cachenames taken out of the batch, whose output is thrown away.
+	char *batch_owner;    // cachename of the file whose process fetches this one, if any.
 
 	/* Metadata info stored in disk in .meta file. */
 	vine_file_type_t original_type; // original type of the object: file, url, temp, etc..
 	vine_cache_level_t cache_level; // how long to cache the object.
 	int mode;                       // unix mode bits of original object
 	uint64_t size;                  // summed size of the file or dir tree in bytes
+	int64_t file_count;             // number of files in the dir tree, or 1 for a single file
 	time_t mtime;                   // source mtime of original object
 	timestamp_t transfer_time;      // time to transfer (or create) the object
 };
@@ -43,6 +53,6 @@ void vine_cache_file_delete( struct vine_cache_file *f);
 int vine_cache_file_load_metadata( struct vine_cache_file *f, const char *filename );
 int vine_cache_file_save_metadata( struct vine_cache_file *f, const char *filename );
 
-int vine_cache_file_measure_metadata( const char *path, int *mode, int64_t *size, time_t *mtime );
+int vine_cache_file_measure_metadata( const char *path, int *mode, int64_t *size, int64_t *nfiles, time_t *mtime );
 
 #endif
@@ -74,6 +74,17 @@ static const char *vine_process_sandbox_code(vine_process_type_t type)
 	return "task";
 }
 
+/*
+Return true if this process is a function call whose arguments are
+sent inline to the library, and which needs no sandbox directory.
+*/
+
+int vine_process_is_inline_function(struct vine_process *p)
+{
+	struct vine_task *t = p->task;
+	return p->type == VINE_PROCESS_TYPE_FUNCTION && t->function_input && list_size(t->input_mounts) == 0 && list_size(t->output_mounts) == 0;
+}
+
 /*
 Create a vine_process and all of the information necessary for invocation.
 However, do not allocate substantial resources at this point.
@@ -87,15 +98,25 @@ struct vine_process *vine_process_create(struct vine_task *task, vine_process_ty
 	p->task = task;
 	p->type = type;
 
+	p->output_length = 0;
+
+	p->functions_running = 0;
+	p->library_ready = 0;
+
+	/*
+	A function call with inline arguments and no files touches nothing on disk:
+	the arguments and the result travel through the library pipes.
+	*/
+
+	if (vine_process_is_inline_function(p)) {
+		return p;
+	}
+
 	const char *dirtype = vine_process_sandbox_code(p->type);
 
 	p->sandbox = string_format("%s/%s.%d", workspace->workspace_dir, dirtype, p->task->task_id);
 	p->tmpdir = string_format("%s/.taskvine.tmp", p->sandbox);
 	p->output_file_name = string_format("%s/.taskvine.stdout", p->sandbox);
-	p->output_length = 0;
-
-	p->functions_running = 0;
-	p->library_ready = 0;
 
 	/* Note that create_dir recursively creates parents, so a single one is sufficient. */
 
@@ -116,6 +137,9 @@ void vine_process_delete(struct vine_process *p)
 		free(p->output_file_name);
 	}
 
+	if (p->output)
+		free(p->output);
+
 	if (p->library_read_link)
 		link_close(p->library_read_link);
 	if (p->library_write_link)
@@ -129,6 +153,9 @@ void vine_process_delete(struct vine_process *p)
 	if (p->tmpdir)
 		free(p->tmpdir);
 
+	if (p->bind_mounts)
+		vine_sandbox_bind_mounts_delete(p->bind_mounts);
+
 	free(p);
 }
 
@@ -234,13 +261,27 @@ int vine_process_execute_and_wait(struct vine_process *p)
 }
 
 /* Send a message containing details of a function call to the relevant library to execute it.
+ * If the arguments are inline, their length follows that of the message, and the arguments follow the message.
  * @param p 	The relevant vine_process structure encapsulating a function call.
  * @return 		1 if the message is successfully sent to the library, 0 otherwise. */
 
 int vine_process_invoke_function(struct vine_process *p)
 {
-	char *buffer = string_format("%d %s %s %s", p->task->task_id, p->task->command_line, p->sandbox, p->output_file_name);
-	ssize_t result = link_printf(p->library_process->library_write_link, time(0) + options->active_timeout, "%ld\n%s", strlen(buffer), buffer);
+	struct vine_task *t = p->task;
+	struct link *l = p->library_process->library_write_link;
+	time_t stoptime = time(0) + options->active_timeout;
+	ssize_t result;
+
+	char *buffer = string_format("%d %s %s %s", t->task_id, t->command_line, p->sandbox ? p->sandbox : "-", p->output_file_name ? p->output_file_name : "-");
+
+	if (t->function_input) {
+		result = link_printf(l, stoptime, "%ld %lld\n%s", strlen(buffer), (long long)t->function_input_length, buffer);
+		if (result >= 0) {
+			result = link_write(l, t->function_input, t->function_input_length, stoptime);
+		}
+	} else {
+		result = link_printf(l, stoptime, "%ld\n%s", strlen(buffer), buffer);
+	}
 
 	// conservatively assume that the function starts executing as soon as we send it to the library.
 	// XXX Alternatively, the library could report when the function started.
@@ -352,6 +393,10 @@ int vine_process_execute(struct vine_process *p)
 		return 0;
 
 	} else {
+		if (!vine_sandbox_bind_inputs(p)) {
+			fatal("could not stage input directories into %s: %s", p->sandbox, strerror(errno));
+		}
+
 		if (chdir(p->sandbox)) {
 			printf("The sandbox dir is %s", p->sandbox);
 			fatal("could not change directory into %s: %s", p->sandbox, strerror(errno));
@@ -461,12 +506,15 @@ int vine_process_wait(struct vine_process *p)
 }
 
 /* Receive a message containing a function call id from the library without blocking.
+ * If the function was called with inline arguments, its result follows the message.
  * @param p			The vine process encapsulating the function call.
  * @param done_task_id          Pointer to location to store completed task id.
  * @param done_exit_code        Pointer to location to the completed task exit code.
+ * @param result                Pointer to location to store the inline result, if any, to be freed by the caller.
+ * @param result_length         Pointer to location to store the length of the inline result.
  * return 			1 if the operation succeeds, 0 otherwise.
  */
-int vine_process_library_get_result(struct vine_process *p, uint64_t *done_task_id, int *done_exit_code)
+int vine_process_library_get_result(struct vine_process *p, uint64_t *done_task_id, int *done_exit_code, char **result, int64_t *result_length)
 {
 	/* If this is not a library process, don't check. */
 	if (p->type != VINE_PROCESS_TYPE_LIBRARY)
@@ -483,12 +531,17 @@ int vine_process_library_get_result(struct vine_process *p, uint64_t *done_task_
 	char buffer[VINE_LINE_MAX]; // Buffer to store length of data from library.
 	int ok = 1;
 
-	/* read number of bytes of data first. */
+	*result = 0;
+	*result_length = 0;
+
+	/* read number of bytes of data first, and of the inline result if any. */
 	ok = link_readline(p->library_read_link, buffer, VINE_LINE_MAX, time(0) + options->active_timeout);
 	if (!ok) {
 		return 0;
 	}
-	int len_buffer = atoi(buffer);
+	int len_buffer = 0;
+	long long len_result = 0;
+	sscanf(buffer, "%d %lld", &len_buffer, &len_result);
 
 	/* now read the buffer, which is the task id of the done function invocation. */
 	char buffer_data[len_buffer + 1];
@@ -500,7 +553,19 @@ int vine_process_library_get_result(struct vine_process *p, uint64_t *done_task_
 	/* null terminate the buffer before treating it as a string. */
 	buffer_data[ok] = 0;
 	sscanf(buffer_data, "%" SCNu64 " %d", done_task_id, done_exit_code);
-	debug(D_VINE, "Received result for function %" PRIu64 ", exit code %d", *done_task_id, *done_exit_code);
+
+	if (len_result > 0) {
+		*result = malloc(len_result + 1);
+		if (link_read(p->library_read_link, *result, len_result, time(0) + options->active_timeout) != len_result) {
+			free(*result);
+			*result = 0;
+			return 0;
+		}
+		(*result)[len_result] = 0;
+		*result_length = len_result;
+	}
+
+	debug(D_VINE, "Received result for function %" PRIu64 ", exit code %d, %lld bytes inline", *done_task_id, *done_exit_code, len_result);
 
 	return ok;
 }
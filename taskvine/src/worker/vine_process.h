@@ -72,8 +72,17 @@ struct vine_process {
 	/* size of the process' stdout file */
 	int64_t output_length;
 
+	/* If a function call with inline arguments, the result returned by the library. */
+	char *output;
+
 	/* state between complete disk measurements. */
 	struct path_disk_size_info *disk_measurement_state;
+
+	/* Time spent staging input files into the sandbox, in microseconds. */
+	timestamp_t stage_in_time;
+
+	/* Cached directories to bind-mount into the sandbox when the process starts. */
+	struct list *bind_mounts;
 };
 
 struct vine_process * vine_process_create( struct vine_task *task, vine_process_type_t type );
@@ -86,7 +95,8 @@ void  vine_process_delete( struct vine_process *p );
 
 int   vine_process_execute_and_wait( struct vine_process *p );
 
-int   vine_process_library_get_result( struct vine_process *p, uint64_t *done_task_id, int *exit_code );
+int   vine_process_library_get_result( struct vine_process *p, uint64_t *done_task_id, int *exit_code, char **result, int64_t *result_length );
+int   vine_process_is_inline_function( struct vine_process *p );
 
 void  vine_process_compute_disk_needed( struct vine_process *p );
 int   vine_process_measure_disk(struct vine_process *p, int max_time_on_measurement);
@@ -16,13 +16,34 @@ See the file COPYING for details.
 #include "create_dir.h"
 #include "debug.h"
 #include "file_link_recursive.h"
+#include "list.h"
 #include "stringtools.h"
+#include "timestamp.h"
+#include "xxmalloc.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#ifdef CCTOOLS_OPSYS_LINUX
+#include <sched.h>
+#include <sys/mount.h>
+#endif
+
+/* A cached directory to be mounted read-only into the sandbox when the process starts. */
+
+struct vine_sandbox_bind {
+	char *source;
+	char *target;
+};
+
+/* Whether bind mounts work on this host: -1 until checked, then 0 or 1. */
+static int bind_mounts_available = -1;
+
 char *vine_sandbox_full_path(struct vine_process *p, const char *sandbox_name)
 {
 	return string_format("%s/%s", p->sandbox, sandbox_name);
@@ -65,6 +86,119 @@ vine_cache_status_t vine_sandbox_ensure(struct vine_process *p, struct vine_cach
 	}
 }
 
+#ifdef CCTOOLS_OPSYS_LINUX
+
+static int write_proc_file(const char *path, const char *str)
+{
+	int fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return 0;
+	int result = write(fd, str, strlen(str)) == (ssize_t)strlen(str);
+	close(fd);
+	return result;
+}
+
+/*
+Move the current process into a new user and mount namespace,
+keeping its own uid and gid, so that it may create bind mounts
+that no other process can see. The mounts go away with the namespace.
+*/
+
+static int enter_mount_namespace()
+{
+	uid_t uid = geteuid();
+	gid_t gid = getegid();
+
+	if (unshare(CLONE_NEWUSER | CLONE_NEWNS) < 0)
+		return 0;
+
+	char map[64];
+
+	snprintf(map, sizeof(map), "%d %d 1", (int)uid, (int)uid);
+	if (!write_proc_file("/proc/self/uid_map", map))
+		return 0;
+
+	write_proc_file("/proc/self/setgroups", "deny");
+
+	snprintf(map, sizeof(map), "%d %d 1", (int)gid, (int)gid);
+	if (!write_proc_file("/proc/self/gid_map", map))
+		return 0;
+
+	if (mount(0, "/", 0, MS_REC | MS_PRIVATE, 0) < 0)
+		return 0;
+
+	return 1;
+}
+
+static int bind_readonly(const char *source, const char *target)
+{
+	if (mount(source, target, 0, MS_BIND | MS_REC, 0) < 0)
+		return 0;
+
+	if (mount(0, target, 0, MS_BIND | MS_REMOUNT | MS_RDONLY, 0) < 0)
+		return 0;
+
+	return 1;
+}
+
+/*
+Find out once whether this host lets unprivileged processes
+create bind mounts, by trying it out in a short lived child.
+*/
+
+static int check_bind_mounts(const char *source, const char *target)
+{
+	if (bind_mounts_available >= 0)
+		return bind_mounts_available;
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		_exit(enter_mount_namespace() && bind_readonly(source, target) ? 0 : 1);
+	} else if (pid > 0) {
+		int status;
+		bind_mounts_available = waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	} else {
+		bind_mounts_available = 0;
+	}
+
+	debug(D_VINE, "sandbox: bind mounts of input directories are %s", bind_mounts_available ? "available" : "not available, using links");
+
+	return bind_mounts_available;
+}
+
+#endif
+
+/*
+Decide whether a cached object can be bind-mounted into the sandbox
+instead of linked file by file. That only applies to directories,
+only when the worker was asked to do it and the host allows it, and
+not to function calls, which run inside the process of their library.
+*/
+
+static int can_bind_input(struct vine_process *p, const char *cache_path, const char *sandbox_path)
+{
+#ifdef CCTOOLS_OPSYS_LINUX
+	if (!options->bind_input_dirs || p->type == VINE_PROCESS_TYPE_FUNCTION)
+		return 0;
+
+	struct stat info;
+	if (stat(cache_path, &info) < 0 || !S_ISDIR(info.st_mode))
+		return 0;
+
+	if (mkdir(sandbox_path, 0755) < 0)
+		return 0;
+
+	if (!check_bind_mounts(cache_path, sandbox_path)) {
+		rmdir(sandbox_path);
+		return 0;
+	}
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
 /*
 Ensure that a given input file/dir/object is present in the cache,
 (which should have occurred from a prior transfer)
@@ -88,6 +222,15 @@ static int stage_input_file(struct vine_process *p, struct vine_mount *m, struct
 			result = symlink(cache_path, sandbox_path);
 			/* Change sense of Unix result to true/false. */
 			result = !result;
+		} else if (can_bind_input(p, cache_path, sandbox_path)) {
+			/* A directory is mounted when the process starts, at the empty mount point just created. */
+			struct vine_sandbox_bind *b = malloc(sizeof(*b));
+			b->source = xxstrdup(cache_path);
+			b->target = xxstrdup(sandbox_path);
+			if (!p->bind_mounts)
+				p->bind_mounts = list_create();
+			list_push_tail(p->bind_mounts, b);
+			result = 1;
 		} else {
 			/* Otherwise recursively hard-link the object into the sandbox. */
 			result = file_link_recursive(cache_path, sandbox_path, 1);
@@ -133,6 +276,8 @@ int vine_sandbox_stagein(struct vine_process *p, struct vine_cache *cache)
 	struct vine_task *t = p->task;
 	int result = 1;
 
+	timestamp_t start = timestamp_get();
+
 	struct vine_mount *m;
 
 	/* For each input mount, stage it into the sandbox. */
@@ -155,9 +300,55 @@ int vine_sandbox_stagein(struct vine_process *p, struct vine_cache *cache)
 		}
 	}
 
+	p->stage_in_time = timestamp_get() - start;
+
 	return result;
 }
 
+/*
+Mount the input directories chosen by stage_input_file into the sandbox.
+This runs in the child process, so the mounts are only visible to the task.
+If the mounts cannot be made after all, fall back to linking the
+directories into place, as is done for any other input.
+*/
+
+int vine_sandbox_bind_inputs(struct vine_process *p)
+{
+	if (!p->bind_mounts)
+		return 1;
+
+	int mounted = 0;
+
+#ifdef CCTOOLS_OPSYS_LINUX
+	mounted = enter_mount_namespace();
+#endif
+
+	struct vine_sandbox_bind *b;
+	LIST_ITERATE(p->bind_mounts, b)
+	{
+#ifdef CCTOOLS_OPSYS_LINUX
+		if (mounted && bind_readonly(b->source, b->target))
+			continue;
+#endif
+		mounted = 0;
+		if (!file_link_recursive(b->source, b->target, 1))
+			return 0;
+	}
+
+	return 1;
+}
+
+void vine_sandbox_bind_mounts_delete(struct list *bind_mounts)
+{
+	struct vine_sandbox_bind *b;
+	while ((b = list_pop_head(bind_mounts))) {
+		free(b->source);
+		free(b->target);
+		free(b);
+	}
+	list_delete(bind_mounts);
+}
+
 /*
 Move a given output file back to the target cache location
 and inform the manager of the added file.
@@ -172,13 +363,14 @@ static int stage_output_file(struct vine_process *p, struct vine_mount *m, struc
 	int mode;
 	time_t mtime;
 	int64_t size;
+	int64_t nfiles;
 
 	timestamp_t transfer_time = p->execution_end - p->execution_start;
 
 	debug(D_VINE, "output: measuring %s", sandbox_path);
-	if (vine_cache_file_measure_metadata(sandbox_path, &mode, &size, &mtime)) {
+	if (vine_cache_file_measure_metadata(sandbox_path, &mode, &size, &nfiles, &mtime)) {
 		debug(D_VINE, "output: moving %s to %s", sandbox_path, cache_path);
-		if (vine_cache_add_file(cache, f->cached_name, sandbox_path, f->cache_level, mode, size, mtime, transfer_time)) {
+		if (vine_cache_add_file(cache, f->cached_name, sandbox_path, f->cache_level, mode, size, nfiles, mtime, transfer_time)) {
 			f->size = size;
 			vine_worker_send_cache_update(manager, f->cached_name, f->type, f->cache_level, f->size, mode, transfer_time, p->execution_start);
 			result = 1;
@@ -17,6 +17,10 @@ vine_cache_status_t vine_sandbox_ensure( struct vine_process *p, struct vine_cac
 
 int vine_sandbox_stagein( struct vine_process *p, struct vine_cache *c);
 
+/* Call only in the child process, just before it executes the task. */
+int vine_sandbox_bind_inputs( struct vine_process *p );
+void vine_sandbox_bind_mounts_delete( struct list *bind_mounts );
+
 /* void because stageout always succeeds. Let manager figure out missing outputs. Call only on reap_process! */
 void vine_sandbox_stageout( struct vine_process *p, struct vine_cache *c, struct link *manager );
 
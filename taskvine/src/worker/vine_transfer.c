@@ -351,3 +351,34 @@ int vine_transfer_request_any(struct link *lnk, const char *request_path, const
 	send_message(lnk, "get %s\n", request_path);
 	return vine_transfer_get_any(lnk, dirname, totalsize, mode, mtime, stoptime);
 }
+
+/*
+Request several items over the same connection.
+All of the requests are sent together before any reply is read,
+so that the peer can send the items back to back without waiting
+for a round trip between them. The peer sends the items in order,
+and the first failure leaves the stream in an unknown state, so
+receiving stops there.
+*/
+
+int vine_transfer_request_many(struct link *lnk, const char **request_paths, int nrequests, const char *dirname, time_t stoptime)
+{
+	int i;
+
+	link_buffer_output(lnk, nrequests * VINE_LINE_MAX);
+	for (i = 0; i < nrequests; i++) {
+		send_message(lnk, "get %s\n", request_paths[i]);
+	}
+	link_buffer_output(lnk, 0);
+
+	for (i = 0; i < nrequests; i++) {
+		int64_t totalsize = 0;
+		int mode, mtime;
+		if (vine_transfer_get_any(lnk, dirname, &totalsize, &mode, &mtime, stoptime) != 1) {
+			debug(D_VINE, "transfer of %s failed, abandoning %d remaining requests", request_paths[i], nrequests - i - 1);
+			break;
+		}
+	}
+
+	return i;
+}
@@ -15,6 +15,9 @@ typedef enum {
 	VINE_TRANSFER_MODE_FILE_ONLY
 } vine_transfer_mode_t;
 
+/* Maximum number of items requested from a peer over one connection. */
+#define VINE_TRANSFER_PIPELINE_MAX 32
+
 /* Send any cached file/dir along the connection to a remote party. */
 
 int vine_transfer_put_any( struct link *lnk, struct vine_cache *cache, const char *filename, vine_transfer_mode_t mode, time_t stoptime );
@@ -27,4 +30,8 @@ int vine_transfer_get_any(struct link *lnk, const char *dirname, int64_t *totals
 
 int vine_transfer_request_any(struct link *lnk, const char *request_name, const char *dirname, int64_t *totalsize, int *mode, int *mtime, time_t stoptime);
 
+/* Request several items at once, and receive them in order. Returns the number received before the first failure. */
+
+int vine_transfer_request_many(struct link *lnk, const char **request_names, int nrequests, const char *dirname, time_t stoptime);
+
 #endif
@@ -13,14 +13,31 @@ See the file COPYING for details.
 #include "debug.h"
 #include "link.h"
 #include "link_auth.h"
+#include "macros.h"
 #include "process.h"
+#include "timestamp.h"
 #include "url_encode.h"
 
 #include <errno.h>
+#include <inttypes.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#ifdef CCTOOLS_OPSYS_LINUX
+#include <sys/prctl.h>
+#endif
+
+/*
+The transfer server is a supervisor process that keeps a fixed pool of
+VINE_TRANSFER_PROC_MAX_CHILD transfer processes alive. Each transfer
+process accepts and serves peer connections one after another from the
+shared listening link, so a connection costs neither a fork nor an exit.
+Each transfer process keeps its statistics in its own slot of a shared
+memory region, which the worker reads to report to the manager.
+*/
+
 /* The initial timeout to wait for a command is short, to avoid unnecessary hangs */
 static int command_timeout = 5;
 
@@ -36,16 +53,27 @@ pid_t transfer_server_pid = 0;
 /* Specific port for the transfer server to listen on.  Zero means choose any available. */
 int vine_transfer_server_port = 0;
 
-/* Handle a single request for a transfer request from a peer. */
+/* Statistics of each transfer process, shared with the worker. */
+struct vine_transfer_slot {
+	pid_t pid;
+	struct vine_transfer_server_stats stats;
+};
+
+static struct vine_transfer_slot *transfer_slots = 0;
+
+/*
+Handle the requests of a peer on one connection.
+The peer may send several get requests, one after the other,
+and the connection is served until the peer closes it or
+stays silent for command_timeout.
+*/
 
-static void vine_transfer_handler(struct link *lnk, struct vine_cache *cache)
+static void vine_transfer_handler(struct link *lnk, struct vine_cache *cache, struct vine_transfer_server_stats *stats)
 {
 	char line[VINE_LINE_MAX];
 	char filename_encoded[VINE_LINE_MAX];
 	char filename[VINE_LINE_MAX];
 
-	change_process_title("vine_worker [transfer]");
-
 	if (options->password) {
 		if (!link_auth_password(lnk, options->password, time(0) + command_timeout)) {
 			debug(D_VINE, "transfer server: could not authenticate peer worker via password!");
@@ -53,49 +81,110 @@ static void vine_transfer_handler(struct link *lnk, struct vine_cache *cache)
 		}
 	}
 
-	if (link_readline(lnk, line, sizeof(line), time(0) + command_timeout)) {
+	while (link_readline(lnk, line, sizeof(line), time(0) + command_timeout)) {
 		if (sscanf(line, "get %s", filename_encoded) == 1) {
 			url_decode(filename_encoded, filename, sizeof(filename));
-			vine_transfer_put_any(lnk, cache, filename, VINE_TRANSFER_MODE_ANY, time(0) + transfer_timeout);
+
+			uint64_t bytes_before = link_bytes_written(lnk);
+			timestamp_t start = timestamp_get();
+
+			int ok = vine_transfer_put_any(lnk, cache, filename, VINE_TRANSFER_MODE_ANY, time(0) + transfer_timeout);
+
+			timestamp_t elapsed = timestamp_get() - start;
+			int64_t bytes = link_bytes_written(lnk) - bytes_before;
+
+			stats->bytes_sent += bytes;
+			stats->time_sent += elapsed;
+
+			double bandwidth = bytes * 1000000.0 / MAX(elapsed, 1);
+			if (bandwidth > stats->max_bandwidth) {
+				stats->max_bandwidth = bandwidth;
+			}
+
+			debug(D_VINE, "transfer server: sent %s (%" PRId64 " bytes) in %.3fs", filename, bytes, elapsed / 1000000.0);
+
+			if (!ok)
+				break;
 		} else {
 			debug(D_VINE, "invalid peer transfer message: %s\n", line);
+			break;
 		}
 	}
 }
 
-static void vine_transfer_process(struct vine_cache *cache)
+/*
+Main loop of one transfer process in the pool.
+It exits when the supervisor goes away, which is how the pool
+is cleaned up when the worker kills the transfer server.
+*/
+
+static void vine_transfer_process(struct vine_cache *cache, struct vine_transfer_slot *slot, pid_t supervisor)
 {
-	static int child_count = 0;
-
-	/*
-	If link is real, fork. Check if we are at the max
-	child count. If we are over, or link_accept timed out,
-	do a blocking wait on an exited child. If we are under
-	the limit, collect all exited tasks and return to recv
-	*/
-	while (1) {
+	change_process_title("vine_worker [transfer]");
+
+#ifdef CCTOOLS_OPSYS_LINUX
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+
+	slot->pid = getpid();
+
+	while (getppid() == supervisor) {
 		struct link *lnk = link_accept(transfer_link, time(0) + 10);
+		if (!lnk)
+			continue;
 
-		child_count++;
-		pid_t p = fork();
-		if (p == 0) {
-			if (lnk) {
-				vine_transfer_handler(lnk, cache);
-				link_close(lnk);
-			}
-			_exit(0);
-		} else {
-			if (child_count < VINE_TRANSFER_PROC_MAX_CHILD) {
-				while (waitpid(-1, NULL, WNOHANG) > 0) {
-					child_count--;
-				}
-				continue;
+		slot->stats.connections++;
+		slot->stats.active = 1;
+		vine_transfer_handler(lnk, cache, &slot->stats);
+		slot->stats.active = 0;
+
+		link_close(lnk);
+	}
+}
+
+static pid_t vine_transfer_process_start(struct vine_cache *cache, struct vine_transfer_slot *slot)
+{
+	pid_t supervisor = getpid();
+
+	pid_t p = fork();
+	if (p == 0) {
+		vine_transfer_process(cache, slot, supervisor);
+		_exit(0);
+	} else if (p > 0) {
+		slot->pid = p;
+	} else {
+		slot->pid = 0;
+		debug(D_VINE, "transfer server: unable to fork transfer process: %s", strerror(errno));
+	}
+
+	return p;
+}
+
+/* Start the pool, and replace any transfer process that exits. */
+
+static void vine_transfer_supervise(struct vine_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < VINE_TRANSFER_PROC_MAX_CHILD; i++) {
+		vine_transfer_process_start(cache, &transfer_slots[i]);
+	}
+
+	while (1) {
+		pid_t p = waitpid(-1, NULL, 0);
+		if (p < 0) {
+			if (errno == ECHILD) {
+				sleep(1);
 			}
 		}
 
-		debug(D_VINE, "Transfer Server: waiting on exited child. Reached %d", child_count);
-		if (waitpid(-1, NULL, 0) > 0) {
-			child_count--;
+		for (i = 0; i < VINE_TRANSFER_PROC_MAX_CHILD; i++) {
+			struct vine_transfer_slot *slot = &transfer_slots[i];
+			if (slot->pid == p || slot->pid <= 0) {
+				debug(D_VINE, "transfer server: restarting transfer process %d", i);
+				slot->stats.active = 0;
+				vine_transfer_process_start(cache, slot);
+			}
 		}
 	}
 }
@@ -108,11 +197,21 @@ void vine_transfer_server_start(struct vine_cache *cache, int port_min, int port
 		fatal("unable to find a port to start a transfer server.");
 	}
 
+	transfer_slots = mmap(0, VINE_TRANSFER_PROC_MAX_CHILD * sizeof(*transfer_slots), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (transfer_slots == MAP_FAILED) {
+		fatal("unable to allocate transfer server statistics: %s", strerror(errno));
+	}
+	memset(transfer_slots, 0, VINE_TRANSFER_PROC_MAX_CHILD * sizeof(*transfer_slots));
+
 	transfer_server_pid = fork();
 	if (transfer_server_pid == 0) {
 		// consider closing additional resources here?
 		change_process_title("vine_worker [transfer server]");
-		vine_transfer_process(cache);
+#ifdef CCTOOLS_OPSYS_LINUX
+		/* Do not outlive the worker, even if it is killed abruptly. */
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+		vine_transfer_supervise(cache);
 		_exit(0);
 	} else if (transfer_server_pid > 0) {
 		char addr[LINK_ADDRESS_MAX];
@@ -135,11 +234,40 @@ void vine_transfer_server_stop()
 	kill(transfer_server_pid, SIGKILL);
 	waitpid(transfer_server_pid, &status, 0);
 
+	/* Transfer processes would exit on their own at the next accept timeout, but may be in a long transfer. */
+	int i;
+	for (i = 0; i < VINE_TRANSFER_PROC_MAX_CHILD; i++) {
+		if (transfer_slots[i].pid > 0) {
+			kill(transfer_slots[i].pid, SIGKILL);
+		}
+	}
+
+	munmap(transfer_slots, VINE_TRANSFER_PROC_MAX_CHILD * sizeof(*transfer_slots));
+
 	transfer_server_pid = 0;
 	transfer_link = 0;
+	transfer_slots = 0;
 }
 
 void vine_transfer_server_address(char *addr, int *port)
 {
 	link_address_local(transfer_link, addr, port);
 }
+
+void vine_transfer_server_stats(struct vine_transfer_server_stats *s)
+{
+	memset(s, 0, sizeof(*s));
+
+	if (!transfer_slots)
+		return;
+
+	int i;
+	for (i = 0; i < VINE_TRANSFER_PROC_MAX_CHILD; i++) {
+		struct vine_transfer_server_stats *t = &transfer_slots[i].stats;
+		s->connections += t->connections;
+		s->bytes_sent += t->bytes_sent;
+		s->time_sent += t->time_sent;
+		s->active += t->active;
+		s->max_bandwidth = MAX(s->max_bandwidth, t->max_bandwidth);
+	}
+}
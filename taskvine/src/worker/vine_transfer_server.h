@@ -9,11 +9,23 @@ See the file COPYING for details.
 
 #include "vine_cache.h"
 #include "link.h"
+#include "timestamp.h"
 
+/* Number of long-lived processes serving peer transfers concurrently. */
 #define VINE_TRANSFER_PROC_MAX_CHILD 8
 
+/* Statistics of the transfers served to peers since the server started. */
+struct vine_transfer_server_stats {
+	int64_t connections;   /* Number of peer connections accepted. */
+	int64_t bytes_sent;    /* Bytes sent to peers. */
+	timestamp_t time_sent; /* Time spent sending to peers, in usecs. */
+	double max_bandwidth;  /* Highest bandwidth of a single transfer, in bytes per second. */
+	int active;            /* Number of connections being served right now. */
+};
+
 void vine_transfer_server_start( struct vine_cache *cache, int port_min, int port_max );
 void vine_transfer_server_stop();
 void vine_transfer_server_address( char *addr, int *port );
+void vine_transfer_server_stats( struct vine_transfer_server_stats *s );
 
 #endif
@@ -22,6 +22,7 @@ See the file COPYING for details.
 
 #include "catalog_query.h"
 #include "cctools.h"
+#include "buffer.h"
 #include "change_process_title.h"
 #include "copy_stream.h"
 #include "create_dir.h"
@@ -46,10 +47,10 @@ See the file COPYING for details.
 #include "macros.h"
 #include "md5.h"
 #include "path.h"
-#include "path_disk_size_info.h"
 #include "pattern.h"
 #include "process.h"
 #include "random.h"
+#include "rmonitor_tasks.h"
 #include "stringtools.h"
 #include "trash.h"
 #include "unlink_recursive.h"
@@ -76,6 +77,12 @@ See the file COPYING for details.
 #include <sys/stat.h>
 #include <sys/types.h>
 
+/* Outputs up to this size are sent along with their completion message. */
+#define VINE_INLINE_OUTPUT_MAX (4 * VINE_LINE_MAX)
+
+/* Completion messages are sent together in frames of up to this size. */
+#define VINE_COMPLETED_FRAME_MAX (8 * VINE_LINE_MAX)
+
 /***************************************************************/
 /* Primary Worker Data Structures for Tracking Tasks and Files */
 /***************************************************************/
@@ -98,6 +105,12 @@ static struct list *procs_waiting = NULL;
 /* List of asynchronous messages pending to be sent to the manager */
 static struct list *pending_async_messages = NULL;
 
+/* An asynchronous message, which may carry binary data such as the result of a function call. */
+struct async_message {
+	char *data;
+	int length;
+};
+
 /* Table of all processes with results to be sent back, indexed by task_id. */
 /* These are additional pointers into procs_table and should not be deleted */
 static struct itable *procs_complete = NULL;
@@ -112,6 +125,12 @@ struct vine_cache *cache_manager = 0;
 /* files marked with VINE_WATCH have been modified and should be streamed back. */
 static struct vine_watcher *watcher = 0;
 
+/* The monitor measuring every task that the manager asked the worker to measure itself. */
+static struct rmonitor_tasks *task_monitor = 0;
+
+/* Seconds between measurements of the monitored tasks, as given by the manager. */
+static int monitor_interval = 5;
+
 /***************************************************************/
 /*         Machine Resources Managed by the Worker             */
 /***************************************************************/
@@ -237,21 +256,38 @@ void deliver_async_messages(struct link *l)
 
 	int messages = list_size(pending_async_messages);
 	int visited;
-	char *message;
+	struct async_message *message;
+
+	/* Messages that fit in the window are sent together in as few writes as possible. */
+	link_buffer_output(l, MAX(bytes_available, 0));
 
 	for (visited = 0; visited < messages; visited++) {
 		message = list_peek_head(pending_async_messages);
-		int message_size = strlen(message);
-		if (message_size < bytes_available) {
+		if (message->length < bytes_available) {
 			message = list_pop_head(pending_async_messages);
-			bytes_available -= message_size;
-			debug(D_VINE, "tx: %s", message);
-			link_printf(l, time(0) + options->active_timeout, "%s", message);
+			bytes_available -= message->length;
+			debug(D_VINE, "tx: %.*s", message->length, message->data);
+			link_putlstring(l, message->data, message->length, time(0) + options->active_timeout);
+			free(message->data);
 			free(message);
 		} else {
 			break;
 		}
 	}
+
+	link_buffer_output(l, 0);
+}
+
+/* Buffer an asynchronous message of the given data, which is freed once sent. */
+
+static void send_async_data(struct link *l, char *data, int length)
+{
+	struct async_message *message = malloc(sizeof(*message));
+	message->data = data;
+	message->length = length;
+
+	list_push_tail(pending_async_messages, message);
+	deliver_async_messages(l); // attempt to deliver message, will be delivered later if buffer is full.
 }
 
 /* Buffer an asynchronous message to be sent to the manager */
@@ -261,11 +297,65 @@ void send_async_message(struct link *l, const char *fmt, ...)
 	va_list va;
 	char *message = malloc(VINE_LINE_MAX);
 	va_start(va, fmt);
-	vsprintf(message, fmt, va);
+	vsnprintf(message, VINE_LINE_MAX, fmt, va);
 	va_end(va);
 
-	list_push_tail(pending_async_messages, message);
-	deliver_async_messages(l); // attempt to deliver message, will be delivered later if buffer is full.
+	send_async_data(l, message, strlen(message));
+}
+
+/*
+Append to a frame the completion message of a task, followed by
+the output of the task if it is given.  The output may be binary.
+*/
+
+static void append_complete_task(buffer_t *frame, struct vine_process *p, const char *output, int64_t output_sent)
+{
+	buffer_printf(frame,
+			"complete %d %d %lld %lld %llu %llu %d %d %llu",
+			p->result,
+			p->exit_code,
+			(long long)p->output_length,
+			(long long)output_sent,
+			(unsigned long long)p->execution_start,
+			(unsigned long long)p->execution_end,
+			(int)p->sandbox_size,
+			p->task->task_id,
+			(unsigned long long)p->stage_in_time);
+
+	/* The resources measured by the worker go at the end of the line, as a single line of json. */
+	if (p->task->monitor_in_worker) {
+		char *measured = rmsummary_print_string(p->task->resources_measured, /* only resources */ 0);
+		buffer_printf(frame, " %s", measured);
+		free(measured);
+	}
+
+	buffer_putliteral(frame, "\n");
+
+	if (output_sent > 0) {
+		buffer_putlstring(frame, output, output_sent);
+	}
+}
+
+/*
+Send a frame of completion messages as a single asynchronous message,
+so that the manager receives them all with one read.
+*/
+
+static void send_completed_frame(struct link *l, buffer_t *frame, int count)
+{
+	size_t length;
+	const char *data = buffer_tolstring(frame, &length);
+
+	char *message = string_format("completed %d %lld\n", count, (long long)length);
+	int header_length = strlen(message);
+
+	message = realloc(message, header_length + length + 1);
+	memcpy(message + header_length, data, length);
+	message[header_length + length] = 0;
+
+	send_async_data(l, message, header_length + length);
+
+	buffer_rewind(frame, 0);
 }
 
 /* Send asynchronous task completion messages for current complete processes */
@@ -274,42 +364,43 @@ void send_complete_tasks(struct link *l)
 {
 	int size = itable_size(procs_complete);
 	int visited;
+	int count = 0;
 	struct vine_process *p;
+
+	buffer_t frame;
+	buffer_init(&frame);
+
 	for (visited = 0; visited < size; visited++) {
 		p = itable_pop(procs_complete);
-		if (p->output_length <= 1024 && p->output_length > 0) {
 
+		/* Start a new frame rather than let this one grow past the limit. */
+		if (count > 0 && buffer_pos(&frame) + VINE_LINE_MAX + MIN(p->output_length, VINE_INLINE_OUTPUT_MAX) > VINE_COMPLETED_FRAME_MAX) {
+			send_completed_frame(l, &frame, count);
+			count = 0;
+		}
+
+		if (p->output && p->output_length <= VINE_INLINE_OUTPUT_MAX) {
+			/* The result of an inline function call is already in memory. */
+			append_complete_task(&frame, p, p->output, p->output_length);
+		} else if (p->output_length <= VINE_INLINE_OUTPUT_MAX && p->output_length > 0 && p->output_file_name) {
 			char *output;
 			int output_file = open(p->output_file_name, O_RDONLY);
 			output = malloc(p->output_length + 1);
-			full_read(output_file, output, p->output_length);
-			output[p->output_length] = '\0';
+			int64_t actual = full_read(output_file, output, p->output_length);
 			close(output_file);
-			send_async_message(l,
-					"complete %d %d %lld %lld %llu %llu %d %d\n%s",
-					p->result,
-					p->exit_code,
-					(long long)p->output_length,
-					(long long)p->output_length,
-					(unsigned long long)p->execution_start,
-					(unsigned long long)p->execution_end,
-					p->sandbox_size,
-					p->task->task_id,
-					output);
+			append_complete_task(&frame, p, output, MAX(actual, 0));
 			free(output);
 		} else {
-			send_async_message(l,
-					"complete %d %d %lld %lld %llu %llu %d %d\n",
-					p->result,
-					p->exit_code,
-					(long long)p->output_length,
-					0,
-					(unsigned long long)p->execution_start,
-					(unsigned long long)p->execution_end,
-					p->sandbox_size,
-					p->task->task_id);
+			append_complete_task(&frame, p, 0, 0);
 		}
+		count++;
+	}
+
+	if (count > 0) {
+		send_completed_frame(l, &frame, count);
 	}
+
+	buffer_free(&frame);
 }
 
 static void report_changes(struct link *manager)
@@ -341,40 +432,30 @@ static void reset_idle_timer()
 }
 
 /*
-Measure the disk used by the worker. We only manually measure the cache directory, as processes measure themselves.
+Measure the disk used by the worker. The cache keeps account of its own
+contents as objects are added and removed, and processes measure themselves.
 */
 
 static int64_t measure_worker_disk()
 {
-	static struct path_disk_size_info *state = NULL;
-
 	if (!cache_manager)
 		return 0;
 
-	char *cache_dir = vine_cache_data_path(cache_manager, ".");
-	path_disk_size_info_get_r(cache_dir, options->max_time_on_measurement, &state, NULL);
-	free(cache_dir);
-
-	int64_t disk_measured = 0;
-	if (state->last_byte_size_complete >= 0) {
-		disk_measured = (int64_t)ceil(state->last_byte_size_complete / (1.0 * MEGA));
-	}
-
-	files_counted = state->last_file_count_complete;
+	int64_t cache_bytes, cache_files;
+	vine_cache_reconcile(cache_manager, options->max_time_on_measurement);
+	vine_cache_disk_usage(cache_manager, &cache_bytes, &cache_files);
 
-	if (state->complete_measurement) {
-		/* if a complete measurement has been done, then update
-		 * for the found value, and add the known values of the processes. */
+	int64_t disk_measured = (int64_t)ceil(cache_bytes / (1.0 * MEGA));
+	files_counted = cache_files;
 
-		struct vine_process *p;
-		uint64_t task_id;
+	struct vine_process *p;
+	uint64_t task_id;
 
-		ITABLE_ITERATE(procs_table, task_id, p)
-		{
-			if (p->sandbox_size > 0) {
-				disk_measured += p->sandbox_size;
-				files_counted += p->sandbox_file_count;
-			}
+	ITABLE_ITERATE(procs_table, task_id, p)
+	{
+		if (p->sandbox_size > 0) {
+			disk_measured += p->sandbox_size;
+			files_counted += p->sandbox_file_count;
 		}
 	}
 
@@ -467,6 +548,32 @@ static void send_stats_update(struct link *manager)
 	send_message(manager, "info tasks_running %lld\n", (long long)itable_size(procs_running));
 }
 
+/*
+Send a message to the manager with the statistics of the transfers served to peers,
+if they changed since the last report.
+*/
+
+static void send_transfer_stats(struct link *manager)
+{
+	static struct vine_transfer_server_stats last;
+
+	struct vine_transfer_server_stats s;
+	vine_transfer_server_stats(&s);
+
+	if (s.connections == last.connections && s.active == last.active)
+		return;
+
+	send_async_message(manager,
+			"info peer-transfers %" PRId64 " %" PRId64 " %" PRIu64 " %.0lf %d\n",
+			s.connections,
+			s.bytes_sent,
+			s.time_sent,
+			s.max_bandwidth,
+			s.active);
+
+	last = s;
+}
+
 /*
 Send a periodic keepalive message to the manager, otherwise it will
 think that the worker has crashed and gone away.
@@ -476,6 +583,7 @@ static int send_keepalive(struct link *manager, int force_resources)
 {
 	send_async_message(manager, "alive\n");
 	send_resource_update(manager);
+	send_transfer_stats(manager);
 	return 1;
 }
 
@@ -586,6 +694,50 @@ static void report_worker_ready(struct link *manager)
 	send_keepalive(manager, 1);
 }
 
+/*
+Start measuring a process for which the manager did not send a resource_monitor.
+Only the cores and memory are enforced here: the disk is measured in the sandbox,
+and the time limits are enforced with the rest of the processes.
+*/
+
+static void monitor_process(struct vine_process *p)
+{
+	struct rmsummary *limits = NULL;
+
+	if (p->task->monitor_in_worker & VINE_MON_WATCHDOG) {
+		limits = rmsummary_create(-1);
+		limits->cores = p->task->resources_requested->cores;
+		limits->memory = p->task->resources_requested->memory;
+	}
+
+	rmonitor_tasks_add(task_monitor, p->task->task_id, p->pid, limits);
+	rmsummary_delete(limits);
+}
+
+/* Stop measuring a process, and keep what was measured for its completion message.
+ * The sandbox is measured here, before its outputs are moved to the cache. */
+
+static void unmonitor_process(struct vine_process *p)
+{
+	struct rmsummary *measured = rmonitor_tasks_remove(task_monitor, p->task->task_id, &p->rusage);
+	if (!measured)
+		return;
+
+	measured->exit_status = p->exit_code;
+
+	int64_t last_size = p->sandbox_size;
+	if (p->sandbox) {
+		vine_process_measure_disk(p, options->max_time_on_measurement);
+	}
+	if (MAX(p->sandbox_size, last_size) >= 0) {
+		measured->disk = MAX(p->sandbox_size, last_size);
+		measured->total_files = p->sandbox_file_count;
+	}
+
+	rmsummary_delete(p->task->resources_measured);
+	p->task->resources_measured = measured;
+}
+
 /*
 Start executing the given process on the local host,
 accounting for the resources as necessary.
@@ -629,6 +781,10 @@ static int start_process(struct vine_process *p, struct link *manager)
 		if (t->needs_library) {
 			p->library_process->functions_running++;
 		}
+
+		if (t->monitor_in_worker) {
+			monitor_process(p);
+		}
 	} else {
 		fatal("unable to start task_id %d!", p->task->task_id);
 	}
@@ -654,6 +810,11 @@ static void reap_process(struct vine_process *p, struct link *manager)
 	gpus_allocated -= p->task->resources_requested->gpus;
 
 	vine_gpus_free(p->task->task_id);
+
+	if (p->task->monitor_in_worker) {
+		unmonitor_process(p);
+	}
+
 	vine_sandbox_stageout(p, cache_manager, manager);
 
 	if (p->type == VINE_PROCESS_TYPE_FUNCTION) {
@@ -663,11 +824,14 @@ static void reap_process(struct vine_process *p, struct link *manager)
 	itable_remove(procs_running, p->task->task_id);
 	itable_insert(procs_complete, p->task->task_id, p);
 
-	struct stat info;
-	if (!stat(p->output_file_name, &info)) {
-		p->output_length = info.st_size;
-	} else {
-		p->output_length = 0;
+	/* The result of an inline function call is already in memory, along with its length. */
+	if (!p->output) {
+		struct stat info;
+		if (p->output_file_name && !stat(p->output_file_name, &info)) {
+			p->output_length = info.st_size;
+		} else {
+			p->output_length = 0;
+		}
 	}
 
 	total_task_execution_time += (p->execution_end - p->execution_start);
@@ -760,6 +924,8 @@ static int handle_completed_tasks(struct link *manager)
 	uint64_t task_id;
 	uint64_t done_task_id;
 	int done_exit_code;
+	char *done_result;
+	int64_t done_result_length;
 
 	ITABLE_ITERATE(procs_running, task_id, p)
 	{
@@ -780,12 +946,16 @@ static int handle_completed_tasks(struct link *manager)
 
 		/* If p is a library, check to see if any results waiting. */
 
-		while (vine_process_library_get_result(p, &done_task_id, &done_exit_code)) {
+		while (vine_process_library_get_result(p, &done_task_id, &done_exit_code, &done_result, &done_result_length)) {
 			fp = itable_lookup(procs_table, done_task_id);
 			if (fp) {
 				fp->exit_code = done_exit_code;
+				fp->output = done_result;
+				fp->output_length = done_result_length;
 				reap_process(fp, manager);
 				result_retrieved++;
+			} else {
+				free(done_result);
 			}
 		}
 
@@ -849,6 +1019,10 @@ static struct vine_task *do_task_body(struct link *manager, int task_id, time_t
 			break;
 		} else if (sscanf(line, "category %s", category)) {
 			vine_task_set_category(task, category);
+		} else if (sscanf(line, "monitor %d %" PRId64, &flags, &n) == 2) {
+			task->monitor_in_worker = flags;
+			/* 0 means the default interval of the monitor */
+			monitor_interval = n > 0 ? n : 5;
 		} else if (sscanf(line, "cmd %d", &length) == 1) {
 			char *cmd = malloc(length + 1);
 			link_read(manager, cmd, length, stoptime);
@@ -858,6 +1032,19 @@ static struct vine_task *do_task_body(struct link *manager, int task_id, time_t
 			free(cmd);
 		} else if (sscanf(line, "needs_library %s", library_name) == 1) {
 			vine_task_set_library_required(task, library_name);
+		} else if (sscanf(line, "function_input %" PRId64, &n) == 1) {
+			if (n < 0 || !(task->function_input = malloc(n + 1))) {
+				debug(D_VINE | D_NOTICE, "invalid function input length from manager: %s", line);
+				vine_task_delete(task);
+				return 0;
+			}
+			if (link_read(manager, task->function_input, n, stoptime) != n) {
+				debug(D_VINE, "failed to read function input of task %d from manager", task_id);
+				vine_task_delete(task);
+				return 0;
+			}
+			task->function_input[n] = 0;
+			task->function_input_length = n;
 		} else if (sscanf(line, "provides_library %s", library_name) == 1) {
 			vine_task_set_library_provided(task, library_name);
 		} else if (sscanf(line, "function_slots %" PRId64, &n) == 1) {
@@ -968,9 +1155,10 @@ static int do_put(struct link *manager, const char *cachename, vine_cache_level_
 	timestamp_t stop = timestamp_get();
 
 	/* XXX actual_size should equal expected size, but only for a simple file, not a dir. */
+	/* The files in a dir are not counted here, but later by vine_cache_reconcile. */
 
 	if (r) {
-		vine_cache_add_file(cache_manager, cachename, transfer_path, cache_level, mode, actual_size, mtime, stop - start);
+		vine_cache_add_file(cache_manager, cachename, transfer_path, cache_level, mode, actual_size, 1, mtime, stop - start);
 	} else {
 		trash_file(transfer_path);
 	}
@@ -1061,6 +1249,10 @@ static int do_kill(int task_id)
 	if (itable_remove(procs_running, task_id)) {
 		vine_process_kill_and_wait(p);
 
+		if (p->task->monitor_in_worker) {
+			unmonitor_process(p);
+		}
+
 		cores_allocated -= p->task->resources_requested->cores;
 		memory_allocated -= p->task->resources_requested->memory;
 		disk_allocated -= p->task->resources_requested->disk;
@@ -1112,8 +1304,8 @@ static void kill_all_tasks()
 
 static int enforce_process_sanbox_limits(struct vine_process *p)
 {
-	/* If the task did not set disk usage, return right away. */
-	if (p->task->resources_requested->disk < 1)
+	/* If the task did not set disk usage, or has no sandbox, return right away. */
+	if (p->task->resources_requested->disk < 1 || !p->sandbox)
 		return 1;
 
 	vine_process_measure_disk(p, options->max_time_on_measurement);
@@ -1159,6 +1351,34 @@ static int enforce_processes_sandbox_limits()
 	return ok;
 }
 
+/*
+Measure all the monitored processes at once, and end those that went over
+their cores or memory as RESOURCE_EXHAUSTION, as their resource_monitor would.
+*/
+
+static void enforce_processes_monitor_limits()
+{
+	static time_t last_check_time = 0;
+
+	struct vine_process *p;
+	uint64_t task_id;
+
+	if (rmonitor_tasks_size(task_monitor) < 1 || (time(0) - last_check_time) < monitor_interval)
+		return;
+
+	if (rmonitor_tasks_poll(task_monitor) > 0) {
+		ITABLE_ITERATE(procs_running, task_id, p)
+		{
+			if (p->task->monitor_in_worker && rmonitor_tasks_exceeded(task_monitor, task_id)) {
+				debug(D_VINE, "Task %d went over its resource limits.", p->task->task_id);
+				finish_running_task(p, VINE_RESULT_RESOURCE_EXHAUSTION);
+			}
+		}
+	}
+
+	last_check_time = time(0);
+}
+
 /*
 We check maximum_running_time by itself (not in enforce_processes_limits),
 as other running tasks should not be affected by a task timeout.
@@ -1231,6 +1451,12 @@ void send_stdout(struct link *l, int64_t task_id)
 		return;
 	}
 
+	if (p->output) {
+		send_message(l, "stdout %" SCNd64 " %lld\n", task_id, (long long)p->output_length);
+		link_write(l, p->output, p->output_length, time(0) + options->active_timeout);
+		return;
+	}
+
 	int output_file = open(p->output_file_name, O_RDONLY);
 	if (output_file < 0) {
 		send_message(l, "error %s %d\n", p->output_file_name, errno);
@@ -1675,6 +1901,11 @@ static void vine_worker_serve_manager(struct link *manager)
 
 		int wait_msec = 5000;
 
+		/* Wake up in time for the next measurement of the monitored tasks. */
+		if (rmonitor_tasks_size(task_monitor) > 0) {
+			wait_msec = MIN(wait_msec, monitor_interval * 1000);
+		}
+
 		if (sigchld_received_flag) {
 			wait_msec = 0;
 			sigchld_received_flag = 0;
@@ -1686,7 +1917,10 @@ static void vine_worker_serve_manager(struct link *manager)
 
 		int ok = 1;
 		if (manager_activity) {
-			ok &= handle_manager(manager);
+			/* Handle every message already buffered, so that requests sent together are seen together. */
+			do {
+				ok &= handle_manager(manager);
+			} while (ok && !link_buffer_empty(manager));
 		}
 
 		expire_procs_running();
@@ -1704,6 +1938,9 @@ static void vine_worker_serve_manager(struct link *manager)
 
 		enforce_processes_max_running_time();
 
+		/* measure the monitored tasks, and end those above their limits as RESOURCE_EXHAUSTION. */
+		enforce_processes_monitor_limits();
+
 		/* end a running processes if goes above its declared limits.
 		 * Mark offending process as RESOURCE_EXHASTION. */
 		enforce_processes_sandbox_limits();
@@ -2185,6 +2422,8 @@ void vine_worker_create_structures()
 
 	watcher = vine_watcher_create();
 
+	task_monitor = rmonitor_tasks_create();
+
 	total_resources = vine_resources_create();
 
 	worker_id = make_worker_id();
@@ -2201,6 +2440,8 @@ static void vine_worker_delete_structures()
 		vine_resources_delete(total_resources);
 	if (watcher)
 		vine_watcher_delete(watcher);
+	if (task_monitor)
+		rmonitor_tasks_delete(task_monitor);
 	if (current_transfers)
 		hash_table_delete(current_transfers);
 
@@ -57,6 +57,7 @@ struct vine_worker_options *vine_worker_options_create()
 	self->transfer_port_max = 0;
 
 	self->max_transfer_procs = 5;
+	self->bind_input_dirs = 0;
 
 	self->reported_transfer_host = 0;
 
@@ -139,6 +140,8 @@ void vine_worker_options_show_help(const char *cmd, struct vine_worker_options *
 	printf(" %-30s One of by_ip, by_hostname, or by_apparent_ip. Default is set by manager.\n", "");
 
 	printf(" %-30s Forbid the use of symlinks for cache management.\n", "--disable-symlinks");
+	printf(" %-30s Mount input directories read-only into task sandboxes instead of linking\n", "--bind-input-dirs");
+	printf(" %-30s each file, if user namespaces are available. (Linux only)\n", "");
 	printf(" %-30s Single-shot mode -- quit immediately after disconnection.\n", "--single-shot");
 	printf(" %-30s Listening port for worker-worker transfers. Either port or port_min:port_max (default: any)\n", "--transfer-port");
 	printf(" %-30s Explicit contact host:port for worker-worker transfers, e.g., when routing is used. (default: :<transfer_port>)\n", "--contact-hostport");
@@ -174,6 +177,7 @@ enum {
 	LONG_OPT_WORKSPACE,
 	LONG_OPT_KEEP_WORKSPACE,
 	LONG_OPT_MAX_TRANSFER_PROCS,
+	LONG_OPT_BIND_INPUT_DIRS,
 };
 
 static const struct option long_options[] = {{"advertise", no_argument, 0, 'a'},
@@ -215,6 +219,7 @@ static const struct option long_options[] = {{"advertise", no_argument, 0, 'a'},
 		{"from-factory", required_argument, 0, LONG_OPT_FROM_FACTORY},
 		{"transfer-port", required_argument, 0, LONG_OPT_TRANSFER_PORT},
 		{"max-transfer-procs", required_argument, 0, LONG_OPT_MAX_TRANSFER_PROCS},
+		{"bind-input-dirs", no_argument, 0, LONG_OPT_BIND_INPUT_DIRS},
 		{"contact-hostport", required_argument, 0, LONG_OPT_CONTACT_HOSTPORT},
 		{0, 0, 0, 0}};
 
@@ -466,6 +471,9 @@ void vine_worker_options_get(struct vine_worker_options *options, int argc, char
 		case LONG_OPT_MAX_TRANSFER_PROCS:
 			options->max_transfer_procs = atoi(optarg);
 			break;
+		case LONG_OPT_BIND_INPUT_DIRS:
+			options->bind_input_dirs = 1;
+			break;
 		default:
 			vine_worker_options_show_help(argv[0], options);
 			exit(1);
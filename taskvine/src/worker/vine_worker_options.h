@@ -108,6 +108,9 @@ struct vine_worker_options {
 	/* Maximum number of concurrent worker transfer requests made by worker */
 	int max_transfer_procs;
 
+	/* If true, mount cached input directories read-only into sandboxes instead of linking their contents. */
+	int bind_input_dirs;
+
   /* Explicit contact host (address or hostname) for transfers bewteen workers. */
   char *reported_transfer_host;
   int reported_transfer_port;
@@ -23,6 +23,7 @@ See the file COPYING for details.
 #include "itable.h"
 #include "list.h"
 #include "macros.h"
+#include "priority_queue.h"
 #include "username.h"
 #include "create_dir.h"
 #include "xxmalloc.h"
@@ -40,6 +41,7 @@ See the file COPYING for details.
 #include "url_encode.h"
 #include "jx_print.h"
 #include "jx_parse.h"
+#include "shape_index.h"
 #include "shell.h"
 #include "pattern.h"
 #include "tlq_config.h"
@@ -154,12 +156,18 @@ struct work_queue {
 	char workingdir[PATH_MAX];
 
 	struct link      *manager_link;   // incoming tcp connection for workers.
-	struct link_info *poll_table;
+	struct link_poller *poller;       // persistent poller of manager_link, foreman uplink, and worker links.
+	struct link_info *poll_table;     // filled with the links found ready by poller.
 	int poll_table_size;
+	int manager_link_ready;           // true if the last poll found new connections on manager_link.
 
 	struct itable *tasks;           // taskid -> task
 	struct itable *task_state_map;  // taskid -> state
-	struct list   *ready_list;      // ready to be sent to a worker
+	struct priority_queue *ready_tasks;          // ready to be sent to a worker, by priority
+	struct shape_index *ready_index;             // the same ready tasks, grouped by shape
+	struct rmsummary *ready_resources;           // sum of the resources requested by the ready tasks
+	struct list   *waiting_retrieval_list;       // done at the worker, outputs not yet fetched
+	struct list   *retrieved_list;               // complete, to be returned by work_queue_wait
 
 	struct hash_table *worker_table;
 	struct hash_table *worker_blocklist;
@@ -219,6 +227,7 @@ struct work_queue {
 	int monitor_mode;
 	FILE *monitor_file;
 	int monitor_interval;
+	int monitor_in_worker;
 
 	char *monitor_output_directory;
 	char *monitor_summary_filename;
@@ -346,6 +355,8 @@ static void find_max_worker(struct work_queue *q);
 static void update_max_worker(struct work_queue *q, struct work_queue_worker *w);
 
 static void push_task_to_ready_list( struct work_queue *q, struct work_queue_task *t );
+static void remove_from_ready_list( struct work_queue *q, struct work_queue_task *t );
+static void *ready_shape_resources( void *t );
 
 /* returns old state */
 static work_queue_task_state_t change_task_state( struct work_queue *q, struct work_queue_task *t, work_queue_task_state_t new_state);
@@ -356,8 +367,6 @@ const char *task_state_str(work_queue_task_state_t state);
 static int task_state_is( struct work_queue *q, uint64_t taskid, work_queue_task_state_t state);
 /* pointer to first task found with state. NULL if no such task */
 static struct work_queue_task *task_state_any(struct work_queue *q, work_queue_task_state_t state);
-/* number of tasks with state */
-static int task_state_count( struct work_queue *q, const char *category, work_queue_task_state_t state);
 /* number of tasks with the resource allocation request */
 static int task_request_count( struct work_queue *q, const char *category, category_allocation_t request);
 
@@ -1389,6 +1398,9 @@ static void add_worker(struct work_queue *q)
 	sprintf(w->addrport, "%s:%d", addr, port);
 	hash_table_insert(q->worker_table, w->hashkey, w);
 
+	// the link stays registered until it is closed when the worker is removed.
+	link_poller_add(q->poller, link, LINK_READ);
+
 	return;
 }
 
@@ -1795,6 +1807,35 @@ void read_measured_resources(struct work_queue *q, struct work_queue_task *t) {
 	free(summary);
 }
 
+/* Complete the resources measured by the worker, and write them where the summary of a resource_monitor would be. */
+static void write_measured_resources(struct work_queue *q, struct work_queue_task *t)
+{
+	if(!t->resources_measured) {
+		/* A foreman does not measure its tasks, so only the time at the worker is known. */
+		t->resources_measured = rmsummary_create(-1);
+		t->resources_measured->wall_time = ((double) t->time_workers_execute_last) / ONE_SECOND;
+	}
+
+	t->resources_measured->exit_status = t->return_status;
+
+	/* cleanup noise in cores value, as in read_measured_resources */
+	if(t->resources_measured->cores > 0) {
+		t->resources_measured->cores = MIN(t->resources_measured->cores, ceil(t->resources_measured->cores - 0.1));
+	}
+
+	if(t->monitor_output_directory || q->monitor_output_directory) {
+		char *summary = monitor_file_name(q, t, ".summary");
+		FILE *f = fopen(summary, "w");
+		if(f) {
+			rmsummary_print(f, t->resources_measured, /* pprint */ 0, NULL);
+			fclose(f);
+		} else {
+			debug(D_WQ, "could not write monitor summary %s: %s", summary, strerror(errno));
+		}
+		free(summary);
+	}
+}
+
 void resource_monitor_append_report(struct work_queue *q, struct work_queue_task *t)
 {
 	if(q->monitor_mode == MON_DISABLED)
@@ -1878,7 +1919,12 @@ static void fetch_output_from_worker(struct work_queue *q, struct work_queue_wor
 	t->time_when_retrieval = timestamp_get();
 
 	if(t->result == WORK_QUEUE_RESULT_RESOURCE_EXHAUSTION) {
-		result = get_monitor_output_file(q,w,t);
+		if(t->monitor_in_worker) {
+			// the summary already came with the result, so the sandbox is not needed anymore.
+			send_worker_msg(q,w, "kill %d\n",t->taskid);
+		} else {
+			result = get_monitor_output_file(q,w,t);
+		}
 	} else {
 		result = get_output_files(q,w,t);
 	}
@@ -1899,7 +1945,9 @@ static void fetch_output_from_worker(struct work_queue *q, struct work_queue_wor
 
 	/* if q is monitoring, append the task summary to the single
 	 * queue summary, update t->resources_used, and delete the task summary. */
-	if(q->monitor_mode) {
+	if(t->monitor_in_worker) {
+		write_measured_resources(q, t);
+	} else if(q->monitor_mode) {
 		read_measured_resources(q, t);
 
 		/* Further, if we got debug and series files, gzip them. */
@@ -1996,26 +2044,24 @@ static void fetch_output_from_worker(struct work_queue *q, struct work_queue_wor
 static int expire_waiting_tasks(struct work_queue *q)
 {
 	struct work_queue_task *t;
+	int t_idx;
 	int expired = 0;
 
-	int tasks_considered = 0;
 	double current_time = timestamp_get() / ONE_SECOND;
-	while( (t = list_rotate(q->ready_list)) ) {
-		if(tasks_considered > q->attempt_schedule_depth) {
-			return expired;
-		}
+
+	/* leaving the ready state takes the task off the ready list. */
+	int iter_count = 0;
+	int iter_depth = q->attempt_schedule_depth;
+	PRIORITY_QUEUE_STATIC_ITERATE(q->ready_tasks, t_idx, t, iter_count, iter_depth) {
 		if(t->resources_requested->end > 0 && t->resources_requested->end <= current_time) {
 			update_task_result(t, WORK_QUEUE_RESULT_TASK_TIMEOUT);
 			change_task_state(q, t, WORK_QUEUE_TASK_RETRIEVED);
 			expired++;
-			list_pop_tail(q->ready_list);
 		} else if(t->max_retries > 0 && t->try_count > t->max_retries) {
 			update_task_result(t, WORK_QUEUE_RESULT_MAX_RETRIES);
 			change_task_state(q, t, WORK_QUEUE_TASK_RETRIEVED);
 			expired++;
-			list_pop_tail(q->ready_list);
 		}
-		tasks_considered++;
 	}
 	return expired;
 }
@@ -2305,12 +2351,21 @@ static work_queue_result_code_t get_result(struct work_queue *q, struct work_que
 	t->result        = task_status;
 	t->return_status = exit_status;
 
+	/* A worker that measured the task itself appends the summary to the result line. */
+	if(t->monitor_in_worker) {
+		const char *measured = strchr(line, '{');
+		if(t->resources_measured) {
+			rmsummary_delete(t->resources_measured);
+		}
+		t->resources_measured = measured ? rmsummary_parse_string(measured) : NULL;
+	}
+
 	q->stats->time_workers_execute += t->time_workers_execute_last;
 
 	w->finished_tasks++;
 
 	// Convert resource_monitor status into work queue status if needed.
-	if(q->monitor_mode) {
+	if(q->monitor_mode && !t->monitor_in_worker) {
 		if(t->return_status == RM_OVERFLOW) {
 			update_task_result(t, WORK_QUEUE_RESULT_RESOURCE_EXHAUSTION);
 		} else if(t->return_status == RM_TIME_EXPIRE) {
@@ -2412,12 +2467,14 @@ static struct jx *blocked_to_json( struct work_queue  *q ) {
 static struct rmsummary  *total_resources_needed(struct work_queue *q) {
 
 	struct work_queue_task *t;
+	int t_idx;
 
 	struct rmsummary *total = rmsummary_create(0);
 
 	/* for waiting tasks, we use what they would request if dispatched right now. */
-	list_first_item(q->ready_list);
-	while((t = list_next_item(q->ready_list))) {
+	int iter_count = 0;
+	int iter_depth = priority_queue_size(q->ready_tasks);
+	PRIORITY_QUEUE_BASE_ITERATE(q->ready_tasks, t_idx, t, iter_count, iter_depth) {
 		const struct rmsummary *s = task_min_resources(q, t);
 		rmsummary_add(total, s);
 	}
@@ -3208,6 +3265,11 @@ static work_queue_result_code_t handle_worker(struct work_queue *q, struct link
 	link_to_hash_key(l, key);
 	w = hash_table_lookup(q->worker_table, key);
 
+	// the worker may have been removed while handling another link reported by the same poll.
+	if(!w) {
+		return WQ_SUCCESS;
+	}
+
 	work_queue_msg_code_t mcode;
 	mcode = recv_worker_msg(q, w, line, sizeof(line));
 
@@ -3241,57 +3303,6 @@ static work_queue_result_code_t handle_worker(struct work_queue *q, struct link
 	return WQ_SUCCESS;
 }
 
-static int build_poll_table(struct work_queue *q, struct link *manager)
-{
-	int n = 0;
-	char *key;
-	struct work_queue_worker *w;
-
-	// Allocate a small table, if it hasn't been done yet.
-	if(!q->poll_table) {
-		q->poll_table = malloc(sizeof(*q->poll_table) * q->poll_table_size);
-		if(!q->poll_table) {
-			//if we can't allocate a poll table, we can't do anything else.
-			fatal("allocating memory for poll table failed.");
-		}
-	}
-
-	// The first item in the poll table is the manager link, which accepts new connections.
-	q->poll_table[0].link = q->manager_link;
-	q->poll_table[0].events = LINK_READ;
-	q->poll_table[0].revents = 0;
-	n = 1;
-
-	if(manager) {
-		/* foreman uplink */
-		q->poll_table[1].link = manager;
-		q->poll_table[1].events = LINK_READ;
-		q->poll_table[1].revents = 0;
-		n++;
-	}
-
-	// For every worker in the hash table, add an item to the poll table
-	hash_table_firstkey(q->worker_table);
-	while(hash_table_nextkey(q->worker_table, &key, (void **) &w)) {
-		// If poll table is not large enough, reallocate it
-		if(n >= q->poll_table_size) {
-			q->poll_table_size *= 2;
-			q->poll_table = realloc(q->poll_table, sizeof(*q->poll_table) * q->poll_table_size);
-			if(q->poll_table == NULL) {
-				//if we can't allocate a poll table, we can't do anything else.
-				fatal("reallocating memory for poll table failed.");
-			}
-		}
-
-		q->poll_table[n].link = w->link;
-		q->poll_table[n].events = LINK_READ;
-		q->poll_table[n].revents = 0;
-		n++;
-	}
-
-	return n;
-}
-
 /*
 Send a symbolic link to the remote worker.
 Note that the target of the link is sent
@@ -3756,7 +3767,7 @@ int in_ramp_down(struct work_queue *q) {
 		return 0;
 	}
 
-	if(hash_table_size(q->worker_table) > list_size(q->ready_list)) {
+	if(hash_table_size(q->worker_table) > priority_queue_size(q->ready_tasks)) {
 		return 1;
 	}
 
@@ -3889,7 +3900,7 @@ static work_queue_result_code_t start_one_task(struct work_queue *q, struct work
 	struct rmsummary *limits = task_worker_box_size(q, w, t);
 
 	char *command_line;
-	if(q->monitor_mode && !t->coprocess) {
+	if(q->monitor_mode && !t->coprocess && !t->monitor_in_worker) {
 		command_line = work_queue_monitor_wrap(q, w, t, limits);
 	} else {
 		command_line = xxstrdup(t->command_line);
@@ -3919,13 +3930,17 @@ static work_queue_result_code_t start_one_task(struct work_queue *q, struct work
 
 	send_worker_msg(q,w, "category %s\n", t->category);
 
+	if(t->monitor_in_worker) {
+		send_worker_msg(q,w, "monitor %d %d\n", (q->monitor_mode & MON_WATCHDOG) ? 1 : 0, q->monitor_interval);
+	}
+
 	send_worker_msg(q,w, "cores %s\n",  rmsummary_resource_to_str("cores", limits->cores, 0));
 	send_worker_msg(q,w, "gpus %s\n",   rmsummary_resource_to_str("gpus", limits->gpus, 0));
 	send_worker_msg(q,w, "memory %s\n", rmsummary_resource_to_str("memory", limits->memory, 0));
 	send_worker_msg(q,w, "disk %s\n",   rmsummary_resource_to_str("disk", limits->disk, 0));
 
 	/* Do not specify end, wall_time if running the resource monitor. We let the monitor police these resources. */
-	if(q->monitor_mode == MON_DISABLED) {
+	if(q->monitor_mode == MON_DISABLED || (t->monitor_in_worker && (q->monitor_mode & MON_WATCHDOG))) {
 		if(limits->end > 0) {
 			send_worker_msg(q,w, "end_time %s\n",  rmsummary_resource_to_str("end", limits->end, 0));
 		}
@@ -4580,40 +4595,74 @@ static void reap_task_from_worker(struct work_queue *q, struct work_queue_worker
 	count_worker_resources(q, w);
 }
 
-static int send_one_task( struct work_queue *q )
+// Returns a worker that may run t now, or NULL if t has to wait.
+static struct work_queue_worker *consider_task(struct work_queue *q, struct work_queue_task *t, timestamp_t now)
 {
-	struct work_queue_task *t;
-	struct work_queue_worker *w;
+	// Skip task if min requested start time not met.
+	if(t->resources_requested->start > now) {
+		return NULL;
+	}
 
-	int tasks_considered = 0;
-	timestamp_t now = timestamp_get();
+	struct category *c = work_queue_category_lookup_or_create(q, t->category);
+	if (c->max_concurrent > -1 && c->max_concurrent < c->wq_stats->tasks_running) {
+		return NULL;
+	}
 
-	while( (t = list_rotate(q->ready_list)) ) {
-		if(tasks_considered++ > q->attempt_schedule_depth) {
-			return 0;
-		}
+	return find_best_worker(q,t);
+}
 
-		// Skip task if min requested start time not met.
-		if(t->resources_requested->start > now) {
-			continue;
-		}
+/*
+Offer the highest priority task of each shape to the workers, from the
+highest to the lowest priority. When the top task of a shape cannot run,
+neither can any other task of the shape, so the cost of a dispatch does
+not depend on the number of tasks waiting.
+*/
+static int send_one_task_by_shape( struct work_queue *q, timestamp_t now )
+{
+	int nshapes = shape_index_shapes(q->ready_index);
+	if(nshapes == 0) {
+		return 0;
+	}
 
-		struct category *c = work_queue_category_lookup_or_create(q, t->category);
-		if (c->max_concurrent > -1 && c->max_concurrent < c->wq_stats->tasks_running) {
-			continue;
+	struct work_queue_task *tops[nshapes];
+	int ntops = shape_index_tops(q->ready_index, (void **) tops, nshapes);
+
+	int i;
+	for(i = 0; i < ntops; i++) {
+		struct work_queue_task *t = tops[i];
+		struct work_queue_worker *w = consider_task(q, t, now);
+		if(w) {
+			// committing the task takes it off the ready list.
+			commit_task_to_worker(q,w,t);
+			return 1;
 		}
+	}
 
-		// Find the best worker for the task at the head of the list
-		w = find_best_worker(q,t);
+	return 0;
+}
 
-		if(!w) {
-			continue;
-		}
+static int send_one_task( struct work_queue *q )
+{
+	struct work_queue_task *t;
+	struct work_queue_worker *w;
+	int t_idx;
 
-		// Otherwise, remove it from the ready list and start it:
-		list_pop_tail(q->ready_list);
-		commit_task_to_worker(q,w,t);
-		return 1;
+	timestamp_t now = timestamp_get();
+
+	/* when there are too many shapes to visit them all, we rotate through
+	 * the ready list instead, as far as attempt_schedule_depth. */
+	if(shape_index_shapes(q->ready_index) <= q->attempt_schedule_depth) {
+		return send_one_task_by_shape(q, now);
+	}
+
+	int iter_count = 0;
+	int iter_depth = MIN(priority_queue_size(q->ready_tasks), q->attempt_schedule_depth);
+	PRIORITY_QUEUE_ROTATE_ITERATE(q->ready_tasks, t_idx, t, iter_count, iter_depth) {
+		w = consider_task(q, t, now);
+		if(w) {
+			commit_task_to_worker(q,w,t);
+			return 1;
+		}
 	}
 
 	// if we made it here we reached the end of the list
@@ -4637,8 +4686,10 @@ static void print_large_tasks_warning(struct work_queue *q)
 
 	struct rmsummary *largest_unfit_task = rmsummary_create(-1);
 
-	list_first_item(q->ready_list);
-	while( (t = list_next_item(q->ready_list))){
+	int t_idx;
+	int iter_count = 0;
+	int iter_depth = priority_queue_size(q->ready_tasks);
+	PRIORITY_QUEUE_BASE_ITERATE(q->ready_tasks, t_idx, t, iter_count, iter_depth) {
 		// check each task against the queue of connected workers
 		int bit_set = is_task_larger_than_connected_workers(q, t);
 		if(bit_set) {
@@ -4697,17 +4748,10 @@ static int receive_one_task( struct work_queue *q )
 {
 	struct work_queue_task *t;
 	struct work_queue_worker *w;
-	uint64_t taskid;
 
-	int found = 0;
-	ITABLE_ITERATE(q->tasks, taskid, t) {
-		if( task_state_is(q, taskid, WORK_QUEUE_TASK_WAITING_RETRIEVAL) ) {
-			found = 1;
-			break;
-		}
-	}
-	if(!found) return 0;
-	
+	t = list_peek_head(q->waiting_retrieval_list);
+	if(!t) return 0;
+
 	w = itable_lookup(q->worker_task_map, t->taskid);
 	fetch_output_from_worker(q, w, t->taskid);
 
@@ -5876,7 +5920,11 @@ struct work_queue *work_queue_ssl_create(int port, const char *key, const char *
 
 	q->next_taskid = 1;
 
-	q->ready_list = list_create();
+	q->ready_tasks = priority_queue_create_indexed(0);
+	q->ready_index = shape_index_create(ready_shape_resources, (shape_index_data_delete_t) rmsummary_delete);
+	q->ready_resources = rmsummary_create(0);
+	q->waiting_retrieval_list = list_create();
+	q->retrieved_list = list_create();
 
 	q->tasks          = itable_create(0);
 	q->task_state_map = itable_create(0);
@@ -5898,9 +5946,16 @@ struct work_queue *work_queue_ssl_create(int port, const char *key, const char *
 
 	q->workers_with_available_results = hash_table_create(0, 0);
 
-	// The poll table is initially null, and will be created
-	// (and resized) as needed by build_poll_table.
+	// The manager link and every worker link are registered with the poller
+	// once, and the poll table receives only the links that are ready.
+	q->poller = link_poller_create();
+	if(!q->poller) {
+		fatal("creating the link poller failed.");
+	}
+	link_poller_add(q->poller, q->manager_link, LINK_READ);
+
 	q->poll_table_size = 8;
+	q->poll_table = malloc(sizeof(*q->poll_table) * q->poll_table_size);
 
 	q->worker_selection_algorithm = WORK_QUEUE_SCHEDULE_TIME;
 	q->process_pending_check = 0;
@@ -5921,6 +5976,7 @@ struct work_queue *work_queue_ssl_create(int port, const char *key, const char *
 	q->keepalive_timeout = WORK_QUEUE_DEFAULT_KEEPALIVE_TIMEOUT;
 
 	q->monitor_mode = MON_DISABLED;
+	q->monitor_in_worker = 0;
 
 	q->hungry_minimum = 10;
 	q->hungry_minimum_factor = 2;
@@ -6212,7 +6268,11 @@ void work_queue_delete(struct work_queue *q)
 		}
 		hash_table_delete(q->categories);
 
-		list_delete(q->ready_list);
+		priority_queue_delete(q->ready_tasks);
+		shape_index_delete(q->ready_index);
+		rmsummary_delete(q->ready_resources);
+		list_delete(q->waiting_retrieval_list);
+		list_delete(q->retrieved_list);
 
 		itable_delete(q->tasks);
 
@@ -6242,6 +6302,7 @@ void work_queue_delete(struct work_queue *q)
 		free(q->ssl_key);
 
 		link_close(q->manager_link);
+		link_poller_delete(q->poller);
 		if(q->logfile) {
 			fclose(q->logfile);
 		}
@@ -6392,36 +6453,95 @@ char *work_queue_monitor_wrap(struct work_queue *q, struct work_queue_worker *w,
 	return wrap_cmd;
 }
 
-static double work_queue_task_priority(void *item) {
-	assert(item);
-	struct work_queue_task *t = item;
-	return t->priority;
+/* The resources requested by each task of a ready shape, as its first task requested them. */
+static void *ready_shape_resources( void *t )
+{
+	return rmsummary_copy(((struct work_queue_task *) t)->resources_requested, 0);
+}
+
+/* Add (sign 1) or subtract (sign -1) the resources of one ready task of a shape to the totals. Each task counts for at least one core. */
+static void account_ready_resources( struct work_queue *q, const struct rmsummary *r, int sign )
+{
+	q->ready_resources->cores  += sign * (int64_t) MAX(1, r->cores);
+	q->ready_resources->memory += sign * (int64_t) r->memory;
+	q->ready_resources->disk   += sign * (int64_t) r->disk;
+	q->ready_resources->gpus   += sign * (int64_t) r->gpus;
+}
+
+/*
+The shape of a ready task includes everything check_hand_against_task and
+send_one_task look at, so that tasks of the same shape can run on exactly
+the same workers. With bucketing, the allocation is predicted for each
+task, so each task is a shape of its own.
+*/
+static char *task_ready_shape( struct work_queue *q, struct work_queue_task *t )
+{
+	const struct rmsummary *r = t->resources_requested;
+	struct category *c = work_queue_category_lookup_or_create(q, t->category);
+
+	struct buffer b;
+	buffer_init(&b);
+
+	buffer_printf(&b, "%s\t%d\t%g\t%g\t%g\t%g\t%g\t%g\t%" PRId64 "\t%s",
+			t->category, (int) t->resource_request,
+			r->cores, r->memory, r->disk, r->gpus, r->start, r->end,
+			t->min_running_time, t->coprocess ? t->coprocess : "");
+
+	if(t->features) {
+		char *feature;
+		list_first_item(t->features);
+		while((feature = list_next_item(t->features))) {
+			buffer_printf(&b, "\t%s", feature);
+		}
+	}
+
+	if(category_in_bucketing_mode(c)) {
+		buffer_printf(&b, "\t#%d", t->taskid);
+	}
+
+	char *key = xxstrdup(buffer_tostring(&b));
+	buffer_free(&b);
+
+	return key;
 }
 
 /* Put a given task on the ready list, taking into account the task priority and the queue schedule. */
 
 void push_task_to_ready_list( struct work_queue *q, struct work_queue_task *t )
 {
-	int by_priority = 1;
+	double priority = t->priority;
 
 	if(t->result == WORK_QUEUE_RESULT_RESOURCE_EXHAUSTION) {
 		/* when a task is resubmitted given resource exhaustion, we
-		 * push it at the head of the list, so it gets to run as soon
-		 * as possible. This avoids the issue in which all 'big' tasks
-		 * fail because the first allocation is too small. */
-		by_priority = 0;
+		 * increment its priority by 1, so it gets to run before the
+		 * others of the same priority. This avoids the issue in which
+		 * all 'big' tasks fail because the first allocation is too small. */
+		priority += 1;
 	}
 
-	if(by_priority) {
-		list_push_priority(q->ready_list, work_queue_task_priority, t);
-	} else {
-		list_push_head(q->ready_list,t);
-	}
+	char *key = task_ready_shape(q, t);
+	priority_queue_push(q->ready_tasks, t, priority);
+	shape_index_insert(q->ready_index, t, key, priority);
+	account_ready_resources(q, shape_index_data(q->ready_index, t), 1);
+	free(key);
 
 	/* If the task has been used before, clear out accumulated state. */
 	clean_task_state(t, 0);
 }
 
+/* Take a task off the ready list, when it leaves the ready state. */
+
+static void remove_from_ready_list( struct work_queue *q, struct work_queue_task *t )
+{
+	priority_queue_remove(q->ready_tasks, priority_queue_find_idx(q->ready_tasks, t));
+
+	struct rmsummary *r = shape_index_data(q->ready_index, t);
+	if(r) {
+		account_ready_resources(q, r, -1);
+		shape_index_remove(q->ready_index, t);
+	}
+}
+
 
 work_queue_task_state_t work_queue_task_state(struct work_queue *q, int taskid) {
 	return (int)(uintptr_t)itable_lookup(q->task_state_map, taskid);
@@ -6470,14 +6590,17 @@ static work_queue_task_state_t change_task_state( struct work_queue *q, struct w
 			break;
 		case WORK_QUEUE_TASK_READY:
 			c->wq_stats->tasks_waiting--;
+			remove_from_ready_list(q, t);
 			break;
 		case WORK_QUEUE_TASK_RUNNING:
 			c->wq_stats->tasks_running--;
 			break;
 		case WORK_QUEUE_TASK_WAITING_RETRIEVAL:
 			c->wq_stats->tasks_with_results--;
+			list_remove(q->waiting_retrieval_list, t);
 			break;
 		case WORK_QUEUE_TASK_RETRIEVED:
+			list_remove(q->retrieved_list, t);
 			break;
 		case WORK_QUEUE_TASK_DONE:
 			break;
@@ -6501,8 +6624,10 @@ static work_queue_task_state_t change_task_state( struct work_queue *q, struct w
 			break;
 		case WORK_QUEUE_TASK_WAITING_RETRIEVAL:
 			c->wq_stats->tasks_with_results++;
+			list_push_tail(q->waiting_retrieval_list, t);
 			break;
 		case WORK_QUEUE_TASK_RETRIEVED:
+			list_push_tail(q->retrieved_list, t);
 			break;
 		case WORK_QUEUE_TASK_DONE:
 		case WORK_QUEUE_TASK_CANCELED:
@@ -6642,38 +6767,6 @@ static struct work_queue_task *task_state_any(struct work_queue *q, work_queue_t
 	return NULL;
 }
 
-static struct work_queue_task *task_state_any_with_tag(struct work_queue *q, work_queue_task_state_t state, const char *tag) {
-	struct work_queue_task *t;
-	uint64_t taskid;
-
-	itable_firstkey(q->tasks);
-	while( itable_nextkey(q->tasks, &taskid, (void **) &t) ) {
-		if( task_state_is(q, taskid, state) && tasktag_comparator((void *) t, (void *) tag)) {
-			return t;
-		}
-	}
-
-	return NULL;
-}
-
-static int task_state_count(struct work_queue *q, const char *category, work_queue_task_state_t state) {
-	struct work_queue_task *t;
-	uint64_t taskid;
-
-	int count = 0;
-
-	itable_firstkey(q->tasks);
-	while( itable_nextkey(q->tasks, &taskid, (void **) &t) ) {
-		if( task_state_is(q, taskid, state) ) {
-			if(!category || strcmp(category, t->category) == 0) {
-				count++;
-			}
-		}
-	}
-
-	return count;
-}
-
 static int task_request_count( struct work_queue *q, const char *category, category_allocation_t request) {
 	struct work_queue_task *t;
 	uint64_t taskid;
@@ -6704,8 +6797,15 @@ int work_queue_submit_internal(struct work_queue *q, struct work_queue_task *t)
 	t->time_when_submitted = timestamp_get();
 	q->stats->tasks_submitted++;
 
-	if(q->monitor_mode != MON_DISABLED)
-		work_queue_monitor_add_files(q, t);
+	/* The worker measures the task itself when only the summary is needed. Series and snapshots still need a resource_monitor with the task. */
+	t->monitor_in_worker = 0;
+	if(q->monitor_mode != MON_DISABLED) {
+		if(q->monitor_in_worker && !(q->monitor_mode & MON_FULL) && !t->monitor_snapshot_file && !t->coprocess) {
+			t->monitor_in_worker = 1;
+		} else {
+			work_queue_monitor_add_files(q, t);
+		}
+	}
 
 	rmsummary_merge_max(q->max_task_resources_requested, t->resources_requested);
 
@@ -6866,7 +6966,23 @@ static int poll_active_workers(struct work_queue *q, int stoptime, struct link *
 {
 	BEGIN_ACCUM_TIME(q, time_polling);
 
-	int n = build_poll_table(q, foreman_uplink);
+	if(foreman_uplink) {
+		link_poller_add(q->poller, foreman_uplink, LINK_READ);
+		*foreman_uplink_active = 0;
+	}
+
+	// Make room for every registered link to be ready at once.
+	int nlinks = link_poller_size(q->poller);
+	if(nlinks > q->poll_table_size) {
+		q->poll_table_size = MAX(nlinks, 2 * q->poll_table_size);
+		q->poll_table = realloc(q->poll_table, sizeof(*q->poll_table) * q->poll_table_size);
+		if(q->poll_table == NULL) {
+			//if we can't allocate a poll table, we can't do anything else.
+			fatal("reallocating memory for poll table failed.");
+		}
+	}
+
+	q->manager_link_ready = 0;
 
 	// We poll in at most small time segments (of a second). This lets
 	// promptly dispatch tasks, while avoiding busy waiting.
@@ -6883,30 +6999,26 @@ static int poll_active_workers(struct work_queue *q, int stoptime, struct link *
 
 	BEGIN_ACCUM_TIME(q, time_polling);
 
-	// Poll all links for activity.
-	link_poll(q->poll_table, n, msec);
+	// Wait for activity on any registered link.
+	int n = link_poller_wait(q->poller, q->poll_table, q->poll_table_size, msec);
 	q->link_poll_end = timestamp_get();
 
-	int i, j = 1;
-	// Consider the foreman_uplink passed into the function and disregard if inactive.
-	if(foreman_uplink) {
-		if(q->poll_table[1].revents) {
-			*foreman_uplink_active = 1; //signal that the manager link saw activity
-		} else {
-			*foreman_uplink_active = 0;
-		}
-		j++;
-	}
-
 	END_ACCUM_TIME(q, time_polling);
 
 	BEGIN_ACCUM_TIME(q, time_status_msgs);
 
+	int i;
 	int workers_failed = 0;
-	// Then consider all existing active workers
-	for(i = j; i < n; i++) {
-		if(q->poll_table[i].revents) {
-			if(handle_worker(q, q->poll_table[i].link) == WQ_WORKER_FAILURE) {
+	// Then consider the links that are ready
+	for(i = 0; i < n; i++) {
+		struct link *l = q->poll_table[i].link;
+		if(l == q->manager_link) {
+			q->manager_link_ready = 1;
+		} else if(foreman_uplink && l == foreman_uplink) {
+			// Consider the foreman_uplink passed into the function and signal that the manager link saw activity.
+			*foreman_uplink_active = 1;
+		} else if(q->poll_table[i].revents) {
+			if(handle_worker(q, l) == WQ_WORKER_FAILURE) {
 				workers_failed++;
 			}
 		}
@@ -6936,7 +7048,8 @@ static int connect_new_workers(struct work_queue *q, int stoptime, int max_new_w
 	// If the manager link was awake, then accept at most max_new_workers.
 	// Note we are using the information gathered in poll_active_workers, which
 	// is a little ugly.
-	if(q->poll_table[0].revents) {
+	if(q->manager_link_ready) {
+		q->manager_link_ready = 0;
 		do {
 			add_worker(q);
 			new_workers++;
@@ -6989,9 +7102,9 @@ struct work_queue_task *work_queue_wait_internal(struct work_queue *q, int timeo
 		if (t == NULL)
 		{
 			if(tag) {
-				t = task_state_any_with_tag(q, WORK_QUEUE_TASK_RETRIEVED, tag);
+				t = list_find(q->retrieved_list, tasktag_comparator, tag);
 			} else {
-				t = task_state_any(q, WORK_QUEUE_TASK_RETRIEVED);
+				t = list_peek_head(q->retrieved_list);
 			}
 			if(t) {
 				change_task_state(q, t, WORK_QUEUE_TASK_DONE);
@@ -7122,7 +7235,7 @@ struct work_queue_task *work_queue_wait_internal(struct work_queue *q, int timeo
 		// in this wait.
 		if(events > 0) {
 			BEGIN_ACCUM_TIME(q, time_internal);
-			int done = !(task_state_any(q, WORK_QUEUE_TASK_READY) || task_state_any(q, WORK_QUEUE_TASK_RUNNING) || task_state_any(q, WORK_QUEUE_TASK_WAITING_RETRIEVAL) || (foreman_uplink));
+			int done = !(priority_queue_size(q->ready_tasks) || list_size(q->waiting_retrieval_list) || task_state_any(q, WORK_QUEUE_TASK_RUNNING) || (foreman_uplink));
 			END_ACCUM_TIME(q, time_internal);
 
 			if(done) {
@@ -7185,28 +7298,12 @@ int work_queue_hungry(struct work_queue *q)
 	workers_total_avail_gpus	= overcommitted_resource_total(q, q->stats->total_gpus) - q->stats->committed_gpus;
 	workers_total_avail_disk 	= q->stats->total_disk - q->stats->committed_disk; //never overcommit disk
 
-	//get required resources (cores, memory, disk, gpus) of one waiting task
-	int64_t ready_task_cores 	= 0;
-	int64_t ready_task_memory 	= 0;
-	int64_t ready_task_disk 	= 0;
-	int64_t ready_task_gpus		= 0;
-
-	struct work_queue_task *t;
-
-	int count = task_state_count(q, NULL, WORK_QUEUE_TASK_READY);
-
-	while(count > 0)
-	{
-		count--;
-		t = list_pop_head(q->ready_list);
-
-		ready_task_cores  += MAX(1,t->resources_requested->cores);
-		ready_task_memory += t->resources_requested->memory;
-		ready_task_disk   += t->resources_requested->disk;
-		ready_task_gpus   += t->resources_requested->gpus;
-
-		list_push_tail(q->ready_list, t);
-	}
+	//get required resources (cores, memory, disk, gpus) of all waiting tasks,
+	//which the ready index keeps summed up as tasks come and go.
+	int64_t ready_task_cores 	= q->ready_resources->cores;
+	int64_t ready_task_memory 	= q->ready_resources->memory;
+	int64_t ready_task_disk 	= q->ready_resources->disk;
+	int64_t ready_task_gpus		= q->ready_resources->gpus;
 
 	//check possible limiting factors
 	//return false if required resources exceed available resources
@@ -7471,6 +7568,9 @@ int work_queue_tune(struct work_queue *q, const char *name, double value)
 	} else if (!strcmp(name, "ramp-down-heuristic")) {
 		q->ramp_down_heuristic = MAX(0, (int)value);
 
+	} else if(!strcmp(name, "monitor-in-worker")) {
+		q->monitor_in_worker = MAX(0, (int)value);
+
 	} else {
 		debug(D_NOTICE|D_WQ, "Warning: tuning parameter \"%s\" not recognized\n", name);
 		return -1;
@@ -7561,31 +7661,20 @@ void work_queue_get_stats(struct work_queue *q, struct work_queue_stats *s)
 	s->workers_idle      = s->workers_connected - s->workers_busy;
 	// s->workers_able computed below.
 
-	//info about tasks
-	struct work_queue_task *t;
-	uint64_t taskid;
-
-	int ready_tasks = 0;
+	//info about tasks, from the counts kept by each category as tasks change state.
+	int ready_tasks = priority_queue_size(q->ready_tasks);
 	int waiting_tasks = 0;
 	int running_tasks = 0;
 
-	itable_firstkey(q->tasks);
-	while( itable_nextkey(q->tasks, &taskid, (void **) &t) ) {
-		int state = (long)itable_lookup(q->task_state_map, taskid);
-		switch (state)
-		{
-			case WORK_QUEUE_TASK_READY:
-				ready_tasks++;
-				break;
-			case WORK_QUEUE_TASK_WAITING_RETRIEVAL:
-				waiting_tasks++;
-				break;
-			case WORK_QUEUE_TASK_RUNNING:
-				running_tasks++;
-				break;
-			default:
-				break;
+	char *name;
+	struct category *c;
+	hash_table_firstkey(q->categories);
+	while(hash_table_nextkey(q->categories, &name, (void **) &c)) {
+		if(!c->wq_stats) {
+			continue;
 		}
+		waiting_tasks += c->wq_stats->tasks_with_results;
+		running_tasks += c->wq_stats->tasks_running;
 	}
 
 	s->tasks_waiting      = ready_tasks;
@@ -188,6 +188,7 @@ struct work_queue_task {
 	char *monitor_output_directory;                        /**< Custom output directory for the monitoring output files. If NULL, save to directory from @ref work_queue_enable_monitoring */
 
 	char *monitor_snapshot_file;                          /**< Filename the monitor checks to produce snapshots. */
+	int monitor_in_worker;                                /**< If not zero, the worker measures the task itself, instead of a resource_monitor wrapping its command. */
 	struct list *features;                                /**< User-defined features this task requires. (See work_queue_worker's --feature option.) */
 
 	/* deprecated fields */
@@ -1132,6 +1133,7 @@ void work_queue_manager_preferred_connection(struct work_queue *q, const char *p
  - "attempt-schedule-depth" The amount of tasks to attempt scheduling on each pass of send_one_task in the main loop. (default=100)
  - "wait_retrieve_many" Parameter to alter how work_queue_wait works. If set to 0, work_queue_wait breaks out of the while loop whenever a task changes to WORK_QUEUE_TASK_DONE (wait_retrieve_one mode). If set to 1, work_queue_wait does not break, but continues recieving and dispatching tasks. This occurs until no task is sent or recieved, at which case it breaks out of the while loop (wait_retrieve_many mode). (default=0)
  - "monitor-interval" Parameter to change how frequently the resource monitor records resource consumption of a task in a times series, if this feature is enabled. See @ref work_queue_enable_monitoring_full.
+ - "monitor-in-worker" If not zero, tasks monitored only for their summary are measured by the worker itself, rather than by a resource_monitor sent with each task. (default=0)
 @param value The value to set the parameter to.
 @return 0 on succes, -1 on failure.
 */
@@ -47,6 +47,9 @@ struct work_queue_process {
 
 	/* variables for coprocess funciton calls */
 	void *coprocess;
+
+	/* 0 if the process is not measured by the worker, 1 if it is, 2 if it is also ended when over its cores or memory. */
+	int monitor;
 };
 
 struct work_queue_process * work_queue_process_create( struct work_queue_task *task, int disk_allocation );
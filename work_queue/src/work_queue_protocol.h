@@ -22,8 +22,9 @@ This file should not be installed and should only be included by .c files.
 /* 9: recursive send/recv and filename encoding. */
 /* 10: added coprocess message. */
 /* 11: added url/command as a file source, added cache-update/invalidate */
+/* 12: added monitor message, worker appends measured resources to result. */
 
-#define WORK_QUEUE_PROTOCOL_VERSION 11
+#define WORK_QUEUE_PROTOCOL_VERSION 12
 
 #define WORK_QUEUE_LINE_MAX 4096       /**< Maximum length of a work queue message line. */
 #define WORK_QUEUE_POOL_NAME_MAX 128   /**< Maximum length of a work queue pool name. */
@@ -53,6 +53,7 @@ See the file COPYING for details.
 #include "stringtools.h"
 #include "trash.h"
 #include "process.h"
+#include "rmonitor_tasks.h"
 
 #include <unistd.h>
 #include <dirent.h>
@@ -166,6 +167,12 @@ static timestamp_t worker_start_time = 0;
 
 static struct work_queue_watcher * watcher = 0;
 
+// The monitor measuring every task that the manager asked the worker to measure itself.
+static struct rmonitor_tasks *task_monitor = 0;
+
+// Seconds between measurements of the monitored tasks, as given by the manager.
+static int monitor_interval = 5;
+
 static struct work_queue_resources * local_resources = 0;
 struct work_queue_resources * total_resources = 0;
 struct work_queue_resources * total_resources_last = 0;
@@ -577,6 +584,48 @@ static void report_worker_ready( struct link *manager )
 		send_manager_message(manager, "info from-factory %s\n", factory_name);
 }
 
+/*
+Start measuring a process for which the manager did not send a resource_monitor.
+Only the cores and memory are enforced here: the disk is measured in the sandbox,
+and the time limits are enforced with the rest of the processes.
+*/
+
+static void monitor_process( struct work_queue_process *p )
+{
+	struct rmsummary *limits = NULL;
+
+	if(p->monitor > 1) {
+		limits = rmsummary_create(-1);
+		limits->cores  = p->task->resources_requested->cores;
+		limits->memory = p->task->resources_requested->memory;
+	}
+
+	rmonitor_tasks_add(task_monitor, p->task->taskid, p->pid, limits);
+	rmsummary_delete(limits);
+}
+
+/* Stop measuring a process, and keep what was measured for its result message.
+ * The sandbox is measured here, before its outputs are moved to the cache. */
+
+static void unmonitor_process( struct work_queue_process *p )
+{
+	struct rmsummary *measured = rmonitor_tasks_remove(task_monitor, p->task->taskid, &p->rusage);
+	if(!measured)
+		return;
+
+	measured->exit_status = p->exit_status;
+
+	int64_t last_size = p->sandbox_size;
+	work_queue_process_measure_disk(p, max_time_on_measurement);
+	if(MAX(p->sandbox_size, last_size) >= 0) {
+		measured->disk = MAX(p->sandbox_size, last_size);
+		measured->total_files = p->sandbox_file_count;
+	}
+
+	rmsummary_delete(p->task->resources_measured);
+	p->task->resources_measured = measured;
+}
+
 /*
 Start executing the given process on the local host,
 accounting for the resources as necessary.
@@ -610,6 +659,10 @@ static int start_process( struct work_queue_process *p, struct link *manager )
 	if(pid<0) fatal("unable to fork process for taskid %d!",p->task->taskid);
 
 	itable_insert(procs_running,p->pid,p);
+
+	if(p->monitor) {
+		monitor_process(p);
+	}
 	
 	return 1;
 }
@@ -631,6 +684,10 @@ static void reap_process( struct work_queue_process *p )
 
 	work_queue_gpus_free(p->task->taskid);
 
+	if(p->monitor) {
+		unmonitor_process(p);
+	}
+
 	if(!work_queue_sandbox_stageout(p,global_cache)) {
 		p->task_status = WORK_QUEUE_RESULT_OUTPUT_MISSING;
 		p->exit_status = 1;
@@ -655,7 +712,14 @@ static void report_task_complete( struct link *manager, struct work_queue_proces
 		fstat(p->output_fd, &st);
 		output_length = st.st_size;
 		lseek(p->output_fd, 0, SEEK_SET);
-		send_manager_message(manager, "result %d %d %lld %llu %d\n", p->task_status, p->exit_status, (long long) output_length, (unsigned long long) p->execution_end-p->execution_start, p->task->taskid);
+		if(p->monitor) {
+			// The resources measured by the worker go at the end of the line, as a single line of json.
+			char *measured = rmsummary_print_string(p->task->resources_measured, /* only resources */ 0);
+			send_manager_message(manager, "result %d %d %lld %llu %d %s\n", p->task_status, p->exit_status, (long long) output_length, (unsigned long long) p->execution_end-p->execution_start, p->task->taskid, measured);
+			free(measured);
+		} else {
+			send_manager_message(manager, "result %d %d %lld %llu %d\n", p->task_status, p->exit_status, (long long) output_length, (unsigned long long) p->execution_end-p->execution_start, p->task->taskid);
+		}
 		link_stream_from_fd(manager, p->output_fd, output_length, time(0)+active_timeout);
 
 		total_task_execution_time += (p->execution_end - p->execution_start);
@@ -934,6 +998,8 @@ static int do_task( struct link *manager, int taskid, time_t stoptime )
 
 	timestamp_t nt;
 
+	int monitor = 0;
+
 	struct work_queue_task *task = work_queue_task_create(0);
 	task->taskid = taskid;
 
@@ -942,6 +1008,10 @@ static int do_task( struct link *manager, int taskid, time_t stoptime )
 			break;
 		} else if(sscanf(line, "category %s",category)) {
 			work_queue_task_specify_category(task, category);
+		} else if(sscanf(line,"monitor %d %" PRId64,&flags,&n)==2) {
+			monitor = flags ? 2 : 1;
+			// 0 means the default interval of the monitor
+			monitor_interval = n > 0 ? n : 5;
 		} else if(sscanf(line,"cmd %d",&length)==1) {
 			char *cmd = malloc(length+1);
 			link_read(manager,cmd,length,stoptime);
@@ -1006,6 +1076,7 @@ static int do_task( struct link *manager, int taskid, time_t stoptime )
 	if(worker_mode==WORKER_MODE_FOREMAN) {
 		work_queue_submit_internal(foreman_q,task);
 	} else {
+		p->monitor = monitor;
 		normalize_resources(p);
 		list_push_tail(procs_waiting,p);
 	}
@@ -1289,6 +1360,11 @@ static int do_kill(int taskid)
 	} else {
 		if(itable_remove(procs_running, p->pid)) {
 			work_queue_process_kill(p);
+
+			if(p->monitor) {
+				unmonitor_process(p);
+			}
+
 			cores_allocated -= p->task->resources_requested->cores;
 			memory_allocated -= p->task->resources_requested->memory;
 			disk_allocated -= p->task->resources_requested->disk;
@@ -1419,6 +1495,34 @@ static int enforce_processes_limits()
 	return ok;
 }
 
+/*
+Measure all the monitored processes at once, and end those that went over
+their cores or memory as RESOURCE_EXHAUSTION, as their resource_monitor would.
+*/
+
+static void enforce_processes_monitor_limits()
+{
+	static time_t last_check_time = 0;
+
+	struct work_queue_process *p;
+	pid_t pid;
+
+	if(rmonitor_tasks_size(task_monitor) < 1 || (time(0) - last_check_time) < monitor_interval)
+		return;
+
+	if(rmonitor_tasks_poll(task_monitor) > 0) {
+		itable_firstkey(procs_running);
+		while(itable_nextkey(procs_running, (uint64_t*) &pid, (void**) &p)) {
+			if(p->monitor && rmonitor_tasks_exceeded(task_monitor, p->task->taskid)) {
+				debug(D_WQ,"Task %d went over its resource limits.\n", p->task->taskid);
+				finish_running_task(p, WORK_QUEUE_RESULT_RESOURCE_EXHAUSTION);
+			}
+		}
+	}
+
+	last_check_time = time(0);
+}
+
 /*
 We check maximum_running_time by itself (not in enforce_processes_limits),
 as other running tasks should not be affected by a task timeout.
@@ -1724,6 +1828,11 @@ static void work_for_manager(struct link *manager)
 
 		int wait_msec = 5000;
 
+		/* Wake up in time for the next measurement of the monitored tasks. */
+		if(rmonitor_tasks_size(task_monitor) > 0) {
+			wait_msec = MIN(wait_msec, monitor_interval*1000);
+		}
+
 		if(sigchld_received_flag) {
 			wait_msec = 0;
 			sigchld_received_flag = 0;
@@ -1751,6 +1860,9 @@ static void work_for_manager(struct link *manager)
 
 		enforce_processes_max_running_time();
 
+		/* measure the monitored tasks, and end those above their limits as RESOURCE_EXHAUSTION. */
+		enforce_processes_monitor_limits();
+
 		/* end a running processes if goes above its declared limits.
 		 * Mark offending process as RESOURCE_EXHASTION. */
 		enforce_processes_limits();
@@ -2010,6 +2122,7 @@ static void workspace_delete()
 	if(procs_waiting)      list_delete(procs_waiting);
 
 	if(watcher)            work_queue_watcher_delete(watcher);
+	if(task_monitor)       rmonitor_tasks_delete(task_monitor);
 
 	printf( "work_queue_worker: deleting workspace %s\n", workspace);
 
@@ -2886,6 +2999,8 @@ int main(int argc, char *argv[])
 
 	watcher = work_queue_watcher_create();
 
+	task_monitor = rmonitor_tasks_create();
+
 	local_resources = work_queue_resources_create();
 	total_resources = work_queue_resources_create();
 	total_resources_last = work_queue_resources_create();